@@ -55,6 +55,7 @@ enum ipset_keywords {
 	IPSET_ARG_SKBMARK,			/* skbmark */
 	IPSET_ARG_SKBPRIO,			/* skbprio */
 	IPSET_ARG_SKBQUEUE,			/* skbqueue */
+	IPSET_ARG_CACHE,			/* cache */
 	IPSET_ARG_MAX,
 };
 
@@ -66,6 +66,10 @@ enum ipset_opt {
 	IPSET_OPT_SKBMARK,
 	IPSET_OPT_SKBPRIO,
 	IPSET_OPT_SKBQUEUE,
+	IPSET_OPT_CACHE,
+	/* Filled out by the kernel */
+	IPSET_OPT_CACHE_HITS,
+	IPSET_OPT_CACHE_MISSES,
 	/* Internal options */
 	IPSET_OPT_FLAGS = 48,	/* IPSET_FLAG_EXIST| */
 	IPSET_OPT_CADT_FLAGS,	/* IPSET_FLAG_BEFORE| */
@@ -75,6 +79,8 @@ enum ipset_opt {
 	IPSET_OPT_REVISION,
 	IPSET_OPT_REVISION_MIN,
 	IPSET_OPT_INDEX,
+	/* Second operand of set operations */
+	IPSET_OPT_SETNAME3,
 	IPSET_OPT_MAX,
 };
 
@@ -102,7 +108,8 @@ enum ipset_opt {
 	| IPSET_FLAG(IPSET_OPT_COUNTERS)\
 	| IPSET_FLAG(IPSET_OPT_CREATE_COMMENT)\
 	| IPSET_FLAG(IPSET_OPT_FORCEADD)\
-	| IPSET_FLAG(IPSET_OPT_SKBINFO))
+	| IPSET_FLAG(IPSET_OPT_SKBINFO)	\
+	| IPSET_FLAG(IPSET_OPT_CACHE))
 
 #define IPSET_ADT_FLAGS			\
 	(IPSET_FLAG(IPSET_OPT_IP)	\
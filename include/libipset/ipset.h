@@ -53,6 +53,10 @@ extern void ipset_port_usage(void);
 extern int ipset_parse_filename(struct ipset *ipset, int opt, const char *str);
 extern int ipset_parse_output(struct ipset *ipset,
 			      int opt, const char *str);
+extern int ipset_parse_parallel(struct ipset *ipset,
+				int opt, const char *str);
+extern int ipset_parse_elem_filter(struct ipset *ipset,
+				   int opt, const char *str);
 extern int ipset_envopt_parse(struct ipset *ipset,
 			      int env, const char *str);
 
@@ -0,0 +1,22 @@
+/* Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef LIBIPSET_MOCK_H
+#define LIBIPSET_MOCK_H
+
+#include <libipset/transport.h>			/* struct ipset_transport */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const struct ipset_transport ipset_mock_transport;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBIPSET_MOCK_H */
@@ -11,6 +11,7 @@
 #include <stdint.h>				/* uintxx_t */
 #include <stdio.h>				/* printf */
 
+#include <libipset/data.h>			/* enum ipset_opt */
 #include <libipset/linux_ip_set.h>		/* enum ipset_cmd */
 
 /* Report and output buffer sizes */
@@ -19,6 +20,7 @@
 
 struct ipset_session;
 struct ipset_data;
+struct ipset_transport;
 
 #ifdef __cplusplus
 extern "C" {
@@ -102,8 +104,18 @@ enum ipset_output_mode {
 
 extern int ipset_session_output(struct ipset_session *session,
 				enum ipset_output_mode mode);
+extern int ipset_session_dump_filter(struct ipset_session *session,
+				     uint16_t from, uint16_t to,
+				     const char *prefix, uint32_t flags);
+extern int ipset_session_elem_filter(struct ipset_session *session,
+				     enum ipset_opt opt, const char *str);
 
 extern int ipset_commit(struct ipset_session *session);
+extern int ipset_replace_publish(struct ipset_session *session);
+extern const uint8_t *
+	ipset_test_batch_results(const struct ipset_session *session,
+				 uint32_t *count);
+extern void ipset_test_batch_reset(struct ipset_session *session);
 extern int ipset_cmd(struct ipset_session *session, enum ipset_cmd cmd,
 		     uint32_t lineno);
 
@@ -129,11 +141,20 @@ extern FILE * ipset_session_io_stream(struct ipset_session *session,
 extern int ipset_session_io_close(struct ipset_session *session,
 				  enum ipset_io_type what);
 
+extern int ipset_session_transport(struct ipset_session *session,
+				   const struct ipset_transport *transport);
+
+typedef void (*ipset_save_linefn)(void *p, char *line);
+
+extern int ipset_session_save_lines(struct ipset_session *session,
+				    const char *setname,
+				    ipset_save_linefn linefn, void *p);
+
 extern struct ipset_session *ipset_session_init(ipset_print_outfn outfn,
 						void *p);
 extern int ipset_session_fini(struct ipset_session *session);
 
-extern void ipset_debug_msg(const char *dir, void *buffer, int len);
+extern void ipset_debug_msg(const char *dir, const void *buffer, int len);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef LIBIPSET_SNAPSHOT_H
+#define LIBIPSET_SNAPSHOT_H
+
+#include <stdbool.h>				/* bool */
+#include <stdint.h>				/* uintxx_t */
+
+#include <libipset/linux_ip_set.h>		/* IPSET_MAXNAMELEN */
+
+#define IPSET_SNAPSHOT_MAGIC		"IPSETSNP"
+#define IPSET_SNAPSHOT_VERSION		1
+#define IPSET_SNAPSHOT_BYTEORDER	0x01020304
+
+/* Snapshot file header. The header is followed by the sorted, disjoint
+ * address intervals of the set in host byte order: struct
+ * ipset_snapshot_ip4 or struct ipset_snapshot_ip6 items, depending on
+ * the family.
+ */
+struct ipset_snapshot_hdr {
+	char magic[8];				/* IPSET_SNAPSHOT_MAGIC */
+	uint32_t version;			/* IPSET_SNAPSHOT_VERSION */
+	uint32_t byteorder;			/* IPSET_SNAPSHOT_BYTEORDER */
+	uint8_t family;				/* NFPROTO_IPV4|IPV6 */
+	uint8_t pad[7];
+	uint64_t count;				/* Number of intervals */
+	char setname[IPSET_MAXNAMELEN];		/* Source set */
+	char typename[IPSET_MAXNAMELEN];	/* Type of the set */
+};
+
+struct ipset_snapshot_ip4 {
+	uint32_t first, last;
+};
+
+struct ipset_snapshot_ip6 {
+	uint64_t first[2], last[2];		/* High, low 64 bits */
+};
+
+struct ipset_session;
+struct ipset_snapshot;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int ipset_snapshot_create(struct ipset_session *session,
+				 const char *setname, const char *filename);
+extern struct ipset_snapshot *ipset_snapshot_open(const char *filename);
+extern bool ipset_snapshot_test(const struct ipset_snapshot *snapshot,
+				uint8_t family, const void *addr);
+extern const struct ipset_snapshot_hdr *
+	ipset_snapshot_header(const struct ipset_snapshot *snapshot);
+extern void ipset_snapshot_close(struct ipset_snapshot *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBIPSET_SNAPSHOT_H */
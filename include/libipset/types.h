@@ -37,6 +37,7 @@ enum {
 	IPSET_OPTIONAL_ARG,
 	IPSET_MANDATORY_ARG,
 	IPSET_MANDATORY_ARG2,
+	IPSET_MANDATORY_ARG3,
 };
 
 struct ipset_session;
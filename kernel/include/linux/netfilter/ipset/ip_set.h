@@ -70,6 +70,7 @@ enum ip_set_extension {
 #define SET_WITH_COMMENT(s)	((s)->extensions & IPSET_EXT_COMMENT)
 #define SET_WITH_SKBINFO(s)	((s)->extensions & IPSET_EXT_SKBINFO)
 #define SET_WITH_FORCEADD(s)	((s)->flags & IPSET_CREATE_FLAG_FORCEADD)
+#define SET_WITH_CACHE(s)	((s)->flags & IPSET_CREATE_FLAG_CACHE)
 
 /* Extension id, in size order */
 enum ip_set_ext_id {
@@ -142,6 +143,30 @@ typedef int (*ipset_adtfn)(struct ip_set *set, void *value,
 			   const struct ip_set_ext *ext,
 			   struct ip_set_ext *mext, u32 cmdflags);
 
+/* Set operations: called for the live elements of a walked set */
+typedef int (*ipset_walkfn)(struct ip_set *set, void *value, u32 cmdflags,
+			    void *priv);
+
+/* Elements walked before the walk returns to let others run */
+#define IPSET_WALK_BATCH	1024
+
+/* Layer-4 data of the packet, extracted at the first set which needs it
+ * and reused by the other sets tested with the same options. It belongs
+ * to the packet: the options must be reinitialized for a new packet.
+ */
+enum {
+	IPSET_L4_UNKNOWN = 0,	/* Not extracted yet */
+	IPSET_L4_NONE,		/* No usable Layer-4 data */
+	IPSET_L4_PROTO,		/* Protocol only: no ports or fragment */
+	IPSET_L4_PORTS,		/* Protocol and ports */
+};
+
+struct ip_set_l4 {
+	u8 state;		/* IPSET_L4_* */
+	u8 proto;		/* Layer-4 protocol */
+	__be16 port[2];		/* Source and destination port */
+};
+
 /* Kernel API function options */
 struct ip_set_adt_opt {
 	u8 family;		/* Actual protocol family */
@@ -149,8 +174,20 @@ struct ip_set_adt_opt {
 	u8 flags;		/* Direction and negation flags */
 	u32 cmdflags;		/* Command-like flags */
 	struct ip_set_ext ext;	/* Extensions */
+	struct ip_set_l4 l4;	/* Layer-4 data of the packet */
 };
 
+/* Internal command flags of the prefetch passes of ip_set_test_batch(),
+ * which are never accepted from userspace: the test functions of the
+ * types bring in the memory the test of the element will read, first
+ * the hash table slot or bitmap word, then the hash bucket, and report
+ * no match.
+ */
+#define IPSET_FLAG_PREFETCH_TABLE	(1U << 30)
+#define IPSET_FLAG_PREFETCH_BUCKET	(1U << 31)
+#define IPSET_FLAG_PREFETCH		(IPSET_FLAG_PREFETCH_TABLE | \
+					 IPSET_FLAG_PREFETCH_BUCKET)
+
 /* Set type, variant-specific part */
 struct ip_set_type_variant {
 	/* Kernelspace: test/add/del entries
@@ -191,6 +228,23 @@ struct ip_set_type_variant {
 	/* Return true if "b" set is the same as "a"
 	 * according to the create set parameters */
 	bool (*same_set)(const struct ip_set *a, const struct ip_set *b);
+
+	/* Set operations: walk the elements from *cursor.
+	 *		returns negative error code from fn,
+	 *			zero when the walk is finished,
+	 *			positive when it must be called again */
+	int (*walk)(struct ip_set *set, ipset_walkfn fn, void *priv,
+		    unsigned long *cursor);
+	/* Return true if the elements of "b" can be stored in "a"
+	 * unchanged, regardless of the extensions */
+	bool (*same_layout)(const struct ip_set *a, const struct ip_set *b);
+
+	/* Replace: create the empty data of the shadow copy of the set */
+	int (*shadow_create)(struct ip_set *set, struct ip_set *shadow);
+	/* Replace: publish the shadow data as the content of the set */
+	void (*shadow_publish)(struct ip_set *set, struct ip_set *shadow);
+	/* Replace: destroy the unpublished shadow data */
+	void (*shadow_destroy)(struct ip_set *shadow);
 };
 
 /* The core set type structure */
@@ -236,11 +290,11 @@ struct ip_set {
 	/* Lock protecting the set data */
 	spinlock_t lock;
 	/* References to the set */
-	u32 ref;
+	atomic_t ref;
 	/* References to the set for netlink events like dump,
 	 * ref can be swapped out by ip_set_swap
 	 */
-	u32 ref_netlink;
+	atomic_t ref_netlink;
 	/* The core set type */
 	struct ip_set_type *type;
 	/* The type variant doing the real job */
@@ -265,6 +319,10 @@ struct ip_set {
 	size_t offset[IPSET_EXT_ID_MAX];
 	/* The type specific data */
 	void *data;
+	/* Unpublished new content when the set is being replaced */
+	struct ip_set *shadow;
+	/* Netlink portid of the socket replacing the set */
+	u32 shadow_portid;
 };
 
 static inline void
@@ -295,6 +353,8 @@ ip_set_put_flags(struct sk_buff *skb, struct ip_set *set)
 		cadt_flags |= IPSET_FLAG_WITH_SKBINFO;
 	if (SET_WITH_FORCEADD(set))
 		cadt_flags |= IPSET_FLAG_WITH_FORCEADD;
+	if (SET_WITH_CACHE(set))
+		cadt_flags |= IPSET_FLAG_WITH_CACHE;
 
 	if (!cadt_flags)
 		return 0;
@@ -304,18 +364,43 @@ ip_set_put_flags(struct sk_buff *skb, struct ip_set *set)
 /* Netlink CB args */
 enum {
 	IPSET_CB_NET = 0,	/* net namespace */
-	IPSET_CB_PROTO,		/* ipset protocol */
+	IPSET_CB_FILTER,	/* element filter */
 	IPSET_CB_DUMP,		/* dump single set/all sets */
 	IPSET_CB_INDEX,		/* set index */
 	IPSET_CB_PRIVATE,	/* set private data */
 	IPSET_CB_ARG0,		/* type specific */
 };
 
+/* Element filter of a list/save request, parsed once at dump start */
+struct ip_set_elem_filter {
+	union nf_inet_addr ip;	/* Elements must be within ip/cidr */
+	u8 family;		/* Family of ip or NFPROTO_UNSPEC */
+	u8 cidr;
+	bool with_port;
+	u16 port, port_to;	/* Port of elements must be in range */
+	const char *comment;	/* Comment must contain it, or NULL */
+};
+
+/* The element filter of the dump request or NULL */
+static inline const struct ip_set_elem_filter *
+ip_set_dump_elem_filter(const struct netlink_callback *cb)
+{
+	return (const struct ip_set_elem_filter *)cb->args[IPSET_CB_FILTER];
+}
+
+extern bool ip_set_elem_filter_key(const struct ip_set_elem_filter *filter,
+				   u8 family, const void *ip, u8 cidr,
+				   const __be16 *port);
+extern bool ip_set_elem_filter_ext(const struct ip_set *set,
+				   const struct ip_set_elem_filter *filter,
+				   const void *e);
+
 /* register and unregister set references */
 extern ip_set_id_t ip_set_get_byname(struct net *net,
 				     const char *name, struct ip_set **set);
 extern void ip_set_put_byindex(struct net *net, ip_set_id_t index);
 extern void ip_set_name_byindex(struct net *net, ip_set_id_t index, char *name);
+extern u16 ip_set_features_byindex(struct net *net, ip_set_id_t index);
 extern ip_set_id_t ip_set_nfnl_get_byindex(struct net *net, ip_set_id_t index);
 extern void ip_set_nfnl_put(struct net *net, ip_set_id_t index);
 
@@ -330,6 +415,10 @@ extern int ip_set_del(ip_set_id_t id, const struct sk_buff *skb,
 extern int ip_set_test(ip_set_id_t id, const struct sk_buff *skb,
 		       const struct xt_action_param *par,
 		       struct ip_set_adt_opt *opt);
+extern void ip_set_test_batch(ip_set_id_t id, unsigned int n,
+			      const struct sk_buff * const skb[],
+			      const struct xt_action_param par[],
+			      struct ip_set_adt_opt opt[], int ret[]);
 
 /* Utility functions */
 extern void *ip_set_alloc(size_t size);
@@ -459,11 +548,13 @@ ip6addrptr(const struct sk_buff *skb, bool src, struct in6_addr *addr)
 	       sizeof(*addr));
 }
 
-/* Calculate the bytes required to store the inclusive range of a-b */
+/* Calculate the bytes required to store the inclusive range of a-b,
+ * in whole longs, so that the bitmap can be scanned word by word.
+ */
 static inline int
 bitmap_bytes(u32 a, u32 b)
 {
-	return 4 * ((((b - a + 8) / 8) + 3) / 4);
+	return BITS_TO_LONGS(b - a + 1) * sizeof(unsigned long);
 }
 
 #include <linux/netfilter/ipset/ip_set_timeout.h>
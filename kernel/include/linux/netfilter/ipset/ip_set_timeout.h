@@ -47,6 +47,15 @@ ip_set_timeout_expired(const unsigned long *t)
 	return *t != IPSET_ELEM_PERMANENT && time_is_before_jiffies(*t);
 }
 
+/* Same as above, but against a jiffies value sampled once by the caller:
+ * dumping a large set does not have to reload jiffies for every element.
+ */
+static inline bool
+ip_set_timeout_expired_at(const unsigned long *t, unsigned long now)
+{
+	return *t != IPSET_ELEM_PERMANENT && time_after(now, *t);
+}
+
 static inline void
 ip_set_timeout_set(unsigned long *timeout, u32 value)
 {
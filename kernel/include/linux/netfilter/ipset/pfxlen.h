@@ -42,13 +42,27 @@ do {						\
 	to = from | ~ip_set_hostmask(cidr);	\
 } while (0)
 
+/* Mask the address with the precomputed netmask of the prefix. Where it
+ * is cheap, use two 64 bit words just like ipv6_addr_equal() does, so
+ * masking and comparing the elements of the IPv6 hash types go hand in hand.
+ */
 static inline void
 ip6_netmask(union nf_inet_addr *ip, u8 prefix)
 {
-	ip->ip6[0] &= ip_set_netmask6(prefix)[0];
-	ip->ip6[1] &= ip_set_netmask6(prefix)[1];
-	ip->ip6[2] &= ip_set_netmask6(prefix)[2];
-	ip->ip6[3] &= ip_set_netmask6(prefix)[3];
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) && BITS_PER_LONG == 64
+	const u64 *mask = (const u64 *)ip_set_netmask6(prefix);
+	u64 *addr = (u64 *)&ip->ip6[0];
+
+	addr[0] &= mask[0];
+	addr[1] &= mask[1];
+#else
+	const __be32 *mask = ip_set_netmask6(prefix);
+
+	ip->ip6[0] &= mask[0];
+	ip->ip6[1] &= mask[1];
+	ip->ip6[2] &= mask[2];
+	ip->ip6[3] &= mask[3];
+#endif
 }
 
 #endif /*_PFXLEN_H */
@@ -40,17 +40,24 @@ enum ipset_cmd {
 	IPSET_CMD_TYPE,		/* 13: Get set type */
 	IPSET_CMD_GET_BYNAME,	/* 14: Get set index by name */
 	IPSET_CMD_GET_BYINDEX,	/* 15: Get set name by index */
+	IPSET_CMD_UNION,	/* 16: Store the union of two sets */
+	IPSET_CMD_INTERSECT,	/* 17: Store the intersection of two sets */
+	IPSET_CMD_DIFF,		/* 18: Store the difference of two sets */
+	IPSET_CMD_REPLACE,	/* 19: Start/publish replacing a set */
+	IPSET_CMD_TEST_BATCH,	/* 20: Test multiple elements in a set */
 	IPSET_MSG_MAX,		/* Netlink message commands */
 
 	/* Commands in userspace: */
-	IPSET_CMD_RESTORE = IPSET_MSG_MAX, /* 16: Enter restore mode */
-	IPSET_CMD_HELP,		/* 17: Get help */
-	IPSET_CMD_VERSION,	/* 18: Get program version */
-	IPSET_CMD_QUIT,		/* 19: Quit from interactive mode */
+	IPSET_CMD_RESTORE = IPSET_MSG_MAX, /* 21: Enter restore mode */
+	IPSET_CMD_HELP,		/* 22: Get help */
+	IPSET_CMD_VERSION,	/* 23: Get program version */
+	IPSET_CMD_QUIT,		/* 24: Quit from interactive mode */
+	IPSET_CMD_SYNC,		/* 25: Sync set content with a list */
+	IPSET_CMD_SNAPSHOT,	/* 26: Create a snapshot file of a set */
 
 	IPSET_CMD_MAX,
 
-	IPSET_CMD_COMMIT = IPSET_CMD_MAX, /* 20: Commit buffered commands */
+	IPSET_CMD_COMMIT = IPSET_CMD_MAX, /* 27: Commit buffered commands */
 };
 
 /* Attributes at command level */
@@ -69,6 +76,10 @@ enum {
 	IPSET_ATTR_PROTOCOL_MIN, /* 10: Minimal supported version number */
 	IPSET_ATTR_REVISION_MIN	= IPSET_ATTR_PROTOCOL_MIN, /* type rev min */
 	IPSET_ATTR_INDEX,	/* 11: Kernel index of set */
+	IPSET_ATTR_INDEX_TO,	/* 12: Last index of sets to dump */
+	IPSET_ATTR_SETNAME_PREFIX, /* 13: Prefix of setnames to dump */
+	IPSET_ATTR_SETNAME3,	/* 14: Second operand of set operations */
+	IPSET_ATTR_RESULTS,	/* 15: Bitmap of batched test results */
 	__IPSET_ATTR_CMD_MAX,
 };
 #define IPSET_ATTR_CMD_MAX	(__IPSET_ATTR_CMD_MAX - 1)
@@ -102,6 +113,9 @@ enum {
 	IPSET_ATTR_ELEMENTS,
 	IPSET_ATTR_REFERENCES,
 	IPSET_ATTR_MEMSIZE,
+	IPSET_ATTR_CACHE_HITS,
+	IPSET_ATTR_CACHE_MISSES,
+	IPSET_ATTR_CREATE_PAD,
 
 	__IPSET_ATTR_CREATE_MAX,
 };
@@ -156,6 +170,11 @@ enum ipset_errno {
 	IPSET_ERR_COMMENT,
 	IPSET_ERR_INVALID_MARKMASK,
 	IPSET_ERR_SKBINFO,
+	IPSET_ERR_SETOP_TYPE,
+	IPSET_ERR_SETOP_TARGET,
+	IPSET_ERR_REPLACE_TYPE,
+	IPSET_ERR_NO_REPLACE,
+	IPSET_ERR_CACHE,
 
 	/* Type specific error codes */
 	IPSET_ERR_TYPE_SPECIFIC = 4352,
@@ -185,6 +204,14 @@ enum ipset_cmd_flags {
 	IPSET_FLAG_MAP_SKBPRIO = (1 << IPSET_FLAG_BIT_MAP_SKBPRIO),
 	IPSET_FLAG_BIT_MAP_SKBQUEUE = 10,
 	IPSET_FLAG_MAP_SKBQUEUE = (1 << IPSET_FLAG_BIT_MAP_SKBQUEUE),
+	IPSET_FLAG_BIT_LIST_SKIP_LAST = 11,
+	IPSET_FLAG_LIST_SKIP_LAST = (1 << IPSET_FLAG_BIT_LIST_SKIP_LAST),
+	IPSET_FLAG_BIT_LIST_ONLY_LAST = 12,
+	IPSET_FLAG_LIST_ONLY_LAST = (1 << IPSET_FLAG_BIT_LIST_ONLY_LAST),
+	IPSET_FLAG_BIT_SHADOW = 13,
+	IPSET_FLAG_SHADOW = (1 << IPSET_FLAG_BIT_SHADOW),
+	IPSET_FLAG_BIT_PUBLISH = 14,
+	IPSET_FLAG_PUBLISH = (1 << IPSET_FLAG_BIT_PUBLISH),
 	IPSET_FLAG_CMD_MAX = 15,
 };
 
@@ -204,6 +231,8 @@ enum ipset_cadt_flags {
 	IPSET_FLAG_WITH_FORCEADD = (1 << IPSET_FLAG_BIT_WITH_FORCEADD),
 	IPSET_FLAG_BIT_WITH_SKBINFO = 6,
 	IPSET_FLAG_WITH_SKBINFO = (1 << IPSET_FLAG_BIT_WITH_SKBINFO),
+	IPSET_FLAG_BIT_WITH_CACHE = 7,
+	IPSET_FLAG_WITH_CACHE = (1 << IPSET_FLAG_BIT_WITH_CACHE),
 	IPSET_FLAG_CADT_MAX	= 15,
 };
 
@@ -211,6 +240,8 @@ enum ipset_cadt_flags {
 enum ipset_create_flags {
 	IPSET_CREATE_FLAG_BIT_FORCEADD = 0,
 	IPSET_CREATE_FLAG_FORCEADD = (1 << IPSET_CREATE_FLAG_BIT_FORCEADD),
+	IPSET_CREATE_FLAG_BIT_CACHE = 1,
+	IPSET_CREATE_FLAG_CACHE = (1 << IPSET_CREATE_FLAG_BIT_CACHE),
 	IPSET_CREATE_FLAG_BIT_MAX = 7,
 };
 
@@ -91,4 +91,22 @@ struct xt_set_info_match_v4 {
 	__u32 flags;
 };
 
+/* Revision 5 match: several sets in one match */
+
+#define XT_SET_MATCH_MAX_SETS	16
+
+enum xt_set_match_mode {
+	XT_SET_MATCH_ANY,	/* Any of the sets matches */
+	XT_SET_MATCH_ALL,	/* All of the sets match */
+};
+
+struct xt_set_info_match_v5 {
+	struct xt_set_info match_set[XT_SET_MATCH_MAX_SETS];
+	struct ip_set_counter_match packets;
+	struct ip_set_counter_match bytes;
+	__u32 flags;
+	__u8 count;		/* Number of sets in match_set */
+	__u8 mode;		/* enum xt_set_match_mode */
+};
+
 #endif /*_XT_SET_H*/
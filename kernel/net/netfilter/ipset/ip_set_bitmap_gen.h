@@ -8,6 +8,8 @@
 #ifndef __IP_SET_BITMAP_IP_GEN_H
 #define __IP_SET_BITMAP_IP_GEN_H
 
+#include <linux/prefetch.h>
+
 #define mtype_do_test		IPSET_TOKEN(MTYPE, _do_test)
 #define mtype_gc_test		IPSET_TOKEN(MTYPE, _gc_test)
 #define mtype_is_filled		IPSET_TOKEN(MTYPE, _is_filled)
@@ -15,6 +17,8 @@
 #define mtype_ext_cleanup	IPSET_TOKEN(MTYPE, _ext_cleanup)
 #define mtype_do_del		IPSET_TOKEN(MTYPE, _do_del)
 #define mtype_do_list		IPSET_TOKEN(MTYPE, _do_list)
+#define mtype_do_filter		IPSET_TOKEN(MTYPE, _do_filter)
+#define mtype_do_walk		IPSET_TOKEN(MTYPE, _do_walk)
 #define mtype_do_head		IPSET_TOKEN(MTYPE, _do_head)
 #define mtype_adt_elem		IPSET_TOKEN(MTYPE, _adt_elem)
 #define mtype_add_timeout	IPSET_TOKEN(MTYPE, _add_timeout)
@@ -26,11 +30,14 @@
 #define mtype_flush		IPSET_TOKEN(MTYPE, _flush)
 #define mtype_head		IPSET_TOKEN(MTYPE, _head)
 #define mtype_same_set		IPSET_TOKEN(MTYPE, _same_set)
+#define mtype_same_layout	IPSET_TOKEN(MTYPE, _same_layout)
 #define mtype_elem		IPSET_TOKEN(MTYPE, _elem)
 #define mtype_test		IPSET_TOKEN(MTYPE, _test)
 #define mtype_add		IPSET_TOKEN(MTYPE, _add)
+#define mtype_add_range		IPSET_TOKEN(MTYPE, _add_range)
 #define mtype_del		IPSET_TOKEN(MTYPE, _del)
 #define mtype_list		IPSET_TOKEN(MTYPE, _list)
+#define mtype_walk		IPSET_TOKEN(MTYPE, _walk)
 #define mtype_gc		IPSET_TOKEN(MTYPE, _gc)
 #define mtype			MTYPE
 
@@ -51,9 +58,8 @@ mtype_ext_cleanup(struct ip_set *set)
 	struct mtype *map = set->data;
 	u32 id;
 
-	for (id = 0; id < map->elements; id++)
-		if (test_bit(id, map->members))
-			ip_set_ext_destroy(set, get_ext(set, map, id));
+	for_each_set_bit(id, map->members, map->elements)
+		ip_set_ext_destroy(set, get_ext(set, map, id));
 }
 
 static void
@@ -105,7 +111,8 @@ mtype_head(struct ip_set *set, struct sk_buff *skb)
 	if (!nested)
 		goto nla_put_failure;
 	if (mtype_do_head(skb, map) ||
-	    nla_put_net32(skb, IPSET_ATTR_REFERENCES, htonl(set->ref)) ||
+	    nla_put_net32(skb, IPSET_ATTR_REFERENCES,
+			  htonl(atomic_read(&set->ref))) ||
 	    nla_put_net32(skb, IPSET_ATTR_MEMSIZE, htonl(memsize)) ||
 	    nla_put_net32(skb, IPSET_ATTR_ELEMENTS, htonl(set->elements)))
 		goto nla_put_failure;
@@ -125,8 +132,18 @@ mtype_test(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	struct mtype *map = set->data;
 	const struct mtype_adt_elem *e = value;
 	void *x = get_ext(set, map, e->id);
-	int ret = mtype_do_test(e, map, set->dsize);
-
+	int ret;
+
+	if (unlikely(flags & IPSET_FLAG_PREFETCH)) {
+		/* Prefetch pass of ip_set_test_batch() */
+		if (flags & IPSET_FLAG_PREFETCH_TABLE) {
+			prefetch((unsigned long *)map->members +
+				 BIT_WORD(e->id));
+			prefetch(x);
+		}
+		return 0;
+	}
+	ret = mtype_do_test(e, map, set->dsize);
 	if (ret <= 0)
 		return ret;
 	return ip_set_match_extensions(set, ext, mext, flags, x);
@@ -177,6 +194,66 @@ mtype_add(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	return 0;
 }
 
+#ifndef IP_SET_BITMAP_STORED_TIMEOUT
+/* Add the inclusive range of ids at once: the result is the same as
+ * calling mtype_add() for the ids one by one, but the member bits are
+ * set in one go and the extensions are filled in a single pass.
+ */
+static int
+mtype_add_range(struct ip_set *set, u32 first, u32 last,
+		const struct ip_set_ext *ext, u32 flags)
+{
+	struct mtype *map = set->data;
+	u32 id, stop = last + 1;
+	unsigned long timeout;
+	void *x;
+	int ret = 0;
+
+	/* Existing elements are re-added, expired ones are replaced */
+	for (id = find_next_bit(map->members, last + 1, first);
+	     id <= last;
+	     id = find_next_bit(map->members, last + 1, id + 1)) {
+		x = get_ext(set, map, id);
+		if (!(flags & IPSET_FLAG_EXIST) &&
+		    !(SET_WITH_TIMEOUT(set) &&
+		      ip_set_timeout_expired(ext_timeout(x, set)))) {
+			stop = id;
+			ret = -IPSET_ERR_EXIST;
+			break;
+		}
+		ip_set_ext_destroy(set, x);
+		set->elements--;
+	}
+	if (stop == first)
+		return ret;
+
+	if (SET_WITH_TIMEOUT(set)) {
+		ip_set_timeout_set(&timeout, ext->timeout);
+		for (id = first; id < stop; id++)
+			*ext_timeout(get_ext(set, map, id), set) = timeout;
+	}
+	if (SET_WITH_COUNTER(set))
+		for (id = first; id < stop; id++)
+			ip_set_init_counter(ext_counter(get_ext(set, map, id),
+							set), ext);
+	if (SET_WITH_COMMENT(set))
+		for (id = first; id < stop; id++)
+			ip_set_init_comment(set, ext_comment(get_ext(set, map,
+								     id),
+							     set), ext);
+	if (SET_WITH_SKBINFO(set))
+		for (id = first; id < stop; id++)
+			ip_set_init_skbinfo(ext_skbinfo(get_ext(set, map, id),
+							set), ext);
+
+	/* Activate elements */
+	bitmap_set(map->members, first, stop - first);
+	set->elements += stop - first;
+
+	return ret;
+}
+#endif
+
 static int
 mtype_del(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	  struct ip_set_ext *mext, u32 flags)
@@ -211,8 +288,10 @@ mtype_list(const struct ip_set *set,
 {
 	struct mtype *map = set->data;
 	struct nlattr *adt, *nested;
+	const struct ip_set_elem_filter *filter = ip_set_dump_elem_filter(cb);
 	void *x;
-	u32 id, first = cb->args[IPSET_CB_ARG0];
+	u32 id, first;
+	unsigned long now = jiffies;
 	int ret = 0;
 
 	adt = ipset_nest_start(skb, IPSET_ATTR_ADT);
@@ -220,17 +299,24 @@ mtype_list(const struct ip_set *set,
 		return -EMSGSIZE;
 	/* Extensions may be replaced */
 	rcu_read_lock();
-	for (; cb->args[IPSET_CB_ARG0] < map->elements;
-	     cb->args[IPSET_CB_ARG0]++) {
+	/* Jump from member to member instead of testing every id */
+	first = find_next_bit(map->members, map->elements,
+			      cb->args[IPSET_CB_ARG0]);
+	for (id = first; id < map->elements;
+	     id = find_next_bit(map->members, map->elements, id + 1)) {
 		cond_resched_rcu();
-		id = cb->args[IPSET_CB_ARG0];
+		cb->args[IPSET_CB_ARG0] = id;
 		x = get_ext(set, map, id);
-		if (!test_bit(id, map->members) ||
-		    (SET_WITH_TIMEOUT(set) &&
+		if (SET_WITH_TIMEOUT(set) &&
 #ifdef IP_SET_BITMAP_STORED_TIMEOUT
-		     mtype_is_filled(x) &&
+		    mtype_is_filled(x) &&
 #endif
-		     ip_set_timeout_expired(ext_timeout(x, set))))
+		    ip_set_timeout_expired_at(ext_timeout(x, set), now))
+			continue;
+		/* Filtered out elements are not sent */
+		if (filter &&
+		    !(mtype_do_filter(map, id, filter) &&
+		      ip_set_elem_filter_ext(set, filter, x)))
 			continue;
 		nested = ipset_nest_start(skb, IPSET_ATTR_DATA);
 		if (!nested) {
@@ -267,6 +353,43 @@ out:
 	return ret;
 }
 
+/* Walk the elements for a set operation */
+static int
+mtype_walk(struct ip_set *set, ipset_walkfn fn, void *priv,
+	   unsigned long *cursor)
+{
+	struct mtype *map = set->data;
+	struct mtype_adt_elem e = { .id = 0 };
+	unsigned long now = jiffies;
+	u32 id, walked = 0;
+	void *x;
+	int ret = 0;
+
+	rcu_read_lock_bh();
+	for (id = find_next_bit(map->members, map->elements, *cursor);
+	     id < map->elements;
+	     id = find_next_bit(map->members, map->elements, id + 1)) {
+		if (walked++ >= IPSET_WALK_BATCH) {
+			ret = 1;
+			break;
+		}
+		x = get_ext(set, map, id);
+		if (SET_WITH_TIMEOUT(set) &&
+#ifdef IP_SET_BITMAP_STORED_TIMEOUT
+		    mtype_is_filled(x) &&
+#endif
+		    ip_set_timeout_expired_at(ext_timeout(x, set), now))
+			continue;
+		mtype_do_walk(&e, map, id, set->dsize);
+		ret = fn(set, &e, 0, priv);
+		if (ret)
+			break;
+	}
+	*cursor = id;
+	rcu_read_unlock_bh();
+	return ret;
+}
+
 static void
 mtype_gc(GC_ARG)
 {
@@ -278,7 +401,7 @@ mtype_gc(GC_ARG)
 	 * but adding/deleting new entries is locked out
 	 */
 	spin_lock_bh(&set->lock);
-	for (id = 0; id < map->elements; id++)
+	for_each_set_bit(id, map->members, map->elements)
 		if (mtype_gc_test(id, map, set->dsize)) {
 			x = get_ext(set, map, id);
 			if (ip_set_timeout_expired(ext_timeout(x, set))) {
@@ -306,6 +429,8 @@ static const struct ip_set_type_variant mtype = {
 	.head	= mtype_head,
 	.list	= mtype_list,
 	.same_set = mtype_same_set,
+	.walk	= mtype_walk,
+	.same_layout = mtype_same_layout,
 };
 
 #endif /* __IP_SET_BITMAP_IP_GEN_H */
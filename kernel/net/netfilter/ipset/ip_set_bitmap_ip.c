@@ -102,6 +102,23 @@ bitmap_ip_do_list(struct sk_buff *skb, const struct bitmap_ip *map, u32 id,
 			htonl(map->first_ip + id * map->hosts));
 }
 
+static inline bool
+bitmap_ip_do_filter(const struct bitmap_ip *map, u32 id,
+		    const struct ip_set_elem_filter *filter)
+{
+	__be32 ip = htonl(map->first_ip + id * map->hosts);
+
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV4, &ip, HOST_MASK,
+				      NULL);
+}
+
+static inline void
+bitmap_ip_do_walk(struct bitmap_ip_adt_elem *e, const struct bitmap_ip *map,
+		  u32 id, size_t dsize)
+{
+	e->id = id;
+}
+
 static inline int
 bitmap_ip_do_head(struct sk_buff *skb, const struct bitmap_ip *map)
 {
@@ -131,6 +148,9 @@ bitmap_ip_kadt(struct ip_set *set, const struct sk_buff *skb,
 	return adtfn(set, &e, &ext, &opt->ext, opt->cmdflags);
 }
 
+static int bitmap_ip_add_range(struct ip_set *set, u32 first, u32 last,
+			       const struct ip_set_ext *ext, u32 flags);
+
 static int
 bitmap_ip_uadt(struct ip_set *set, struct nlattr *tb[],
 	       enum ipset_adt adt, u32 *lineno, u32 flags, bool retried)
@@ -186,6 +206,13 @@ bitmap_ip_uadt(struct ip_set *set, struct nlattr *tb[],
 	if (ip_to > map->last_ip)
 		return -IPSET_ERR_BITMAP_RANGE;
 
+	if (adt == IPSET_ADD) {
+		e.id = ip_to_id(map, ip);
+		return bitmap_ip_add_range(set, e.id,
+					   e.id + (ip_to - ip) / map->hosts,
+					   &ext, flags);
+	}
+
 	for (; !before(ip_to, ip); ip += map->hosts) {
 		e.id = ip_to_id(map, ip);
 		ret = adtfn(set, &e, &ext, &ext, flags);
@@ -199,14 +226,20 @@ bitmap_ip_uadt(struct ip_set *set, struct nlattr *tb[],
 }
 
 static bool
-bitmap_ip_same_set(const struct ip_set *a, const struct ip_set *b)
+bitmap_ip_same_layout(const struct ip_set *a, const struct ip_set *b)
 {
 	const struct bitmap_ip *x = a->data;
 	const struct bitmap_ip *y = b->data;
 
 	return x->first_ip == y->first_ip &&
 	       x->last_ip == y->last_ip &&
-	       x->netmask == y->netmask &&
+	       x->netmask == y->netmask;
+}
+
+static bool
+bitmap_ip_same_set(const struct ip_set *a, const struct ip_set *b)
+{
+	return bitmap_ip_same_layout(a, b) &&
 	       a->timeout == b->timeout &&
 	       a->extensions == b->extensions;
 }
@@ -47,6 +47,7 @@ enum {
 /* Type structure */
 struct bitmap_ipmac {
 	void *members;		/* the set members */
+	unsigned long *filling;	/* elements with MAC being filled out */
 	u32 first_ip;		/* host byte order, included in range */
 	u32 last_ip;		/* host byte order, included in range */
 	u32 elements;		/* number of max elements in the set */
@@ -94,7 +95,8 @@ bitmap_ipmac_do_test(const struct bitmap_ipmac_adt_elem *e,
 	if (!test_bit(e->id, map->members))
 		return 0;
 	elem = get_const_elem(map->extensions, e->id, dsize);
-	if (e->add_mac && elem->filled == MAC_FILLED)
+	/* Pairs with smp_store_release() in bitmap_ipmac_complete() */
+	if (e->add_mac && smp_load_acquire(&elem->filled) == MAC_FILLED)
 		return ether_addr_equal(e->ether, elem->ether);
 	/* Trigger kernel to fill out the ethernet address */
 	return -EAGAIN;
@@ -109,7 +111,7 @@ bitmap_ipmac_gc_test(u16 id, const struct bitmap_ipmac *map, size_t dsize)
 		return 0;
 	elem = get_const_elem(map->extensions, id, dsize);
 	/* Timer not started for the incomplete elements */
-	return elem->filled == MAC_FILLED;
+	return smp_load_acquire(&elem->filled) == MAC_FILLED;
 }
 
 static inline int
@@ -145,13 +147,32 @@ bitmap_ipmac_add_timeout(unsigned long *timeout,
 	return 0;
 }
 
+/* Take over an element from the packet path: wait until a MAC address
+ * being filled out is completed and stop the completion of the element
+ * until bitmap_ipmac_release().
+ */
+static inline void
+bitmap_ipmac_claim(struct bitmap_ipmac *map, u16 id)
+{
+	while (test_and_set_bit_lock(id, map->filling))
+		cpu_relax();
+}
+
+static inline void
+bitmap_ipmac_release(struct bitmap_ipmac *map, u16 id)
+{
+	clear_bit_unlock(id, map->filling);
+}
+
 static inline int
 bitmap_ipmac_do_add(const struct bitmap_ipmac_adt_elem *e,
 		    struct bitmap_ipmac *map, u32 flags, size_t dsize)
 {
 	struct bitmap_ipmac_elem *elem;
+	int ret;
 
 	elem = get_elem(map->extensions, e->id, dsize);
+	bitmap_ipmac_claim(map, e->id);
 	if (test_bit(e->id, map->members)) {
 		if (elem->filled == MAC_FILLED) {
 			if (e->add_mac &&
@@ -162,25 +183,32 @@ bitmap_ipmac_do_add(const struct bitmap_ipmac_adt_elem *e,
 				smp_mb__after_atomic();
 				ether_addr_copy(elem->ether, e->ether);
 			}
-			return IPSET_ADD_FAILED;
-		} else if (!e->add_mac)
+			ret = IPSET_ADD_FAILED;
+		} else if (!e->add_mac) {
 			/* Already added without ethernet address */
-			return IPSET_ADD_FAILED;
-		/* Fill the MAC address and trigger the timer activation */
-		clear_bit(e->id, map->members);
-		smp_mb__after_atomic();
-		ether_addr_copy(elem->ether, e->ether);
-		elem->filled = MAC_FILLED;
-		return IPSET_ADD_START_STORED_TIMEOUT;
+			ret = IPSET_ADD_FAILED;
+		} else {
+			/* Fill the MAC address and trigger the timer
+			 * activation
+			 */
+			clear_bit(e->id, map->members);
+			smp_mb__after_atomic();
+			ether_addr_copy(elem->ether, e->ether);
+			elem->filled = MAC_FILLED;
+			ret = IPSET_ADD_START_STORED_TIMEOUT;
+		}
 	} else if (e->add_mac) {
 		/* We can store MAC too */
 		ether_addr_copy(elem->ether, e->ether);
 		elem->filled = MAC_FILLED;
-		return 0;
+		ret = 0;
+	} else {
+		elem->filled = MAC_UNSET;
+		/* MAC is not stored yet, don't start timer */
+		ret = IPSET_ADD_STORE_PLAIN_TIMEOUT;
 	}
-	elem->filled = MAC_UNSET;
-	/* MAC is not stored yet, don't start timer */
-	return IPSET_ADD_STORE_PLAIN_TIMEOUT;
+	bitmap_ipmac_release(map, e->id);
+	return ret;
 }
 
 static inline int
@@ -203,6 +231,29 @@ bitmap_ipmac_do_list(struct sk_buff *skb, const struct bitmap_ipmac *map,
 		nla_put(skb, IPSET_ATTR_ETHER, ETH_ALEN, elem->ether));
 }
 
+static inline bool
+bitmap_ipmac_do_filter(const struct bitmap_ipmac *map, u32 id,
+		       const struct ip_set_elem_filter *filter)
+{
+	__be32 ip = htonl(map->first_ip + id);
+
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV4, &ip, HOST_MASK,
+				      NULL);
+}
+
+static inline void
+bitmap_ipmac_do_walk(struct bitmap_ipmac_adt_elem *e,
+		     const struct bitmap_ipmac *map, u32 id, size_t dsize)
+{
+	const struct bitmap_ipmac_elem *elem =
+		get_const_elem(map->extensions, id, dsize);
+
+	e->id = id;
+	e->add_mac = elem->filled == MAC_FILLED;
+	if (e->add_mac)
+		ether_addr_copy(e->ether, elem->ether);
+}
+
 static inline int
 bitmap_ipmac_do_head(struct sk_buff *skb, const struct bitmap_ipmac *map)
 {
@@ -210,6 +261,40 @@ bitmap_ipmac_do_head(struct sk_buff *skb, const struct bitmap_ipmac *map)
 	       nla_put_ipaddr4(skb, IPSET_ATTR_IP_TO, htonl(map->last_ip));
 }
 
+/* Fill out the MAC address of an element added without it, when a packet
+ * matches the element. The set lock is not taken: the CPU which takes the
+ * bit lock of the element in map->filling stores the address, the other
+ * ones skip the completion and the add path waits for it.
+ */
+static int
+bitmap_ipmac_complete(struct ip_set *set, struct bitmap_ipmac *map,
+		      const struct bitmap_ipmac_adt_elem *e,
+		      const struct ip_set_ext *ext)
+{
+	struct bitmap_ipmac_elem *elem;
+
+	elem = get_elem(map->extensions, e->id, set->dsize);
+	if (test_and_set_bit_lock(e->id, map->filling))
+		/* Being completed by another packet or added */
+		return 1;
+	if (elem->filled != MAC_UNSET)
+		/* Completed by another packet */
+		goto out;
+	ether_addr_copy(elem->ether, e->ether);
+	if (SET_WITH_TIMEOUT(set))
+		bitmap_ipmac_add_timeout(ext_timeout(elem, set), e, ext, set,
+					 map, IPSET_ADD_START_STORED_TIMEOUT);
+	if (SET_WITH_COUNTER(set))
+		ip_set_init_counter(ext_counter(elem, set), ext);
+	/* The garbage collector and the matching read the timeout and
+	 * the address of the filled out elements only.
+	 */
+	smp_store_release(&elem->filled, MAC_FILLED);
+out:
+	bitmap_ipmac_release(map, e->id);
+	return 1;
+}
+
 static int
 bitmap_ipmac_kadt(struct ip_set *set, const struct sk_buff *skb,
 		  const struct xt_action_param *par,
@@ -220,6 +305,7 @@ bitmap_ipmac_kadt(struct ip_set *set, const struct sk_buff *skb,
 	struct bitmap_ipmac_adt_elem e = { .id = 0, .add_mac = 1 };
 	struct ip_set_ext ext = IP_SET_INIT_KEXT(skb, opt, set);
 	u32 ip;
+	int ret;
 
 	ip = ntohl(ip4addr(skb, opt->flags & IPSET_DIM_ONE_SRC));
 	if (ip < map->first_ip || ip > map->last_ip)
@@ -240,7 +326,10 @@ bitmap_ipmac_kadt(struct ip_set *set, const struct sk_buff *skb,
 	if (is_zero_ether_addr(e.ether))
 		return -EINVAL;
 
-	return adtfn(set, &e, &ext, &opt->ext, opt->cmdflags);
+	ret = adtfn(set, &e, &ext, &opt->ext, opt->cmdflags);
+	if (adt == IPSET_TEST && ret == -EAGAIN)
+		ret = bitmap_ipmac_complete(set, map, &e, &ext);
+	return ret;
 }
 
 static int
@@ -284,13 +373,19 @@ bitmap_ipmac_uadt(struct ip_set *set, struct nlattr *tb[],
 }
 
 static bool
-bitmap_ipmac_same_set(const struct ip_set *a, const struct ip_set *b)
+bitmap_ipmac_same_layout(const struct ip_set *a, const struct ip_set *b)
 {
 	const struct bitmap_ipmac *x = a->data;
 	const struct bitmap_ipmac *y = b->data;
 
 	return x->first_ip == y->first_ip &&
-	       x->last_ip == y->last_ip &&
+	       x->last_ip == y->last_ip;
+}
+
+static bool
+bitmap_ipmac_same_set(const struct ip_set *a, const struct ip_set *b)
+{
+	return bitmap_ipmac_same_layout(a, b) &&
 	       a->timeout == b->timeout &&
 	       a->extensions == b->extensions;
 }
@@ -305,9 +400,11 @@ static bool
 init_map_ipmac(struct ip_set *set, struct bitmap_ipmac *map,
 	       u32 first_ip, u32 last_ip, u32 elements)
 {
-	map->members = ip_set_alloc(map->memsize);
+	/* The filling bitmap is allocated together with the members */
+	map->members = ip_set_alloc(2 * map->memsize);
 	if (!map->members)
 		return false;
+	map->filling = map->members + map->memsize;
 	map->first_ip = first_ip;
 	map->last_ip = last_ip;
 	map->elements = elements;
@@ -95,6 +95,22 @@ bitmap_port_do_list(struct sk_buff *skb, const struct bitmap_port *map, u32 id,
 			     htons(map->first_port + id));
 }
 
+static inline bool
+bitmap_port_do_filter(const struct bitmap_port *map, u32 id,
+		      const struct ip_set_elem_filter *filter)
+{
+	__be16 port = htons(map->first_port + id);
+
+	return ip_set_elem_filter_key(filter, NFPROTO_UNSPEC, NULL, 0, &port);
+}
+
+static inline void
+bitmap_port_do_walk(struct bitmap_port_adt_elem *e,
+		    const struct bitmap_port *map, u32 id, size_t dsize)
+{
+	e->id = id;
+}
+
 static inline int
 bitmap_port_do_head(struct sk_buff *skb, const struct bitmap_port *map)
 {
@@ -114,7 +130,7 @@ bitmap_port_kadt(struct ip_set *set, const struct sk_buff *skb,
 	__be16 __port;
 	u16 port = 0;
 
-	if (!ip_set_get_ip_port(skb, opt->family,
+	if (!ip_set_get_ip_port(skb, opt->family, &opt->l4,
 				opt->flags & IPSET_DIM_ONE_SRC, &__port))
 		return -EINVAL;
 
@@ -128,6 +144,9 @@ bitmap_port_kadt(struct ip_set *set, const struct sk_buff *skb,
 	return adtfn(set, &e, &ext, &opt->ext, opt->cmdflags);
 }
 
+static int bitmap_port_add_range(struct ip_set *set, u32 first, u32 last,
+				 const struct ip_set_ext *ext, u32 flags);
+
 static int
 bitmap_port_uadt(struct ip_set *set, struct nlattr *tb[],
 		 enum ipset_adt adt, u32 *lineno, u32 flags, bool retried)
@@ -173,6 +192,11 @@ bitmap_port_uadt(struct ip_set *set, struct nlattr *tb[],
 	if (port_to > map->last_port)
 		return -IPSET_ERR_BITMAP_RANGE;
 
+	if (adt == IPSET_ADD)
+		return bitmap_port_add_range(set, port_to_id(map, port),
+					     port_to_id(map, port_to),
+					     &ext, flags);
+
 	for (; port <= port_to; port++) {
 		e.id = port_to_id(map, port);
 		ret = adtfn(set, &e, &ext, &ext, flags);
@@ -186,13 +210,19 @@ bitmap_port_uadt(struct ip_set *set, struct nlattr *tb[],
 }
 
 static bool
-bitmap_port_same_set(const struct ip_set *a, const struct ip_set *b)
+bitmap_port_same_layout(const struct ip_set *a, const struct ip_set *b)
 {
 	const struct bitmap_port *x = a->data;
 	const struct bitmap_port *y = b->data;
 
 	return x->first_port == y->first_port &&
-	       x->last_port == y->last_port &&
+	       x->last_port == y->last_port;
+}
+
+static bool
+bitmap_port_same_set(const struct ip_set *a, const struct ip_set *b)
+{
+	return bitmap_port_same_layout(a, b) &&
 	       a->timeout == b->timeout &&
 	       a->extensions == b->extensions;
 }
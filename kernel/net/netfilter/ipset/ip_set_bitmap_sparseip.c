@@ -0,0 +1,769 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/* Kernel module implementing an IP set type: the bitmap:sparseip type
+ *
+ * The range of the set is covered by a two level bitmap: the first level
+ * is an array of pointers to fixed size chunks of member bits, which are
+ * allocated only when the first element in the chunk is added. So
+ * the range can be as large as the whole IPv4 address space, while
+ * memory usage grows with the number of populated chunks and the test
+ * of an element costs two memory reads.
+ */
+
+#include <linux/module.h>
+#include <linux/ip.h>
+#include <linux/skbuff.h>
+#include <linux/errno.h>
+#include <linux/bitops.h>
+#include <linux/bitmap.h>
+#include <linux/prefetch.h>
+#include <linux/spinlock.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/netlink.h>
+#include <net/netlink.h>
+
+#include <linux/netfilter/ipset/pfxlen.h>
+#include <linux/netfilter/ipset/ip_set.h>
+#include <linux/netfilter/ipset/ip_set_bitmap.h>
+
+#define IPSET_TYPE_REV_MIN	0
+#define IPSET_TYPE_REV_MAX	0
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("agent <agent@local>");
+IP_SET_MODULE_DESC("bitmap:sparseip", IPSET_TYPE_REV_MIN, IPSET_TYPE_REV_MAX);
+MODULE_ALIAS("ip_set_bitmap:sparseip");
+
+#define HOST_MASK	32
+
+/* A chunk covers 64k addresses in an 8k bitmap */
+#define SPARSEIP_CHUNK_SHIFT	16
+#define SPARSEIP_CHUNK_BITS	(1U << SPARSEIP_CHUNK_SHIFT)
+#define SPARSEIP_CHUNK_MASK	(SPARSEIP_CHUNK_BITS - 1)
+#define SPARSEIP_CHUNK_SIZE	\
+	(BITS_TO_LONGS(SPARSEIP_CHUNK_BITS) * sizeof(unsigned long))
+
+/* Type structure */
+struct bitmap_sparseip {
+	unsigned long __rcu **chunks;	/* member bits of the chunks */
+	u32 *weight;			/* number of members per chunk */
+	unsigned long *spare;		/* preallocated chunks */
+	u64 members;			/* number of members */
+	u32 first_ip;		/* host byte order, included in range */
+	u32 last_ip;		/* host byte order, included in range */
+	u32 nchunks;		/* size of the chunk array */
+	u32 populated;		/* number of allocated chunks */
+	u32 nspare;		/* number of preallocated chunks */
+	u32 need;		/* number of chunks to preallocate */
+};
+
+/* Chunks are released after a grace period */
+struct bitmap_sparseip_release {
+	struct rcu_head rcu;
+	unsigned long *bits;
+};
+
+/* ADT structure for generic function args: inclusive range of ids */
+struct bitmap_sparseip_adt_elem {
+	u32 from;
+	u32 to;
+};
+
+#define sparseip_chunk(map, c)						\
+	rcu_dereference_bh_check((map)->chunks[c], rcu_read_lock_held())
+
+static inline u64
+sparseip_last_id(const struct bitmap_sparseip *map)
+{
+	return (u64)map->last_ip - map->first_ip;
+}
+
+static inline size_t
+sparseip_memsize(const struct bitmap_sparseip *map)
+{
+	return sizeof(*map) +
+	       map->nchunks * (sizeof(*map->chunks) + sizeof(*map->weight)) +
+	       ((size_t)map->populated + map->nspare) * SPARSEIP_CHUNK_SIZE;
+}
+
+/* The whole IPv4 space does not fit into the element counter of the set */
+static inline void
+sparseip_account(struct ip_set *set, struct bitmap_sparseip *map, s64 n)
+{
+	map->members += n;
+	set->elements = min_t(u64, map->members, U32_MAX);
+}
+
+/* Take a zeroed chunk from the preallocated ones, which are linked
+ * through their first word.
+ */
+static unsigned long *
+sparseip_spare(struct bitmap_sparseip *map)
+{
+	unsigned long *bits = map->spare;
+
+	if (bits) {
+		map->spare = (unsigned long *)bits[0];
+		bits[0] = 0;
+		map->nspare--;
+	}
+	return bits;
+}
+
+/* Number of member bits in the inclusive range s-e of a chunk */
+static unsigned int
+sparseip_range_weight(const unsigned long *bits, u32 s, u32 e)
+{
+	unsigned int first = s / BITS_PER_LONG, last = e / BITS_PER_LONG;
+	unsigned int w, n = 0;
+	unsigned long word;
+
+	for (w = first; w <= last; w++) {
+		word = bits[w];
+		if (w == first)
+			word &= BITMAP_FIRST_WORD_MASK(s);
+		if (w == last)
+			word &= BITMAP_LAST_WORD_MASK(e + 1);
+		n += hweight_long(word);
+	}
+	return n;
+}
+
+/* First member id at or after id, beyond the last id if none */
+static u64
+sparseip_next_member(const struct bitmap_sparseip *map, u64 id)
+{
+	u64 last = sparseip_last_id(map);
+	const unsigned long *bits;
+	u32 c, i;
+
+	while (id <= last) {
+		c = id >> SPARSEIP_CHUNK_SHIFT;
+		bits = sparseip_chunk(map, c);
+		if (bits) {
+			i = find_next_bit(bits, SPARSEIP_CHUNK_BITS,
+					  id & SPARSEIP_CHUNK_MASK);
+			if (i < SPARSEIP_CHUNK_BITS)
+				return ((u64)c << SPARSEIP_CHUNK_SHIFT) + i;
+		}
+		id = (u64)(c + 1) << SPARSEIP_CHUNK_SHIFT;
+	}
+	return id;
+}
+
+/* First non-member id at or after id */
+static u64
+sparseip_next_hole(const struct bitmap_sparseip *map, u64 id)
+{
+	u64 last = sparseip_last_id(map);
+	const unsigned long *bits;
+	u32 c, i;
+
+	while (id <= last) {
+		c = id >> SPARSEIP_CHUNK_SHIFT;
+		bits = sparseip_chunk(map, c);
+		if (!bits)
+			return id;
+		i = find_next_zero_bit(bits, SPARSEIP_CHUNK_BITS,
+				       id & SPARSEIP_CHUNK_MASK);
+		if (i < SPARSEIP_CHUNK_BITS)
+			return ((u64)c << SPARSEIP_CHUNK_SHIFT) + i;
+		id = (u64)(c + 1) << SPARSEIP_CHUNK_SHIFT;
+	}
+	return id;
+}
+
+static void
+sparseip_release_rcu(struct rcu_head *head)
+{
+	struct bitmap_sparseip_release *r =
+		container_of(head, struct bitmap_sparseip_release, rcu);
+
+	kfree(r->bits);
+	kfree(r);
+}
+
+/* Unlink an empty chunk and free it when the readers are gone.
+ * If there's no memory for that, the chunk is simply kept.
+ */
+static void
+sparseip_release(struct bitmap_sparseip *map, u32 c, unsigned long *bits)
+{
+	struct bitmap_sparseip_release *r;
+
+	r = kmalloc(sizeof(*r), GFP_ATOMIC);
+	if (!r) {
+		bitmap_zero(bits, SPARSEIP_CHUNK_BITS);
+		return;
+	}
+	RCU_INIT_POINTER(map->chunks[c], NULL);
+	r->bits = bits;
+	call_rcu(&r->rcu, sparseip_release_rcu);
+	map->populated--;
+}
+
+static int
+bitmap_sparseip_test(struct ip_set *set, void *value,
+		     const struct ip_set_ext *ext,
+		     struct ip_set_ext *mext, u32 flags)
+{
+	const struct bitmap_sparseip *map = set->data;
+	const struct bitmap_sparseip_adt_elem *e = value;
+	u32 c = e->from >> SPARSEIP_CHUNK_SHIFT;
+	const unsigned long *bits;
+
+	if (unlikely(flags & IPSET_FLAG_PREFETCH_TABLE)) {
+		/* Prefetch passes of ip_set_test_batch() */
+		prefetch(&map->chunks[c]);
+		return 0;
+	}
+	bits = sparseip_chunk(map, c);
+	if (unlikely(flags & IPSET_FLAG_PREFETCH_BUCKET)) {
+		if (bits)
+			prefetch(bits +
+				 BIT_WORD(e->from & SPARSEIP_CHUNK_MASK));
+		return 0;
+	}
+	return bits && test_bit(e->from & SPARSEIP_CHUNK_MASK, bits);
+}
+
+static int
+bitmap_sparseip_add(struct ip_set *set, void *value,
+		    const struct ip_set_ext *ext,
+		    struct ip_set_ext *mext, u32 flags)
+{
+	struct bitmap_sparseip *map = set->data;
+	const struct bitmap_sparseip_adt_elem *e = value;
+	u32 c, s, end, len, n, missing = 0;
+	unsigned long *bits;
+	unsigned int hit;
+
+	/* Adding a range may need many new chunks: those are allocated
+	 * by resize() outside of the set lock. A single chunk, as needed
+	 * by the packet path, is allocated here.
+	 */
+	for (c = e->from >> SPARSEIP_CHUNK_SHIFT;
+	     c <= e->to >> SPARSEIP_CHUNK_SHIFT; c++)
+		if (!rcu_access_pointer(map->chunks[c]))
+			missing++;
+	if (missing > 1 && missing > map->nspare) {
+		map->need = missing;
+		return -EAGAIN;
+	}
+
+	for (c = e->from >> SPARSEIP_CHUNK_SHIFT;
+	     c <= e->to >> SPARSEIP_CHUNK_SHIFT; c++) {
+		s = c == e->from >> SPARSEIP_CHUNK_SHIFT ?
+			e->from & SPARSEIP_CHUNK_MASK : 0;
+		end = c == e->to >> SPARSEIP_CHUNK_SHIFT ?
+			e->to & SPARSEIP_CHUNK_MASK : SPARSEIP_CHUNK_MASK;
+		len = end - s + 1;
+
+		bits = rcu_dereference_protected(map->chunks[c], 1);
+		if (!bits) {
+			/* Fill the new chunk before readers can see it */
+			bits = sparseip_spare(map);
+			if (!bits)
+				bits = kzalloc(SPARSEIP_CHUNK_SIZE, GFP_ATOMIC);
+			if (!bits)
+				return -ENOMEM;
+			bitmap_set(bits, s, len);
+			rcu_assign_pointer(map->chunks[c], bits);
+			map->populated++;
+			map->weight[c] = len;
+			sparseip_account(set, map, len);
+			continue;
+		}
+		hit = find_next_bit(bits, end + 1, s);
+		if (hit <= end && !(flags & IPSET_FLAG_EXIST)) {
+			/* Add the elements up to the existing one */
+			bitmap_set(bits, s, hit - s);
+			map->weight[c] += hit - s;
+			sparseip_account(set, map, hit - s);
+			return -IPSET_ERR_EXIST;
+		}
+		n = hit <= end ? sparseip_range_weight(bits, s, end) : 0;
+		bitmap_set(bits, s, len);
+		map->weight[c] += len - n;
+		sparseip_account(set, map, len - n);
+	}
+	return 0;
+}
+
+static int
+bitmap_sparseip_del(struct ip_set *set, void *value,
+		    const struct ip_set_ext *ext,
+		    struct ip_set_ext *mext, u32 flags)
+{
+	struct bitmap_sparseip *map = set->data;
+	const struct bitmap_sparseip_adt_elem *e = value;
+	u32 c, s, end, len, n;
+	unsigned long *bits;
+	unsigned int hole;
+	int ret = 0;
+
+	for (c = e->from >> SPARSEIP_CHUNK_SHIFT;
+	     c <= e->to >> SPARSEIP_CHUNK_SHIFT; c++) {
+		s = c == e->from >> SPARSEIP_CHUNK_SHIFT ?
+			e->from & SPARSEIP_CHUNK_MASK : 0;
+		end = c == e->to >> SPARSEIP_CHUNK_SHIFT ?
+			e->to & SPARSEIP_CHUNK_MASK : SPARSEIP_CHUNK_MASK;
+		len = end - s + 1;
+
+		bits = rcu_dereference_protected(map->chunks[c], 1);
+		if (!bits) {
+			if (!(flags & IPSET_FLAG_EXIST))
+				return -IPSET_ERR_EXIST;
+			continue;
+		}
+		hole = find_next_zero_bit(bits, end + 1, s);
+		if (hole > end) {
+			n = len;
+		} else if (!(flags & IPSET_FLAG_EXIST)) {
+			/* Delete the elements up to the missing one */
+			len = n = hole - s;
+			ret = -IPSET_ERR_EXIST;
+		} else {
+			n = sparseip_range_weight(bits, s, end);
+		}
+		bitmap_clear(bits, s, len);
+		map->weight[c] -= n;
+		sparseip_account(set, map, -(s64)n);
+		if (!map->weight[c])
+			sparseip_release(map, c, bits);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int
+bitmap_sparseip_kadt(struct ip_set *set, const struct sk_buff *skb,
+		     const struct xt_action_param *par,
+		     enum ipset_adt adt, struct ip_set_adt_opt *opt)
+{
+	struct bitmap_sparseip *map = set->data;
+	ipset_adtfn adtfn = set->variant->adt[adt];
+	struct bitmap_sparseip_adt_elem e = { .from = 0 };
+	struct ip_set_ext ext = IP_SET_INIT_KEXT(skb, opt, set);
+	u32 ip;
+
+	ip = ntohl(ip4addr(skb, opt->flags & IPSET_DIM_ONE_SRC));
+	if (ip < map->first_ip || ip > map->last_ip)
+		return -IPSET_ERR_BITMAP_RANGE;
+
+	e.from = e.to = ip - map->first_ip;
+
+	return adtfn(set, &e, &ext, &opt->ext, opt->cmdflags);
+}
+
+static int
+bitmap_sparseip_uadt(struct ip_set *set, struct nlattr *tb[],
+		     enum ipset_adt adt, u32 *lineno, u32 flags, bool retried)
+{
+	struct bitmap_sparseip *map = set->data;
+	ipset_adtfn adtfn = set->variant->adt[adt];
+	u32 ip = 0, ip_to = 0;
+	struct bitmap_sparseip_adt_elem e = { .from = 0 };
+	struct ip_set_ext ext = IP_SET_INIT_UEXT(set);
+	int ret = 0;
+
+	if (tb[IPSET_ATTR_LINENO])
+		*lineno = nla_get_u32(tb[IPSET_ATTR_LINENO]);
+
+	if (unlikely(!tb[IPSET_ATTR_IP]))
+		return -IPSET_ERR_PROTOCOL;
+
+	ret = ip_set_get_hostipaddr4(tb[IPSET_ATTR_IP], &ip);
+	if (ret)
+		return ret;
+
+	if (ip < map->first_ip || ip > map->last_ip)
+		return -IPSET_ERR_BITMAP_RANGE;
+
+	if (adt == IPSET_TEST) {
+		e.from = e.to = ip - map->first_ip;
+		return adtfn(set, &e, &ext, &ext, flags);
+	}
+
+	if (tb[IPSET_ATTR_IP_TO]) {
+		ret = ip_set_get_hostipaddr4(tb[IPSET_ATTR_IP_TO], &ip_to);
+		if (ret)
+			return ret;
+		if (ip > ip_to) {
+			swap(ip, ip_to);
+			if (ip < map->first_ip)
+				return -IPSET_ERR_BITMAP_RANGE;
+		}
+	} else if (tb[IPSET_ATTR_CIDR]) {
+		u8 cidr = nla_get_u8(tb[IPSET_ATTR_CIDR]);
+
+		if (!cidr || cidr > HOST_MASK)
+			return -IPSET_ERR_INVALID_CIDR;
+		ip_set_mask_from_to(ip, ip_to, cidr);
+	} else {
+		ip_to = ip;
+	}
+
+	if (ip < map->first_ip || ip_to > map->last_ip)
+		return -IPSET_ERR_BITMAP_RANGE;
+
+	/* The whole range is handled chunk by chunk */
+	e.from = ip - map->first_ip;
+	e.to = ip_to - map->first_ip;
+
+	return adtfn(set, &e, &ext, &ext, flags);
+}
+
+static void
+bitmap_sparseip_flush(struct ip_set *set)
+{
+	struct bitmap_sparseip *map = set->data;
+	unsigned long *bits;
+	u32 c;
+
+	for (c = 0; c < map->nchunks; c++) {
+		bits = rcu_dereference_protected(map->chunks[c], 1);
+		if (!bits)
+			continue;
+		map->weight[c] = 0;
+		sparseip_release(map, c, bits);
+	}
+	map->members = 0;
+	set->elements = 0;
+}
+
+/* Preallocate the chunks needed by the range to be added */
+static int
+bitmap_sparseip_resize(struct ip_set *set, bool retried)
+{
+	struct bitmap_sparseip *map = set->data;
+	unsigned long *bits, *list = NULL;
+	u32 i, n;
+
+	spin_lock_bh(&set->lock);
+	n = map->need > map->nspare ? map->need - map->nspare : 0;
+	map->need = 0;
+	spin_unlock_bh(&set->lock);
+
+	for (i = 0; i < n; i++) {
+		bits = kzalloc(SPARSEIP_CHUNK_SIZE, GFP_KERNEL);
+		if (!bits)
+			goto cleanup;
+		bits[0] = (unsigned long)list;
+		list = bits;
+		cond_resched();
+	}
+
+	spin_lock_bh(&set->lock);
+	while (list) {
+		bits = list;
+		list = (unsigned long *)bits[0];
+		bits[0] = (unsigned long)map->spare;
+		map->spare = bits;
+		map->nspare++;
+	}
+	spin_unlock_bh(&set->lock);
+
+	return 0;
+
+cleanup:
+	while (list) {
+		bits = list;
+		list = (unsigned long *)bits[0];
+		kfree(bits);
+	}
+	return -ENOMEM;
+}
+
+static void
+bitmap_sparseip_destroy(struct ip_set *set)
+{
+	struct bitmap_sparseip *map = set->data;
+	u32 c;
+
+	/* No readers: the set is not referenced anymore */
+	for (c = 0; c < map->nchunks; c++)
+		kfree(rcu_dereference_protected(map->chunks[c], 1));
+	while (map->nspare)
+		kfree(sparseip_spare(map));
+	ip_set_free(map->chunks);
+	ip_set_free(map->weight);
+	kfree(map);
+
+	set->data = NULL;
+}
+
+static int
+bitmap_sparseip_head(struct ip_set *set, struct sk_buff *skb)
+{
+	const struct bitmap_sparseip *map = set->data;
+	struct nlattr *nested;
+
+	nested = ipset_nest_start(skb, IPSET_ATTR_DATA);
+	if (!nested)
+		goto nla_put_failure;
+	if (nla_put_ipaddr4(skb, IPSET_ATTR_IP, htonl(map->first_ip)) ||
+	    nla_put_ipaddr4(skb, IPSET_ATTR_IP_TO, htonl(map->last_ip)) ||
+	    nla_put_net32(skb, IPSET_ATTR_REFERENCES,
+			  htonl(atomic_read(&set->ref))) ||
+	    nla_put_net32(skb, IPSET_ATTR_MEMSIZE,
+			  htonl(sparseip_memsize(map))) ||
+	    nla_put_net32(skb, IPSET_ATTR_ELEMENTS, htonl(set->elements)))
+		goto nla_put_failure;
+	if (unlikely(ip_set_put_flags(skb, set)))
+		goto nla_put_failure;
+	ipset_nest_end(skb, nested);
+
+	return 0;
+nla_put_failure:
+	return -EMSGSIZE;
+}
+
+/* Clip a range of members to the address filter of the dump request.
+ * The elements have got no port or comment, so such filters match nothing.
+ */
+static bool
+sparseip_filter_range(const struct ip_set_elem_filter *filter,
+		      u32 *ip, u32 *ip_to)
+{
+	u32 first, last;
+
+	if (filter->family != NFPROTO_IPV4 || filter->with_port ||
+	    filter->comment)
+		return false;
+	first = ntohl(filter->ip.ip) & ip_set_hostmask(filter->cidr);
+	last = first | ~ip_set_hostmask(filter->cidr);
+	*ip = max(*ip, first);
+	*ip_to = min(*ip_to, last);
+
+	return *ip <= *ip_to;
+}
+
+/* Consecutive members are listed as ranges */
+static int
+bitmap_sparseip_list(const struct ip_set *set,
+		     struct sk_buff *skb, struct netlink_callback *cb)
+{
+	const struct bitmap_sparseip *map = set->data;
+	struct nlattr *adt, *nested;
+	const struct ip_set_elem_filter *filter = ip_set_dump_elem_filter(cb);
+	u64 id, end, last = sparseip_last_id(map);
+	bool listed = false;
+	u32 ip, ip_to;
+	int ret = 0;
+
+	adt = ipset_nest_start(skb, IPSET_ATTR_ADT);
+	if (!adt)
+		return -EMSGSIZE;
+	rcu_read_lock();
+	for (id = sparseip_next_member(map, cb->args[IPSET_CB_ARG0]);
+	     id <= last;
+	     id = sparseip_next_member(map, end + 1)) {
+		cond_resched_rcu();
+		end = sparseip_next_hole(map, id) - 1;
+		ip = map->first_ip + (u32)id;
+		ip_to = map->first_ip + (u32)end;
+		if (filter && !sparseip_filter_range(filter, &ip, &ip_to)) {
+			cb->args[IPSET_CB_ARG0] = end + 1;
+			continue;
+		}
+		nested = ipset_nest_start(skb, IPSET_ATTR_DATA);
+		if (!nested)
+			goto nla_put_failure;
+		if (nla_put_ipaddr4(skb, IPSET_ATTR_IP, htonl(ip)) ||
+		    (ip_to != ip &&
+		     nla_put_ipaddr4(skb, IPSET_ATTR_IP_TO, htonl(ip_to)))) {
+			nla_nest_cancel(skb, nested);
+			goto nla_put_failure;
+		}
+		ipset_nest_end(skb, nested);
+		cb->args[IPSET_CB_ARG0] = end + 1;
+		listed = true;
+	}
+	ipset_nest_end(skb, adt);
+
+	/* Set listing finished */
+	cb->args[IPSET_CB_ARG0] = 0;
+
+	goto out;
+
+nla_put_failure:
+	if (unlikely(!listed)) {
+		nla_nest_cancel(skb, adt);
+		cb->args[IPSET_CB_ARG0] = 0;
+		ret = -EMSGSIZE;
+		goto out;
+	}
+	ipset_nest_end(skb, adt);
+out:
+	rcu_read_unlock();
+	return ret;
+}
+
+/* The elements are handed over one by one, so that the other operand
+ * of a set operation can test them.
+ */
+static int
+bitmap_sparseip_walk(struct ip_set *set, ipset_walkfn fn, void *priv,
+		     unsigned long *cursor)
+{
+	const struct bitmap_sparseip *map = set->data;
+	struct bitmap_sparseip_adt_elem e;
+	u64 id, last = sparseip_last_id(map);
+	u32 walked = 0;
+	int ret = 0;
+
+	rcu_read_lock_bh();
+	for (id = sparseip_next_member(map, *cursor);
+	     id <= last;
+	     id = sparseip_next_member(map, id + 1)) {
+		if (walked++ >= IPSET_WALK_BATCH) {
+			ret = 1;
+			break;
+		}
+		e.from = e.to = id;
+		ret = fn(set, &e, 0, priv);
+		if (ret)
+			break;
+	}
+	if (ret)
+		*cursor = id;
+	rcu_read_unlock_bh();
+	return ret;
+}
+
+static bool
+bitmap_sparseip_same_layout(const struct ip_set *a, const struct ip_set *b)
+{
+	const struct bitmap_sparseip *x = a->data;
+	const struct bitmap_sparseip *y = b->data;
+
+	return x->first_ip == y->first_ip &&
+	       x->last_ip == y->last_ip;
+}
+
+static bool
+bitmap_sparseip_same_set(const struct ip_set *a, const struct ip_set *b)
+{
+	return bitmap_sparseip_same_layout(a, b) &&
+	       a->extensions == b->extensions;
+}
+
+static const struct ip_set_type_variant bitmap_sparseip = {
+	.kadt	= bitmap_sparseip_kadt,
+	.uadt	= bitmap_sparseip_uadt,
+	.adt	= {
+		[IPSET_ADD] = bitmap_sparseip_add,
+		[IPSET_DEL] = bitmap_sparseip_del,
+		[IPSET_TEST] = bitmap_sparseip_test,
+	},
+	.destroy = bitmap_sparseip_destroy,
+	.flush	= bitmap_sparseip_flush,
+	.resize	= bitmap_sparseip_resize,
+	.head	= bitmap_sparseip_head,
+	.list	= bitmap_sparseip_list,
+	.same_set = bitmap_sparseip_same_set,
+	.walk	= bitmap_sparseip_walk,
+	.same_layout = bitmap_sparseip_same_layout,
+};
+
+/* Create bitmap:sparseip type of sets */
+
+static int
+bitmap_sparseip_create(struct net *net, struct ip_set *set,
+		       struct nlattr *tb[], u32 flags)
+{
+	struct bitmap_sparseip *map;
+	u32 first_ip = 0, last_ip = 0, nchunks;
+	int ret;
+
+	if (unlikely(!tb[IPSET_ATTR_IP]))
+		return -IPSET_ERR_PROTOCOL;
+
+	ret = ip_set_get_hostipaddr4(tb[IPSET_ATTR_IP], &first_ip);
+	if (ret)
+		return ret;
+
+	if (tb[IPSET_ATTR_IP_TO]) {
+		ret = ip_set_get_hostipaddr4(tb[IPSET_ATTR_IP_TO], &last_ip);
+		if (ret)
+			return ret;
+		if (first_ip > last_ip)
+			swap(first_ip, last_ip);
+	} else if (tb[IPSET_ATTR_CIDR]) {
+		u8 cidr = nla_get_u8(tb[IPSET_ATTR_CIDR]);
+
+		if (cidr > HOST_MASK)
+			return -IPSET_ERR_INVALID_CIDR;
+		ip_set_mask_from_to(first_ip, last_ip, cidr);
+	} else {
+		return -IPSET_ERR_PROTOCOL;
+	}
+
+	nchunks = (((u64)last_ip - first_ip) >> SPARSEIP_CHUNK_SHIFT) + 1;
+	pr_debug("range %pI4h-%pI4h, chunks %u\n",
+		 &first_ip, &last_ip, nchunks);
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return -ENOMEM;
+	map->chunks = ip_set_alloc(nchunks * sizeof(*map->chunks));
+	map->weight = ip_set_alloc(nchunks * sizeof(*map->weight));
+	if (!map->chunks || !map->weight) {
+		ip_set_free(map->chunks);
+		ip_set_free(map->weight);
+		kfree(map);
+		return -ENOMEM;
+	}
+	map->first_ip = first_ip;
+	map->last_ip = last_ip;
+	map->nchunks = nchunks;
+
+	set->variant = &bitmap_sparseip;
+	set->timeout = IPSET_NO_TIMEOUT;
+	set->data = map;
+	set->family = NFPROTO_IPV4;
+
+	return 0;
+}
+
+static struct ip_set_type bitmap_sparseip_type __read_mostly = {
+	.name		= "bitmap:sparseip",
+	.protocol	= IPSET_PROTOCOL,
+	.features	= IPSET_TYPE_IP,
+	.dimension	= IPSET_DIM_ONE,
+	.family		= NFPROTO_IPV4,
+	.revision_min	= IPSET_TYPE_REV_MIN,
+	.revision_max	= IPSET_TYPE_REV_MAX,
+	.create		= bitmap_sparseip_create,
+	.create_policy	= {
+		[IPSET_ATTR_IP]		= { .type = NLA_NESTED },
+		[IPSET_ATTR_IP_TO]	= { .type = NLA_NESTED },
+		[IPSET_ATTR_CIDR]	= { .type = NLA_U8 },
+	},
+	.adt_policy	= {
+		[IPSET_ATTR_IP]		= { .type = NLA_NESTED },
+		[IPSET_ATTR_IP_TO]	= { .type = NLA_NESTED },
+		[IPSET_ATTR_CIDR]	= { .type = NLA_U8 },
+		[IPSET_ATTR_LINENO]	= { .type = NLA_U32 },
+	},
+	.me		= THIS_MODULE,
+};
+
+static int __init
+bitmap_sparseip_init(void)
+{
+	return ip_set_type_register(&bitmap_sparseip_type);
+}
+
+static void __exit
+bitmap_sparseip_fini(void)
+{
+	rcu_barrier();
+	ip_set_type_unregister(&bitmap_sparseip_type);
+}
+
+module_init(bitmap_sparseip_init);
+module_exit(bitmap_sparseip_fini);
@@ -13,6 +13,7 @@
 #include <linux/module.h>
 #include <linux/moduleparam.h>
 #include <linux/ip.h>
+#include <linux/jhash.h>
 #include <linux/skbuff.h>
 #include <linux/spinlock.h>
 #include <linux/rculist.h>
@@ -24,13 +25,15 @@
 #include <linux/netfilter/x_tables.h>
 #include <linux/netfilter/nfnetlink.h>
 #include <linux/netfilter/ipset/ip_set.h>
+#include <linux/netfilter/ipset/pfxlen.h>
 
 static LIST_HEAD(ip_set_type_list);		/* all registered set types */
 static DEFINE_MUTEX(ip_set_type_mutex);		/* protects ip_set_type_list */
-static DEFINE_RWLOCK(ip_set_ref_lock);		/* protects the set refs */
+static DEFINE_RWLOCK(ip_set_ref_lock);		/* protects rename/swap */
 
 struct ip_set_net {
 	struct ip_set * __rcu *ip_set_list;	/* all individual sets */
+	struct hlist_head *ip_set_names;	/* set name index */
 	ip_set_id_t	ip_set_max;	/* max number of sets */
 	bool		is_deleted;	/* deleted by ip_set_net_exit */
 	bool		is_destroyed;	/* all sets are destroyed */
@@ -46,6 +49,10 @@ static inline struct ip_set_net *ip_set_pernet(struct net *net)
 #define IP_SET_INC	64
 #define STRNCMP(a, b)	(strncmp(a, b, IPSET_MAXNAMELEN) == 0)
 
+/* Number of buckets in the set name index */
+#define IP_SET_NAME_HBITS	10
+#define IP_SET_NAME_HSIZE	(1 << IP_SET_NAME_HBITS)
+
 static unsigned int max_sets;
 
 module_param(max_sets, int, 0600);
@@ -248,296 +255,153 @@ ip_set_type_unregister(struct ip_set_type *type)
 }
 EXPORT_SYMBOL_GPL(ip_set_type_unregister);
 
-/* Utility functions */
-void *
-ip_set_alloc(size_t size)
+static inline bool
+flag_nested(const struct nlattr *nla)
 {
-	void *members = NULL;
+	return nla->nla_type & NLA_F_NESTED;
+}
 
-	if (size < KMALLOC_MAX_SIZE)
-		members = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+/* Creating/destroying/renaming/swapping affect the existence and
+ * the properties of a set. All of these can be executed from userspace
+ * only and serialized by the nfnl mutex indirectly from nfnetlink.
+ *
+ * Sets are identified by their index in ip_set_list and the index
+ * is used by the external references (set/SET netfilter modules).
+ *
+ * The set behind an index may change by swapping only, from userspace.
+ */
 
-	if (members) {
-		pr_debug("%p: allocated with kmalloc\n", members);
-		return members;
-	}
+/* The references are atomic counters: taking and releasing them does not
+ * need ip_set_ref_lock. New references are taken under the nfnl mutex only,
+ * netlink references by the dumpers under ip_set_ref_lock as reader,
+ * so a counter seen as zero by destroy/rename can't grow behind their back.
+ */
+static inline void
+__ip_set_get(struct ip_set *set)
+{
+	atomic_inc(&set->ref);
+}
 
-	members = vzalloc(size);
-	if (!members)
-		return NULL;
-	pr_debug("%p: allocated with vmalloc\n", members);
+static inline void
+__ip_set_put(struct ip_set *set)
+{
+	BUG_ON(atomic_dec_if_positive(&set->ref) < 0);
+}
 
-	return members;
+/* set->ref can be swapped out by ip_set_swap, netlink events (like dump) need
+ * a separate reference counter
+ */
+static inline void
+__ip_set_get_netlink(struct ip_set *set)
+{
+	atomic_inc(&set->ref_netlink);
 }
-EXPORT_SYMBOL_GPL(ip_set_alloc);
 
-void
-ip_set_free(void *members)
+static inline void
+__ip_set_put_netlink(struct ip_set *set)
 {
-	pr_debug("%p: free with %s\n", members,
-		 is_vmalloc_addr(members) ? "vfree" : "kfree");
-	kvfree(members);
+	BUG_ON(atomic_dec_if_positive(&set->ref_netlink) < 0);
 }
-EXPORT_SYMBOL_GPL(ip_set_free);
 
 static inline bool
-flag_nested(const struct nlattr *nla)
+ip_set_is_referenced(const struct ip_set *set)
 {
-	return nla->nla_type & NLA_F_NESTED;
+	return atomic_read(&set->ref) || atomic_read(&set->ref_netlink);
 }
 
-static const struct nla_policy ipaddr_policy[IPSET_ATTR_IPADDR_MAX + 1] = {
-	[IPSET_ATTR_IPADDR_IPV4]	= { .type = NLA_U32 },
-	[IPSET_ATTR_IPADDR_IPV6]	= { .type = NLA_BINARY,
-					    .len = sizeof(struct in6_addr) },
+/* The set name index maps the names of the sets to their index in
+ * ip_set_list, so the commands need not scan the whole array.
+ * It is modified under the nfnl mutex and searched under RCU.
+ * Swapping exchanges the names together with the sets behind the
+ * indices, so only creating, renaming and destroying a set touch it.
+ */
+struct ip_set_name {
+	struct hlist_node node;
+	struct rcu_head rcu;
+	ip_set_id_t id;
+	char name[IPSET_MAXNAMELEN];
 };
 
-int
-ip_set_get_ipaddr4(struct nlattr *nla,  __be32 *ipaddr)
+static inline struct hlist_head *
+ip_set_name_bucket(struct ip_set_net *inst, const char *name)
 {
-	struct nlattr *tb[IPSET_ATTR_IPADDR_MAX + 1];
+	u32 hash = jhash(name, strnlen(name, IPSET_MAXNAMELEN), 0);
 
-	if (unlikely(!flag_nested(nla)))
-		return -IPSET_ERR_PROTOCOL;
-	if (NLA_PARSE_NESTED(tb, IPSET_ATTR_IPADDR_MAX, nla,
-			     ipaddr_policy, NULL))
-		return -IPSET_ERR_PROTOCOL;
-	if (unlikely(!ip_set_attr_netorder(tb, IPSET_ATTR_IPADDR_IPV4)))
-		return -IPSET_ERR_PROTOCOL;
-
-	*ipaddr = nla_get_be32(tb[IPSET_ATTR_IPADDR_IPV4]);
-	return 0;
+	return &inst->ip_set_names[hash & (IP_SET_NAME_HSIZE - 1)];
 }
-EXPORT_SYMBOL_GPL(ip_set_get_ipaddr4);
 
-int
-ip_set_get_ipaddr6(struct nlattr *nla, union nf_inet_addr *ipaddr)
+static struct ip_set_name *
+ip_set_name_alloc(const char *name, ip_set_id_t id)
 {
-	struct nlattr *tb[IPSET_ATTR_IPADDR_MAX + 1];
-
-	if (unlikely(!flag_nested(nla)))
-		return -IPSET_ERR_PROTOCOL;
-
-	if (NLA_PARSE_NESTED(tb, IPSET_ATTR_IPADDR_MAX, nla,
-			     ipaddr_policy, NULL))
-		return -IPSET_ERR_PROTOCOL;
-	if (unlikely(!ip_set_attr_netorder(tb, IPSET_ATTR_IPADDR_IPV6)))
-		return -IPSET_ERR_PROTOCOL;
+	struct ip_set_name *n = kmalloc(sizeof(*n), GFP_KERNEL);
 
-	memcpy(ipaddr, nla_data(tb[IPSET_ATTR_IPADDR_IPV6]),
-	       sizeof(struct in6_addr));
-	return 0;
+	if (!n)
+		return NULL;
+	strlcpy(n->name, name, IPSET_MAXNAMELEN);
+	n->id = id;
+	return n;
 }
-EXPORT_SYMBOL_GPL(ip_set_get_ipaddr6);
 
-typedef void (*destroyer)(struct ip_set *, void *);
-/* ipset data extension types, in size order */
-
-const struct ip_set_ext_type ip_set_extensions[] = {
-	[IPSET_EXT_ID_COUNTER] = {
-		.type	= IPSET_EXT_COUNTER,
-		.flag	= IPSET_FLAG_WITH_COUNTERS,
-		.len	= sizeof(struct ip_set_counter),
-		.align	= __alignof__(struct ip_set_counter),
-	},
-	[IPSET_EXT_ID_TIMEOUT] = {
-		.type	= IPSET_EXT_TIMEOUT,
-		.len	= sizeof(unsigned long),
-		.align	= __alignof__(unsigned long),
-	},
-	[IPSET_EXT_ID_SKBINFO] = {
-		.type	= IPSET_EXT_SKBINFO,
-		.flag	= IPSET_FLAG_WITH_SKBINFO,
-		.len	= sizeof(struct ip_set_skbinfo),
-		.align	= __alignof__(struct ip_set_skbinfo),
-	},
-	[IPSET_EXT_ID_COMMENT] = {
-		.type	 = IPSET_EXT_COMMENT | IPSET_EXT_DESTROY,
-		.flag	 = IPSET_FLAG_WITH_COMMENT,
-		.len	 = sizeof(struct ip_set_comment),
-		.align	 = __alignof__(struct ip_set_comment),
-		.destroy = (destroyer) ip_set_comment_free,
-	},
-};
-EXPORT_SYMBOL_GPL(ip_set_extensions);
-
-static inline bool
-add_extension(enum ip_set_ext_id id, u32 flags, struct nlattr *tb[])
+/* Called under the nfnl mutex */
+static inline void
+ip_set_name_insert(struct ip_set_net *inst, struct ip_set_name *n)
 {
-	return ip_set_extensions[id].flag ?
-		(flags & ip_set_extensions[id].flag) :
-		!!tb[IPSET_ATTR_TIMEOUT];
+	hlist_add_head_rcu(&n->node, ip_set_name_bucket(inst, n->name));
 }
 
-size_t
-ip_set_elem_len(struct ip_set *set, struct nlattr *tb[], size_t len,
-		size_t align)
+static struct ip_set_name *
+__ip_set_name_find(struct ip_set_net *inst, const char *name)
 {
-	enum ip_set_ext_id id;
-	u32 cadt_flags = 0;
+	struct ip_set_name *n;
 
-	if (tb[IPSET_ATTR_CADT_FLAGS])
-		cadt_flags = ip_set_get_h32(tb[IPSET_ATTR_CADT_FLAGS]);
-	if (cadt_flags & IPSET_FLAG_WITH_FORCEADD)
-		set->flags |= IPSET_CREATE_FLAG_FORCEADD;
-	if (!align)
-		align = 1;
-	for (id = 0; id < IPSET_EXT_ID_MAX; id++) {
-		if (!add_extension(id, cadt_flags, tb))
-			continue;
-		len = ALIGN(len, ip_set_extensions[id].align);
-		set->offset[id] = len;
-		set->extensions |= ip_set_extensions[id].type;
-		len += ip_set_extensions[id].len;
-	}
-	return ALIGN(len, align);
+	hlist_for_each_entry_rcu(n, ip_set_name_bucket(inst, name), node)
+		if (STRNCMP(n->name, name))
+			return n;
+	return NULL;
 }
-EXPORT_SYMBOL_GPL(ip_set_elem_len);
 
-int
-ip_set_get_extensions(struct ip_set *set, struct nlattr *tb[],
-		      struct ip_set_ext *ext)
+static ip_set_id_t
+ip_set_name_lookup(struct ip_set_net *inst, const char *name)
 {
-	u64 fullmark;
+	struct ip_set_name *n;
+	ip_set_id_t id = IPSET_INVALID_ID;
 
-	if (unlikely(!ip_set_optattr_netorder(tb, IPSET_ATTR_TIMEOUT) ||
-		     !ip_set_optattr_netorder(tb, IPSET_ATTR_PACKETS) ||
-		     !ip_set_optattr_netorder(tb, IPSET_ATTR_BYTES) ||
-		     !ip_set_optattr_netorder(tb, IPSET_ATTR_SKBMARK) ||
-		     !ip_set_optattr_netorder(tb, IPSET_ATTR_SKBPRIO) ||
-		     !ip_set_optattr_netorder(tb, IPSET_ATTR_SKBQUEUE)))
-		return -IPSET_ERR_PROTOCOL;
+	rcu_read_lock();
+	n = __ip_set_name_find(inst, name);
+	if (n)
+		id = n->id;
+	rcu_read_unlock();
 
-	if (tb[IPSET_ATTR_TIMEOUT]) {
-		if (!SET_WITH_TIMEOUT(set))
-			return -IPSET_ERR_TIMEOUT;
-		ext->timeout = ip_set_timeout_uget(tb[IPSET_ATTR_TIMEOUT]);
-	}
-	if (tb[IPSET_ATTR_BYTES] || tb[IPSET_ATTR_PACKETS]) {
-		if (!SET_WITH_COUNTER(set))
-			return -IPSET_ERR_COUNTER;
-		if (tb[IPSET_ATTR_BYTES])
-			ext->bytes = be64_to_cpu(nla_get_be64(
-						 tb[IPSET_ATTR_BYTES]));
-		if (tb[IPSET_ATTR_PACKETS])
-			ext->packets = be64_to_cpu(nla_get_be64(
-						   tb[IPSET_ATTR_PACKETS]));
-	}
-	if (tb[IPSET_ATTR_COMMENT]) {
-		if (!SET_WITH_COMMENT(set))
-			return -IPSET_ERR_COMMENT;
-		ext->comment = ip_set_comment_uget(tb[IPSET_ATTR_COMMENT]);
-	}
-	if (tb[IPSET_ATTR_SKBMARK]) {
-		if (!SET_WITH_SKBINFO(set))
-			return -IPSET_ERR_SKBINFO;
-		fullmark = be64_to_cpu(nla_get_be64(tb[IPSET_ATTR_SKBMARK]));
-		ext->skbinfo.skbmark = fullmark >> 32;
-		ext->skbinfo.skbmarkmask = fullmark & 0xffffffff;
-	}
-	if (tb[IPSET_ATTR_SKBPRIO]) {
-		if (!SET_WITH_SKBINFO(set))
-			return -IPSET_ERR_SKBINFO;
-		ext->skbinfo.skbprio =
-			be32_to_cpu(nla_get_be32(tb[IPSET_ATTR_SKBPRIO]));
-	}
-	if (tb[IPSET_ATTR_SKBQUEUE]) {
-		if (!SET_WITH_SKBINFO(set))
-			return -IPSET_ERR_SKBINFO;
-		ext->skbinfo.skbqueue =
-			be16_to_cpu(nla_get_be16(tb[IPSET_ATTR_SKBQUEUE]));
-	}
-	return 0;
+	return id;
 }
-EXPORT_SYMBOL_GPL(ip_set_get_extensions);
 
-int
-ip_set_put_extensions(struct sk_buff *skb, const struct ip_set *set,
-		      const void *e, bool active)
+/* Called under the nfnl mutex */
+static void
+ip_set_name_remove(struct ip_set_net *inst, const char *name)
 {
-	if (SET_WITH_TIMEOUT(set)) {
-		unsigned long *timeout = ext_timeout(e, set);
+	struct ip_set_name *n = __ip_set_name_find(inst, name);
 
-		if (nla_put_net32(skb, IPSET_ATTR_TIMEOUT,
-			htonl(active ? ip_set_timeout_get(timeout)
-			      : *timeout)))
-			return -EMSGSIZE;
+	if (n) {
+		hlist_del_rcu(&n->node);
+		kfree_rcu(n, rcu);
 	}
-	if (SET_WITH_COUNTER(set) &&
-	    ip_set_put_counter(skb, ext_counter(e, set)))
-		return -EMSGSIZE;
-	if (SET_WITH_COMMENT(set) &&
-	    ip_set_put_comment(skb, ext_comment(e, set)))
-		return -EMSGSIZE;
-	if (SET_WITH_SKBINFO(set) &&
-	    ip_set_put_skbinfo(skb, ext_skbinfo(e, set)))
-		return -EMSGSIZE;
-	return 0;
 }
-EXPORT_SYMBOL_GPL(ip_set_put_extensions);
 
-bool
-ip_set_match_extensions(struct ip_set *set, const struct ip_set_ext *ext,
-			struct ip_set_ext *mext, u32 flags, void *data)
-{
-	if (SET_WITH_TIMEOUT(set) &&
-	    ip_set_timeout_expired(ext_timeout(data, set)))
-		return false;
-	if (SET_WITH_COUNTER(set)) {
-		struct ip_set_counter *counter = ext_counter(data, set);
-
-		if (flags & IPSET_FLAG_MATCH_COUNTERS &&
-		    !(ip_set_match_counter(ip_set_get_packets(counter),
-				mext->packets, mext->packets_op) &&
-		      ip_set_match_counter(ip_set_get_bytes(counter),
-				mext->bytes, mext->bytes_op)))
-			return false;
-		ip_set_update_counter(counter, ext, flags);
-	}
-	if (SET_WITH_SKBINFO(set))
-		ip_set_get_skbinfo(ext_skbinfo(data, set),
-				   ext, mext, flags);
-	return true;
-}
-EXPORT_SYMBOL_GPL(ip_set_match_extensions);
-
-/* Creating/destroying/renaming/swapping affect the existence and
- * the properties of a set. All of these can be executed from userspace
- * only and serialized by the nfnl mutex indirectly from nfnetlink.
- *
- * Sets are identified by their index in ip_set_list and the index
- * is used by the external references (set/SET netfilter modules).
- *
- * The set behind an index may change by swapping only, from userspace.
- */
-
-static inline void
-__ip_set_get(struct ip_set *set)
+/* Called under the nfnl mutex */
+static void
+ip_set_name_flush(struct ip_set_net *inst)
 {
-	write_lock_bh(&ip_set_ref_lock);
-	set->ref++;
-	write_unlock_bh(&ip_set_ref_lock);
-}
+	struct ip_set_name *n;
+	struct hlist_node *next;
+	u32 i;
 
-static inline void
-__ip_set_put(struct ip_set *set)
-{
-	write_lock_bh(&ip_set_ref_lock);
-	BUG_ON(set->ref == 0);
-	set->ref--;
-	write_unlock_bh(&ip_set_ref_lock);
-}
-
-/* set->ref can be swapped out by ip_set_swap, netlink events (like dump) need
- * a separate reference counter
- */
-static inline void
-__ip_set_put_netlink(struct ip_set *set)
-{
-	write_lock_bh(&ip_set_ref_lock);
-	BUG_ON(set->ref_netlink == 0);
-	set->ref_netlink--;
-	write_unlock_bh(&ip_set_ref_lock);
+	for (i = 0; i < IP_SET_NAME_HSIZE; i++) {
+		hlist_for_each_entry_safe(n, next, &inst->ip_set_names[i],
+					  node) {
+			hlist_del_rcu(&n->node);
+			kfree_rcu(n, rcu);
+		}
+	}
 }
 
 /* Add, del and test set entries from kernel.
@@ -574,30 +438,64 @@ ip_set_test(ip_set_id_t index, const struct sk_buff *skb,
 	    !(opt->family == set->family || set->family == NFPROTO_UNSPEC))
 		return 0;
 
+	/* The types complete the matching elements themselves, without
+	 * taking the set lock: the test never falls back to an add.
+	 */
 	rcu_read_lock_bh();
 	ret = set->variant->kadt(set, skb, par, IPSET_TEST, opt);
 	rcu_read_unlock_bh();
 
-	if (ret == -EAGAIN) {
-		/* Type requests element to be completed */
-		pr_debug("element must be completed, ADD is triggered\n");
-		spin_lock_bh(&set->lock);
-		set->variant->kadt(set, skb, par, IPSET_ADD, opt);
-		spin_unlock_bh(&set->lock);
-		ret = 1;
-	} else {
-		/* --return-nomatch: invert matched element */
-		if ((opt->cmdflags & IPSET_FLAG_RETURN_NOMATCH) &&
-		    (set->type->features & IPSET_TYPE_NOMATCH) &&
-		    (ret > 0 || ret == -ENOTEMPTY))
-			ret = -ret;
-	}
+	/* --return-nomatch: invert matched element */
+	if ((opt->cmdflags & IPSET_FLAG_RETURN_NOMATCH) &&
+	    (set->type->features & IPSET_TYPE_NOMATCH) &&
+	    (ret > 0 || ret == -ENOTEMPTY))
+		ret = -ret;
 
 	/* Convert error codes to nomatch */
 	return (ret < 0 ? 0 : ret);
 }
 EXPORT_SYMBOL_GPL(ip_set_test);
 
+/* Test a batch of packets against a set. The types prefetch the memory
+ * of the elements for all the packets first, in two passes, so that the
+ * cache misses of the lookups overlap when the set does not fit into the
+ * cache. The passes fill out the Layer-4 data in the options, so the
+ * real tests do not extract it again: every packet needs its own options.
+ */
+void
+ip_set_test_batch(ip_set_id_t index, unsigned int n,
+		  const struct sk_buff * const skb[],
+		  const struct xt_action_param par[],
+		  struct ip_set_adt_opt opt[], int ret[])
+{
+	struct ip_set *set;
+	u32 pass;
+	unsigned int i;
+
+	if (!n)
+		return;
+	set = ip_set_rcu_get(IPSET_DEV_NET(&par[0]), index);
+	BUG_ON(!set);
+
+	rcu_read_lock_bh();
+	for (pass = IPSET_FLAG_PREFETCH_TABLE;
+	     pass & IPSET_FLAG_PREFETCH; pass <<= 1)
+		for (i = 0; i < n; i++) {
+			if (opt[i].dim < set->type->dimension ||
+			    !(opt[i].family == set->family ||
+			      set->family == NFPROTO_UNSPEC))
+				continue;
+			opt[i].cmdflags |= pass;
+			set->variant->kadt(set, skb[i], &par[i], IPSET_TEST,
+					   &opt[i]);
+			opt[i].cmdflags &= ~pass;
+		}
+	for (i = 0; i < n; i++)
+		ret[i] = ip_set_test(index, skb[i], &par[i], &opt[i]);
+	rcu_read_unlock_bh();
+}
+EXPORT_SYMBOL_GPL(ip_set_test_batch);
+
 int
 ip_set_add(ip_set_id_t index, const struct sk_buff *skb,
 	   const struct xt_action_param *par, struct ip_set_adt_opt *opt)
@@ -649,18 +547,19 @@ EXPORT_SYMBOL_GPL(ip_set_del);
 ip_set_id_t
 ip_set_get_byname(struct net *net, const char *name, struct ip_set **set)
 {
-	ip_set_id_t i, index = IPSET_INVALID_ID;
+	ip_set_id_t index = IPSET_INVALID_ID;
+	struct ip_set_name *n;
 	struct ip_set *s;
 	struct ip_set_net *inst = ip_set_pernet(net);
 
 	rcu_read_lock();
-	for (i = 0; i < inst->ip_set_max; i++) {
-		s = rcu_dereference(inst->ip_set_list)[i];
-		if (s && STRNCMP(s->name, name)) {
+	n = __ip_set_name_find(inst, name);
+	if (n) {
+		s = rcu_dereference(inst->ip_set_list)[n->id];
+		if (s) {
 			__ip_set_get(s);
-			index = i;
+			index = n->id;
 			*set = s;
-			break;
 		}
 	}
 	rcu_read_unlock();
@@ -714,6 +613,21 @@ ip_set_name_byindex(struct net *net, ip_set_id_t index, char *name)
 }
 EXPORT_SYMBOL_GPL(ip_set_name_byindex);
 
+/* Get the features of the set type behind a set index. Swapping is allowed
+ * between sets with identical features only, so the value stays valid as
+ * long as the caller holds a reference to the set.
+ */
+u16
+ip_set_features_byindex(struct net *net, ip_set_id_t index)
+{
+	struct ip_set *set = ip_set_rcu_get(net, index);
+
+	BUG_ON(!set);
+
+	return set->type->features;
+}
+EXPORT_SYMBOL_GPL(ip_set_features_byindex);
+
 /* Routines to call by external subsystems, which do not
  * call nfnl_lock for us.
  */
@@ -830,18 +744,8 @@ static const struct nla_policy ip_set_create_policy[IPSET_ATTR_CMD_MAX + 1] = {
 static struct ip_set *
 find_set_and_id(struct ip_set_net *inst, const char *name, ip_set_id_t *id)
 {
-	struct ip_set *set = NULL;
-	ip_set_id_t i;
-
-	*id = IPSET_INVALID_ID;
-	for (i = 0; i < inst->ip_set_max; i++) {
-		set = ip_set(inst, i);
-		if (set && STRNCMP(set->name, name)) {
-			*id = i;
-			break;
-		}
-	}
-	return (*id == IPSET_INVALID_ID ? NULL : set);
+	*id = ip_set_name_lookup(inst, name);
+	return (*id == IPSET_INVALID_ID ? NULL : ip_set(inst, *id));
 }
 
 static inline struct ip_set *
@@ -860,15 +764,16 @@ find_free_id(struct ip_set_net *inst, const char *name, ip_set_id_t *index,
 	ip_set_id_t i;
 
 	*index = IPSET_INVALID_ID;
+	s = find_set_and_id(inst, name, &i);
+	if (s) {
+		/* Name clash */
+		*set = s;
+		return -EEXIST;
+	}
 	for (i = 0;  i < inst->ip_set_max; i++) {
-		s = ip_set(inst, i);
-		if (!s) {
-			if (*index == IPSET_INVALID_ID)
-				*index = i;
-		} else if (STRNCMP(name, s->name)) {
-			/* Name clash */
-			*set = s;
-			return -EEXIST;
+		if (!ip_set(inst, i)) {
+			*index = i;
+			break;
 		}
 	}
 	if (*index == IPSET_INVALID_ID)
@@ -895,6 +800,7 @@ IPSET_CBFN(ip_set_create, struct net *n, struct sock *ctnl,
 	struct net *net = IPSET_SOCK_NET(n, ctnl);
 	struct ip_set_net *inst = ip_set_pernet(net);
 	struct ip_set *set, *clash = NULL;
+	struct ip_set_name *sname;
 	ip_set_id_t index = IPSET_INVALID_ID;
 	struct nlattr *tb[IPSET_ATTR_CREATE_MAX + 1] = {};
 	const char *name, *typename;
@@ -924,6 +830,11 @@ IPSET_CBFN(ip_set_create, struct net *n, struct sock *ctnl,
 	set = kzalloc(sizeof(*set), GFP_KERNEL);
 	if (!set)
 		return -ENOMEM;
+	sname = ip_set_name_alloc(name, IPSET_INVALID_ID);
+	if (!sname) {
+		kfree(set);
+		return -ENOMEM;
+	}
 	spin_lock_init(&set->lock);
 	strlcpy(set->name, name, IPSET_MAXNAMELEN);
 	set->family = family;
@@ -998,6 +909,8 @@ IPSET_CBFN(ip_set_create, struct net *n, struct sock *ctnl,
 	/* Finally! Add our shiny new set to the list, and be done. */
 	pr_debug("create: '%s' created with index %u!\n", set->name, index);
 	ip_set(inst, index) = set;
+	sname->id = index;
+	ip_set_name_insert(inst, sname);
 
 	return ret;
 
@@ -1006,6 +919,7 @@ cleanup:
 put_out:
 	module_put(set->type->me);
 out:
+	kfree(sname);
 	kfree(set);
 	return ret;
 }
@@ -1019,12 +933,26 @@ ip_set_setname_policy[IPSET_ATTR_CMD_MAX + 1] = {
 				    .len = IPSET_MAXNAMELEN - 1 },
 };
 
+/* Drop the unpublished new content of a set being replaced */
+static void
+ip_set_shadow_destroy(struct ip_set *set)
+{
+	struct ip_set *shadow = set->shadow;
+
+	if (!shadow)
+		return;
+	set->shadow = NULL;
+	shadow->variant->shadow_destroy(shadow);
+	kfree(shadow);
+}
+
 static void
 ip_set_destroy_set(struct ip_set *set)
 {
 	pr_debug("set: %s\n",  set->name);
 
 	/* Must call it without holding any lock */
+	ip_set_shadow_destroy(set);
 	set->variant->destroy(set);
 	module_put(set->type->me);
 	kfree(set);
@@ -1048,26 +976,28 @@ IPSET_CBFN(ip_set_destroy, struct net *net, struct sock *ctnl,
 	rcu_barrier();
 
 	/* Commands are serialized and references are
-	 * protected by the ip_set_ref_lock.
+	 * taken under the nfnl mutex.
 	 * External systems (i.e. xt_set) must call
 	 * ip_set_put|get_nfnl_* functions, that way we
 	 * can safely check references here.
 	 *
 	 * list:set timer can only decrement the reference
-	 * counter, so if it's already zero, we can proceed
-	 * without holding the lock.
+	 * counter, so if it's already zero, we can proceed.
+	 * Dumping takes netlink references under ip_set_ref_lock
+	 * as reader, which we exclude here.
 	 */
-	read_lock_bh(&ip_set_ref_lock);
+	write_lock_bh(&ip_set_ref_lock);
 	if (!attr[IPSET_ATTR_SETNAME]) {
 		for (i = 0; i < inst->ip_set_max; i++) {
 			s = ip_set(inst, i);
-			if (s && (s->ref || s->ref_netlink)) {
+			if (s && ip_set_is_referenced(s)) {
 				ret = -IPSET_ERR_BUSY;
 				goto out;
 			}
 		}
 		inst->is_destroyed = true;
-		read_unlock_bh(&ip_set_ref_lock);
+		write_unlock_bh(&ip_set_ref_lock);
+		ip_set_name_flush(inst);
 		for (i = 0; i < inst->ip_set_max; i++) {
 			s = ip_set(inst, i);
 			if (s) {
@@ -1083,18 +1013,19 @@ IPSET_CBFN(ip_set_destroy, struct net *net, struct sock *ctnl,
 		if (!s) {
 			ret = -ENOENT;
 			goto out;
-		} else if (s->ref || s->ref_netlink) {
+		} else if (ip_set_is_referenced(s)) {
 			ret = -IPSET_ERR_BUSY;
 			goto out;
 		}
 		ip_set(inst, i) = NULL;
-		read_unlock_bh(&ip_set_ref_lock);
+		write_unlock_bh(&ip_set_ref_lock);
 
+		ip_set_name_remove(inst, s->name);
 		ip_set_destroy_set(s);
 	}
 	return 0;
 out:
-	read_unlock_bh(&ip_set_ref_lock);
+	write_unlock_bh(&ip_set_ref_lock);
 	return ret;
 }
 
@@ -1158,7 +1089,8 @@ IPSET_CBFN(ip_set_rename, struct net *net, struct sock *ctnl,
 	   struct netlink_ext_ack *extack)
 {
 	struct ip_set_net *inst = ip_set_pernet(IPSET_SOCK_NET(net, ctnl));
-	struct ip_set *set, *s;
+	struct ip_set *set;
+	struct ip_set_name *n;
 	const char *name2;
 	ip_set_id_t i;
 	int ret = 0;
@@ -1168,36 +1100,41 @@ IPSET_CBFN(ip_set_rename, struct net *net, struct sock *ctnl,
 		     !attr[IPSET_ATTR_SETNAME2]))
 		return -IPSET_ERR_PROTOCOL;
 
-	set = find_set(inst, nla_data(attr[IPSET_ATTR_SETNAME]));
+	set = find_set_and_id(inst, nla_data(attr[IPSET_ATTR_SETNAME]), &i);
 	if (!set)
 		return -ENOENT;
 
+	name2 = nla_data(attr[IPSET_ATTR_SETNAME2]);
+	n = ip_set_name_alloc(name2, i);
+	if (!n)
+		return -ENOMEM;
+
 	write_lock_bh(&ip_set_ref_lock);
-	if (set->ref != 0) {
+	if (atomic_read(&set->ref) != 0) {
 		ret = -IPSET_ERR_REFERENCED;
 		goto out;
 	}
 
-	name2 = nla_data(attr[IPSET_ATTR_SETNAME2]);
-	for (i = 0; i < inst->ip_set_max; i++) {
-		s = ip_set(inst, i);
-		if (s && STRNCMP(s->name, name2)) {
-			ret = -IPSET_ERR_EXIST_SETNAME2;
-			goto out;
-		}
+	if (ip_set_name_lookup(inst, name2) != IPSET_INVALID_ID) {
+		ret = -IPSET_ERR_EXIST_SETNAME2;
+		goto out;
 	}
+	ip_set_name_remove(inst, set->name);
 	strncpy(set->name, name2, IPSET_MAXNAMELEN);
+	ip_set_name_insert(inst, n);
+	n = NULL;
 
 out:
 	write_unlock_bh(&ip_set_ref_lock);
+	kfree(n);
 	return ret;
 }
 
 /* Swap two sets so that name/index points to the other.
  * References and set names are also swapped.
  *
- * The commands are serialized by the nfnl mutex and references are
- * protected by the ip_set_ref_lock. The kernel interfaces
+ * The commands are serialized by the nfnl mutex and ip_set_ref_lock
+ * keeps the dumpers away while swapping. The kernel interfaces
  * do not hold the mutex but the pointer settings are atomic
  * so the ip_set_list always contains valid pointers to the sets.
  */
@@ -1212,6 +1149,7 @@ IPSET_CBFN(ip_set_swap, struct net *net, struct sock *ctnl,
 	struct ip_set *from, *to;
 	ip_set_id_t from_id, to_id;
 	char from_name[IPSET_MAXNAMELEN];
+	int refs;
 
 	if (unlikely(protocol_min_failed(attr) ||
 		     !attr[IPSET_ATTR_SETNAME] ||
@@ -1238,16 +1176,24 @@ IPSET_CBFN(ip_set_swap, struct net *net, struct sock *ctnl,
 
 	write_lock_bh(&ip_set_ref_lock);
 
-	if (from->ref_netlink || to->ref_netlink) {
+	if (atomic_read(&from->ref_netlink) ||
+	    atomic_read(&to->ref_netlink)) {
 		write_unlock_bh(&ip_set_ref_lock);
 		return -EBUSY;
 	}
 
+	/* The names stay at their indices: the name index is unchanged */
 	strncpy(from_name, from->name, IPSET_MAXNAMELEN);
 	strncpy(from->name, to->name, IPSET_MAXNAMELEN);
 	strncpy(to->name, from_name, IPSET_MAXNAMELEN);
 
-	swap(from->ref, to->ref);
+	/* The references belong to the indices. list:set may release
+	 * references concurrently, so move the difference instead of
+	 * exchanging the values to preserve the parallel decrements.
+	 */
+	refs = atomic_read(&to->ref) - atomic_read(&from->ref);
+	atomic_add(refs, &from->ref);
+	atomic_sub(refs, &to->ref);
 	ip_set(inst, from_id) = to;
 	ip_set(inst, to_id) = from;
 	write_unlock_bh(&ip_set_ref_lock);
@@ -1255,6 +1201,272 @@ IPSET_CBFN(ip_set_swap, struct net *net, struct sock *ctnl,
 	return 0;
 }
 
+/* Set operations: store the union, intersection or difference
+ * of two sets in a third one.
+ *
+ * The operands are walked by the set types and the selected elements
+ * are added to the target with the target defaults: extensions
+ * (counters, comments, etc.) of the operands are not copied.
+ * The commands are serialized by the nfnl mutex, so none of the sets
+ * can be destroyed, renamed or swapped away while we work.
+ */
+
+static const struct nla_policy
+ip_set_setop_policy[IPSET_ATTR_CMD_MAX + 1] = {
+	[IPSET_ATTR_PROTOCOL]	= { .type = NLA_U8 },
+	[IPSET_ATTR_SETNAME]	= { .type = NLA_NUL_STRING,
+				    .len = IPSET_MAXNAMELEN - 1 },
+	[IPSET_ATTR_SETNAME2]	= { .type = NLA_NUL_STRING,
+				    .len = IPSET_MAXNAMELEN - 1 },
+	[IPSET_ATTR_SETNAME3]	= { .type = NLA_NUL_STRING,
+				    .len = IPSET_MAXNAMELEN - 1 },
+};
+
+struct ip_set_setop {
+	struct ip_set *target;	/* set to store the result in */
+	struct ip_set *other;	/* set to test the walked elements in */
+	bool member;		/* store the elements found in other */
+};
+
+static int
+ip_set_setop_elem(struct ip_set *set, void *value, u32 cmdflags,
+		  void *priv)
+{
+	struct ip_set_setop *op = priv;
+	struct ip_set *target = op->target;
+	struct ip_set_ext ext = IP_SET_INIT_UEXT(target);
+	int ret;
+
+	if (op->other) {
+		struct ip_set_ext text = IP_SET_INIT_UEXT(op->other);
+
+		/* Same as a userspace test: -EAGAIN means a match */
+		ret = op->other->variant->adt[IPSET_TEST](op->other, value,
+							  &text, &text, 0);
+		if ((ret > 0 || ret == -EAGAIN) != op->member)
+			return 0;
+	}
+
+	spin_lock_bh(&target->lock);
+	ret = target->variant->adt[IPSET_ADD](target, value, &ext, &ext,
+					      cmdflags | IPSET_FLAG_EXIST);
+	spin_unlock_bh(&target->lock);
+
+	return ret;
+}
+
+static int
+ip_set_setop_walk(struct ip_set *set, struct ip_set_setop *op)
+{
+	unsigned long cursor = 0;
+	bool retried = false;
+	int ret;
+
+	while ((ret = set->variant->walk(set, ip_set_setop_elem, op,
+					 &cursor)) != 0) {
+		if (ret > 0) {
+			cond_resched();
+			continue;
+		}
+		/* The target is full: resize and continue where we are */
+		if (ret != -EAGAIN || !op->target->variant->resize)
+			return ret;
+		ret = op->target->variant->resize(op->target, retried);
+		if (ret)
+			return ret;
+		retried = true;
+	}
+	return 0;
+}
+
+static int
+ip_set_setop(struct ip_set_net *inst, const struct nlattr * const attr[],
+	     enum ipset_cmd cmd)
+{
+	struct ip_set *a, *b;
+	struct ip_set_setop op = { };
+	int ret;
+
+	if (unlikely(protocol_min_failed(attr) ||
+		     !attr[IPSET_ATTR_SETNAME] ||
+		     !attr[IPSET_ATTR_SETNAME2] ||
+		     !attr[IPSET_ATTR_SETNAME3]))
+		return -IPSET_ERR_PROTOCOL;
+
+	op.target = find_set(inst, nla_data(attr[IPSET_ATTR_SETNAME]));
+	a = find_set(inst, nla_data(attr[IPSET_ATTR_SETNAME2]));
+	b = find_set(inst, nla_data(attr[IPSET_ATTR_SETNAME3]));
+	if (!op.target || !a || !b)
+		return -ENOENT;
+	if (op.target == a || op.target == b)
+		return -IPSET_ERR_SETOP_TARGET;
+	if (!(a->type == op.target->type && b->type == op.target->type &&
+	      a->family == op.target->family &&
+	      b->family == op.target->family))
+		return -IPSET_ERR_TYPE_MISMATCH;
+	if (!op.target->variant->walk)
+		return -IPSET_ERR_SETOP_TYPE;
+	if (!(op.target->variant->same_layout(op.target, a) &&
+	      op.target->variant->same_layout(op.target, b)))
+		return -IPSET_ERR_TYPE_MISMATCH;
+
+	ip_set_flush_set(op.target);
+
+	switch (cmd) {
+	case IPSET_CMD_UNION:
+		ret = ip_set_setop_walk(a, &op);
+		if (!ret)
+			ret = ip_set_setop_walk(b, &op);
+		break;
+	case IPSET_CMD_INTERSECT:
+		/* Always walk the first operand: the test of a walked
+		 * element is not symmetric for the network types, an
+		 * address is found in a stored network but a network
+		 * is not found in a stored address.
+		 */
+		op.other = b;
+		op.member = true;
+		ret = ip_set_setop_walk(a, &op);
+		break;
+	default:
+		op.other = b;
+		ret = ip_set_setop_walk(a, &op);
+		break;
+	}
+	return ret;
+}
+
+static int
+IPSET_CBFN(ip_set_union, struct net *net, struct sock *ctnl,
+	   struct sk_buff *skb, const struct nlmsghdr *nlh,
+	   const struct nlattr * const attr[],
+	   struct netlink_ext_ack *extack)
+{
+	return ip_set_setop(ip_set_pernet(IPSET_SOCK_NET(net, ctnl)), attr,
+			    IPSET_CMD_UNION);
+}
+
+static int
+IPSET_CBFN(ip_set_intersect, struct net *net, struct sock *ctnl,
+	   struct sk_buff *skb, const struct nlmsghdr *nlh,
+	   const struct nlattr * const attr[],
+	   struct netlink_ext_ack *extack)
+{
+	return ip_set_setop(ip_set_pernet(IPSET_SOCK_NET(net, ctnl)), attr,
+			    IPSET_CMD_INTERSECT);
+}
+
+static int
+IPSET_CBFN(ip_set_diff, struct net *net, struct sock *ctnl,
+	   struct sk_buff *skb, const struct nlmsghdr *nlh,
+	   const struct nlattr * const attr[],
+	   struct netlink_ext_ack *extack)
+{
+	return ip_set_setop(ip_set_pernet(IPSET_SOCK_NET(net, ctnl)), attr,
+			    IPSET_CMD_DIFF);
+}
+
+/* Replace the content of a set atomically.
+ *
+ * A REPLACE command creates an empty shadow copy of the set, which is
+ * filled up by ADD commands flagged with IPSET_FLAG_SHADOW. A REPLACE
+ * command flagged with IPSET_FLAG_PUBLISH then makes the shadow content
+ * the content of the set in one step, and the old content is freed.
+ * Packets are matched against the old content until the switch, and
+ * no temporary set is created and swapped in. The commands are
+ * serialized by the nfnl mutex, so the shadow pointer needs no locking.
+ * The shadow is dropped when adding to it fails or when the socket which
+ * started the replace is closed before publishing it.
+ */
+
+static const struct nla_policy
+ip_set_replace_policy[IPSET_ATTR_CMD_MAX + 1] = {
+	[IPSET_ATTR_PROTOCOL]	= { .type = NLA_U8 },
+	[IPSET_ATTR_SETNAME]	= { .type = NLA_NUL_STRING,
+				    .len = IPSET_MAXNAMELEN - 1 },
+	[IPSET_ATTR_FLAGS]	= { .type = NLA_U32 },
+};
+
+static int
+IPSET_CBFN(ip_set_replace, struct net *net, struct sock *ctnl,
+	   struct sk_buff *skb, const struct nlmsghdr *nlh,
+	   const struct nlattr * const attr[],
+	   struct netlink_ext_ack *extack)
+{
+	struct ip_set_net *inst = ip_set_pernet(IPSET_SOCK_NET(net, ctnl));
+	struct ip_set *set, *shadow;
+	u32 flags = 0;
+	int ret;
+
+	if (unlikely(protocol_min_failed(attr) ||
+		     !attr[IPSET_ATTR_SETNAME]))
+		return -IPSET_ERR_PROTOCOL;
+
+	set = find_set(inst, nla_data(attr[IPSET_ATTR_SETNAME]));
+	if (!set)
+		return -ENOENT;
+	if (!set->variant->shadow_create)
+		return -IPSET_ERR_REPLACE_TYPE;
+	if (attr[IPSET_ATTR_FLAGS])
+		flags = ip_set_get_h32(attr[IPSET_ATTR_FLAGS]);
+
+	if (flags & IPSET_FLAG_PUBLISH) {
+		shadow = set->shadow;
+		if (!shadow)
+			return -IPSET_ERR_NO_REPLACE;
+		set->shadow = NULL;
+		set->variant->shadow_publish(set, shadow);
+		kfree(shadow);
+		return 0;
+	}
+
+	/* Start over when a previous replace was not published */
+	ip_set_shadow_destroy(set);
+	shadow = kmemdup(set, sizeof(*set), GFP_KERNEL);
+	if (!shadow)
+		return -ENOMEM;
+	spin_lock_init(&shadow->lock);
+	shadow->elements = 0;
+	shadow->ext_size = 0;
+	ret = set->variant->shadow_create(set, shadow);
+	if (ret) {
+		kfree(shadow);
+		return ret;
+	}
+	set->shadow = shadow;
+	set->shadow_portid = NETLINK_PORTID(skb);
+
+	return 0;
+}
+
+static int
+ip_set_netlink_notify(struct notifier_block *nb, unsigned long event,
+		      void *ptr)
+{
+	struct netlink_notify *n = ptr;
+	struct ip_set_net *inst;
+	struct ip_set *set;
+	ip_set_id_t i;
+
+	if (event != NETLINK_URELEASE || n->protocol != NETLINK_NETFILTER)
+		return NOTIFY_DONE;
+
+	inst = ip_set_pernet(n->net);
+	nfnl_lock(NFNL_SUBSYS_IPSET);
+	for (i = 0; i < inst->ip_set_max; i++) {
+		set = ip_set(inst, i);
+		if (set && set->shadow && set->shadow_portid == n->portid)
+			ip_set_shadow_destroy(set);
+	}
+	nfnl_unlock(NFNL_SUBSYS_IPSET);
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block ip_set_netlink_notifier = {
+	.notifier_call	= ip_set_netlink_notify,
+};
+
 /* List/save set data */
 
 #define DUMP_INIT	0
@@ -1262,12 +1474,15 @@ IPSET_CBFN(ip_set_swap, struct net *net, struct sock *ctnl,
 #define DUMP_ONE	2
 #define DUMP_LAST	3
 
-#define DUMP_TYPE(arg)		(((u32)(arg)) & 0x0000FFFF)
+#define DUMP_TYPE(arg)		(((u32)(arg)) & 0x000000FF)
+#define DUMP_PROTO(arg)		((((u32)(arg)) >> 8) & 0x000000FF)
 #define DUMP_FLAGS(arg)		(((u32)(arg)) >> 16)
 
 static int
 ip_set_dump_done(struct netlink_callback *cb)
 {
+	kfree(ip_set_dump_elem_filter(cb));
+	cb->args[IPSET_CB_FILTER] = 0;
 	if (cb->args[IPSET_CB_ARG0]) {
 		struct ip_set_net *inst =
 			(struct ip_set_net *)cb->args[IPSET_CB_NET];
@@ -1294,47 +1509,192 @@ dump_attrs(struct nlmsghdr *nlh)
 	}
 }
 
+static const struct nla_policy
+ip_set_dump_policy[IPSET_ATTR_CMD_MAX + 1] = {
+	[IPSET_ATTR_PROTOCOL]	= { .type = NLA_U8 },
+	[IPSET_ATTR_SETNAME]	= { .type = NLA_NUL_STRING,
+				    .len = IPSET_MAXNAMELEN - 1 },
+	[IPSET_ATTR_FLAGS]	= { .type = NLA_U32 },
+	[IPSET_ATTR_INDEX]	= { .type = NLA_U16 },
+	[IPSET_ATTR_INDEX_TO]	= { .type = NLA_U16 },
+	[IPSET_ATTR_SETNAME_PREFIX] = { .type = NLA_NUL_STRING,
+					.len = IPSET_MAXNAMELEN - 1 },
+	[IPSET_ATTR_DATA]	= { .type = NLA_NESTED },
+};
+
+/* Restriction of a dump of all sets, so that userspace can dump
+ * disjoint parts of the sets over multiple sockets in parallel.
+ */
+struct ip_set_dump_filter {
+	ip_set_id_t from;		/* First index to dump */
+	ip_set_id_t to;			/* Last index to dump */
+	const char *prefix;		/* Setname prefix or NULL */
+	size_t prefix_len;
+};
+
+/* The dump request stays available in cb->skb during the whole dump */
 static int
-dump_init(struct netlink_callback *cb, struct ip_set_net *inst)
+dump_parse(struct netlink_callback *cb, struct nlattr *cda[],
+	   struct ip_set_dump_filter *filter)
 {
 	struct nlmsghdr *nlh = nlmsg_hdr(cb->skb);
 	int min_len = nlmsg_total_size(sizeof(struct nfgenmsg));
-	struct nlattr *cda[IPSET_ATTR_CMD_MAX + 1];
 	struct nlattr *attr = (void *)nlh + min_len;
-	u32 dump_type;
-	ip_set_id_t index;
 	int ret;
 
 	ret = NLA_PARSE(cda, IPSET_ATTR_CMD_MAX, attr,
 			nlh->nlmsg_len - min_len,
-			ip_set_setname_policy, NULL);
+			ip_set_dump_policy, NULL);
 	if (ret)
 		return ret;
 
-	cb->args[IPSET_CB_PROTO] = nla_get_u8(cda[IPSET_ATTR_PROTOCOL]);
+	filter->from = 0;
+	filter->to = IPSET_INVALID_ID - 1;
+	filter->prefix = NULL;
+	filter->prefix_len = 0;
+	if (cda[IPSET_ATTR_INDEX])
+		filter->from = ntohs(nla_get_be16(cda[IPSET_ATTR_INDEX]));
+	if (cda[IPSET_ATTR_INDEX_TO])
+		filter->to = ntohs(nla_get_be16(cda[IPSET_ATTR_INDEX_TO]));
+	if (cda[IPSET_ATTR_SETNAME_PREFIX]) {
+		filter->prefix = nla_data(cda[IPSET_ATTR_SETNAME_PREFIX]);
+		filter->prefix_len = strlen(filter->prefix);
+	}
+	return 0;
+}
+
+static const struct nla_policy
+ip_set_elem_filter_policy[IPSET_ATTR_ADT_MAX + 1] = {
+	[IPSET_ATTR_IP]		= { .type = NLA_NESTED },
+	[IPSET_ATTR_CIDR]	= { .type = NLA_U8 },
+	[IPSET_ATTR_PORT]	= { .type = NLA_U16 },
+	[IPSET_ATTR_PORT_TO]	= { .type = NLA_U16 },
+	[IPSET_ATTR_COMMENT]	= { .type = NLA_NUL_STRING,
+				    .len  = IPSET_MAX_COMMENT_SIZE },
+};
+
+/* The element filter is the nested IPSET_ATTR_DATA of a dump request:
+ * the address/cidr, port range and comment substring the dumped elements
+ * must match, so that the filtered out elements are not sent at all.
+ */
+static int
+elem_filter_parse(struct nlattr *attr, struct ip_set_elem_filter *filter)
+{
+	struct nlattr *tb[IPSET_ATTR_ADT_MAX + 1];
+	u8 maxcidr = 0;
+
+	if (unlikely(!flag_nested(attr) ||
+		     NLA_PARSE_NESTED(tb, IPSET_ATTR_ADT_MAX, attr,
+				      ip_set_elem_filter_policy, NULL)))
+		return -IPSET_ERR_PROTOCOL;
+	if (unlikely(!ip_set_optattr_netorder(tb, IPSET_ATTR_PORT) ||
+		     !ip_set_optattr_netorder(tb, IPSET_ATTR_PORT_TO)))
+		return -IPSET_ERR_PROTOCOL;
+	if (unlikely(!tb[IPSET_ATTR_IP] && !tb[IPSET_ATTR_PORT] &&
+		     !tb[IPSET_ATTR_COMMENT]))
+		return -IPSET_ERR_PROTOCOL;
+
+	memset(filter, 0, sizeof(*filter));
+	if (tb[IPSET_ATTR_IP]) {
+		if (!ip_set_get_ipaddr4(tb[IPSET_ATTR_IP], &filter->ip.ip)) {
+			filter->family = NFPROTO_IPV4;
+			maxcidr = 32;
+		} else if (!ip_set_get_ipaddr6(tb[IPSET_ATTR_IP],
+					       &filter->ip)) {
+			filter->family = NFPROTO_IPV6;
+			maxcidr = 128;
+		} else {
+			return -IPSET_ERR_PROTOCOL;
+		}
+		filter->cidr = maxcidr;
+		if (tb[IPSET_ATTR_CIDR]) {
+			filter->cidr = nla_get_u8(tb[IPSET_ATTR_CIDR]);
+			if (filter->cidr > maxcidr)
+				return -IPSET_ERR_INVALID_CIDR;
+		}
+	} else if (tb[IPSET_ATTR_CIDR]) {
+		return -IPSET_ERR_PROTOCOL;
+	}
+	if (tb[IPSET_ATTR_PORT]) {
+		filter->with_port = true;
+		filter->port = ntohs(nla_get_be16(tb[IPSET_ATTR_PORT]));
+		filter->port_to = filter->port;
+		if (tb[IPSET_ATTR_PORT_TO]) {
+			filter->port_to =
+				ntohs(nla_get_be16(tb[IPSET_ATTR_PORT_TO]));
+			if (filter->port > filter->port_to)
+				swap(filter->port, filter->port_to);
+		}
+	} else if (tb[IPSET_ATTR_PORT_TO]) {
+		return -IPSET_ERR_PROTOCOL;
+	}
+	if (tb[IPSET_ATTR_COMMENT])
+		filter->comment = nla_data(tb[IPSET_ATTR_COMMENT]);
+
+	return 0;
+}
+
+static int
+dump_init(struct netlink_callback *cb, struct ip_set_net *inst,
+	  struct ip_set_dump_filter *filter)
+{
+	struct nlattr *cda[IPSET_ATTR_CMD_MAX + 1];
+	struct ip_set_elem_filter *efilter = NULL;
+	u32 dump_type, f = 0;
+	ip_set_id_t index;
+	int ret;
+
+	ret = dump_parse(cb, cda, filter);
+	if (ret)
+		return ret;
+	/* The element filter is parsed once and freed when the dump
+	 * is done, so the set types check the elements without parsing
+	 * the request at every call.
+	 */
+	if (cda[IPSET_ATTR_DATA]) {
+		efilter = kmalloc(sizeof(*efilter), GFP_KERNEL);
+		if (!efilter)
+			return -ENOMEM;
+		ret = elem_filter_parse(cda[IPSET_ATTR_DATA], efilter);
+		if (ret)
+			goto free_filter;
+	}
+
+	if (cda[IPSET_ATTR_FLAGS])
+		f = ip_set_get_h32(cda[IPSET_ATTR_FLAGS]);
+
 	if (cda[IPSET_ATTR_SETNAME]) {
 		struct ip_set *set;
 
 		set = find_set_and_id(inst, nla_data(cda[IPSET_ATTR_SETNAME]),
 				      &index);
-		if (!set)
-			return -ENOENT;
+		if (!set) {
+			ret = -ENOENT;
+			goto free_filter;
+		}
 
 		dump_type = DUMP_ONE;
 		cb->args[IPSET_CB_INDEX] = index;
 	} else {
-		dump_type = DUMP_ALL;
+		if (filter->from > filter->to) {
+			ret = -ERANGE;
+			goto free_filter;
+		}
+		dump_type = f & IPSET_FLAG_LIST_ONLY_LAST ? DUMP_LAST
+							  : DUMP_ALL;
+		cb->args[IPSET_CB_INDEX] = filter->from;
 	}
 
-	if (cda[IPSET_ATTR_FLAGS]) {
-		u32 f = ip_set_get_h32(cda[IPSET_ATTR_FLAGS]);
-
-		dump_type |= (f << 16);
-	}
+	dump_type |= (nla_get_u8(cda[IPSET_ATTR_PROTOCOL]) << 8) | (f << 16);
 	cb->args[IPSET_CB_NET] = (unsigned long)inst;
 	cb->args[IPSET_CB_DUMP] = dump_type;
+	cb->args[IPSET_CB_FILTER] = (unsigned long)efilter;
 
 	return 0;
+
+free_filter:
+	kfree(efilter);
+	return ret;
 }
 
 static int
@@ -1345,12 +1705,15 @@ ip_set_dump_start(struct sk_buff *skb, struct netlink_callback *cb)
 	struct nlmsghdr *nlh = NULL;
 	unsigned int flags = NETLINK_PORTID(cb->skb) ? NLM_F_MULTI : 0;
 	struct ip_set_net *inst = ip_set_pernet(sock_net(skb->sk));
+	struct ip_set_dump_filter filter;
+	struct nlattr *cda[IPSET_ATTR_CMD_MAX + 1];
 	u32 dump_type, dump_flags;
 	bool is_destroyed;
 	int ret = 0;
+	u8 proto;
 
 	if (!cb->args[IPSET_CB_DUMP]) {
-		ret = dump_init(cb, inst);
+		ret = dump_init(cb, inst, &filter);
 		if (ret < 0) {
 			nlh = nlmsg_hdr(cb->skb);
 			/* We have to create and send the error message
@@ -1360,25 +1723,31 @@ ip_set_dump_start(struct sk_buff *skb, struct netlink_callback *cb)
 				NETLINK_ACK(cb->skb, nlh, ret, NULL);
 			return ret;
 		}
+	} else if (dump_parse(cb, cda, &filter)) {
+		/* Cannot happen: it was parsed successfully at start */
+		return -EINVAL;
 	}
 
 	if (cb->args[IPSET_CB_INDEX] >= inst->ip_set_max)
 		goto out;
 
 	dump_type = DUMP_TYPE(cb->args[IPSET_CB_DUMP]);
+	proto = DUMP_PROTO(cb->args[IPSET_CB_DUMP]);
 	dump_flags = DUMP_FLAGS(cb->args[IPSET_CB_DUMP]);
 	max = dump_type == DUMP_ONE ? cb->args[IPSET_CB_INDEX] + 1
-				    : inst->ip_set_max;
+				    : min_t(u32, inst->ip_set_max,
+					    (u32)filter.to + 1);
 dump_last:
 	pr_debug("dump type, flag: %u %u index: %ld\n",
 		 dump_type, dump_flags, cb->args[IPSET_CB_INDEX]);
 	for (; cb->args[IPSET_CB_INDEX] < max; cb->args[IPSET_CB_INDEX]++) {
 		index = (ip_set_id_t)cb->args[IPSET_CB_INDEX];
-		write_lock_bh(&ip_set_ref_lock);
+		/* Dumpers exclude destroy and swap only, not each other */
+		read_lock_bh(&ip_set_ref_lock);
 		set = ip_set(inst, index);
 		is_destroyed = inst->is_destroyed;
 		if (!set || is_destroyed) {
-			write_unlock_bh(&ip_set_ref_lock);
+			read_unlock_bh(&ip_set_ref_lock);
 			if (dump_type == DUMP_ONE) {
 				ret = -ENOENT;
 				goto out;
@@ -1396,16 +1765,21 @@ dump_last:
 		if (dump_type != DUMP_ONE &&
 		    ((dump_type == DUMP_ALL) ==
 		     !!(set->type->features & IPSET_DUMP_LAST))) {
-			write_unlock_bh(&ip_set_ref_lock);
+			read_unlock_bh(&ip_set_ref_lock);
+			continue;
+		}
+		if (dump_type != DUMP_ONE && filter.prefix &&
+		    strncmp(set->name, filter.prefix, filter.prefix_len)) {
+			read_unlock_bh(&ip_set_ref_lock);
 			continue;
 		}
 		pr_debug("List set: %s\n", set->name);
 		if (!cb->args[IPSET_CB_ARG0]) {
 			/* Start listing: make sure set won't be destroyed */
 			pr_debug("reference set\n");
-			set->ref_netlink++;
+			__ip_set_get_netlink(set);
 		}
-		write_unlock_bh(&ip_set_ref_lock);
+		read_unlock_bh(&ip_set_ref_lock);
 		nlh = start_msg(skb, NETLINK_PORTID(cb->skb),
 				cb->nlh->nlmsg_seq, flags,
 				IPSET_CMD_LIST);
@@ -1413,8 +1787,7 @@ dump_last:
 			ret = -EMSGSIZE;
 			goto release_refcount;
 		}
-		if (nla_put_u8(skb, IPSET_ATTR_PROTOCOL,
-			       cb->args[IPSET_CB_PROTO]) ||
+		if (nla_put_u8(skb, IPSET_ATTR_PROTOCOL, proto) ||
 		    nla_put_string(skb, IPSET_ATTR_SETNAME, set->name))
 			goto nla_put_failure;
 		if (dump_flags & IPSET_FLAG_LIST_SETNAME)
@@ -1429,7 +1802,7 @@ dump_last:
 			    nla_put_u8(skb, IPSET_ATTR_REVISION,
 				       set->revision))
 				goto nla_put_failure;
-			if (cb->args[IPSET_CB_PROTO] > IPSET_PROTOCOL_MIN &&
+			if (proto > IPSET_PROTOCOL_MIN &&
 			    nla_put_net16(skb, IPSET_ATTR_INDEX, htons(index)))
 				goto nla_put_failure;
 			ret = set->variant->head(set, skb);
@@ -1449,10 +1822,12 @@ dump_last:
 		}
 	}
 	/* If we dump all sets, continue with dumping last ones */
-	if (dump_type == DUMP_ALL) {
+	if (dump_type == DUMP_ALL &&
+	    !(dump_flags & IPSET_FLAG_LIST_SKIP_LAST)) {
 		dump_type = DUMP_LAST;
-		cb->args[IPSET_CB_DUMP] = dump_type | (dump_flags << 16);
-		cb->args[IPSET_CB_INDEX] = 0;
+		cb->args[IPSET_CB_DUMP] = dump_type | (proto << 8) |
+					  (dump_flags << 16);
+		cb->args[IPSET_CB_INDEX] = filter.from;
 		if (set && set->variant->uref)
 			set->variant->uref(set, cb, false);
 		goto dump_last;
@@ -1523,6 +1898,7 @@ static const struct nla_policy ip_set_adt_policy[IPSET_ATTR_CMD_MAX + 1] = {
 	[IPSET_ATTR_LINENO]	= { .type = NLA_U32 },
 	[IPSET_ATTR_DATA]	= { .type = NLA_NESTED },
 	[IPSET_ATTR_ADT]	= { .type = NLA_NESTED },
+	[IPSET_ATTR_FLAGS]	= { .type = NLA_U32 },
 };
 
 static int
@@ -1597,7 +1973,7 @@ IPSET_CBFN_AD(ip_set_ad, struct net *net, struct sock *ctnl,
 	      struct netlink_ext_ack *extack)
 {
 	struct ip_set_net *inst = ip_set_pernet(IPSET_SOCK_NET(net, ctnl));
-	struct ip_set *set;
+	struct ip_set *set, *replaced = NULL;
 	struct nlattr *tb[IPSET_ATTR_ADT_MAX + 1] = {};
 	const struct nlattr *nla;
 	u32 flags = flag_exist(nlh);
@@ -1618,15 +1994,26 @@ IPSET_CBFN_AD(ip_set_ad, struct net *net, struct sock *ctnl,
 	set = find_set(inst, nla_data(attr[IPSET_ATTR_SETNAME]));
 	if (!set)
 		return -ENOENT;
+	if (attr[IPSET_ATTR_FLAGS] &&
+	    ip_set_get_h32(attr[IPSET_ATTR_FLAGS]) & IPSET_FLAG_SHADOW) {
+		/* Fill up the new content of the set being replaced */
+		if (adt != IPSET_ADD)
+			return -IPSET_ERR_PROTOCOL;
+		if (!set->shadow)
+			return -IPSET_ERR_NO_REPLACE;
+		replaced = set;
+		set = set->shadow;
+	}
 
 	use_lineno = !!attr[IPSET_ATTR_LINENO];
 	if (attr[IPSET_ATTR_DATA]) {
 		if (NLA_PARSE_NESTED(tb, IPSET_ATTR_ADT_MAX,
 				     attr[IPSET_ATTR_DATA],
 				     set->type->adt_policy, NULL))
-			return -IPSET_ERR_PROTOCOL;
-		ret = call_ad(ctnl, skb, set, tb, adt, flags,
-			      use_lineno);
+			ret = -IPSET_ERR_PROTOCOL;
+		else
+			ret = call_ad(ctnl, skb, set, tb, adt, flags,
+				      use_lineno);
 	} else {
 		int nla_rem;
 
@@ -1634,14 +2021,19 @@ IPSET_CBFN_AD(ip_set_ad, struct net *net, struct sock *ctnl,
 			if (nla_type(nla) != IPSET_ATTR_DATA ||
 			    !flag_nested(nla) ||
 			    NLA_PARSE_NESTED(tb, IPSET_ATTR_ADT_MAX, nla,
-					     set->type->adt_policy, NULL))
-				return -IPSET_ERR_PROTOCOL;
+					     set->type->adt_policy, NULL)) {
+				ret = -IPSET_ERR_PROTOCOL;
+				break;
+			}
 			ret = call_ad(ctnl, skb, set, tb, adt,
 				      flags, use_lineno);
 			if (ret < 0)
-				return ret;
+				break;
 		}
 	}
+	/* The failed replace is not published: drop the new content */
+	if (ret < 0 && replaced)
+		ip_set_shadow_destroy(replaced);
 	return ret;
 }
 
@@ -1701,6 +2093,104 @@ IPSET_CBFN(ip_set_utest, struct net *net, struct sock *ctnl,
 	return ret > 0 ? 0 : -IPSET_ERR_EXIST;
 }
 
+/* Test multiple elements in one round trip: the results are sent back
+ * as a bitmap, bit n is set when the nth element is in the set.
+ */
+
+static int
+IPSET_CBFN(ip_set_utest_batch, struct net *net, struct sock *ctnl,
+	   struct sk_buff *skb,
+	   const struct nlmsghdr *nlh,
+	   const struct nlattr * const attr[],
+	   struct netlink_ext_ack *extack)
+{
+	struct ip_set_net *inst = ip_set_pernet(IPSET_SOCK_NET(net, ctnl));
+	struct ip_set *set;
+	struct nlattr *tb[IPSET_ATTR_ADT_MAX + 1] = {};
+	const struct nlattr *nla;
+	struct nlattr *results;
+	struct sk_buff *skb2;
+	struct nlmsghdr *nlh2;
+	u32 count = 0, n = 0, lineno = 0;
+	int nla_rem, ret = 0;
+	u8 *bits;
+
+	if (unlikely(protocol_min_failed(attr) ||
+		     !attr[IPSET_ATTR_SETNAME] ||
+		     !attr[IPSET_ATTR_ADT] ||
+		     !flag_nested(attr[IPSET_ATTR_ADT])))
+		return -IPSET_ERR_PROTOCOL;
+
+	set = find_set(inst, nla_data(attr[IPSET_ATTR_SETNAME]));
+	if (!set)
+		return -ENOENT;
+
+	nla_for_each_nested(nla, attr[IPSET_ATTR_ADT], nla_rem) {
+		if (nla_type(nla) != IPSET_ATTR_DATA || !flag_nested(nla))
+			return -IPSET_ERR_PROTOCOL;
+		count++;
+	}
+	if (!count)
+		return -IPSET_ERR_PROTOCOL;
+
+	skb2 = nlmsg_new(NLMSG_DEFAULT_SIZE +
+			 nla_total_size(DIV_ROUND_UP(count, 8)), GFP_KERNEL);
+	if (!skb2)
+		return -ENOMEM;
+
+	nlh2 = start_msg(skb2, NETLINK_PORTID(skb), nlh->nlmsg_seq, 0,
+			 IPSET_CMD_TEST_BATCH);
+	if (!nlh2)
+		goto nlmsg_failure;
+	if (nla_put_u8(skb2, IPSET_ATTR_PROTOCOL, protocol(attr)) ||
+	    nla_put_string(skb2, IPSET_ATTR_SETNAME, set->name))
+		goto nla_put_failure;
+	results = nla_reserve(skb2, IPSET_ATTR_RESULTS,
+			      DIV_ROUND_UP(count, 8));
+	if (!results)
+		goto nla_put_failure;
+	bits = nla_data(results);
+	memset(bits, 0, nla_len(results));
+
+	rcu_read_lock_bh();
+	nla_for_each_nested(nla, attr[IPSET_ATTR_ADT], nla_rem) {
+		if (NLA_PARSE_NESTED(tb, IPSET_ATTR_ADT_MAX, nla,
+				     set->type->adt_policy, NULL)) {
+			ret = -IPSET_ERR_PROTOCOL;
+			break;
+		}
+		ret = set->variant->uadt(set, tb, IPSET_TEST, &lineno, 0, 0);
+		/* Malformed element: the whole batch is rejected */
+		if (ret == -IPSET_ERR_PROTOCOL)
+			break;
+		/* Other errors, like out of range elements, mean no match.
+		 * Userspace can't trigger element to be re-added.
+		 */
+		if (ret > 0 || ret == -EAGAIN)
+			bits[n / 8] |= 1 << (n % 8);
+		ret = 0;
+		n++;
+	}
+	rcu_read_unlock_bh();
+	if (ret < 0) {
+		nlmsg_free(skb2);
+		return ret;
+	}
+	nlmsg_end(skb2, nlh2);
+
+	ret = netlink_unicast(ctnl, skb2, NETLINK_PORTID(skb), MSG_DONTWAIT);
+	if (ret < 0)
+		return ret;
+
+	return 0;
+
+nla_put_failure:
+	nlmsg_cancel(skb2, nlh2);
+nlmsg_failure:
+	kfree_skb(skb2);
+	return -EMSGSIZE;
+}
+
 /* Get headed data of a set */
 
 static int
@@ -1999,12 +2489,12 @@ static const struct nfnl_callback ip_set_netlink_subsys_cb[IPSET_MSG_MAX] = {
 	[IPSET_CMD_LIST]	= {
 		.call		= ip_set_dump,
 		.attr_count	= IPSET_ATTR_CMD_MAX,
-		.policy		= ip_set_setname_policy,
+		.policy		= ip_set_dump_policy,
 	},
 	[IPSET_CMD_SAVE]	= {
 		.call		= ip_set_dump,
 		.attr_count	= IPSET_ATTR_CMD_MAX,
-		.policy		= ip_set_setname_policy,
+		.policy		= ip_set_dump_policy,
 	},
 	[IPSET_CMD_ADD]	= {
 		.call		= ip_set_uadd,
@@ -2046,6 +2536,31 @@ static const struct nfnl_callback ip_set_netlink_subsys_cb[IPSET_MSG_MAX] = {
 		.attr_count	= IPSET_ATTR_CMD_MAX,
 		.policy		= ip_set_index_policy,
 	},
+	[IPSET_CMD_UNION]	= {
+		.call		= ip_set_union,
+		.attr_count	= IPSET_ATTR_CMD_MAX,
+		.policy		= ip_set_setop_policy,
+	},
+	[IPSET_CMD_INTERSECT]	= {
+		.call		= ip_set_intersect,
+		.attr_count	= IPSET_ATTR_CMD_MAX,
+		.policy		= ip_set_setop_policy,
+	},
+	[IPSET_CMD_DIFF]	= {
+		.call		= ip_set_diff,
+		.attr_count	= IPSET_ATTR_CMD_MAX,
+		.policy		= ip_set_setop_policy,
+	},
+	[IPSET_CMD_REPLACE]	= {
+		.call		= ip_set_replace,
+		.attr_count	= IPSET_ATTR_CMD_MAX,
+		.policy		= ip_set_replace_policy,
+	},
+	[IPSET_CMD_TEST_BATCH]	= {
+		.call		= ip_set_utest_batch,
+		.attr_count	= IPSET_ATTR_CMD_MAX,
+		.policy		= ip_set_adt_policy,
+	},
 };
 
 static struct nfnetlink_subsystem ip_set_netlink_subsys __read_mostly = {
@@ -2213,6 +2728,16 @@ ip_set_net_init(struct net *net)
 #else
 		goto err_alloc;
 #endif
+	inst->ip_set_names = kvcalloc(IP_SET_NAME_HSIZE,
+				      sizeof(struct hlist_head), GFP_KERNEL);
+	if (!inst->ip_set_names) {
+		kvfree(list);
+#ifdef HAVE_NET_OPS_ID
+		return -ENOMEM;
+#else
+		goto err_alloc;
+#endif
+	}
 	inst->is_deleted = false;
 	inst->is_destroyed = false;
 	rcu_assign_pointer(inst->ip_set_list, list);
@@ -2236,6 +2761,7 @@ ip_set_net_exit(struct net *net)
 	inst->is_deleted = true; /* flag for ip_set_nfnl_put */
 
 	nfnl_lock(NFNL_SUBSYS_IPSET);
+	ip_set_name_flush(inst);
 	for (i = 0; i < inst->ip_set_max; i++) {
 		set = ip_set(inst, i);
 		if (set) {
@@ -2244,6 +2770,7 @@ ip_set_net_exit(struct net *net)
 		}
 	}
 	nfnl_unlock(NFNL_SUBSYS_IPSET);
+	kvfree(inst->ip_set_names);
 	kvfree(rcu_dereference_protected(inst->ip_set_list, 1));
 #ifndef HAVE_NET_OPS_ID
 	kvfree(inst);
@@ -2300,12 +2827,22 @@ ip_set_init(void)
 		return ret;
 	}
 
+	ret = netlink_register_notifier(&ip_set_netlink_notifier);
+	if (ret != 0) {
+		pr_err("ip_set: cannot register netlink notifier.\n");
+		nf_unregister_sockopt(&so_set);
+		nfnetlink_subsys_unregister(&ip_set_netlink_subsys);
+		UNREGISTER_PERNET_SUBSYS(&ip_set_net_ops);
+		return ret;
+	}
+
 	return 0;
 }
 
 static void __exit
 ip_set_fini(void)
 {
+	netlink_unregister_notifier(&ip_set_netlink_notifier);
 	nf_unregister_sockopt(&so_set);
 	nfnetlink_subsys_unregister(&ip_set_netlink_subsys);
 
@@ -17,14 +17,16 @@
 #include <net/ip.h>
 #include <net/ipv6.h>
 
+#include <linux/netfilter/ipset/ip_set.h>
 #include <linux/netfilter/ipset/ip_set_getport.h>
 #include <linux/netfilter/ipset/ip_set_compat.h>
 
 /* We must handle non-linear skbs */
-static bool
+static void
 get_port(const struct sk_buff *skb, int protocol, unsigned int protooff,
-	 bool src, __be16 *port, u8 *proto)
+	 struct ip_set_l4 *l4)
 {
+	l4->state = IPSET_L4_NONE;
 	switch (protocol) {
 	case IPPROTO_TCP: {
 		struct tcphdr _tcph;
@@ -33,9 +35,10 @@ get_port(const struct sk_buff *skb, int protocol, unsigned int protooff,
 		th = skb_header_pointer(skb, protooff, sizeof(_tcph), &_tcph);
 		if (!th)
 			/* No choice either */
-			return false;
+			return;
 
-		*port = src ? th->source : th->dest;
+		l4->port[0] = th->source;
+		l4->port[1] = th->dest;
 		break;
 	}
 	case IPPROTO_SCTP: {
@@ -50,9 +53,10 @@ get_port(const struct sk_buff *skb, int protocol, unsigned int protooff,
 		sh = skb_header_pointer(skb, protooff, sizeof(_sh), &_sh);
 		if (!sh)
 			/* No choice either */
-			return false;
+			return;
 
-		*port = src ? sh->source : sh->dest;
+		l4->port[0] = sh->source;
+		l4->port[1] = sh->dest;
 		break;
 	}
 	case IPPROTO_UDP:
@@ -63,9 +67,10 @@ get_port(const struct sk_buff *skb, int protocol, unsigned int protooff,
 		uh = skb_header_pointer(skb, protooff, sizeof(_udph), &_udph);
 		if (!uh)
 			/* No choice either */
-			return false;
+			return;
 
-		*port = src ? uh->source : uh->dest;
+		l4->port[0] = uh->source;
+		l4->port[1] = uh->dest;
 		break;
 	}
 	case IPPROTO_ICMP: {
@@ -74,9 +79,10 @@ get_port(const struct sk_buff *skb, int protocol, unsigned int protooff,
 
 		ic = skb_header_pointer(skb, protooff, sizeof(_ich), &_ich);
 		if (!ic)
-			return false;
+			return;
 
-		*port = (__force __be16)htons((ic->type << 8) | ic->code);
+		l4->port[0] = (__force __be16)htons((ic->type << 8) | ic->code);
+		l4->port[1] = l4->port[0];
 		break;
 	}
 	case IPPROTO_ICMPV6: {
@@ -85,31 +91,50 @@ get_port(const struct sk_buff *skb, int protocol, unsigned int protooff,
 
 		ic = skb_header_pointer(skb, protooff, sizeof(_ich), &_ich);
 		if (!ic)
-			return false;
+			return;
 
-		*port = (__force __be16)
+		l4->port[0] = (__force __be16)
 			htons((ic->icmp6_type << 8) | ic->icmp6_code);
+		l4->port[1] = l4->port[0];
 		break;
 	}
 	default:
-		break;
+		l4->proto = protocol;
+		l4->state = IPSET_L4_PROTO;
+		return;
 	}
-	*proto = protocol;
+	l4->proto = protocol;
+	l4->state = IPSET_L4_PORTS;
+}
 
-	return true;
+/* Return the already extracted data of the packet */
+static bool
+l4_port(const struct ip_set_l4 *l4, bool src, __be16 *port, u8 *proto)
+{
+	switch (l4->state) {
+	case IPSET_L4_PORTS:
+		*port = l4->port[src ? 0 : 1];
+		/* fall through */
+	case IPSET_L4_PROTO:
+		*proto = l4->proto;
+		return true;
+	default:
+		return false;
+	}
 }
 
-bool
-ip_set_get_ip4_port(const struct sk_buff *skb, bool src,
-		    __be16 *port, u8 *proto)
+static void
+get_ip4_l4(const struct sk_buff *skb, struct ip_set_l4 *l4)
 {
 	const struct iphdr *iph = ip_hdr(skb);
 	unsigned int protooff = skb_network_offset(skb) + ip_hdrlen(skb);
 	int protocol = iph->protocol;
 
 	/* See comments at tcp_match in ip_tables.c */
-	if (protocol <= 0)
-		return false;
+	if (protocol <= 0) {
+		l4->state = IPSET_L4_NONE;
+		return;
+	}
 
 	if (ntohs(iph->frag_off) & IP_OFFSET)
 		switch (protocol) {
@@ -119,23 +144,37 @@ ip_set_get_ip4_port(const struct sk_buff *skb, bool src,
 		case IPPROTO_UDPLITE:
 		case IPPROTO_ICMP:
 			/* Port info not available for fragment offset > 0 */
-			return false;
+			l4->state = IPSET_L4_NONE;
+			return;
 		default:
 			/* Other protocols doesn't have ports,
 			 * so we can match fragments.
 			 */
-			*proto = protocol;
-			return true;
+			l4->proto = protocol;
+			l4->state = IPSET_L4_PROTO;
+			return;
 		}
 
-	return get_port(skb, protocol, protooff, src, port, proto);
+	get_port(skb, protocol, protooff, l4);
+}
+
+/* The packet is parsed at the first call only, the later calls with the
+ * same l4 return the stored protocol and ports.
+ */
+bool
+ip_set_get_ip4_port(const struct sk_buff *skb, struct ip_set_l4 *l4,
+		    bool src, __be16 *port, u8 *proto)
+{
+	if (l4->state == IPSET_L4_UNKNOWN)
+		get_ip4_l4(skb, l4);
+
+	return l4_port(l4, src, port, proto);
 }
 EXPORT_SYMBOL_GPL(ip_set_get_ip4_port);
 
 #if IS_ENABLED(CONFIG_IP6_NF_IPTABLES)
-bool
-ip_set_get_ip6_port(const struct sk_buff *skb, bool src,
-		    __be16 *port, u8 *proto)
+static void
+get_ip6_l4(const struct sk_buff *skb, struct ip_set_l4 *l4)
 {
 	int protoff;
 	u8 nexthdr;
@@ -146,26 +185,40 @@ ip_set_get_ip6_port(const struct sk_buff *skb, bool src,
 				   skb_network_offset(skb) +
 					sizeof(struct ipv6hdr), &nexthdr,
 				   &frag_off);
-	if (protoff < 0 || (frag_off & htons(~0x7)) != 0)
-		return false;
+	if (protoff < 0 || (frag_off & htons(~0x7)) != 0) {
+		l4->state = IPSET_L4_NONE;
+		return;
+	}
+
+	get_port(skb, nexthdr, protoff, l4);
+}
+
+/* The extension headers are walked at the first call only */
+bool
+ip_set_get_ip6_port(const struct sk_buff *skb, struct ip_set_l4 *l4,
+		    bool src, __be16 *port, u8 *proto)
+{
+	if (l4->state == IPSET_L4_UNKNOWN)
+		get_ip6_l4(skb, l4);
 
-	return get_port(skb, nexthdr, protoff, src, port, proto);
+	return l4_port(l4, src, port, proto);
 }
 EXPORT_SYMBOL_GPL(ip_set_get_ip6_port);
 #endif
 
 bool
-ip_set_get_ip_port(const struct sk_buff *skb, u8 pf, bool src, __be16 *port)
+ip_set_get_ip_port(const struct sk_buff *skb, u8 pf, struct ip_set_l4 *l4,
+		   bool src, __be16 *port)
 {
 	bool ret;
 	u8 proto;
 
 	switch (pf) {
 	case NFPROTO_IPV4:
-		ret = ip_set_get_ip4_port(skb, src, port, &proto);
+		ret = ip_set_get_ip4_port(skb, l4, src, port, &proto);
 		break;
 	case NFPROTO_IPV6:
-		ret = ip_set_get_ip6_port(skb, src, port, &proto);
+		ret = ip_set_get_ip6_port(skb, l4, src, port, &proto);
 		break;
 	default:
 		return false;
@@ -10,6 +10,7 @@
 
 #include <linux/rcupdate.h>
 #include <linux/jhash.h>
+#include <linux/prefetch.h>
 #include <linux/types.h>
 #include <linux/netfilter/ipset/ip_set_timeout.h>
 
@@ -19,6 +20,16 @@
 
 #define rcu_dereference_bh_nfnl(p)	rcu_dereference_bh_check(p, 1)
 
+/* The elements must be destroyed one by one when they have extensions
+ * to release or, with IP_SET_HASH_WITH_DATA_REF, hold references taken
+ * by mtype_data_get() when they were added.
+ */
+#ifdef IP_SET_HASH_WITH_DATA_REF
+#define SET_ELEM_DESTROY(set)		true
+#else
+#define SET_ELEM_DESTROY(set)		((set)->extensions & IPSET_EXT_DESTROY)
+#endif
+
 /* Hashing which uses arrays to resolve clashing. The hash table is resized
  * (doubled) when searching becomes too long.
  * Internally jhash is used with the assumption that the size of the
@@ -39,6 +50,10 @@
 /* Max muber of elements in the array block when tuned */
 #define AHASH_MAX_TUNED			64
 
+/* Number of entries in the per-CPU verdict cache of a set */
+#define AHASH_CACHE_BITS		6
+#define AHASH_CACHE_SIZE		(1 << AHASH_CACHE_BITS)
+
 /* Max number of elements can be tuned */
 #ifdef IP_SET_HASH_WITH_MULTI
 #define AHASH_MAX(h)			((h)->ahash_max)
@@ -190,29 +205,44 @@ htable_bits(u32 hashsize)
 #undef mtype_data_reset_flags
 #undef mtype_data_netmask
 #undef mtype_data_list
+#undef mtype_data_filter
 #undef mtype_data_next
+#undef mtype_data_get
+#undef mtype_data_put
+#undef mtype_data_ref
 #undef mtype_elem
+#undef mtype_cache_entry
+#undef mtype_cache
+#undef mtype_cache_bump
 
 #undef mtype_ahash_destroy
+#undef mtype_ahash_destroy_replaced
 #undef mtype_ext_cleanup
 #undef mtype_add_cidr
 #undef mtype_del_cidr
 #undef mtype_ahash_memsize
+#undef mtype_ahash_elements
 #undef mtype_flush
 #undef mtype_destroy
 #undef mtype_same_set
+#undef mtype_same_layout
 #undef mtype_kadt
 #undef mtype_uadt
 
 #undef mtype_add
 #undef mtype_del
+#undef mtype_prefetch
 #undef mtype_test_cidrs
 #undef mtype_test
 #undef mtype_uref
 #undef mtype_expire
 #undef mtype_resize
+#undef mtype_shadow_create
+#undef mtype_shadow_publish
+#undef mtype_shadow_destroy
 #undef mtype_head
 #undef mtype_list
+#undef mtype_walk
 #undef mtype_gc
 #undef mtype_gc_init
 #undef mtype_variant
@@ -231,30 +261,58 @@ htable_bits(u32 hashsize)
 #define mtype_data_reset_elem	IPSET_TOKEN(MTYPE, _data_reset_elem)
 #define mtype_data_reset_flags	IPSET_TOKEN(MTYPE, _data_reset_flags)
 #define mtype_data_netmask	IPSET_TOKEN(MTYPE, _data_netmask)
-#define mtype_data_list		IPSET_TOKEN(MTYPE, _data_list)
+#define mtype_data_filter	IPSET_TOKEN(MTYPE, _data_filter)
 #define mtype_data_next		IPSET_TOKEN(MTYPE, _data_next)
+/* The data the elements refer to hangs off the set, the type functions
+ * get it from the set.
+ */
+#ifdef IP_SET_HASH_WITH_DATA_REF
+#define mtype_data_ref(set)	(((struct htype *)(set)->data)->data_ref)
+#define mtype_data_list(skb, set, d)	\
+	IPSET_TOKEN(MTYPE, _data_list)(skb, mtype_data_ref(set), d)
+#define mtype_data_get(set, d)	\
+	IPSET_TOKEN(MTYPE, _data_get)(mtype_data_ref(set), d)
+#define mtype_data_put(set, d)	\
+	IPSET_TOKEN(MTYPE, _data_put)(mtype_data_ref(set), d)
+#else
+#define mtype_data_list(skb, set, d)	IPSET_TOKEN(MTYPE, _data_list)(skb, d)
+#define mtype_data_get(set, d)
+#define mtype_data_put(set, d)
+#endif
 #define mtype_elem		IPSET_TOKEN(MTYPE, _elem)
+#define mtype_cache_entry	IPSET_TOKEN(MTYPE, _cache_entry)
+#define mtype_cache		IPSET_TOKEN(MTYPE, _cache)
+#define mtype_cache_bump	IPSET_TOKEN(MTYPE, _cache_bump)
 
 #define mtype_ahash_destroy	IPSET_TOKEN(MTYPE, _ahash_destroy)
+#define mtype_ahash_destroy_replaced	\
+	IPSET_TOKEN(MTYPE, _ahash_destroy_replaced)
 #define mtype_ext_cleanup	IPSET_TOKEN(MTYPE, _ext_cleanup)
 #define mtype_add_cidr		IPSET_TOKEN(MTYPE, _add_cidr)
 #define mtype_del_cidr		IPSET_TOKEN(MTYPE, _del_cidr)
 #define mtype_ahash_memsize	IPSET_TOKEN(MTYPE, _ahash_memsize)
+#define mtype_ahash_elements	IPSET_TOKEN(MTYPE, _ahash_elements)
 #define mtype_flush		IPSET_TOKEN(MTYPE, _flush)
 #define mtype_destroy		IPSET_TOKEN(MTYPE, _destroy)
 #define mtype_same_set		IPSET_TOKEN(MTYPE, _same_set)
+#define mtype_same_layout	IPSET_TOKEN(MTYPE, _same_layout)
 #define mtype_kadt		IPSET_TOKEN(MTYPE, _kadt)
 #define mtype_uadt		IPSET_TOKEN(MTYPE, _uadt)
 
 #define mtype_add		IPSET_TOKEN(MTYPE, _add)
 #define mtype_del		IPSET_TOKEN(MTYPE, _del)
+#define mtype_prefetch		IPSET_TOKEN(MTYPE, _prefetch)
 #define mtype_test_cidrs	IPSET_TOKEN(MTYPE, _test_cidrs)
 #define mtype_test		IPSET_TOKEN(MTYPE, _test)
 #define mtype_uref		IPSET_TOKEN(MTYPE, _uref)
 #define mtype_expire		IPSET_TOKEN(MTYPE, _expire)
 #define mtype_resize		IPSET_TOKEN(MTYPE, _resize)
+#define mtype_shadow_create	IPSET_TOKEN(MTYPE, _shadow_create)
+#define mtype_shadow_publish	IPSET_TOKEN(MTYPE, _shadow_publish)
+#define mtype_shadow_destroy	IPSET_TOKEN(MTYPE, _shadow_destroy)
 #define mtype_head		IPSET_TOKEN(MTYPE, _head)
 #define mtype_list		IPSET_TOKEN(MTYPE, _list)
+#define mtype_walk		IPSET_TOKEN(MTYPE, _walk)
 #define mtype_gc		IPSET_TOKEN(MTYPE, _gc)
 #define mtype_gc_init		IPSET_TOKEN(MTYPE, _gc_init)
 #define mtype_variant		IPSET_TOKEN(MTYPE, _variant)
@@ -276,6 +334,21 @@ htable_bits(u32 hashsize)
 	jhash2(__k, __l, initval) & jhash_mask(htable_bits);	\
 })
 
+/* Per-CPU direct-mapped cache of the test verdicts. An entry is valid
+ * only while its generation matches the generation of the set.
+ */
+struct mtype_cache_entry {
+	u64 gen;		/* generation of the set, 0: unused */
+	int ret;		/* verdict of mtype_test() */
+	struct mtype_elem elem;	/* tested element */
+};
+
+struct mtype_cache {
+	u64 hits;
+	u64 misses;
+	struct mtype_cache_entry e[AHASH_CACHE_SIZE];
+};
+
 /* The generic hash structure */
 struct htype {
 	struct htable __rcu *table; /* the hash table */
@@ -285,6 +358,14 @@ struct htype {
 #endif
 	u32 maxelem;		/* max elements in the hash */
 	u32 initval;		/* random jhash init value */
+	u64 gen;		/* generation of the content */
+	void __percpu *cache;	/* struct mtype_cache, if enabled */
+#ifdef IP_SET_HASH_WITH_DATA_REF
+	/* Shared with the shadow copy, so it precedes the family
+	 * dependent members
+	 */
+	struct IPSET_TOKEN(HTYPE, _data_ref) *data_ref;
+#endif
 #ifdef IP_SET_HASH_WITH_MARKMASK
 	u32 markmask;		/* markmask value for mark mask to store */
 #endif
@@ -300,6 +381,21 @@ struct htype {
 #endif
 };
 
+/* Invalidate the verdict cache: called under set->lock after every
+ * change of the content, so a new generation is seen only together
+ * with the change. The generation is 64 bits wide and starts from 1,
+ * so it never wraps around to the generation of a stale entry or to
+ * zero, the generation of the unused entries.
+ */
+static inline void
+mtype_cache_bump(struct htype *h)
+{
+	if (!h->cache)
+		return;
+	smp_wmb();
+	WRITE_ONCE(h->gen, h->gen + 1);
+}
+
 #ifdef IP_SET_HASH_WITH_NETS
 /* Network cidr size book keeping when the hash stores different
  * sized networks. cidr == real cidr + 1 to support /0.
@@ -358,14 +454,44 @@ mtype_ahash_memsize(const struct htype *h, const struct htable *t)
 #define ahash_data(n, i, dsize)	\
 	((struct mtype_elem *)((n)->value + ((i) * (dsize))))
 
+/* Count the not yet expired elements, called under rcu_read_lock_bh */
+static u32
+mtype_ahash_elements(const struct ip_set *set, const struct htable *t)
+{
+	const struct hbucket *n;
+	const struct mtype_elem *data;
+	unsigned long now = jiffies;
+	u32 i, j, elements = 0;
+
+	for (i = 0; i < jhash_size(t->htable_bits); i++) {
+		n = rcu_dereference_bh(hbucket(t, i));
+		if (!n)
+			continue;
+		for (j = 0; j < n->pos; j++) {
+			if (!test_bit(j, n->used))
+				continue;
+			data = ahash_data(n, j, set->dsize);
+			if (!ip_set_timeout_expired_at(ext_timeout(data, set),
+						       now))
+				elements++;
+		}
+	}
+	return elements;
+}
+
 static void
 mtype_ext_cleanup(struct ip_set *set, struct hbucket *n)
 {
+	struct mtype_elem *data;
 	int i;
 
-	for (i = 0; i < n->pos; i++)
-		if (test_bit(i, n->used))
-			ip_set_ext_destroy(set, ahash_data(n, i, set->dsize));
+	for (i = 0; i < n->pos; i++) {
+		if (!test_bit(i, n->used))
+			continue;
+		data = ahash_data(n, i, set->dsize);
+		ip_set_ext_destroy(set, data);
+		mtype_data_put(set, data);
+	}
 }
 
 /* Flush a hash type of set: destroy all elements */
@@ -382,7 +508,7 @@ mtype_flush(struct ip_set *set)
 		n = __ipset_dereference_protected(hbucket(t, i), 1);
 		if (!n)
 			continue;
-		if (set->extensions & IPSET_EXT_DESTROY)
+		if (SET_ELEM_DESTROY(set))
 			mtype_ext_cleanup(set, n);
 		/* FIXME: use slab cache */
 		rcu_assign_pointer(hbucket(t, i), NULL);
@@ -393,6 +519,7 @@ mtype_flush(struct ip_set *set)
 #endif
 	set->elements = 0;
 	set->ext_size = 0;
+	mtype_cache_bump(h);
 }
 
 /* Destroy the hashtable part of the set */
@@ -406,7 +533,7 @@ mtype_ahash_destroy(struct ip_set *set, struct htable *t, bool ext_destroy)
 		n = __ipset_dereference_protected(hbucket(t, i), 1);
 		if (!n)
 			continue;
-		if (set->extensions & IPSET_EXT_DESTROY && ext_destroy)
+		if (SET_ELEM_DESTROY(set) && ext_destroy)
 			mtype_ext_cleanup(set, n);
 		/* FIXME: use slab cache */
 		kfree(n);
@@ -415,6 +542,23 @@ mtype_ahash_destroy(struct ip_set *set, struct htable *t, bool ext_destroy)
 	ip_set_free(t);
 }
 
+/* Destroy a table which was replaced by a new one, together with its
+ * extensions. set->ext_size accounts the new table already, so the
+ * released extensions are accounted against a detached counter.
+ */
+static void
+mtype_ahash_destroy_replaced(struct ip_set *set, struct htable *t)
+{
+	struct ip_set detached = {
+		.extensions = set->extensions,
+		.dsize = set->dsize,
+		.data = set->data,
+	};
+
+	memcpy(detached.offset, set->offset, sizeof(detached.offset));
+	mtype_ahash_destroy(&detached, t, true);
+}
+
 /* Destroy a hash type of set */
 static void
 mtype_destroy(struct ip_set *set)
@@ -426,6 +570,10 @@ mtype_destroy(struct ip_set *set)
 
 	mtype_ahash_destroy(set,
 			    __ipset_dereference_protected(h->table, 1), true);
+	free_percpu(h->cache);
+#ifdef IP_SET_HASH_WITH_DATA_REF
+	IPSET_TOKEN(HTYPE, _data_ref_release)(h->data_ref);
+#endif
 	kfree(h);
 
 	set->data = NULL;
@@ -442,6 +590,23 @@ mtype_gc_init(struct ip_set *set, void (*gc)(GC_ARG))
 		 IPSET_GC_PERIOD(set->timeout));
 }
 
+/* The elements are stored masked */
+static bool
+mtype_same_layout(const struct ip_set *a, const struct ip_set *b)
+{
+#ifdef IP_SET_HASH_WITH_NETMASK
+	if (((const struct htype *)a->data)->netmask !=
+	    ((const struct htype *)b->data)->netmask)
+		return false;
+#endif
+#ifdef IP_SET_HASH_WITH_MARKMASK
+	if (((const struct htype *)a->data)->markmask !=
+	    ((const struct htype *)b->data)->markmask)
+		return false;
+#endif
+	return true;
+}
+
 static bool
 mtype_same_set(const struct ip_set *a, const struct ip_set *b)
 {
@@ -451,12 +616,7 @@ mtype_same_set(const struct ip_set *a, const struct ip_set *b)
 	/* Resizing changes htable_bits, so we ignore it */
 	return x->maxelem == y->maxelem &&
 	       a->timeout == b->timeout &&
-#ifdef IP_SET_HASH_WITH_NETMASK
-	       x->netmask == y->netmask &&
-#endif
-#ifdef IP_SET_HASH_WITH_MARKMASK
-	       x->markmask == y->markmask &&
-#endif
+	       mtype_same_layout(a, b) &&
 	       a->extensions == b->extensions;
 }
 
@@ -496,6 +656,7 @@ mtype_expire(struct ip_set *set, struct htype *h)
 					k);
 #endif
 			ip_set_ext_destroy(set, data);
+			mtype_data_put(set, data);
 			set->elements--;
 			d++;
 		}
@@ -527,6 +688,7 @@ mtype_expire(struct ip_set *set, struct htype *h)
 			kfree_rcu(n, rcu);
 		}
 	}
+	mtype_cache_bump(h);
 }
 
 static void
@@ -662,6 +824,7 @@ retry:
 	}
 	rcu_assign_pointer(h->table, t);
 	set->ext_size = extsize;
+	mtype_cache_bump(h);
 
 	spin_unlock_bh(&set->lock);
 
@@ -692,6 +855,106 @@ cleanup:
 	goto out;
 }
 
+/* Replace the content of the set in one step: the new elements are added
+ * to the shadow copy of the set, which is published by switching over to
+ * its hash table. The shadow table is sized as the live one, so that
+ * refilling the set with about the same number of elements does not
+ * trigger a resize, which would allocate yet another table.
+ */
+static int
+mtype_shadow_create(struct ip_set *set, struct ip_set *shadow)
+{
+	struct htype *h = set->data, *sh;
+	struct htable *t;
+	u8 htable_bits;
+
+	sh = kmemdup(h, sizeof(*h), GFP_KERNEL);
+	if (!sh)
+		return -ENOMEM;
+	/* The shadow is not garbage collected nor tested by packets */
+	memset(&sh->gc, 0, sizeof(sh->gc));
+	sh->cache = NULL;
+#ifdef HAVE_TIMER_SETUP
+	sh->set = shadow;
+#endif
+#ifdef IP_SET_HASH_WITH_NETS
+	memset(sh->nets, 0, sizeof(sh->nets));
+#endif
+	rcu_read_lock_bh();
+	htable_bits = rcu_dereference_bh_nfnl(h->table)->htable_bits;
+	rcu_read_unlock_bh();
+	t = ip_set_alloc(htable_size(htable_bits));
+	if (!t) {
+		kfree(sh);
+		return -ENOMEM;
+	}
+	t->htable_bits = htable_bits;
+	RCU_INIT_POINTER(sh->table, t);
+#ifdef IP_SET_HASH_WITH_DATA_REF
+	IPSET_TOKEN(HTYPE, _data_ref_hold)(sh->data_ref);
+#endif
+	shadow->data = sh;
+
+	return 0;
+}
+
+static void
+mtype_shadow_publish(struct ip_set *set, struct ip_set *shadow)
+{
+	struct htype *h = set->data, *sh = shadow->data;
+	struct htable *t, *orig;
+
+	t = __ipset_dereference_protected(sh->table, 1);
+	spin_lock_bh(&set->lock);
+	orig = __ipset_dereference_protected(h->table, 1);
+	/* Parallel dumping may still use the old table: ref == 2 tells
+	 * that its extensions are not shared with the new table.
+	 */
+	atomic_set(&orig->ref, 2);
+	atomic_inc(&orig->uref);
+	/* Packets matched during the switch may see the new prefixes
+	 * with the old table, just like when elements are added or
+	 * deleted in parallel.
+	 */
+#ifdef IP_SET_HASH_WITH_NETS
+	memcpy(h->nets, sh->nets, sizeof(h->nets));
+#endif
+#ifdef IP_SET_HASH_WITH_MULTI
+	h->ahash_max = sh->ahash_max;
+#endif
+	rcu_assign_pointer(h->table, t);
+	set->elements = shadow->elements;
+	set->ext_size = shadow->ext_size;
+	mtype_cache_bump(h);
+	spin_unlock_bh(&set->lock);
+
+	/* Give time to other readers of the set */
+	synchronize_rcu_bh();
+
+	pr_debug("set %s replaced, table %p -> %p\n", set->name, orig, t);
+	if (atomic_dec_and_test(&orig->uref))
+		mtype_ahash_destroy_replaced(set, orig);
+#ifdef IP_SET_HASH_WITH_DATA_REF
+	IPSET_TOKEN(HTYPE, _data_ref_release)(sh->data_ref);
+#endif
+	kfree(sh);
+	shadow->data = NULL;
+}
+
+static void
+mtype_shadow_destroy(struct ip_set *shadow)
+{
+	struct htype *sh = shadow->data;
+
+	mtype_ahash_destroy(shadow,
+			    __ipset_dereference_protected(sh->table, 1), true);
+#ifdef IP_SET_HASH_WITH_DATA_REF
+	IPSET_TOKEN(HTYPE, _data_ref_release)(sh->data_ref);
+#endif
+	kfree(sh);
+	shadow->data = NULL;
+}
+
 /* Add an element to a hash and update the internal counters when succeeded,
  * otherwise report the proper error code.
  */
@@ -770,6 +1033,7 @@ mtype_add(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 					i);
 #endif
 			ip_set_ext_destroy(set, data);
+			mtype_data_put(set, data);
 			set->elements--;
 		}
 		goto copy_data;
@@ -806,6 +1070,7 @@ copy_data:
 		mtype_add_cidr(h, NCIDR_PUT(DCIDR_GET(d->cidr, i)), i);
 #endif
 	memcpy(data, d, sizeof(struct mtype_elem));
+	mtype_data_get(set, data);
 overwrite_extensions:
 #ifdef IP_SET_HASH_WITH_NETS
 	mtype_data_set_flags(data, flags);
@@ -826,6 +1091,7 @@ overwrite_extensions:
 		if (old)
 			kfree_rcu(old, rcu);
 	}
+	mtype_cache_bump(h);
 
 	return 0;
 set_full:
@@ -879,6 +1145,8 @@ mtype_del(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 				       j);
 #endif
 		ip_set_ext_destroy(set, data);
+		mtype_data_put(set, data);
+		mtype_cache_bump(h);
 
 		for (; i < n->pos; i++) {
 			if (!test_bit(i, n->used))
@@ -925,6 +1193,24 @@ mtype_data_match(struct mtype_elem *data, const struct ip_set_ext *ext,
 	return mtype_do_data_match(data);
 }
 
+/* Prefetch pass of ip_set_test_batch(): bring in the table slot of the
+ * element at the first pass and the bucket it points to at the second one,
+ * so that the cache misses of a batch of lookups overlap.
+ */
+static inline void
+mtype_prefetch(struct htable *t, u32 key, u32 flags)
+{
+	struct hbucket *n;
+
+	if (flags & IPSET_FLAG_PREFETCH_TABLE) {
+		prefetch(&hbucket(t, key));
+		return;
+	}
+	n = rcu_dereference_bh(hbucket(t, key));
+	if (n)
+		prefetch(n);
+}
+
 #ifdef IP_SET_HASH_WITH_NETS
 /* Special test function which takes into account the different network
  * sizes added to the set
@@ -959,6 +1245,10 @@ mtype_test_cidrs(struct ip_set *set, struct mtype_elem *d,
 		mtype_data_netmask(d, NCIDR_GET(h->nets[j].cidr[0]));
 #endif
 		key = HKEY(d, h->initval, t->htable_bits);
+		if (unlikely(flags & IPSET_FLAG_PREFETCH)) {
+			mtype_prefetch(t, key, flags);
+			continue;
+		}
 		n =  rcu_dereference_bh(hbucket(t, key));
 		if (!n)
 			continue;
@@ -994,8 +1284,27 @@ mtype_test(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	struct mtype_elem *d = value;
 	struct hbucket *n;
 	struct mtype_elem *data;
+	struct mtype_cache_entry *e = NULL;
 	int i, ret = 0;
 	u32 key, multi = 0;
+	u64 gen = 0;
+
+	if (h->cache && !(flags & IPSET_FLAG_PREFETCH)) {
+		struct mtype_cache *c = this_cpu_ptr(h->cache);
+
+		/* Pairs with smp_wmb() in mtype_cache_bump() */
+		gen = READ_ONCE(h->gen);
+		smp_rmb();
+		e = &c->e[HKEY(d, h->initval, AHASH_CACHE_BITS)];
+		if (e->gen == gen && mtype_data_equal(&e->elem, d, &multi)) {
+			c->hits++;
+			return e->ret;
+		}
+		c->misses++;
+		/* The lookup by nets modifies the tested element */
+		e->gen = 0;
+		memcpy(&e->elem, d, sizeof(e->elem));
+	}
 
 	t = rcu_dereference_bh(h->table);
 #ifdef IP_SET_HASH_WITH_NETS
@@ -1012,6 +1321,10 @@ mtype_test(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 #endif
 
 	key = HKEY(d, h->initval, t->htable_bits);
+	if (unlikely(flags & IPSET_FLAG_PREFETCH)) {
+		mtype_prefetch(t, key, flags);
+		return 0;
+	}
 	n = rcu_dereference_bh(hbucket(t, key));
 	if (!n) {
 		ret = 0;
@@ -1028,6 +1341,10 @@ mtype_test(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 			goto out;
 	}
 out:
+	if (e) {
+		e->ret = ret;
+		e->gen = gen;
+	}
 	return ret;
 }
 
@@ -1039,25 +1356,33 @@ mtype_head(struct ip_set *set, struct sk_buff *skb)
 	const struct htable *t;
 	struct nlattr *nested;
 	size_t memsize;
+	u64 hits = 0, misses = 0;
+	u32 elements;
 	u8 htable_bits;
-
-	/* If any members have expired, set->elements will be wrong
-	 * mytype_expire function will update it with the right count.
-	 * we do not hold set->lock here, so grab it first.
-	 * set->elements can still be incorrect in the case of a huge set,
-	 * because elements might time out during the listing.
-	 */
-	if (SET_WITH_TIMEOUT(set)) {
-		spin_lock_bh(&set->lock);
-		mtype_expire(set, h);
-		spin_unlock_bh(&set->lock);
-	}
+	int cpu;
 
 	rcu_read_lock_bh();
 	t = rcu_dereference_bh_nfnl(h->table);
 	memsize = mtype_ahash_memsize(h, t) + set->ext_size;
 	htable_bits = t->htable_bits;
+	/* If any members have expired, set->elements will be wrong until
+	 * the garbage collector runs. Count the live entries instead of
+	 * expiring them here: that would need set->lock and would stall
+	 * the add/del paths for the whole walk. The count can still be
+	 * incorrect in the case of a huge set, because elements might
+	 * time out during the listing.
+	 */
+	elements = SET_WITH_TIMEOUT(set) ? mtype_ahash_elements(set, t)
+					 : set->elements;
 	rcu_read_unlock_bh();
+	if (h->cache)
+		for_each_possible_cpu(cpu) {
+			const struct mtype_cache *c = per_cpu_ptr(h->cache,
+								  cpu);
+
+			hits += READ_ONCE(c->hits);
+			misses += READ_ONCE(c->misses);
+		}
 
 	nested = ipset_nest_start(skb, IPSET_ATTR_DATA);
 	if (!nested)
@@ -1075,9 +1400,16 @@ mtype_head(struct ip_set *set, struct sk_buff *skb)
 	if (nla_put_u32(skb, IPSET_ATTR_MARKMASK, h->markmask))
 		goto nla_put_failure;
 #endif
-	if (nla_put_net32(skb, IPSET_ATTR_REFERENCES, htonl(set->ref)) ||
+	if (nla_put_net32(skb, IPSET_ATTR_REFERENCES,
+			  htonl(atomic_read(&set->ref))) ||
 	    nla_put_net32(skb, IPSET_ATTR_MEMSIZE, htonl(memsize)) ||
-	    nla_put_net32(skb, IPSET_ATTR_ELEMENTS, htonl(set->elements)))
+	    nla_put_net32(skb, IPSET_ATTR_ELEMENTS, htonl(elements)))
+		goto nla_put_failure;
+	if (h->cache &&
+	    (IPSET_NLA_PUT_NET64(skb, IPSET_ATTR_CACHE_HITS,
+				 cpu_to_be64(hits), IPSET_ATTR_CREATE_PAD) ||
+	     IPSET_NLA_PUT_NET64(skb, IPSET_ATTR_CACHE_MISSES,
+				 cpu_to_be64(misses), IPSET_ATTR_CREATE_PAD)))
 		goto nla_put_failure;
 	if (unlikely(ip_set_put_flags(skb, set)))
 		goto nla_put_failure;
@@ -1104,9 +1436,12 @@ mtype_uref(struct ip_set *set, struct netlink_callback *cb, bool start)
 	} else if (cb->args[IPSET_CB_PRIVATE]) {
 		t = (struct htable *)cb->args[IPSET_CB_PRIVATE];
 		if (atomic_dec_and_test(&t->uref) && atomic_read(&t->ref)) {
-			/* Resizing didn't destroy the hash table */
+			/* Resizing/replacing didn't destroy the hash table */
 			pr_debug("Table destroy by dump: %p\n", t);
-			mtype_ahash_destroy(set, t, false);
+			if (atomic_read(&t->ref) > 1)
+				mtype_ahash_destroy_replaced(set, t);
+			else
+				mtype_ahash_destroy(set, t, false);
 		}
 		cb->args[IPSET_CB_PRIVATE] = 0;
 	}
@@ -1121,7 +1456,9 @@ mtype_list(const struct ip_set *set,
 	struct nlattr *atd, *nested;
 	const struct hbucket *n;
 	const struct mtype_elem *e;
+	const struct ip_set_elem_filter *filter = ip_set_dump_elem_filter(cb);
 	u32 first = cb->args[IPSET_CB_ARG0];
+	unsigned long now = jiffies;
 	/* We assume that one hash bucket fills into one page */
 	void *incomplete;
 	int i, ret = 0;
@@ -1148,7 +1485,12 @@ mtype_list(const struct ip_set *set,
 				continue;
 			e = ahash_data(n, i, set->dsize);
 			if (SET_WITH_TIMEOUT(set) &&
-			    ip_set_timeout_expired(ext_timeout(e, set)))
+			    ip_set_timeout_expired_at(ext_timeout(e, set), now))
+				continue;
+			/* Filtered out elements are not sent */
+			if (filter &&
+			    !(mtype_data_filter(e, filter) &&
+			      ip_set_elem_filter_ext(set, filter, e)))
 				continue;
 			pr_debug("list hash %lu hbucket %p i %u, data %p\n",
 				 cb->args[IPSET_CB_ARG0], n, i, e);
@@ -1161,7 +1503,7 @@ mtype_list(const struct ip_set *set,
 				}
 				goto nla_put_failure;
 			}
-			if (mtype_data_list(skb, e))
+			if (mtype_data_list(skb, set, e))
 				goto nla_put_failure;
 			if (ip_set_put_extensions(skb, set, e, true))
 				goto nla_put_failure;
@@ -1189,6 +1531,62 @@ out:
 	return ret;
 }
 
+/* Walk the elements for a set operation */
+static int
+mtype_walk(struct ip_set *set, ipset_walkfn fn, void *priv,
+	   unsigned long *cursor)
+{
+	struct htype *h = set->data;
+	const struct htable *t;
+	const struct hbucket *n;
+	const struct mtype_elem *data;
+	struct mtype_elem d;
+	unsigned long now = jiffies;
+	u32 walked = 0, flags = 0;
+	int i, ret = 0;
+
+	rcu_read_lock_bh();
+	t = rcu_dereference_bh(h->table);
+	for (; *cursor < jhash_size(t->htable_bits); (*cursor)++) {
+		if (walked >= IPSET_WALK_BATCH) {
+			ret = 1;
+			break;
+		}
+		n = rcu_dereference_bh(hbucket(t, *cursor));
+		if (!n)
+			continue;
+		for (i = 0; i < n->pos; i++) {
+			if (!test_bit(i, n->used))
+				continue;
+			data = ahash_data(n, i, set->dsize);
+			if (SET_WITH_TIMEOUT(set) &&
+			    ip_set_timeout_expired_at(ext_timeout(data, set),
+						      now))
+				continue;
+			/* The live element cannot be modified */
+			memcpy(&d, data, sizeof(d));
+#ifdef IP_SET_HASH_WITH_NETS
+			{
+				u8 nomatch = 0;
+
+				mtype_data_reset_flags(&d, &nomatch);
+				flags = (u32)nomatch << 16;
+			}
+#endif
+			/* On error the bucket is walked again:
+			 * re-adding the elements is harmless.
+			 */
+			ret = fn(set, &d, flags, priv);
+			if (ret)
+				goto out;
+			walked++;
+		}
+	}
+out:
+	rcu_read_unlock_bh();
+	return ret;
+}
+
 static int
 IPSET_TOKEN(MTYPE, _kadt)(struct ip_set *set, const struct sk_buff *skb,
 			  const struct xt_action_param *par,
@@ -1214,6 +1612,11 @@ static const struct ip_set_type_variant mtype_variant = {
 	.uref	= mtype_uref,
 	.resize	= mtype_resize,
 	.same_set = mtype_same_set,
+	.walk	= mtype_walk,
+	.same_layout = mtype_same_layout,
+	.shadow_create = mtype_shadow_create,
+	.shadow_publish = mtype_shadow_publish,
+	.shadow_destroy = mtype_shadow_destroy,
 };
 
 #ifdef IP_SET_EMIT_CREATE
@@ -1222,6 +1625,7 @@ IPSET_TOKEN(HTYPE, _create)(struct net *net, struct ip_set *set,
 			    struct nlattr *tb[], u32 flags)
 {
 	u32 hashsize = IPSET_DEFAULT_HASHSIZE, maxelem = IPSET_DEFAULT_MAXELEM;
+	u32 cadt_flags = 0;
 #ifdef IP_SET_HASH_WITH_MARKMASK
 	u32 markmask;
 #endif
@@ -1250,6 +1654,17 @@ IPSET_TOKEN(HTYPE, _create)(struct net *net, struct ip_set *set,
 		     !ip_set_optattr_netorder(tb, IPSET_ATTR_CADT_FLAGS)))
 		return -IPSET_ERR_PROTOCOL;
 
+	if (tb[IPSET_ATTR_CADT_FLAGS])
+		cadt_flags = ip_set_get_h32(tb[IPSET_ATTR_CADT_FLAGS]);
+	/* The verdict of a cached test must not depend on the time
+	 * and must not update the extensions of the matching element.
+	 */
+	if (cadt_flags & IPSET_FLAG_WITH_CACHE &&
+	    (tb[IPSET_ATTR_TIMEOUT] ||
+	     cadt_flags & (IPSET_FLAG_WITH_COUNTERS |
+			   IPSET_FLAG_WITH_SKBINFO)))
+		return -IPSET_ERR_CACHE;
+
 #ifdef IP_SET_HASH_WITH_MARKMASK
 	/* Separated condition in order to avoid directive in argument list */
 	if (unlikely(!ip_set_optattr_netorder(tb, IPSET_ATTR_MARKMASK)))
@@ -1300,6 +1715,32 @@ IPSET_TOKEN(HTYPE, _create)(struct net *net, struct ip_set *set,
 		kfree(h);
 		return -ENOMEM;
 	}
+	if (cadt_flags & IPSET_FLAG_WITH_CACHE) {
+		/* The cache entries hold family dependent elements */
+#ifndef IP_SET_PROTO_UNDEF
+		if (set->family == NFPROTO_IPV6)
+			h->cache = alloc_percpu(struct IPSET_TOKEN(HTYPE,
+								   6_cache));
+		else
+#endif
+			h->cache = alloc_percpu(struct IPSET_TOKEN(HTYPE,
+								   4_cache));
+		if (!h->cache) {
+			ip_set_free(t);
+			kfree(h);
+			return -ENOMEM;
+		}
+	}
+#ifdef IP_SET_HASH_WITH_DATA_REF
+	h->data_ref = IPSET_TOKEN(HTYPE, _data_ref_create)();
+	if (!h->data_ref) {
+		free_percpu(h->cache);
+		ip_set_free(t);
+		kfree(h);
+		return -ENOMEM;
+	}
+#endif
+	h->gen = 1;
 	h->maxelem = maxelem;
 #ifdef IP_SET_HASH_WITH_NETMASK
 	h->netmask = netmask;
@@ -27,7 +27,8 @@
 /*				1	   Counters support */
 /*				2	   Comments support */
 /*				3	   Forceadd support */
-#define IPSET_TYPE_REV_MAX	4	/* skbinfo support  */
+/*				4	   skbinfo support */
+#define IPSET_TYPE_REV_MAX	5	/* cache support */
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Jozsef Kadlecsik <kadlec@netfilter.org>");
@@ -67,6 +68,13 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_ip4_data_filter(const struct hash_ip4_elem *e,
+		     const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV4, &e->ip, 32, NULL);
+}
+
 static inline void
 hash_ip4_data_next(struct hash_ip4_elem *next, const struct hash_ip4_elem *e)
 {
@@ -200,6 +208,13 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_ip6_data_filter(const struct hash_ip6_elem *e,
+		     const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV6, &e->ip, 128, NULL);
+}
+
 static inline void
 hash_ip6_data_next(struct hash_ip6_elem *next, const struct hash_ip6_elem *e)
 {
@@ -26,7 +26,7 @@
 #include <linux/netfilter/ipset/ip_set_hash.h>
 
 #define IPSET_TYPE_REV_MIN	0
-#define IPSET_TYPE_REV_MAX	0
+#define IPSET_TYPE_REV_MAX	1	/* cache support */
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Tomasz Chilinski <tomasz.chilinski@chilan.com>");
@@ -55,7 +55,8 @@ hash_ipmac4_data_equal(const struct hash_ipmac4_elem *e1,
 		       const struct hash_ipmac4_elem *e2,
 		       u32 *multi)
 {
-	return e1->ip == e2->ip && ether_addr_equal(e1->ether, e2->ether);
+	return e1->ip == e2->ip &&
+		ether_addr_equal_64bits(e1->ether, e2->ether);
 }
 
 static bool
@@ -70,6 +71,13 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_ipmac4_data_filter(const struct hash_ipmac4_elem *e,
+			const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV4, &e->ip, 32, NULL);
+}
+
 static inline void
 hash_ipmac4_data_next(struct hash_ipmac4_elem *next,
 		      const struct hash_ipmac4_elem *e)
@@ -163,7 +171,7 @@ hash_ipmac6_data_equal(const struct hash_ipmac6_elem *e1,
 		       u32 *multi)
 {
 	return ipv6_addr_equal(&e1->ip.in6, &e2->ip.in6) &&
-		ether_addr_equal(e1->ether, e2->ether);
+		ether_addr_equal_64bits(e1->ether, e2->ether);
 }
 
 static bool
@@ -178,6 +186,13 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_ipmac6_data_filter(const struct hash_ipmac6_elem *e,
+			const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV6, &e->ip, 128, NULL);
+}
+
 static inline void
 hash_ipmac6_data_next(struct hash_ipmac6_elem *next,
 		      const struct hash_ipmac6_elem *e)
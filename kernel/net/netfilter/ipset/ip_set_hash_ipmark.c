@@ -26,7 +26,8 @@
 
 #define IPSET_TYPE_REV_MIN	0
 /*				1	   Forceadd support */
-#define IPSET_TYPE_REV_MAX	2	/* skbinfo support  */
+/*				2	   skbinfo support */
+#define IPSET_TYPE_REV_MAX	3	/* cache support */
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Vytas Dauksa <vytas.dauksa@smoothwall.net>");
@@ -69,6 +70,14 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_ipmark4_data_filter(const struct hash_ipmark4_elem *data,
+			 const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV4, &data->ip, 32,
+				      NULL);
+}
+
 static inline void
 hash_ipmark4_data_next(struct hash_ipmark4_elem *next,
 		       const struct hash_ipmark4_elem *d)
@@ -192,6 +201,14 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_ipmark6_data_filter(const struct hash_ipmark6_elem *data,
+			 const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV6, &data->ip, 128,
+				      NULL);
+}
+
 static inline void
 hash_ipmark6_data_next(struct hash_ipmark6_elem *next,
 		       const struct hash_ipmark6_elem *d)
@@ -29,7 +29,8 @@
 /*				2    Counters support added */
 /*				3    Comments support added */
 /*				4    Forceadd support added */
-#define IPSET_TYPE_REV_MAX	5 /* skbinfo support added */
+/*				5    skbinfo support added */
+#define IPSET_TYPE_REV_MAX	6 /* cache support added */
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Jozsef Kadlecsik <kadlec@netfilter.org>");
@@ -75,6 +76,14 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_ipport4_data_filter(const struct hash_ipport4_elem *data,
+			 const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV4, &data->ip, 32,
+				      &data->port);
+}
+
 static inline void
 hash_ipport4_data_next(struct hash_ipport4_elem *next,
 		       const struct hash_ipport4_elem *d)
@@ -96,7 +105,8 @@ hash_ipport4_kadt(struct ip_set *set, const struct sk_buff *skb,
 	struct hash_ipport4_elem e = { .ip = 0 };
 	struct ip_set_ext ext = IP_SET_INIT_KEXT(skb, opt, set);
 
-	if (!ip_set_get_ip4_port(skb, opt->flags & IPSET_DIM_TWO_SRC,
+	if (!ip_set_get_ip4_port(skb, &opt->l4,
+				 opt->flags & IPSET_DIM_TWO_SRC,
 				 &e.port, &e.proto))
 		return -EINVAL;
 
@@ -230,6 +240,14 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_ipport6_data_filter(const struct hash_ipport6_elem *data,
+			 const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV6, &data->ip, 128,
+				      &data->port);
+}
+
 static inline void
 hash_ipport6_data_next(struct hash_ipport6_elem *next,
 		       const struct hash_ipport6_elem *d)
@@ -254,7 +272,8 @@ hash_ipport6_kadt(struct ip_set *set, const struct sk_buff *skb,
 	struct hash_ipport6_elem e = { .ip = { .all = { 0 } } };
 	struct ip_set_ext ext = IP_SET_INIT_KEXT(skb, opt, set);
 
-	if (!ip_set_get_ip6_port(skb, opt->flags & IPSET_DIM_TWO_SRC,
+	if (!ip_set_get_ip6_port(skb, &opt->l4,
+				 opt->flags & IPSET_DIM_TWO_SRC,
 				 &e.port, &e.proto))
 		return -EINVAL;
 
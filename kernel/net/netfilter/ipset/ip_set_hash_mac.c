@@ -20,7 +20,7 @@
 #include <linux/netfilter/ipset/ip_set_hash.h>
 
 #define IPSET_TYPE_REV_MIN	0
-#define IPSET_TYPE_REV_MAX	0
+#define IPSET_TYPE_REV_MAX	1	/* cache support */
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Jozsef Kadlecsik <kadlec@netfilter.org>");
@@ -35,6 +35,9 @@ struct hash_mac4_elem {
 	/* Zero valued IP addresses cannot be stored */
 	union {
 		unsigned char ether[ETH_ALEN];
+		/* The padding is kept zero: the address is hashed
+		 * as two words and compared as a single 64 bit key.
+		 */
 		__be32 foo[2];
 	};
 };
@@ -46,7 +49,7 @@ hash_mac4_data_equal(const struct hash_mac4_elem *e1,
 		     const struct hash_mac4_elem *e2,
 		     u32 *multi)
 {
-	return ether_addr_equal(e1->ether, e2->ether);
+	return ether_addr_equal_64bits(e1->ether, e2->ether);
 }
 
 static inline bool
@@ -60,6 +63,13 @@ nla_put_failure:
 	return true;
 }
 
+static inline bool
+hash_mac4_data_filter(const struct hash_mac4_elem *e,
+		      const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_UNSPEC, NULL, 0, NULL);
+}
+
 static inline void
 hash_mac4_data_next(struct hash_mac4_elem *next,
 		    const struct hash_mac4_elem *e)
@@ -28,7 +28,8 @@
 /*				3    Counters support added */
 /*				4    Comments support added */
 /*				5    Forceadd support added */
-#define IPSET_TYPE_REV_MAX	6 /* skbinfo mapping support added */
+/*				6    skbinfo mapping support added */
+#define IPSET_TYPE_REV_MAX	7 /* cache support added */
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Jozsef Kadlecsik <kadlec@netfilter.org>");
@@ -101,6 +102,14 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_net4_data_filter(const struct hash_net4_elem *data,
+		      const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV4, &data->ip,
+				      data->cidr, NULL);
+}
+
 static inline void
 hash_net4_data_next(struct hash_net4_elem *next,
 		    const struct hash_net4_elem *d)
@@ -266,6 +275,14 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_net6_data_filter(const struct hash_net6_elem *data,
+		      const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV6, &data->ip,
+				      data->cidr, NULL);
+}
+
 static inline void
 hash_net6_data_next(struct hash_net6_elem *next,
 		    const struct hash_net6_elem *d)
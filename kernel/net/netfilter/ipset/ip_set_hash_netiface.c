@@ -9,8 +9,11 @@
 
 #include <linux/jhash.h>
 #include <linux/module.h>
+#include <linux/idr.h>
 #include <linux/ip.h>
+#include <linux/rculist.h>
 #include <linux/skbuff.h>
+#include <linux/spinlock.h>
 #include <linux/errno.h>
 #include <linux/random.h>
 #include <net/ip.h>
@@ -29,7 +32,8 @@
 /*				3    Counters support added */
 /*				4    Comments support added */
 /*				5    Forceadd support added */
-#define IPSET_TYPE_REV_MAX	6 /* skbinfo support added */
+/*				6    skbinfo support added */
+#define IPSET_TYPE_REV_MAX	7 /* cache support added */
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Jozsef Kadlecsik <kadlec@netfilter.org>");
@@ -41,9 +45,201 @@ MODULE_ALIAS("ip_set_hash:net,iface");
 #define IP_SET_HASH_WITH_NETS
 #define IP_SET_HASH_WITH_MULTI
 #define IP_SET_HASH_WITH_NET0
+#define IP_SET_HASH_WITH_DATA_REF
 
 #define STRLCPY(a, b)	strlcpy(a, b, IFNAMSIZ)
 
+/* Interned interface names
+ *
+ * The elements store a small id instead of the name of the interface,
+ * so they are smaller and compared by integers. Every set has its own
+ * table of names, shared with its shadow copy while the set is replaced,
+ * and the names are reference counted by the elements: a name and its id
+ * are released when the last element using them is destroyed.
+ */
+
+#define IFACE_ID_MAX		65535
+#define IFACE_HSIZE		64
+
+struct iface_name {
+	struct hlist_node node;
+	struct rcu_head rcu;
+	u32 ref;		/* references, protected by the table lock */
+	u16 id;
+	char name[IFNAMSIZ];	/* zero padded */
+};
+
+/* The names of a set, hanging off struct htype */
+struct hash_netiface_data_ref {
+	spinlock_t lock;	/* protects the changes of the table */
+	u32 users;		/* set and shadow, serialized by nfnl mutex */
+	struct idr idr;
+	struct hlist_head names[IFACE_HSIZE];
+};
+
+static struct hash_netiface_data_ref *
+hash_netiface_data_ref_create(void)
+{
+	struct hash_netiface_data_ref *t;
+
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return NULL;
+	spin_lock_init(&t->lock);
+	idr_init(&t->idr);
+	t->users = 1;
+	return t;
+}
+
+static inline void
+hash_netiface_data_ref_hold(struct hash_netiface_data_ref *t)
+{
+	t->users++;
+}
+
+static void
+hash_netiface_data_ref_release(struct hash_netiface_data_ref *t)
+{
+	struct iface_name *n;
+	int id;
+
+	if (--t->users)
+		return;
+	/* The elements are destroyed, so the names are released already */
+	idr_for_each_entry(&t->idr, n, id)
+		kfree(n);
+	idr_destroy(&t->idr);
+	kfree(t);
+}
+
+static inline struct hlist_head *
+iface_bucket(struct hash_netiface_data_ref *t, const char *name)
+{
+	return &t->names[jhash(name, IFNAMSIZ, 0) & (IFACE_HSIZE - 1)];
+}
+
+/* Name must be a zero padded IFNAMSIZ buffer */
+static struct iface_name *
+iface_name_find(struct hash_netiface_data_ref *t, const char *name)
+{
+	struct iface_name *n;
+
+	hlist_for_each_entry_rcu(n, iface_bucket(t, name), node)
+		if (memcmp(n->name, name, IFNAMSIZ) == 0)
+			return n;
+	return NULL;
+}
+
+static int
+iface_id_find(struct hash_netiface_data_ref *t, const char *name, u16 *id)
+{
+	struct iface_name *n;
+	int ret = -IPSET_ERR_EXIST;
+
+	rcu_read_lock();
+	n = iface_name_find(t, name);
+	if (n) {
+		*id = n->id;
+		ret = 0;
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/* Look up or intern the name and take a reference to it */
+static int
+iface_id_get(struct hash_netiface_data_ref *t, const char *name, u16 *id)
+{
+	struct iface_name *n;
+	int ret = 0;
+
+	spin_lock_bh(&t->lock);
+	n = iface_name_find(t, name);
+	if (n) {
+		n->ref++;
+		goto out;
+	}
+	n = kzalloc(sizeof(*n), GFP_ATOMIC);
+	if (!n) {
+		ret = -ENOMEM;
+		goto unlock;
+	}
+	memcpy(n->name, name, IFNAMSIZ);
+	/* Cyclic ids: a listing in progress does not see a reused id */
+	ret = idr_alloc_cyclic(&t->idr, n, 1, IFACE_ID_MAX + 1, GFP_ATOMIC);
+	if (ret < 0) {
+		kfree(n);
+		if (ret == -ENOSPC)
+			ret = -IPSET_ERR_HASH_FULL;
+		goto unlock;
+	}
+	n->id = ret;
+	n->ref = 1;
+	hlist_add_head_rcu(&n->node, iface_bucket(t, name));
+	ret = 0;
+out:
+	*id = n->id;
+unlock:
+	spin_unlock_bh(&t->lock);
+	return ret;
+}
+
+static void
+iface_id_hold(struct hash_netiface_data_ref *t, u16 id)
+{
+	struct iface_name *n;
+
+	spin_lock_bh(&t->lock);
+	n = idr_find(&t->idr, id);
+	if (!WARN_ON(!n))
+		n->ref++;
+	spin_unlock_bh(&t->lock);
+}
+
+static void
+iface_id_put(struct hash_netiface_data_ref *t, u16 id)
+{
+	struct iface_name *n;
+
+	spin_lock_bh(&t->lock);
+	n = idr_find(&t->idr, id);
+	if (!WARN_ON(!n) && --n->ref == 0) {
+		hlist_del_rcu(&n->node);
+		idr_remove(&t->idr, id);
+		kfree_rcu(n, rcu);
+	}
+	spin_unlock_bh(&t->lock);
+}
+
+/* An added element takes its own reference in mtype_data_get(),
+ * the one taken here is released by iface_id_release().
+ */
+static inline int
+iface_id(struct hash_netiface_data_ref *t, const char *name, u16 *id,
+	 enum ipset_adt adt)
+{
+	/* Unknown names cannot be in the set */
+	return adt == IPSET_ADD ? iface_id_get(t, name, id)
+				: iface_id_find(t, name, id);
+}
+
+static inline void
+iface_id_release(struct hash_netiface_data_ref *t, u16 id,
+		 enum ipset_adt adt)
+{
+	if (adt == IPSET_ADD)
+		iface_id_put(t, id);
+}
+
+static const char *
+iface_id_name(const struct hash_netiface_data_ref *t, u16 id)
+{
+	const struct iface_name *n = idr_find(&t->idr, id);
+
+	return n ? n->name : "";
+}
+
 /* IPv4 variant */
 
 struct hash_netiface4_elem_hashed {
@@ -61,7 +257,7 @@ struct hash_netiface4_elem {
 	u8 cidr;
 	u8 nomatch;
 	u8 elem;
-	char iface[IFNAMSIZ];
+	u16 iface;		/* interned name */
 };
 
 /* Common functions */
@@ -75,7 +271,7 @@ hash_netiface4_data_equal(const struct hash_netiface4_elem *ip1,
 	       ip1->cidr == ip2->cidr &&
 	       (++*multi) &&
 	       ip1->physdev == ip2->physdev &&
-	       strcmp(ip1->iface, ip2->iface) == 0;
+	       ip1->iface == ip2->iface;
 }
 
 static inline int
@@ -105,6 +301,7 @@ hash_netiface4_data_netmask(struct hash_netiface4_elem *elem, u8 cidr)
 
 static bool
 hash_netiface4_data_list(struct sk_buff *skb,
+			 const struct hash_netiface_data_ref *t,
 			 const struct hash_netiface4_elem *data)
 {
 	u32 flags = data->physdev ? IPSET_FLAG_PHYSDEV : 0;
@@ -113,7 +310,8 @@ hash_netiface4_data_list(struct sk_buff *skb,
 		flags |= IPSET_FLAG_NOMATCH;
 	if (nla_put_ipaddr4(skb, IPSET_ATTR_IP, data->ip) ||
 	    nla_put_u8(skb, IPSET_ATTR_CIDR, data->cidr) ||
-	    nla_put_string(skb, IPSET_ATTR_IFACE, data->iface) ||
+	    nla_put_string(skb, IPSET_ATTR_IFACE,
+			   iface_id_name(t, data->iface)) ||
 	    (flags &&
 	     nla_put_net32(skb, IPSET_ATTR_CADT_FLAGS, htonl(flags))))
 		goto nla_put_failure;
@@ -123,6 +321,14 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_netiface4_data_filter(const struct hash_netiface4_elem *data,
+			   const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV4, &data->ip,
+				      data->cidr, NULL);
+}
+
 static inline void
 hash_netiface4_data_next(struct hash_netiface4_elem *next,
 			 const struct hash_netiface4_elem *d)
@@ -130,6 +336,20 @@ hash_netiface4_data_next(struct hash_netiface4_elem *next,
 	next->ip = d->ip;
 }
 
+static inline void
+hash_netiface4_data_get(struct hash_netiface_data_ref *t,
+			const struct hash_netiface4_elem *data)
+{
+	iface_id_hold(t, data->iface);
+}
+
+static inline void
+hash_netiface4_data_put(struct hash_netiface_data_ref *t,
+			const struct hash_netiface4_elem *data)
+{
+	iface_id_put(t, data->iface);
+}
+
 #define MTYPE		hash_netiface4
 #define HOST_MASK	32
 #define HKEY_DATALEN	sizeof(struct hash_netiface4_elem_hashed)
@@ -163,6 +383,8 @@ hash_netiface4_kadt(struct ip_set *set, const struct sk_buff *skb,
 		.elem = 1,
 	};
 	struct ip_set_ext ext = IP_SET_INIT_KEXT(skb, opt, set);
+	char iface[IFNAMSIZ] = {};
+	int ret;
 
 	if (adt == IPSET_TEST)
 		e.cidr = HOST_MASK;
@@ -180,16 +402,21 @@ hash_netiface4_kadt(struct ip_set *set, const struct sk_buff *skb,
 
 		if (!eiface)
 			return -EINVAL;
-		STRLCPY(e.iface, eiface);
+		STRLCPY(iface, eiface);
 		e.physdev = 1;
 #endif
 	} else {
-		STRLCPY(e.iface, SRCDIR ? IFACE(in) : IFACE(out));
+		STRLCPY(iface, SRCDIR ? IFACE(in) : IFACE(out));
 	}
 
-	if (strlen(e.iface) == 0)
+	if (strlen(iface) == 0)
 		return -EINVAL;
-	return adtfn(set, &e, &ext, &opt->ext, opt->cmdflags);
+	ret = iface_id(h->data_ref, iface, &e.iface, adt);
+	if (ret)
+		return ret;
+	ret = adtfn(set, &e, &ext, &opt->ext, opt->cmdflags);
+	iface_id_release(h->data_ref, e.iface, adt);
+	return ret;
 }
 
 static int
@@ -200,6 +427,7 @@ hash_netiface4_uadt(struct ip_set *set, struct nlattr *tb[],
 	ipset_adtfn adtfn = set->variant->adt[adt];
 	struct hash_netiface4_elem e = { .cidr = HOST_MASK, .elem = 1 };
 	struct ip_set_ext ext = IP_SET_INIT_UEXT(set);
+	char iface[IFNAMSIZ] = {};
 	u32 ip = 0, ip_to = 0;
 	int ret;
 
@@ -224,7 +452,10 @@ hash_netiface4_uadt(struct ip_set *set, struct nlattr *tb[],
 		if (e.cidr > HOST_MASK)
 			return -IPSET_ERR_INVALID_CIDR;
 	}
-	nla_strlcpy(e.iface, tb[IPSET_ATTR_IFACE], IFNAMSIZ);
+	nla_strlcpy(iface, tb[IPSET_ATTR_IFACE], IFNAMSIZ);
+	ret = iface_id(h->data_ref, iface, &e.iface, adt);
+	if (ret)
+		return ip_set_eexist(ret, flags) ? 0 : ret;
 
 	if (tb[IPSET_ATTR_CADT_FLAGS]) {
 		u32 cadt_flags = ip_set_get_h32(tb[IPSET_ATTR_CADT_FLAGS]);
@@ -237,18 +468,21 @@ hash_netiface4_uadt(struct ip_set *set, struct nlattr *tb[],
 	if (adt == IPSET_TEST || !tb[IPSET_ATTR_IP_TO]) {
 		e.ip = htonl(ip & ip_set_hostmask(e.cidr));
 		ret = adtfn(set, &e, &ext, &ext, flags);
-		return ip_set_enomatch(ret, flags, adt, set) ? -ret :
-		       ip_set_eexist(ret, flags) ? 0 : ret;
+		ret = ip_set_enomatch(ret, flags, adt, set) ? -ret :
+		      ip_set_eexist(ret, flags) ? 0 : ret;
+		goto out;
 	}
 
 	if (tb[IPSET_ATTR_IP_TO]) {
 		ret = ip_set_get_hostipaddr4(tb[IPSET_ATTR_IP_TO], &ip_to);
 		if (ret)
-			return ret;
+			goto out;
 		if (ip_to < ip)
 			swap(ip, ip_to);
-		if (ip + UINT_MAX == ip_to)
-			return -IPSET_ERR_HASH_RANGE;
+		if (ip + UINT_MAX == ip_to) {
+			ret = -IPSET_ERR_HASH_RANGE;
+			goto out;
+		}
 	} else {
 		ip_set_mask_from_to(ip, ip_to, e.cidr);
 	}
@@ -261,10 +495,12 @@ hash_netiface4_uadt(struct ip_set *set, struct nlattr *tb[],
 		ret = adtfn(set, &e, &ext, &ext, flags);
 
 		if (ret && !ip_set_eexist(ret, flags))
-			return ret;
+			goto out;
 
 		ret = 0;
 	} while (ip++ < ip_to);
+out:
+	iface_id_release(h->data_ref, e.iface, adt);
 	return ret;
 }
 
@@ -284,7 +520,7 @@ struct hash_netiface6_elem {
 	u8 cidr;
 	u8 nomatch;
 	u8 elem;
-	char iface[IFNAMSIZ];
+	u16 iface;		/* interned name */
 };
 
 /* Common functions */
@@ -298,7 +534,7 @@ hash_netiface6_data_equal(const struct hash_netiface6_elem *ip1,
 	       ip1->cidr == ip2->cidr &&
 	       (++*multi) &&
 	       ip1->physdev == ip2->physdev &&
-	       strcmp(ip1->iface, ip2->iface) == 0;
+	       ip1->iface == ip2->iface;
 }
 
 static inline int
@@ -328,6 +564,7 @@ hash_netiface6_data_netmask(struct hash_netiface6_elem *elem, u8 cidr)
 
 static bool
 hash_netiface6_data_list(struct sk_buff *skb,
+			 const struct hash_netiface_data_ref *t,
 			 const struct hash_netiface6_elem *data)
 {
 	u32 flags = data->physdev ? IPSET_FLAG_PHYSDEV : 0;
@@ -336,7 +573,8 @@ hash_netiface6_data_list(struct sk_buff *skb,
 		flags |= IPSET_FLAG_NOMATCH;
 	if (nla_put_ipaddr6(skb, IPSET_ATTR_IP, &data->ip.in6) ||
 	    nla_put_u8(skb, IPSET_ATTR_CIDR, data->cidr) ||
-	    nla_put_string(skb, IPSET_ATTR_IFACE, data->iface) ||
+	    nla_put_string(skb, IPSET_ATTR_IFACE,
+			   iface_id_name(t, data->iface)) ||
 	    (flags &&
 	     nla_put_net32(skb, IPSET_ATTR_CADT_FLAGS, htonl(flags))))
 		goto nla_put_failure;
@@ -346,12 +584,34 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_netiface6_data_filter(const struct hash_netiface6_elem *data,
+			   const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV6, &data->ip,
+				      data->cidr, NULL);
+}
+
 static inline void
 hash_netiface6_data_next(struct hash_netiface6_elem *next,
 			 const struct hash_netiface6_elem *d)
 {
 }
 
+static inline void
+hash_netiface6_data_get(struct hash_netiface_data_ref *t,
+			const struct hash_netiface6_elem *data)
+{
+	iface_id_hold(t, data->iface);
+}
+
+static inline void
+hash_netiface6_data_put(struct hash_netiface_data_ref *t,
+			const struct hash_netiface6_elem *data)
+{
+	iface_id_put(t, data->iface);
+}
+
 #undef MTYPE
 #undef HOST_MASK
 
@@ -373,6 +633,8 @@ hash_netiface6_kadt(struct ip_set *set, const struct sk_buff *skb,
 		.elem = 1,
 	};
 	struct ip_set_ext ext = IP_SET_INIT_KEXT(skb, opt, set);
+	char iface[IFNAMSIZ] = {};
+	int ret;
 
 	if (adt == IPSET_TEST)
 		e.cidr = HOST_MASK;
@@ -387,26 +649,32 @@ hash_netiface6_kadt(struct ip_set *set, const struct sk_buff *skb,
 
 		if (!eiface)
 			return -EINVAL;
-		STRLCPY(e.iface, eiface);
+		STRLCPY(iface, eiface);
 		e.physdev = 1;
 #endif
 	} else {
-		STRLCPY(e.iface, SRCDIR ? IFACE(in) : IFACE(out));
+		STRLCPY(iface, SRCDIR ? IFACE(in) : IFACE(out));
 	}
 
-	if (strlen(e.iface) == 0)
+	if (strlen(iface) == 0)
 		return -EINVAL;
-
-	return adtfn(set, &e, &ext, &opt->ext, opt->cmdflags);
+	ret = iface_id(h->data_ref, iface, &e.iface, adt);
+	if (ret)
+		return ret;
+	ret = adtfn(set, &e, &ext, &opt->ext, opt->cmdflags);
+	iface_id_release(h->data_ref, e.iface, adt);
+	return ret;
 }
 
 static int
 hash_netiface6_uadt(struct ip_set *set, struct nlattr *tb[],
 		    enum ipset_adt adt, u32 *lineno, u32 flags, bool retried)
 {
+	struct hash_netiface6 *h = set->data;
 	ipset_adtfn adtfn = set->variant->adt[adt];
 	struct hash_netiface6_elem e = { .cidr = HOST_MASK, .elem = 1 };
 	struct ip_set_ext ext = IP_SET_INIT_UEXT(set);
+	char iface[IFNAMSIZ] = {};
 	int ret;
 
 	if (tb[IPSET_ATTR_LINENO])
@@ -435,7 +703,10 @@ hash_netiface6_uadt(struct ip_set *set, struct nlattr *tb[],
 
 	ip6_netmask(&e.ip, e.cidr);
 
-	nla_strlcpy(e.iface, tb[IPSET_ATTR_IFACE], IFNAMSIZ);
+	nla_strlcpy(iface, tb[IPSET_ATTR_IFACE], IFNAMSIZ);
+	ret = iface_id(h->data_ref, iface, &e.iface, adt);
+	if (ret)
+		return ip_set_eexist(ret, flags) ? 0 : ret;
 
 	if (tb[IPSET_ATTR_CADT_FLAGS]) {
 		u32 cadt_flags = ip_set_get_h32(tb[IPSET_ATTR_CADT_FLAGS]);
@@ -447,6 +718,7 @@ hash_netiface6_uadt(struct ip_set *set, struct nlattr *tb[],
 	}
 
 	ret = adtfn(set, &e, &ext, &ext, flags);
+	iface_id_release(h->data_ref, e.iface, adt);
 
 	return ip_set_enomatch(ret, flags, adt, set) ? -ret :
 	       ip_set_eexist(ret, flags) ? 0 : ret;
@@ -25,7 +25,8 @@
 
 #define IPSET_TYPE_REV_MIN	0
 /*				1	   Forceadd support added */
-#define IPSET_TYPE_REV_MAX	2	/* skbinfo support added */
+/*				2	   skbinfo support added */
+#define IPSET_TYPE_REV_MAX	3	/* cache support added */
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Oliver Smith <oliver@8.c.9.b.0.7.4.0.1.0.0.2.ip6.arpa>");
@@ -120,6 +121,14 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_netnet4_data_filter(const struct hash_netnet4_elem *data,
+			 const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV4, &data->ip[0],
+				      data->cidr[0], NULL);
+}
+
 static inline void
 hash_netnet4_data_next(struct hash_netnet4_elem *next,
 		       const struct hash_netnet4_elem *d)
@@ -351,6 +360,14 @@ nla_put_failure:
 	return true;
 }
 
+static bool
+hash_netnet6_data_filter(const struct hash_netnet6_elem *data,
+			 const struct ip_set_elem_filter *filter)
+{
+	return ip_set_elem_filter_key(filter, NFPROTO_IPV6, &data->ip[0],
+				      data->cidr[0], NULL);
+}
+
 static inline void
 hash_netnet6_data_next(struct hash_netnet6_elem *next,
 		       const struct hash_netnet6_elem *d)
@@ -32,12 +32,29 @@ struct set_elem {
 	struct list_head list;
 	struct ip_set *set;	/* Sigh, in order to cleanup reference */
 	ip_set_id_t id;
+	u8 family;		/* family of the member set */
+	u8 dim;			/* dimension of the member set */
 } __aligned(__alignof__(u64));
 
 struct set_adt_elem {
 	ip_set_id_t id;
 	ip_set_id_t refid;
 	int before;
+	u8 family;
+	u8 dim;
+};
+
+/* Members which can match a packet of a given family, in list order */
+struct list_set_vec {
+	struct rcu_head rcu;
+	u32 count;
+	struct set_elem *elem[0];
+};
+
+enum {
+	LIST_SET_VEC_IPV4,
+	LIST_SET_VEC_IPV6,
+	LIST_SET_VEC_MAX,
 };
 
 /* Type structure */
@@ -49,8 +66,69 @@ struct list_set {
 #endif
 	struct net *net;	/* namespace */
 	struct list_head members; /* the set members */
+	struct list_set_vec __rcu *vec[LIST_SET_VEC_MAX]; /* per family */
 };
 
+static inline int
+list_set_vec_index(u8 family)
+{
+	switch (family) {
+	case NFPROTO_IPV4:
+		return LIST_SET_VEC_IPV4;
+	case NFPROTO_IPV6:
+		return LIST_SET_VEC_IPV6;
+	default:
+		return -1;
+	}
+}
+
+/* Invalidate the vectors before a member is removed or inserted:
+ * the packet path walks the list until they are rebuilt.
+ */
+static void
+list_set_vec_clear(struct list_set *map)
+{
+	struct list_set_vec *vec;
+	int i;
+
+	for (i = 0; i < LIST_SET_VEC_MAX; i++) {
+		vec = rcu_dereference_protected(map->vec[i], 1);
+		if (!vec)
+			continue;
+		RCU_INIT_POINTER(map->vec[i], NULL);
+		kfree_rcu(vec, rcu);
+	}
+}
+
+/* Rebuild the invalidated vectors, skipping the members which
+ * cannot match the family.
+ */
+static void
+list_set_vec_update(struct list_set *map)
+{
+	struct list_set_vec *vec;
+	struct set_elem *e;
+	u32 n = 0;
+	int i;
+
+	list_for_each_entry(e, &map->members, list)
+		n++;
+	for (i = 0; i < LIST_SET_VEC_MAX; i++) {
+		if (rcu_access_pointer(map->vec[i]))
+			continue;
+		vec = kmalloc(sizeof(*vec) + n * sizeof(e), GFP_ATOMIC);
+		if (!vec)
+			/* Keep walking the list, retry at the next change */
+			continue;
+		vec->count = 0;
+		list_for_each_entry(e, &map->members, list)
+			if (e->family == NFPROTO_UNSPEC ||
+			    list_set_vec_index(e->family) == i)
+				vec->elem[vec->count++] = e;
+		rcu_assign_pointer(map->vec[i], vec);
+	}
+}
+
 static int
 list_set_ktest(struct ip_set *set, const struct sk_buff *skb,
 	       const struct xt_action_param *par,
@@ -58,14 +136,31 @@ list_set_ktest(struct ip_set *set, const struct sk_buff *skb,
 {
 	struct list_set *map = set->data;
 	struct ip_set_ext *mext = &opt->ext;
+	const struct list_set_vec *vec = NULL;
 	struct set_elem *e;
-	u32 flags = opt->cmdflags;
+	u32 i, flags = opt->cmdflags;
 	int ret;
 
 	/* Don't lookup sub-counters at all */
 	opt->cmdflags &= ~IPSET_FLAG_MATCH_COUNTERS;
 	if (opt->cmdflags & IPSET_FLAG_SKIP_SUBCOUNTER_UPDATE)
 		opt->cmdflags &= ~IPSET_FLAG_SKIP_COUNTER_UPDATE;
+	ret = list_set_vec_index(opt->family);
+	if (ret >= 0)
+		vec = rcu_dereference(map->vec[ret]);
+	if (vec) {
+		for (i = 0; i < vec->count; i++) {
+			e = vec->elem[i];
+			if (opt->dim < e->dim)
+				continue;
+			ret = ip_set_test(e->id, skb, par, opt);
+			if (ret <= 0)
+				continue;
+			if (ip_set_match_extensions(set, ext, mext, flags, e))
+				return 1;
+		}
+		return 0;
+	}
 	list_for_each_entry_rcu(e, &map->members, list) {
 		ret = ip_set_test(e->id, skb, par, opt);
 		if (ret <= 0)
@@ -162,6 +257,7 @@ list_set_del(struct ip_set *set, struct set_elem *e)
 
 	set->elements--;
 	list_del_rcu(&e->list);
+	list_set_vec_clear(map);
 	ip_set_put_byindex(map->net, e->id);
 	call_rcu(&e->rcu, __list_set_del_rcu);
 }
@@ -172,6 +268,7 @@ list_set_replace(struct ip_set *set, struct set_elem *e, struct set_elem *old)
 	struct list_set *map = set->data;
 
 	list_replace_rcu(&old->list, &e->list);
+	list_set_vec_clear(map);
 	ip_set_put_byindex(map->net, old->id);
 	call_rcu(&old->rcu, __list_set_del_rcu);
 }
@@ -301,6 +398,8 @@ list_set_uadd(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 		return -ENOMEM;
 	e->id = d->id;
 	e->set = set;
+	e->family = d->family;
+	e->dim = d->dim;
 	INIT_LIST_HEAD(&e->list);
 	list_set_init_extensions(set, ext, e);
 	if (n)
@@ -311,6 +410,8 @@ list_set_uadd(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 		list_add_rcu(&e->list, &prev->list);
 	else
 		list_add_tail_rcu(&e->list, &map->members);
+	if (!n)
+		list_set_vec_clear(map);
 	set->elements++;
 
 	return 0;
@@ -377,6 +478,9 @@ list_set_uadt(struct ip_set *set, struct nlattr *tb[],
 		ret = -IPSET_ERR_LOOP;
 		goto finish;
 	}
+	/* Swapped sets have got the same family and features */
+	e.family = s->family;
+	e.dim = s->type->dimension;
 
 	if (tb[IPSET_ATTR_CADT_FLAGS]) {
 		u32 f = ip_set_get_h32(tb[IPSET_ATTR_CADT_FLAGS]);
@@ -404,6 +508,8 @@ list_set_uadt(struct ip_set *set, struct nlattr *tb[],
 		set_cleanup_entries(set);
 
 	ret = adtfn(set, &e, &ext, &ext, flags);
+	if (adt != IPSET_TEST)
+		list_set_vec_update(map);
 
 finish:
 	if (e.refid != IPSET_INVALID_ID)
@@ -424,6 +530,7 @@ list_set_flush(struct ip_set *set)
 		list_set_del(set, e);
 	set->elements = 0;
 	set->ext_size = 0;
+	list_set_vec_update(map);
 }
 
 static void
@@ -431,10 +538,13 @@ list_set_destroy(struct ip_set *set)
 {
 	struct list_set *map = set->data;
 	struct set_elem *e, *n;
+	int i;
 
 	if (SET_WITH_TIMEOUT(set))
 		del_timer_sync(&map->gc);
 
+	for (i = 0; i < LIST_SET_VEC_MAX; i++)
+		kfree(rcu_dereference_protected(map->vec[i], 1));
 	list_for_each_entry_safe(e, n, &map->members, list) {
 		list_del(&e->list);
 		ip_set_put_byindex(map->net, e->id);
@@ -472,7 +582,8 @@ list_set_head(struct ip_set *set, struct sk_buff *skb)
 	if (!nested)
 		goto nla_put_failure;
 	if (nla_put_net32(skb, IPSET_ATTR_SIZE, htonl(map->size)) ||
-	    nla_put_net32(skb, IPSET_ATTR_REFERENCES, htonl(set->ref)) ||
+	    nla_put_net32(skb, IPSET_ATTR_REFERENCES,
+			  htonl(atomic_read(&set->ref))) ||
 	    nla_put_net32(skb, IPSET_ATTR_MEMSIZE, htonl(memsize)) ||
 	    nla_put_net32(skb, IPSET_ATTR_ELEMENTS, htonl(set->elements)))
 		goto nla_put_failure;
@@ -492,6 +603,7 @@ list_set_list(const struct ip_set *set,
 	const struct list_set *map = set->data;
 	struct nlattr *atd, *nested;
 	u32 i = 0, first = cb->args[IPSET_CB_ARG0];
+	unsigned long now = jiffies;
 	char name[IPSET_MAXNAMELEN];
 	struct set_elem *e;
 	int ret = 0;
@@ -504,7 +616,7 @@ list_set_list(const struct ip_set *set,
 	list_for_each_entry_rcu(e, &map->members, list) {
 		if (i < first ||
 		    (SET_WITH_TIMEOUT(set) &&
-		     ip_set_timeout_expired(ext_timeout(e, set)))) {
+		     ip_set_timeout_expired_at(ext_timeout(e, set), now))) {
 			i++;
 			continue;
 		}
@@ -573,6 +685,7 @@ list_set_gc(GC_ARG)
 
 	spin_lock_bh(&set->lock);
 	set_cleanup_entries(set);
+	list_set_vec_update(map);
 	spin_unlock_bh(&set->lock);
 
 	map->gc.expires = jiffies + IPSET_GC_PERIOD(set->timeout) * HZ;
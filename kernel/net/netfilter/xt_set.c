@@ -61,7 +61,7 @@ struct ip_set_adt_opt n = {				\
 	.family	= f,					\
 	.dim = d,					\
 	.flags = fs,					\
-	.cmdflags = cfs,				\
+	.cmdflags = (cfs) & ~IPSET_FLAG_PREFETCH,	\
 	.ext.timeout = t,				\
 	.ext.packets = p,				\
 	.ext.bytes = b,					\
@@ -227,6 +227,92 @@ set_match_v4(const struct sk_buff *skb, CONST struct xt_action_param *par)
 #define set_match_v4_checkentry	set_match_v1_checkentry
 #define set_match_v4_destroy	set_match_v1_destroy
 
+/* Revision 5 match: the sets are tested in order, until the result
+ * of the match is known.
+ */
+
+static bool
+set_match_v5(const struct sk_buff *skb, CONST struct xt_action_param *par)
+{
+	const struct xt_set_info_match_v5 *info = par->matchinfo;
+	bool ret, all = info->mode == XT_SET_MATCH_ALL;
+	struct ip_set_l4 l4 = { .state = IPSET_L4_UNKNOWN };
+	u8 i;
+
+	for (i = 0; i < info->count; i++) {
+		const struct xt_set_info *set = &info->match_set[i];
+
+		ADT_OPT(opt, XT_FAMILY(par), set->dim,
+			set->flags, info->flags, UINT_MAX,
+			info->packets.value, info->bytes.value,
+			info->packets.op, info->bytes.op);
+
+		if (info->packets.op != IPSET_COUNTER_NONE ||
+		    info->bytes.op != IPSET_COUNTER_NONE)
+			opt.cmdflags |= IPSET_FLAG_MATCH_COUNTERS;
+
+		/* The Layer-4 data is extracted once for all the sets */
+		opt.l4 = l4;
+		ret = match_set(set->index, skb, par, &opt,
+				set->flags & IPSET_INV_MATCH);
+		l4 = opt.l4;
+		if (ret != all)
+			return ret;
+	}
+	return all;
+}
+
+static void
+set_match_v5_put(const struct xt_set_info_match_v5 *info, struct net *net,
+		 u8 count)
+{
+	u8 i;
+
+	for (i = 0; i < count; i++)
+		ip_set_nfnl_put(net, info->match_set[i].index);
+}
+
+static FTYPE
+set_match_v5_checkentry(const struct xt_mtchk_param *par)
+{
+	struct xt_set_info_match_v5 *info = par->matchinfo;
+	ip_set_id_t index;
+	u8 i;
+
+	if (info->count == 0 || info->count > XT_SET_MATCH_MAX_SETS ||
+	    info->mode > XT_SET_MATCH_ALL) {
+		pr_warn("Protocol error: invalid number of sets or mode "
+			"in set match!\n");
+		return CHECK_FAIL(-EINVAL);
+	}
+	for (i = 0; i < info->count; i++) {
+		index = ip_set_nfnl_get_byindex(XT_PAR_NET(par),
+						info->match_set[i].index);
+
+		if (index == IPSET_INVALID_ID) {
+			pr_warn("Cannot find set identified by id %u to match\n",
+				info->match_set[i].index);
+			set_match_v5_put(info, XT_PAR_NET(par), i);
+			return CHECK_FAIL(-ENOENT);
+		}
+		if (info->match_set[i].dim > IPSET_DIM_MAX) {
+			pr_warn("Protocol error: set match dimension is over the limit!\n");
+			set_match_v5_put(info, XT_PAR_NET(par), i + 1);
+			return CHECK_FAIL(-ERANGE);
+		}
+	}
+
+	return CHECK_OK;
+}
+
+static void
+set_match_v5_destroy(const struct xt_mtdtor_param *par)
+{
+	struct xt_set_info_match_v5 *info = par->matchinfo;
+
+	set_match_v5_put(info, XT_PAR_NET(par), info->count);
+}
+
 /* Revision 0 interface: backward compatible with netfilter/iptables */
 
 #ifdef HAVE_XT_TARGET_PARAM
@@ -655,6 +741,27 @@ static struct xt_match set_matches[] __read_mostly = {
 		.destroy	= set_match_v4_destroy,
 		.me		= THIS_MODULE
 	},
+	/* multiple sets in one match */
+	{
+		.name		= "set",
+		.family		= NFPROTO_IPV4,
+		.revision	= 5,
+		.match		= set_match_v5,
+		.matchsize	= sizeof(struct xt_set_info_match_v5),
+		.checkentry	= set_match_v5_checkentry,
+		.destroy	= set_match_v5_destroy,
+		.me		= THIS_MODULE
+	},
+	{
+		.name		= "set",
+		.family		= NFPROTO_IPV6,
+		.revision	= 5,
+		.match		= set_match_v5,
+		.matchsize	= sizeof(struct xt_set_info_match_v5),
+		.checkentry	= set_match_v5_checkentry,
+		.destroy	= set_match_v5_destroy,
+		.me		= THIS_MODULE
+	},
 };
 
 static struct xt_target set_targets[] __read_mostly = {
@@ -14,12 +14,26 @@
 #include <linux/kernel.h>
 #include <linux/string.h>
 #include <linux/skbuff.h>
+#include <linux/slab.h>
 #include <linux/netfilter/xt_set.h>
 #include <linux/netfilter/ipset/ip_set_compat.h>
 #include <linux/ipv6.h>
 #include <net/ip.h>
 #include <net/pkt_cls.h>
 
+/* Private data of the match: the set info must come first, because
+ * the ematch core dumps the first em->datalen bytes back to userspace.
+ */
+struct em_ipset {
+	struct xt_set_info info;
+	/* Template of the per packet lookup options */
+	struct ip_set_adt_opt opt;
+	/* The set type matches on the interfaces or, as list:set, may
+	 * contain such sets
+	 */
+	bool need_dev;
+};
+
 #ifdef HAVE_TCF_EMATCH_OPS_CHANGE_ARG_NET
 static int em_ipset_change(struct net *net, void *data, int data_len,
 			   struct tcf_ematch *em)
@@ -29,6 +43,7 @@ static int em_ipset_change(struct tcf_proto *tp, void *data, int data_len,
 #endif
 {
 	struct xt_set_info *set = data;
+	struct em_ipset *e;
 	ip_set_id_t index;
 #ifndef HAVE_TCF_EMATCH_OPS_CHANGE_ARG_NET
 	struct net *net = dev_net(qdisc_dev(tp->q));
@@ -41,10 +56,19 @@ static int em_ipset_change(struct tcf_proto *tp, void *data, int data_len,
 	if (index == IPSET_INVALID_ID)
 		return -ENOENT;
 
-	em->datalen = sizeof(*set);
-	em->data = (unsigned long)kmemdup(data, em->datalen, GFP_KERNEL);
-	if (em->data)
+	e = kzalloc(sizeof(*e), GFP_KERNEL);
+	if (e) {
+		e->info = *set;
+		e->opt.dim = set->dim;
+		e->opt.flags = set->flags;
+		e->opt.ext.timeout = ~0u;
+		e->need_dev = !!(ip_set_features_byindex(net, index) &
+				 (IPSET_TYPE_IFACE | IPSET_TYPE_NAME));
+
+		em->datalen = sizeof(*set);
+		em->data = (unsigned long)e;
 		return 0;
+	}
 
 	ip_set_nfnl_put(net, index);
 	return -ENOMEM;
@@ -71,9 +95,9 @@ static void em_ipset_destroy(struct tcf_proto *p, struct tcf_ematch *em)
 static int em_ipset_match(struct sk_buff *skb, struct tcf_ematch *em,
 			  struct tcf_pkt_info *info)
 {
-	struct ip_set_adt_opt opt;
+	const struct em_ipset *e = (const void *) em->data;
+	struct ip_set_adt_opt opt = e->opt;
 	struct xt_action_param acpar;
-	const struct xt_set_info *set = (const void *) em->data;
 	struct net_device *dev, *indev = NULL;
 #ifdef HAVE_STATE_IN_XT_ACTION_PARAM
 	struct nf_hook_state state = {
@@ -114,10 +138,6 @@ static int em_ipset_match(struct sk_buff *skb, struct tcf_ematch *em,
 
 	opt.family = acpar.family;
 #endif
-	opt.dim = set->dim;
-	opt.flags = set->flags;
-	opt.cmdflags = 0;
-	opt.ext.timeout = ~0u;
 
 	network_offset = skb_network_offset(skb);
 	skb_pull(skb, network_offset);
@@ -126,7 +146,10 @@ static int em_ipset_match(struct sk_buff *skb, struct tcf_ematch *em,
 
 	rcu_read_lock();
 
-	if (skb->skb_iif)
+	/* Resolving the input device is a hash lookup of its own:
+	 * do it only when the set may look at the interfaces.
+	 */
+	if (e->need_dev && skb->skb_iif)
 #ifdef HAVE_TCF_EMATCH_STRUCT_NET
 		indev = dev_get_by_index_rcu(em->net, skb->skb_iif);
 #else
@@ -145,7 +168,7 @@ static int em_ipset_match(struct sk_buff *skb, struct tcf_ematch *em,
 	acpar.out     = dev;
 #endif /* HAVE_STATE_IN_XT_ACTION_PARAM */
 
-	ret = ip_set_test(set->index, skb, &acpar, &opt);
+	ret = ip_set_test(e->info.index, skb, &acpar, &opt);
 
 	rcu_read_unlock();
 
@@ -276,6 +276,14 @@ static const struct ipset_arg ipset_args[] = {
 		.print = ipset_print_number,
 		.help = "[skbqueue VALUE]",
 	},
+	[IPSET_ARG_CACHE] = {
+		.name = { "cache", NULL },
+		.has_arg = IPSET_NO_ARG,
+		.opt = IPSET_OPT_CACHE,
+		.parse = ipset_parse_flag,
+		.print = ipset_print_flag,
+		.help = "[cache]",
+	},
 };
 
 const struct ipset_arg *
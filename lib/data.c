@@ -46,8 +46,11 @@ struct ipset_data {
 	uint16_t port_to;
 	uint16_t index;
 	union {
-		/* RENAME/SWAP */
-		char setname2[IPSET_MAXNAMELEN];
+		/* RENAME/SWAP, UNION/INTERSECT/DIFF */
+		struct {
+			char setname2[IPSET_MAXNAMELEN];
+			char setname3[IPSET_MAXNAMELEN];
+		};
 		/* CREATE/LIST/SAVE */
 		struct {
 			uint8_t probes;
@@ -62,6 +65,8 @@ struct ipset_data {
 			uint32_t references;
 			uint32_t elements;
 			uint32_t memsize;
+			uint64_t cache_hits;
+			uint64_t cache_misses;
 			char typename[IPSET_MAXNAMELEN];
 			uint8_t revision_min;
 			uint8_t revision;
@@ -322,6 +327,9 @@ ipset_data_set(struct ipset_data *data, enum ipset_opt opt, const void *value)
 	case IPSET_OPT_SKBINFO:
 		cadt_flag_type_attr(data, opt, IPSET_FLAG_WITH_SKBINFO);
 		break;
+	case IPSET_OPT_CACHE:
+		cadt_flag_type_attr(data, opt, IPSET_FLAG_WITH_CACHE);
+		break;
 	/* Create-specific options, filled out by the kernel */
 	case IPSET_OPT_ELEMENTS:
 		data->create.elements = *(const uint32_t *) value;
@@ -332,6 +340,12 @@ ipset_data_set(struct ipset_data *data, enum ipset_opt opt, const void *value)
 	case IPSET_OPT_MEMSIZE:
 		data->create.memsize = *(const uint32_t *) value;
 		break;
+	case IPSET_OPT_CACHE_HITS:
+		data->create.cache_hits = *(const uint64_t *) value;
+		break;
+	case IPSET_OPT_CACHE_MISSES:
+		data->create.cache_misses = *(const uint64_t *) value;
+		break;
 	/* Create-specific options, type */
 	case IPSET_OPT_TYPENAME:
 		ipset_strlcpy(data->create.typename, value,
@@ -393,10 +407,13 @@ ipset_data_set(struct ipset_data *data, enum ipset_opt opt, const void *value)
 	case IPSET_OPT_SKBQUEUE:
 		data->adt.skbqueue = *(const uint16_t *) value;
 		break;
-	/* Swap/rename */
+	/* Swap/rename, set operations */
 	case IPSET_OPT_SETNAME2:
 		ipset_strlcpy(data->setname2, value, IPSET_MAXNAMELEN);
 		break;
+	case IPSET_OPT_SETNAME3:
+		ipset_strlcpy(data->setname3, value, IPSET_MAXNAMELEN);
+		break;
 	/* flags */
 	case IPSET_OPT_EXIST:
 		flag_type_attr(data, opt, IPSET_FLAG_EXIST);
@@ -433,6 +450,9 @@ ipset_data_set(struct ipset_data *data, enum ipset_opt opt, const void *value)
 		if (data->cadt_flags & IPSET_FLAG_WITH_SKBINFO)
 			ipset_data_flags_set(data,
 					     IPSET_FLAG(IPSET_OPT_SKBINFO));
+		if (data->cadt_flags & IPSET_FLAG_WITH_CACHE)
+			ipset_data_flags_set(data,
+					     IPSET_FLAG(IPSET_OPT_CACHE));
 		break;
 	default:
 		return -1;
@@ -515,6 +535,10 @@ ipset_data_get(const struct ipset_data *data, enum ipset_opt opt)
 		return &data->create.references;
 	case IPSET_OPT_MEMSIZE:
 		return &data->create.memsize;
+	case IPSET_OPT_CACHE_HITS:
+		return &data->create.cache_hits;
+	case IPSET_OPT_CACHE_MISSES:
+		return &data->create.cache_misses;
 	/* Create-specific options, TYPE */
 	case IPSET_OPT_REVISION:
 		return &data->create.revision;
@@ -549,9 +573,11 @@ ipset_data_get(const struct ipset_data *data, enum ipset_opt opt)
 		return &data->adt.skbprio;
 	case IPSET_OPT_SKBQUEUE:
 		return &data->adt.skbqueue;
-	/* Swap/rename */
+	/* Swap/rename, set operations */
 	case IPSET_OPT_SETNAME2:
 		return data->setname2;
+	case IPSET_OPT_SETNAME3:
+		return data->setname3;
 	/* flags */
 	case IPSET_OPT_FLAGS:
 	case IPSET_OPT_EXIST:
@@ -564,6 +590,7 @@ ipset_data_get(const struct ipset_data *data, enum ipset_opt opt)
 	case IPSET_OPT_CREATE_COMMENT:
 	case IPSET_OPT_FORCEADD:
 	case IPSET_OPT_SKBINFO:
+	case IPSET_OPT_CACHE:
 		return &data->cadt_flags;
 	default:
 		return NULL;
@@ -614,6 +641,8 @@ ipset_data_sizeof(enum ipset_opt opt, uint8_t family)
 	case IPSET_OPT_PACKETS:
 	case IPSET_OPT_BYTES:
 	case IPSET_OPT_SKBMARK:
+	case IPSET_OPT_CACHE_HITS:
+	case IPSET_OPT_CACHE_MISSES:
 		return sizeof(uint64_t);
 	case IPSET_OPT_CIDR:
 	case IPSET_OPT_CIDR2:
@@ -630,6 +659,7 @@ ipset_data_sizeof(enum ipset_opt opt, uint8_t family)
 	case IPSET_OPT_NOMATCH:
 	case IPSET_OPT_COUNTERS:
 	case IPSET_OPT_FORCEADD:
+	case IPSET_OPT_CACHE:
 		return sizeof(uint32_t);
 	case IPSET_OPT_ADT_COMMENT:
 		return IPSET_MAX_COMMENT_SIZE + 1;
@@ -23,6 +23,11 @@ static const struct ipset_attrname cmdattr2name[] = {
 	[IPSET_ATTR_ADT]	= { .name = "ADT" },
 	[IPSET_ATTR_LINENO]	= { .name = "LINENO" },
 	[IPSET_ATTR_PROTOCOL_MIN] = { .name = "PROTO_MIN" },
+	[IPSET_ATTR_INDEX]	= { .name = "INDEX" },
+	[IPSET_ATTR_INDEX_TO]	= { .name = "INDEX_TO" },
+	[IPSET_ATTR_SETNAME_PREFIX] = { .name = "SETNAME_PREFIX" },
+	[IPSET_ATTR_SETNAME3]	= { .name = "SETNAME3" },
+	[IPSET_ATTR_RESULTS]	= { .name = "RESULTS" },
 };
 
 static const struct ipset_attrname createattr2name[] = {
@@ -46,6 +51,9 @@ static const struct ipset_attrname createattr2name[] = {
 	[IPSET_ATTR_ELEMENTS]	= { .name = "ELEMENTS" },
 	[IPSET_ATTR_REFERENCES]	= { .name = "REFERENCES" },
 	[IPSET_ATTR_MEMSIZE]	= { .name = "MEMSIZE" },
+	[IPSET_ATTR_CACHE_HITS]	= { .name = "CACHE_HITS" },
+	[IPSET_ATTR_CACHE_MISSES] = { .name = "CACHE_MISSES" },
+	[IPSET_ATTR_CREATE_PAD]	= { .name = "CREATE_PAD" },
 };
 
 static const struct ipset_attrname adtattr2name[] = {
@@ -245,7 +253,7 @@ debug_cmd_attrs(int cmd, struct nlattr *nla[])
 }
 
 void
-ipset_debug_msg(const char *dir, void *buffer, int len)
+ipset_debug_msg(const char *dir, const void *buffer, int len)
 {
 	const struct nlmsghdr *nlh = buffer;
 	struct nlattr *nla[IPSET_ATTR_CMD_MAX+1] = {};
@@ -61,6 +61,29 @@ static const struct ipset_errcode_table core_errcode_table[] = {
 	{ IPSET_ERR_TYPE_MISMATCH, IPSET_CMD_SWAP,
 	  "The sets cannot be swapped: their type does not match" },
 
+	/* UNION/INTERSECT/DIFF specific error codes */
+	{ IPSET_ERR_TYPE_MISMATCH, IPSET_CMD_UNION,
+	  "The union cannot be stored: the types or parameters "
+	  "of the sets do not match" },
+	{ IPSET_ERR_TYPE_MISMATCH, IPSET_CMD_INTERSECT,
+	  "The intersection cannot be stored: the types or parameters "
+	  "of the sets do not match" },
+	{ IPSET_ERR_TYPE_MISMATCH, IPSET_CMD_DIFF,
+	  "The difference cannot be stored: the types or parameters "
+	  "of the sets do not match" },
+	{ IPSET_ERR_SETOP_TYPE, 0,
+	  "Set operations are not supported by the set type" },
+	{ IPSET_ERR_SETOP_TARGET, 0,
+	  "The target set must differ from the operand sets" },
+
+	/* REPLACE specific error codes */
+	{ IPSET_ERR_REPLACE_TYPE, 0,
+	  "Replacing the content is not supported by the set type" },
+	{ IPSET_ERR_NO_REPLACE, 0,
+	  "The set is not being replaced: the replace command is missing" },
+	{ IPSET_ERR_CACHE, 0,
+	  "The cache cannot be combined with timeout, counters or skbinfo" },
+
 	/* LIST/SAVE specific error codes */
 
 	/* Generic (CADT) error codes */
@@ -13,6 +13,8 @@
 #include <stdio.h>				/* printf */
 #include <stdlib.h>				/* exit */
 #include <string.h>				/* str* */
+#include <sys/wait.h>				/* waitpid */
+#include <unistd.h>				/* fork */
 
 #include <config.h>
 
@@ -24,7 +26,9 @@
 #include <libipset/types.h>			/* IPSET_*_ARG */
 #include <libipset/session.h>			/* ipset_envopt_parse */
 #include <libipset/parse.h>			/* ipset_parse_family */
+#include <libipset/pfxlen.h>			/* prefixlen_netmask_map */
 #include <libipset/print.h>			/* ipset_print_family */
+#include <libipset/snapshot.h>			/* ipset_snapshot_create */
 #include <libipset/utils.h>			/* STREQ */
 #include <libipset/ipset.h>			/* prototypes */
 
@@ -33,6 +37,7 @@ static char program_version[] = PACKAGE_VERSION;
 
 #define MAX_CMDLINE_CHARS			1024
 #define MAX_ARGS				32
+#define MAX_PARALLEL				64
 
 /* The ipset structure */
 struct ipset {
@@ -49,6 +54,9 @@ struct ipset {
 	char *newargv[MAX_ARGS];
 	int newargc;
 	const char *filename;			/* Input/output filename */
+	enum ipset_output_mode output;		/* Output mode by -output */
+	unsigned int parallel;			/* Parallel save sessions */
+	bool elem_filter;			/* Element filter by -match-* */
 };
 
 /* Commands and environment options */
@@ -84,6 +92,14 @@ const struct ipset_commands ipset_commands[] = {
 		.help = "SETNAME ENTRY\n"
 			"        Test entry in the named set",
 	},
+	{	/* test-b[atch] */
+		.cmd = IPSET_CMD_TEST_BATCH,
+		.name = { "test-batch", NULL },
+		.has_arg = IPSET_MANDATORY_ARG,
+		.help = "SETNAME\n"
+			"        Test the entries from stdin in the named set,\n"
+			"        print 1 or 0 for each of them",
+	},
 	{	/* des[troy], --destroy, x, -X */
 		.cmd = IPSET_CMD_DESTROY,
 		.name = { "destroy", "x", "-X" },
@@ -133,6 +149,56 @@ const struct ipset_commands ipset_commands[] = {
 		.help = "FROM-SETNAME TO-SETNAME\n"
 			"        Swap the contect of two existing sets",
 	},
+	{	/* u[nion] */
+		.cmd = IPSET_CMD_UNION,
+		.name = { "union", NULL },
+		.has_arg = IPSET_MANDATORY_ARG3,
+		.help = "TO-SETNAME SETNAME1 SETNAME2\n"
+			"        Store the union of two sets in a third one",
+	},
+	{	/* i[ntersect] */
+		.cmd = IPSET_CMD_INTERSECT,
+		.name = { "intersect", NULL },
+		.has_arg = IPSET_MANDATORY_ARG3,
+		.help = "TO-SETNAME SETNAME1 SETNAME2\n"
+			"        Store the intersection of two sets "
+			"in a third one",
+	},
+	{	/* di[ff] */
+		.cmd = IPSET_CMD_DIFF,
+		.name = { "diff", NULL },
+		.has_arg = IPSET_MANDATORY_ARG3,
+		.help = "TO-SETNAME SETNAME1 SETNAME2\n"
+			"        Store the elements of SETNAME1 "
+			"missing from SETNAME2 in a third set",
+	},
+	{	/* sy[nc] */
+		.cmd = IPSET_CMD_SYNC,
+		.name = { "sync", NULL },
+		.has_arg = IPSET_MANDATORY_ARG,
+		.help = "SETNAME\n"
+			"        Make the set content equal to the element "
+			"list from stdin,\n"
+			"        by adding and deleting the differences only",
+	},
+	{	/* sn[apshot] */
+		.cmd = IPSET_CMD_SNAPSHOT,
+		.name = { "snapshot", NULL },
+		.has_arg = IPSET_MANDATORY_ARG2,
+		.help = "SETNAME FILENAME\n"
+			"        Store the addresses of the set in a file "
+			"for lookups\n"
+			"        from userspace by libipset",
+	},
+	{	/* rep[lace] */
+		.cmd = IPSET_CMD_REPLACE,
+		.name = { "replace", NULL },
+		.has_arg = IPSET_MANDATORY_ARG,
+		.help = "SETNAME\n"
+			"        Replace the content of the set with the "
+			"elements added\n"
+			"        until COMMIT, in restore mode only",
+	},
 	{	/* h[elp, --help, -H */
 		.cmd = IPSET_CMD_HELP,
 		.name = { "help", "-h", "-H" },
@@ -202,6 +268,7 @@ ipset_match_cmd(const char *arg, const char * const name[])
  *	-n		-name
  *	-N		create
  *	-o		-output
+ *	-p		-parallel
  *	-r		-resolve
  *	-R		restore
  *	-s		-sorted
@@ -272,6 +339,33 @@ const struct ipset_envopts ipset_envopts[] = {
 		  "        input (restore) or write to given file instead\n"
 		  "        of standard output (list/save).",
 	},
+	{ .name = { "-p", "-parallel" },
+	  .parse = ipset_parse_parallel,
+	  .has_arg = IPSET_MANDATORY_ARG,	.flag = IPSET_OPT_MAX,
+	  .help = "N\n"
+		  "        Save all sets over N parallel sessions.",
+	},
+	{ .name = { "-match-ip", NULL },
+	  .parse = ipset_parse_elem_filter,
+	  .has_arg = IPSET_MANDATORY_ARG,	.flag = IPSET_OPT_IP,
+	  .help = "ADDR[/CIDR]\n"
+		  "        When listing, list the elements within the\n"
+		  "        network only.",
+	},
+	{ .name = { "-match-port", NULL },
+	  .parse = ipset_parse_elem_filter,
+	  .has_arg = IPSET_MANDATORY_ARG,	.flag = IPSET_OPT_PORT,
+	  .help = "PORT[-PORT]\n"
+		  "        When listing, list the elements with port\n"
+		  "        in the range only.",
+	},
+	{ .name = { "-match-comment", NULL },
+	  .parse = ipset_parse_elem_filter,
+	  .has_arg = IPSET_MANDATORY_ARG,	.flag = IPSET_OPT_ADT_COMMENT,
+	  .help = "STRING\n"
+		  "        When listing, list the elements with comment\n"
+		  "        containing the string only.",
+	},
 	{ },
 };
 
@@ -411,14 +505,67 @@ ipset_parse_output(struct ipset *ipset,
 
 	session = ipset_session(ipset);
 	if (STREQ(str, "plain"))
-		return ipset_session_output(session, IPSET_LIST_PLAIN);
+		ipset->output = IPSET_LIST_PLAIN;
 	else if (STREQ(str, "xml"))
-		return ipset_session_output(session, IPSET_LIST_XML);
+		ipset->output = IPSET_LIST_XML;
 	else if (STREQ(str, "save"))
-		return ipset_session_output(session, IPSET_LIST_SAVE);
+		ipset->output = IPSET_LIST_SAVE;
+	else
+		return ipset_err(session,
+			"Syntax error: unknown output mode '%s'", str);
 
-	return ipset_err(session,
-		"Syntax error: unknown output mode '%s'", str);
+	return ipset_session_output(session, ipset->output);
+}
+
+/**
+ * ipset_parse_parallel - parse the number of parallel save sessions
+ * @ipset: ipset structure
+ * @opt: option kind of the data
+ * @str: string to parse
+ *
+ * Parse the argument of the "-parallel" option.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int
+ipset_parse_parallel(struct ipset *ipset,
+		     int opt UNUSED, const char *str)
+{
+	void *p = ipset_session_printf_private(ipset->session);
+	unsigned long num;
+	char *end;
+
+	errno = 0;
+	num = strtoul(str, &end, 10);
+	if (errno || end == str || *end != '\0' ||
+	    num < 1 || num > MAX_PARALLEL)
+		return ipset->custom_error(ipset, p, IPSET_PARAMETER_PROBLEM,
+			"Number of parallel sessions must be "
+			"between 1 and %u", MAX_PARALLEL);
+	ipset->parallel = num;
+
+	return 0;
+}
+
+/**
+ * ipset_parse_elem_filter - parse an element filter of list/save
+ * @ipset: ipset structure
+ * @opt: IPSET_OPT_IP, IPSET_OPT_PORT or IPSET_OPT_ADT_COMMENT
+ * @str: string to parse
+ *
+ * Parse the argument of the "-match-ip", "-match-port" and
+ * "-match-comment" options. The filter is stored in the session.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int
+ipset_parse_elem_filter(struct ipset *ipset, int opt, const char *str)
+{
+	assert(ipset);
+	assert(str);
+
+	ipset->elem_filter = true;
+	return ipset_session_elem_filter(ipset->session, opt, str);
 }
 
 /**
@@ -922,6 +1069,624 @@ static const char *cmd_prefix[] = {
 	[IPSET_TEST]   = "test   SETNAME",
 };
 
+/* Parallel save */
+
+static int __attribute__((format(printf, 3, 4)))
+count_setnames(struct ipset_session *session UNUSED, void *p,
+	       const char *fmt, ...)
+{
+	unsigned int *count = p;
+	va_list args, copy;
+	char *buf, *c;
+	int len;
+
+	/* The setnames are printed line by line in LIST_SETNAME mode */
+	va_start(args, fmt);
+	va_copy(copy, args);
+	len = vsnprintf(NULL, 0, fmt, copy);
+	va_end(copy);
+	buf = len < 0 ? NULL : malloc(len + 1);
+	if (buf) {
+		vsnprintf(buf, len + 1, fmt, args);
+		for (c = buf; (c = strchr(c, '\n')) != NULL; c++)
+			(*count)++;
+		free(buf);
+	} else
+		len = -1;
+	va_end(args);
+
+	return len;
+}
+
+static int
+save_range(struct ipset_session *parent, uint16_t from, uint16_t to)
+{
+	struct ipset_session *session;
+	int ret;
+
+	session = ipset_session_init(NULL, NULL);
+	if (session == NULL)
+		return -1;
+	if (ipset_envopt_test(parent, IPSET_ENV_SORTED))
+		ipset_envopt_set(session, IPSET_ENV_SORTED);
+	if (ipset_envopt_test(parent, IPSET_ENV_RESOLVE))
+		ipset_envopt_set(session, IPSET_ENV_RESOLVE);
+
+	ret = ipset_session_dump_filter(session, from, to, NULL,
+					IPSET_FLAG_LIST_SKIP_LAST);
+	if (ret == 0)
+		ret = ipset_cmd(session, IPSET_CMD_SAVE, 0);
+	if (ret < 0 && ipset_session_report_msg(session)[0])
+		fprintf(stderr, "%s v%s: %s\n", program_name, program_version,
+			ipset_session_report_msg(session));
+	fflush(stdout);
+	ipset_session_fini(session);
+
+	return ret;
+}
+
+/*
+ * Save all sets over ipset->parallel sessions. The set index space is
+ * split into consecutive ranges, which are dumped by child processes
+ * into temporary files, skipping the list:set type of sets. The files
+ * are then concatenated in order and the list:set type of sets are
+ * saved last, so the result is identical to the output of a serial save.
+ */
+static int
+parallel_save(struct ipset *ipset)
+{
+	struct ipset_session *session = ipset->session;
+	void *p = ipset_session_printf_private(session);
+	struct ipset_session *counter;
+	FILE *tmp[MAX_PARALLEL] = {}, *out;
+	pid_t pid[MAX_PARALLEL] = {};
+	unsigned int i, n, count = 0, chunk, failed = 0;
+	char buf[4096];
+	size_t len;
+	int ret, status;
+
+	/* Count the sets to split the index space evenly */
+	counter = ipset_session_init(count_setnames, &count);
+	if (counter == NULL)
+		return ipset->custom_error(ipset, p, IPSET_OTHER_PROBLEM,
+			"Cannot allocate memory for the session");
+	ipset_envopt_set(counter, IPSET_ENV_LIST_SETNAME);
+	ret = ipset_cmd(counter, IPSET_CMD_LIST, 0);
+	ipset_session_fini(counter);
+	if (ret < 0)
+		return ipset_cmd(session, IPSET_CMD_SAVE, ipset->restore_line);
+
+	n = count < ipset->parallel ? count : ipset->parallel;
+	if (n <= 1)
+		return ipset_cmd(session, IPSET_CMD_SAVE, ipset->restore_line);
+	chunk = (count + n - 1) / n;
+
+	out = ipset_session_io_stream(session, IPSET_IO_OUTPUT);
+	fflush(out);
+	fflush(stdout);
+	for (i = 0; i < n; i++) {
+		uint16_t from = i * chunk;
+		uint16_t to = i + 1 == n ? IPSET_INVALID_ID - 1
+					 : (i + 1) * chunk - 1;
+
+		tmp[i] = tmpfile();
+		if (tmp[i] == NULL) {
+			failed++;
+			break;
+		}
+		pid[i] = fork();
+		if (pid[i] < 0) {
+			failed++;
+			break;
+		} else if (pid[i] == 0) {
+			if (dup2(fileno(tmp[i]), STDOUT_FILENO) < 0)
+				_exit(IPSET_OTHER_PROBLEM);
+			ret = save_range(session, from, to);
+			_exit(ret < 0 ? IPSET_OTHER_PROBLEM : IPSET_NO_PROBLEM);
+		}
+	}
+	for (i = 0; i < n; i++) {
+		if (pid[i] <= 0)
+			continue;
+		if (waitpid(pid[i], &status, 0) < 0 ||
+		    !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed++;
+	}
+	for (i = 0; i < n && tmp[i]; i++) {
+		rewind(tmp[i]);
+		while (!failed && (len = fread(buf, 1, sizeof(buf), tmp[i])))
+			if (fwrite(buf, 1, len, out) != len)
+				failed++;
+		fclose(tmp[i]);
+	}
+	if (failed)
+		return ipset->custom_error(ipset, p, IPSET_OTHER_PROBLEM,
+			"Parallel save failed");
+
+	/* Finally the list:set type of sets, which may refer to any set */
+	ret = ipset_session_dump_filter(session, 0, IPSET_INVALID_ID - 1,
+					NULL, IPSET_FLAG_LIST_ONLY_LAST);
+	if (ret < 0)
+		return ret;
+	return ipset_cmd(session, IPSET_CMD_SAVE, ipset->restore_line);
+}
+
+/* Differential sync */
+
+/* An element of the set or of the desired list, keyed by its canonical
+ * form: the element as printed by save, followed by the element options
+ * which are not changed by the kernel.
+ */
+struct sync_entry {
+	char *key;				/* Canonical element and options */
+	size_t elemlen;				/* Length of the element in key */
+	bool wanted;				/* Element is in the list */
+};
+
+/* Open addressing hash of the elements */
+struct sync_index {
+	struct sync_entry *entries;
+	size_t size;				/* Power of two */
+	size_t count;
+	struct ipset *ipset;
+	const char *setname;
+	uint8_t netmask;			/* Netmask of the set or 0 */
+	bool failed;
+};
+
+/* The options which are part of the key: timeouts and counters change
+ * in the kernel, so those are not compared.
+ */
+static const enum ipset_keywords sync_key_args[] = {
+	IPSET_ARG_NOMATCH,
+	IPSET_ARG_ADT_COMMENT,
+	IPSET_ARG_SKBMARK,
+	IPSET_ARG_SKBPRIO,
+	IPSET_ARG_SKBQUEUE,
+};
+
+static size_t
+sync_hash(const char *key)
+{
+	size_t hash = 2166136261U;		/* FNV-1a */
+
+	for (; *key; key++)
+		hash = (hash ^ (unsigned char)*key) * 16777619U;
+	return hash;
+}
+
+static struct sync_entry *
+sync_lookup(struct sync_index *idx, const char *key, bool *found)
+{
+	size_t i;
+
+	if (idx->count * 2 >= idx->size) {
+		struct sync_entry *entries = idx->entries;
+		size_t j, size = idx->size;
+
+		idx->size = size ? size * 2 : 1024;
+		idx->entries = calloc(idx->size, sizeof(*idx->entries));
+		if (idx->entries == NULL) {
+			idx->entries = entries;
+			idx->size = size;
+			return NULL;
+		}
+		for (j = 0; j < size; j++) {
+			if (entries[j].key == NULL)
+				continue;
+			i = sync_hash(entries[j].key) & (idx->size - 1);
+			while (idx->entries[i].key)
+				i = (i + 1) & (idx->size - 1);
+			idx->entries[i] = entries[j];
+		}
+		free(entries);
+	}
+	for (i = sync_hash(key) & (idx->size - 1);
+	     idx->entries[i].key;
+	     i = (i + 1) & (idx->size - 1)) {
+		if (STREQ(idx->entries[i].key, key)) {
+			*found = true;
+			return &idx->entries[i];
+		}
+	}
+	*found = false;
+	idx->entries[i].key = strdup(key);
+	if (idx->entries[i].key == NULL)
+		return NULL;
+	idx->count++;
+	return &idx->entries[i];
+}
+
+static void
+sync_index_free(struct sync_index *idx)
+{
+	size_t i;
+
+	for (i = 0; i < idx->size; i++)
+		free(idx->entries[i].key);
+	free(idx->entries);
+}
+
+/* Mask the address of the element dimension as the kernel stores it */
+static void
+sync_mask_ip(struct ipset_data *data, enum ipset_opt opt, uint8_t cidr)
+{
+	union nf_inet_addr ip;
+	int i;
+
+	memcpy(&ip, ipset_data_get(data, opt), sizeof(ip));
+	for (i = 0; i < 4; i++)
+		ip.ip6[i] &= prefixlen_netmask_map[cidr].ip6[i];
+	ipset_data_set(data, opt, &ip);
+}
+
+/*
+ * Canonical form of a line "ELEM [options]" of the desired list or of
+ * the saved set: the line is parsed by the session and printed back.
+ * Network addresses are masked by their prefix length and host addresses
+ * by the netmask of the set, as the kernel does when adding them.
+ */
+static int
+sync_elem_key(struct sync_index *idx, char *line, bool input,
+	      char *key, size_t len, size_t *elemlen)
+{
+	struct ipset *ipset = idx->ipset;
+	struct ipset_session *session = ipset->session;
+	struct ipset_data *data = ipset_session_data(session);
+	const struct ipset_type *type;
+	const struct ipset_arg *arg;
+	enum ipset_opt cidropt;
+	int argc, ret, offset, i;
+	bool single;
+
+	ret = build_argv(ipset, line);
+	if (ret < 0)
+		return ret;
+	if (ipset->newargc < 2)
+		return ipset_err(session, "Missing element");
+
+	ipset_data_reset(data);
+	if (ipset_parse_setname(session, IPSET_SETNAME, idx->setname) < 0)
+		return -1;
+	type = ipset_type_get(session, IPSET_CMD_ADD);
+	if (type == NULL ||
+	    ipset_parse_elem(session, type->last_elem_optional,
+			     ipset->newargv[1]) < 0)
+		return -1;
+	if (input &&
+	    (ipset_data_test(data, IPSET_OPT_IP_TO) ||
+	     ipset_data_test(data, IPSET_OPT_IP2_TO) ||
+	     ipset_data_test(data, IPSET_OPT_PORT_TO)))
+		return ipset_err(session,
+			"Ranges are not supported in sync mode: %s",
+			ipset->newargv[1]);
+	for (i = 0; i < type->dimension; i++) {
+		if (type->elem[i].opt != IPSET_OPT_IP &&
+		    type->elem[i].opt != IPSET_OPT_IP2)
+			continue;
+		cidropt = type->elem[i].opt == IPSET_OPT_IP ?
+			IPSET_OPT_CIDR : IPSET_OPT_CIDR2;
+		single = type->elem[i].parse == ipset_parse_ip ||
+			 type->elem[i].parse == ipset_parse_ip4_single6 ||
+			 type->elem[i].parse == ipset_parse_single_ip;
+		if (!ipset_data_test(data, type->elem[i].opt))
+			continue;
+		if (single && ipset_data_test(data, cidropt)) {
+			/* An address block of single address elements */
+			if (input)
+				return ipset_err(session,
+					"Ranges are not supported "
+					"in sync mode: %s", ipset->newargv[1]);
+		} else if (ipset_data_test(data, cidropt))
+			sync_mask_ip(data, type->elem[i].opt,
+				     *(const uint8_t *)
+				     ipset_data_get(data, cidropt));
+		else if (single && idx->netmask)
+			sync_mask_ip(data, type->elem[i].opt, idx->netmask);
+	}
+
+	/* The options, the element is skipped as argv[0] */
+	argc = ipset->newargc - 1;
+	ret = call_parser(ipset, &argc, ipset->newargv + 1, type, IPSET_ADD,
+			  false);
+	if (ret < 0)
+		return ret;
+	/* The parsed flags are stored in the CADT flags only */
+	if (ipset_data_test(data, IPSET_OPT_CADT_FLAGS))
+		ipset_data_set(data, IPSET_OPT_CADT_FLAGS,
+			       ipset_data_get(data, IPSET_OPT_CADT_FLAGS));
+
+	offset = ipset_print_elem(key, len, data, IPSET_OPT_NONE, 0);
+	if (offset < 0 || (size_t)offset >= len)
+		return ipset_err(session, "Element is too long: %s",
+				 ipset->newargv[1]);
+	*elemlen = offset;
+	for (i = 0; i < (int)ARRAY_SIZE(sync_key_args); i++) {
+		arg = ipset_keyword(sync_key_args[i]);
+		if (!ipset_data_test(data, arg->opt))
+			continue;
+		ret = snprintf(key + offset, len - offset, " %s",
+			       arg->name[0]);
+		if (ret >= 0 && (size_t)ret < len - offset &&
+		    arg->has_arg != IPSET_NO_ARG) {
+			offset += ret;
+			ret = snprintf(key + offset, len - offset, " ");
+			if (ret >= 0 && (size_t)ret < len - offset) {
+				offset += ret;
+				ret = arg->print(key + offset, len - offset,
+						 data, arg->opt, 0);
+			}
+		}
+		if (ret < 0 || (size_t)ret >= len - offset)
+			return ipset_err(session, "Element is too long: %s",
+					 ipset->newargv[1]);
+		offset += ret;
+	}
+	return 0;
+}
+
+/* Index the "add SETNAME ELEM [options]" lines of the saved set and
+ * pick up the netmask from the "create" line.
+ */
+static void
+sync_index_line(void *p, char *line)
+{
+	struct sync_index *idx = p;
+	size_t len = strlen(idx->setname), elemlen;
+	char key[MAX_CMDLINE_CHARS], *c;
+	struct sync_entry *e;
+	bool found;
+
+	if (strncmp(line, "create ", 7) == 0 &&
+	    strncmp(line + 7, idx->setname, len) == 0 &&
+	    line[7 + len] == ' ') {
+		c = strstr(line + 7 + len, " netmask ");
+		if (c)
+			idx->netmask = atoi(c + 9);
+		return;
+	}
+	if (idx->failed ||
+	    strncmp(line, "add ", 4) != 0 ||
+	    strncmp(line + 4, idx->setname, len) != 0 ||
+	    line[4 + len] != ' ')
+		return;
+	if (sync_elem_key(idx, line + 4 + len + 1, false,
+			  key, sizeof(key), &elemlen) < 0) {
+		idx->failed = true;
+		return;
+	}
+	e = sync_lookup(idx, key, &found);
+	if (e == NULL)
+		idx->failed = true;
+	else
+		e->elemlen = elemlen;
+}
+
+/*
+ * Make the content of the set equal to the element list read from the
+ * input, one element with optional add options per line. The set is
+ * saved once and indexed by the canonical form of the elements and of
+ * their options. The list is compared against the index, and only the
+ * missing elements are added and the not listed ones deleted, in restore
+ * mode batches. An element listed with changed options is deleted and
+ * added again. Timeouts and counters are not compared: those are set
+ * for the added elements only.
+ */
+static int
+sync_set(struct ipset *ipset, const char *name)
+{
+	struct ipset_session *session = ipset->session;
+	void *p = ipset_session_printf_private(session);
+	struct sync_index idx = { .ipset = ipset };
+	struct sync_entry *e;
+	char **adds = NULL, key[MAX_CMDLINE_CHARS], cmd[MAX_CMDLINE_CHARS];
+	char setname[IPSET_MAXNAMELEN];
+	uint32_t *addlines = NULL;
+	unsigned int nadd = 0, ndel = 0, unchanged = 0, maxadd = 0, i;
+	bool exist = ipset_envopt_test(session, IPSET_ENV_EXIST);
+	FILE *f = stdin;
+	size_t elemlen;
+	char *elem;
+	bool found;
+	int ret;
+
+	/* The arguments may be freed when the lines are parsed */
+	if (strlen(name) >= sizeof(setname))
+		return ipset->custom_error(ipset, p, IPSET_PARAMETER_PROBLEM,
+			"Setname '%s' is longer than %u characters",
+			name, IPSET_MAXNAMELEN - 1);
+	strcpy(setname, name);
+	idx.setname = setname;
+	if (ipset->filename) {
+		ret = ipset_session_io_normal(session, ipset->filename,
+					      IPSET_IO_INPUT);
+		if (ret < 0)
+			return ipset->standard_error(ipset, p);
+		f = ipset_session_io_stream(session, IPSET_IO_INPUT);
+		ipset->filename = NULL;
+	}
+
+	/* Index the current content of the set */
+	ret = ipset_session_save_lines(session, setname, sync_index_line,
+				       &idx);
+	if (ret < 0) {
+		ret = ipset->standard_error(ipset, p);
+		goto out;
+	}
+	if (idx.failed) {
+		ret = ipset_session_report_msg(session)[0] ?
+			ipset->standard_error(ipset, p) :
+			ipset->custom_error(ipset, p, IPSET_OTHER_PROBLEM,
+				"Cannot allocate memory for the element index");
+		goto out;
+	}
+
+	/* Compare the list with the index, collect the elements to add */
+	while (fgets(ipset->cmdline, sizeof(ipset->cmdline), f)) {
+		ipset->restore_line++;
+		elem = ipset->cmdline;
+		while (isspace(elem[0]))
+			elem++;
+		if (elem[0] == '\0' || elem[0] == '#')
+			continue;
+		ret = sync_elem_key(&idx, elem, true, key, sizeof(key),
+				    &elemlen);
+		if (ret < 0) {
+			ret = ipset->standard_error(ipset, p);
+			goto out;
+		}
+		e = sync_lookup(&idx, key, &found);
+		if (e == NULL) {
+			ret = ipset->custom_error(ipset, p, IPSET_OTHER_PROBLEM,
+				"Cannot allocate memory for the element index");
+			goto out;
+		}
+		if (e->wanted)
+			/* Listed twice */
+			continue;
+		e->wanted = true;
+		if (found) {
+			unchanged++;
+			continue;
+		}
+		e->elemlen = elemlen;
+		if (nadd == maxadd) {
+			unsigned int max = maxadd ? maxadd * 2 : 64;
+			char **a = realloc(adds, max * sizeof(*adds));
+			uint32_t *l = NULL;
+
+			if (a != NULL) {
+				adds = a;
+				l = realloc(addlines, max * sizeof(*addlines));
+			}
+			if (l == NULL) {
+				ret = ipset->custom_error(ipset, p,
+					IPSET_OTHER_PROBLEM,
+					"Cannot allocate memory for the elements");
+				goto out;
+			}
+			addlines = l;
+			maxadd = max;
+		}
+		adds[nadd] = strdup(elem);
+		if (adds[nadd] == NULL) {
+			ret = ipset->custom_error(ipset, p, IPSET_OTHER_PROBLEM,
+				"Cannot allocate memory for the elements");
+			goto out;
+		}
+		addlines[nadd++] = ipset->restore_line;
+	}
+
+	/* Send the difference: elements which may have been added or
+	 * timed out in the meantime are not errors. The deletes are
+	 * batched in restore mode too, even when the list is empty.
+	 */
+	ipset_data_reset(ipset_session_data(session));
+	ipset_envopt_set(session, IPSET_ENV_EXIST);
+	if (ipset->restore_line == 0)
+		ipset->restore_line = 1;
+	for (i = 0; i < idx.size; i++) {
+		e = &idx.entries[i];
+		if (e->key == NULL || e->wanted)
+			continue;
+		snprintf(cmd, sizeof(cmd), "del %s %.*s", setname,
+			 (int)e->elemlen, e->key);
+		ret = ipset_parse_line(ipset, cmd);
+		if (ret < 0)
+			goto out;
+		ndel++;
+	}
+	for (i = 0; i < nadd; i++) {
+		ipset->restore_line = addlines[i];
+		snprintf(cmd, sizeof(cmd), "add %s %s", setname, adds[i]);
+		ret = ipset_parse_line(ipset, cmd);
+		if (ret < 0)
+			goto out;
+	}
+	ret = ipset_commit(session);
+	if (ret < 0) {
+		ret = ipset->standard_error(ipset, p);
+		goto out;
+	}
+	if (!ipset_envopt_test(session, IPSET_ENV_QUIET))
+		printf("%s: %u added, %u deleted, %u unchanged\n",
+		       setname, nadd, ndel, unchanged);
+out:
+	if (!exist)
+		ipset_envopt_unset(session, IPSET_ENV_EXIST);
+	ipset->restore_line = 0;
+	for (i = 0; i < nadd; i++)
+		free(adds[i]);
+	free(adds);
+	free(addlines);
+	sync_index_free(&idx);
+	return ret;
+}
+
+/* Batched tests */
+
+/*
+ * Test the elements read from the input, one element per line, in the
+ * set. The elements are sent to the kernel in as few messages as
+ * possible and the results are printed in the order of the elements:
+ * 1 if the element is in the set, 0 otherwise.
+ */
+static int
+test_batch(struct ipset *ipset, const char *setname)
+{
+	struct ipset_session *session = ipset->session;
+	void *p = ipset_session_printf_private(session);
+	const struct ipset_type *type;
+	const uint8_t *results;
+	uint32_t count, i;
+	FILE *f = stdin;
+	char *c, *elem;
+	int ret;
+
+	if (ipset->filename) {
+		ret = ipset_session_io_normal(session, ipset->filename,
+					      IPSET_IO_INPUT);
+		if (ret < 0)
+			return ret;
+		f = ipset_session_io_stream(session, IPSET_IO_INPUT);
+	}
+	ipset_test_batch_reset(session);
+	while (fgets(ipset->cmdline, sizeof(ipset->cmdline), f)) {
+		ipset->restore_line++;
+		elem = ipset->cmdline;
+		while (isspace(elem[0]))
+			elem++;
+		if (elem[0] == '\0' || elem[0] == '#')
+			continue;
+		for (c = elem; *c && !isspace(*c); c++)
+			;
+		*c = '\0';
+		ret = ipset_parse_setname(session, IPSET_SETNAME, setname);
+		if (ret < 0)
+			return ipset->standard_error(ipset, p);
+		type = ipset_type_get(session, IPSET_CMD_TEST);
+		if (type == NULL)
+			return ipset->standard_error(ipset, p);
+		ret = ipset_parse_elem(session, type->last_elem_optional, elem);
+		if (ret < 0)
+			return ipset->standard_error(ipset, p);
+		ret = ipset_cmd(session, IPSET_CMD_TEST_BATCH,
+				ipset->restore_line);
+		if (ret < 0)
+			return ipset->standard_error(ipset, p);
+	}
+	ret = ipset_commit(session);
+	if (ret < 0)
+		return ipset->standard_error(ipset, p);
+
+	results = ipset_test_batch_results(session, &count);
+	if (!ipset_envopt_test(session, IPSET_ENV_QUIET))
+		for (i = 0; i < count; i++)
+			printf("%u\n", !!(results[i / 8] & (1 << (i % 8))));
+	ipset_test_batch_reset(session);
+	return 0;
+}
+
 /* Workhorses */
 
 /**
@@ -940,7 +1705,7 @@ ipset_parse_argv(struct ipset *ipset, int oargc, char *oargv[])
 	int ret = 0;
 	enum ipset_cmd cmd = IPSET_CMD_NONE;
 	int i;
-	char *arg0 = NULL, *arg1 = NULL;
+	char *arg0 = NULL, *arg1 = NULL, *arg2 = NULL;
 	const struct ipset_envopts *opt;
 	const struct ipset_commands *command;
 	const struct ipset_type *type;
@@ -1005,6 +1770,9 @@ ipset_parse_argv(struct ipset *ipset, int oargc, char *oargv[])
 
 		if (ipset->restore_line != 0 &&
 		    (command->cmd == IPSET_CMD_RESTORE ||
+		     command->cmd == IPSET_CMD_SYNC ||
+		     command->cmd == IPSET_CMD_SNAPSHOT ||
+		     command->cmd == IPSET_CMD_TEST_BATCH ||
 		     command->cmd == IPSET_CMD_VERSION ||
 		     command->cmd == IPSET_CMD_HELP))
 			return ipset->custom_error(ipset, p,
@@ -1012,6 +1780,13 @@ ipset_parse_argv(struct ipset *ipset, int oargc, char *oargv[])
 				"Command `%s' is invalid "
 				"in restore mode.",
 				command->name[0]);
+		if (ipset->restore_line == 0 &&
+		    command->cmd == IPSET_CMD_REPLACE)
+			return ipset->custom_error(ipset, p,
+				IPSET_PARAMETER_PROBLEM,
+				"Command `%s' is valid "
+				"in restore mode only.",
+				command->name[0]);
 		if (ipset->interactive && command->cmd == IPSET_CMD_RESTORE) {
 			printf("Restore command is not supported "
 			       "in interactive mode\n");
@@ -1024,6 +1799,7 @@ ipset_parse_argv(struct ipset *ipset, int oargc, char *oargv[])
 		switch (command->has_arg) {
 		case IPSET_MANDATORY_ARG:
 		case IPSET_MANDATORY_ARG2:
+		case IPSET_MANDATORY_ARG3:
 			if (argc < 2)
 				return ipset->custom_error(ipset, p,
 					IPSET_PARAMETER_PROBLEM,
@@ -1040,7 +1816,8 @@ ipset_parse_argv(struct ipset *ipset, int oargc, char *oargv[])
 		default:
 			break;
 		}
-		if (command->has_arg == IPSET_MANDATORY_ARG2) {
+		if (command->has_arg == IPSET_MANDATORY_ARG2 ||
+		    command->has_arg == IPSET_MANDATORY_ARG3) {
 			if (argc < 2)
 				return ipset->custom_error(ipset, p,
 					IPSET_PARAMETER_PROBLEM,
@@ -1051,6 +1828,17 @@ ipset_parse_argv(struct ipset *ipset, int oargc, char *oargv[])
 			/* Shift off second arg */
 			ipset_shift_argv(&argc, argv, 1);
 		}
+		if (command->has_arg == IPSET_MANDATORY_ARG3) {
+			if (argc < 2)
+				return ipset->custom_error(ipset, p,
+					IPSET_PARAMETER_PROBLEM,
+					"Missing third mandatory "
+					"argument to command %s",
+					command->name[0]);
+			arg2 = argv[1];
+			/* Shift off third arg */
+			ipset_shift_argv(&argc, argv, 1);
+		}
 		break;
 	}
 
@@ -1201,6 +1989,19 @@ ipset_parse_argv(struct ipset *ipset, int oargc, char *oargv[])
 		break;
 	case IPSET_CMD_LIST:
 	case IPSET_CMD_SAVE:
+		if (ipset->parallel > 1 &&
+		    (cmd != IPSET_CMD_SAVE ||
+		     (ipset->output != IPSET_LIST_NONE &&
+		      ipset->output != IPSET_LIST_SAVE)))
+			return ipset->custom_error(ipset, p,
+				IPSET_PARAMETER_PROBLEM,
+				"-parallel is supported by the save command "
+				"in save output mode only");
+		if (ipset->parallel > 1 && ipset->elem_filter)
+			return ipset->custom_error(ipset, p,
+				IPSET_PARAMETER_PROBLEM,
+				"-parallel cannot be used together with "
+				"the -match-* options");
 		if (ipset->filename != NULL) {
 			ret = ipset_session_io_normal(session,
 					ipset->filename, IPSET_IO_OUTPUT);
@@ -1230,6 +2031,58 @@ ipset_parse_argv(struct ipset *ipset, int oargc, char *oargv[])
 			return ipset->standard_error(ipset, p);
 		break;
 
+	case IPSET_CMD_UNION:
+	case IPSET_CMD_INTERSECT:
+	case IPSET_CMD_DIFF:
+		/* Args: to-setname setname1 setname2 */
+		ret = ipset_parse_setname(session, IPSET_SETNAME, arg0);
+		if (ret < 0)
+			return ipset->standard_error(ipset, p);
+		ret = ipset_parse_setname(session, IPSET_OPT_SETNAME2, arg1);
+		if (ret < 0)
+			return ipset->standard_error(ipset, p);
+		ret = ipset_parse_setname(session, IPSET_OPT_SETNAME3, arg2);
+		if (ret < 0)
+			return ipset->standard_error(ipset, p);
+		break;
+
+	case IPSET_CMD_SYNC:
+		/* Args: setname */
+		if (argc > 1)
+			return ipset->custom_error(ipset,
+				p, IPSET_PARAMETER_PROBLEM,
+				"Unknown argument %s", argv[1]);
+		return sync_set(ipset, arg0);
+
+	case IPSET_CMD_TEST_BATCH:
+		/* Args: setname */
+		if (argc > 1)
+			return ipset->custom_error(ipset,
+				p, IPSET_PARAMETER_PROBLEM,
+				"Unknown argument %s", argv[1]);
+		return test_batch(ipset, arg0);
+
+	case IPSET_CMD_SNAPSHOT:
+		/* Args: setname filename */
+		if (argc > 1)
+			return ipset->custom_error(ipset,
+				p, IPSET_PARAMETER_PROBLEM,
+				"Unknown argument %s", argv[1]);
+		ret = ipset_snapshot_create(session, arg0, arg1);
+		if (ret < 0)
+			return ipset->standard_error(ipset, p);
+		return ret;
+
+	case IPSET_CMD_REPLACE:
+		/* Args: setname */
+		ret = ipset_replace_publish(session);
+		if (ret < 0)
+			return ipset->standard_error(ipset, p);
+		ret = ipset_parse_setname(session, IPSET_SETNAME, arg0);
+		if (ret < 0)
+			return ipset->standard_error(ipset, p);
+		break;
+
 	case IPSET_CMD_RESTORE:
 		/* Restore mode */
 		if (argc > 1)
@@ -1273,7 +2126,11 @@ ipset_parse_argv(struct ipset *ipset, int oargc, char *oargv[])
 	if (argc > 1)
 		return ipset->custom_error(ipset, p, IPSET_PARAMETER_PROBLEM,
 			"Unknown argument %s", argv[1]);
-	ret = ipset_cmd(session, cmd, ipset->restore_line);
+	if (cmd == IPSET_CMD_SAVE && ipset->parallel > 1 &&
+	    !ipset_data_test(ipset_session_data(session), IPSET_SETNAME))
+		ret = parallel_save(ipset);
+	else
+		ret = ipset_cmd(session, cmd, ipset->restore_line);
 	D("ret %d", ret);
 	/* In the case of warning, the return code is success */
 	if (ret < 0 || ipset_session_report_type(session) > IPSET_NO_ERROR)
@@ -1340,6 +2197,8 @@ ipset_parse_stream(struct ipset *ipset, FILE *f)
 			continue;
 		else if (STREQ(c, "COMMIT\n") || STREQ(c, "COMMIT\r\n")) {
 			ret = ipset_commit(ipset->session);
+			if (ret == 0)
+				ret = ipset_replace_publish(ipset->session);
 			if (ret < 0)
 				ipset->standard_error(ipset, p);
 			continue;
@@ -1356,6 +2215,8 @@ ipset_parse_stream(struct ipset *ipset, FILE *f)
 	}
 	/* implicit "COMMIT" at EOF */
 	ret = ipset_commit(ipset->session);
+	if (ret == 0)
+		ret = ipset_replace_publish(ipset->session);
 	if (ret < 0)
 		ipset->standard_error(ipset, p);
 
@@ -46,6 +46,11 @@ static const uint16_t cmdflags[] = {
 	[IPSET_CMD_HEADER-1]	= NLM_F_REQUEST,
 	[IPSET_CMD_TYPE-1]	= NLM_F_REQUEST,
 	[IPSET_CMD_PROTOCOL-1]	= NLM_F_REQUEST,
+	[IPSET_CMD_UNION-1]	= NLM_F_REQUEST|NLM_F_ACK,
+	[IPSET_CMD_INTERSECT-1]	= NLM_F_REQUEST|NLM_F_ACK,
+	[IPSET_CMD_DIFF-1]	= NLM_F_REQUEST|NLM_F_ACK,
+	[IPSET_CMD_REPLACE-1]	= NLM_F_REQUEST|NLM_F_ACK,
+	[IPSET_CMD_TEST_BATCH-1] = NLM_F_REQUEST,
 };
 
 /**
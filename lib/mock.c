@@ -0,0 +1,831 @@
+/* Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <assert.h>				/* assert */
+#include <errno.h>				/* errno */
+#include <stdlib.h>				/* calloc, free */
+#include <string.h>				/* memcpy, strcmp */
+#include <arpa/inet.h>				/* hto* */
+
+#include <libipset/linux_ip_set.h>		/* enum ipset_cmd */
+#include <libipset/data.h>			/* ipset_strlcpy */
+#include <libipset/debug.h>			/* D() */
+#include <libipset/session.h>			/* ipset_debug_msg */
+#include <libipset/utils.h>			/* STREQ */
+#include <libipset/mnl.h>			/* ipset_mnl_transport */
+#include <libipset/mock.h>			/* prototypes */
+
+/* In-process stand-in of the kernel side of the ipset protocol.
+ *
+ * The sets are stored in memory and shared by the handles of the
+ * process, as the sets of a network namespace are shared by the netlink
+ * sockets: a list or save in a second session sees the sets created in
+ * the first one. The sets are freed with the last handle. The elements
+ * are kept as
+ * the attributes received from userspace: the key of an element is
+ * the attributes except the extensions, the flags and the line number.
+ * Ranges and networks are not expanded and matching is exact, so the
+ * transport is suitable to measure and test the userspace code paths,
+ * not to verify the set types.
+ */
+
+#ifndef NFNL_SUBSYS_IPSET
+#define NFNL_SUBSYS_IPSET	6
+#endif
+
+#define MOCK_HSIZE_MIN		64
+
+struct mock_elem {
+	struct mock_elem *next;		/* next element in the bucket */
+	uint32_t hash;			/* hash of the key */
+	uint16_t keylen;		/* length of the key attributes */
+	uint16_t len;			/* length of all attributes */
+	char attrs[0];			/* key attributes, then the rest */
+};
+
+struct mock_set {
+	struct mock_set *next;		/* next set */
+	char name[IPSET_MAXNAMELEN];	/* set name */
+	char typename[IPSET_MAXNAMELEN]; /* set type name */
+	uint8_t family;			/* set family */
+	uint8_t revision;		/* set type revision */
+	uint32_t elements;		/* number of elements */
+	uint32_t hsize;			/* number of buckets, power of two */
+	struct mock_elem **table;	/* buckets */
+	uint16_t datalen;		/* length of the create attributes */
+	char data[0];			/* create attributes */
+};
+
+/* Sets in creation order */
+static struct mock_set *mock_sets;
+static unsigned int mock_handles;
+
+/* Internal data structure of the mock transport */
+struct ipset_handle {
+	unsigned int seq;		/* netlink message sequence number */
+	mnl_cb_t *cb_ctl;		/* control block callbacks */
+	void *data;			/* data pointer */
+	void *reply;			/* reply buffer */
+	size_t replylen;		/* size of the reply buffer */
+};
+
+/* Extensions, flags and line number: not part of the element key */
+static bool
+mock_ext_attr(uint16_t type)
+{
+	switch (type) {
+	case IPSET_ATTR_TIMEOUT:
+	case IPSET_ATTR_CADT_FLAGS:
+	case IPSET_ATTR_LINENO:
+	case IPSET_ATTR_BYTES:
+	case IPSET_ATTR_PACKETS:
+	case IPSET_ATTR_COMMENT:
+	case IPSET_ATTR_SKBMARK:
+	case IPSET_ATTR_SKBPRIO:
+	case IPSET_ATTR_SKBQUEUE:
+	case IPSET_ATTR_PAD:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* FNV-1a */
+static uint32_t
+mock_hash(const void *key, size_t len)
+{
+	const uint8_t *p = key;
+	uint32_t hash = 2166136261U;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/* Build an element from the DATA attribute, with the key attributes
+ * first. The line number is returned in raw, network byte order.
+ */
+static struct mock_elem *
+mock_elem_build(struct nlattr *nest, uint32_t *lineno)
+{
+	struct nlattr *attr;
+	struct mock_elem *elem;
+	size_t keylen = 0, len = 0;
+	char *key, *ext;
+
+	mnl_attr_for_each_nested(attr, nest) {
+		if (mnl_attr_get_type(attr) == IPSET_ATTR_LINENO)
+			continue;
+		len += MNL_ALIGN(attr->nla_len);
+		if (!mock_ext_attr(mnl_attr_get_type(attr)))
+			keylen += MNL_ALIGN(attr->nla_len);
+	}
+	elem = calloc(1, sizeof(*elem) + len);
+	if (!elem)
+		return NULL;
+	elem->keylen = keylen;
+	elem->len = len;
+	key = elem->attrs;
+	ext = elem->attrs + keylen;
+	mnl_attr_for_each_nested(attr, nest) {
+		uint16_t type = mnl_attr_get_type(attr);
+
+		if (type == IPSET_ATTR_LINENO) {
+			*lineno = mnl_attr_get_u32(attr);
+		} else if (mock_ext_attr(type)) {
+			memcpy(ext, attr, attr->nla_len);
+			ext += MNL_ALIGN(attr->nla_len);
+		} else {
+			memcpy(key, attr, attr->nla_len);
+			key += MNL_ALIGN(attr->nla_len);
+		}
+	}
+	elem->hash = mock_hash(elem->attrs, elem->keylen);
+	return elem;
+}
+
+static struct mock_elem **
+mock_elem_find(const struct mock_set *set, const struct mock_elem *elem)
+{
+	struct mock_elem **e = &set->table[elem->hash & (set->hsize - 1)];
+
+	for (; *e; e = &(*e)->next)
+		if ((*e)->hash == elem->hash &&
+		    (*e)->keylen == elem->keylen &&
+		    memcmp((*e)->attrs, elem->attrs, elem->keylen) == 0)
+			break;
+	return e;
+}
+
+static int
+mock_resize(struct mock_set *set)
+{
+	uint32_t hsize = set->hsize * 2, i;
+	struct mock_elem **table, *e, *next;
+
+	table = calloc(hsize, sizeof(*table));
+	if (!table)
+		return -ENOMEM;
+	for (i = 0; i < set->hsize; i++) {
+		for (e = set->table[i]; e; e = next) {
+			next = e->next;
+			e->next = table[e->hash & (hsize - 1)];
+			table[e->hash & (hsize - 1)] = e;
+		}
+	}
+	free(set->table);
+	set->table = table;
+	set->hsize = hsize;
+	return 0;
+}
+
+static void
+mock_flush(struct mock_set *set)
+{
+	struct mock_elem *e, *next;
+	uint32_t i;
+
+	for (i = 0; i < set->hsize; i++) {
+		for (e = set->table[i]; e; e = next) {
+			next = e->next;
+			free(e);
+		}
+		set->table[i] = NULL;
+	}
+	set->elements = 0;
+}
+
+static void
+mock_destroy(struct mock_set *set)
+{
+	mock_flush(set);
+	free(set->table);
+	free(set);
+}
+
+static struct mock_set **
+mock_set_find(struct ipset_handle *handle UNUSED, const char *name)
+{
+	struct mock_set **s;
+
+	for (s = &mock_sets; *s; s = &(*s)->next)
+		if (STREQ((*s)->name, name))
+			break;
+	return s;
+}
+
+/*
+ * Commands
+ */
+
+static int
+mock_create(struct ipset_handle *handle, const struct nlmsghdr *nlh,
+	    struct nlattr *tb[])
+{
+	const char *name, *typename;
+	struct mock_set *set, **s;
+	uint8_t family, revision;
+
+	if (!(tb[IPSET_ATTR_SETNAME] && tb[IPSET_ATTR_TYPENAME] &&
+	      tb[IPSET_ATTR_REVISION] && tb[IPSET_ATTR_FAMILY]) ||
+	    (tb[IPSET_ATTR_DATA] &&
+	     !(tb[IPSET_ATTR_DATA]->nla_type & NLA_F_NESTED)))
+		return -IPSET_ERR_PROTOCOL;
+
+	name = mnl_attr_get_str(tb[IPSET_ATTR_SETNAME]);
+	typename = mnl_attr_get_str(tb[IPSET_ATTR_TYPENAME]);
+	family = mnl_attr_get_u8(tb[IPSET_ATTR_FAMILY]);
+	revision = mnl_attr_get_u8(tb[IPSET_ATTR_REVISION]);
+
+	s = mock_set_find(handle, name);
+	if (*s) {
+		/* Same as the kernel: not an error with -exist
+		 * when the set is the same
+		 */
+		if ((nlh->nlmsg_flags & NLM_F_EXCL) ||
+		    !STREQ((*s)->typename, typename) ||
+		    (*s)->family != family ||
+		    (*s)->revision != revision)
+			return -EEXIST;
+		return 0;
+	}
+
+	set = calloc(1, sizeof(*set) +
+		     (tb[IPSET_ATTR_DATA] ?
+		      mnl_attr_get_payload_len(tb[IPSET_ATTR_DATA]) : 0));
+	if (!set)
+		return -ENOMEM;
+	set->table = calloc(MOCK_HSIZE_MIN, sizeof(*set->table));
+	if (!set->table) {
+		free(set);
+		return -ENOMEM;
+	}
+	set->hsize = MOCK_HSIZE_MIN;
+	ipset_strlcpy(set->name, name, IPSET_MAXNAMELEN);
+	ipset_strlcpy(set->typename, typename, IPSET_MAXNAMELEN);
+	set->family = family;
+	set->revision = revision;
+	if (tb[IPSET_ATTR_DATA]) {
+		set->datalen = mnl_attr_get_payload_len(tb[IPSET_ATTR_DATA]);
+		memcpy(set->data, mnl_attr_get_payload(tb[IPSET_ATTR_DATA]),
+		       set->datalen);
+	}
+	*s = set;
+	return 0;
+}
+
+static int
+mock_destroy_flush(struct ipset_handle *handle, enum ipset_cmd cmd,
+		   struct nlattr *tb[])
+{
+	struct mock_set **s, *set;
+
+	if (tb[IPSET_ATTR_SETNAME]) {
+		s = mock_set_find(handle,
+				  mnl_attr_get_str(tb[IPSET_ATTR_SETNAME]));
+		if (!*s)
+			return -ENOENT;
+	} else {
+		/* All sets */
+		s = &mock_sets;
+	}
+	while ((set = *s) != NULL) {
+		if (cmd == IPSET_CMD_FLUSH) {
+			mock_flush(set);
+			s = &set->next;
+		} else {
+			*s = set->next;
+			mock_destroy(set);
+		}
+		if (tb[IPSET_ATTR_SETNAME])
+			break;
+	}
+	return 0;
+}
+
+/* Add, delete or test a single element */
+static int
+mock_adt_elem(struct mock_set *set, enum ipset_cmd cmd,
+	      struct nlattr *nest, bool eexist, uint32_t *lineno)
+{
+	struct mock_elem *elem, **e;
+	int ret = 0;
+
+	if (mnl_attr_get_type(nest) != IPSET_ATTR_DATA ||
+	    !(nest->nla_type & NLA_F_NESTED))
+		return -IPSET_ERR_PROTOCOL;
+
+	elem = mock_elem_build(nest, lineno);
+	if (!elem)
+		return -ENOMEM;
+
+	e = mock_elem_find(set, elem);
+	switch (cmd) {
+	case IPSET_CMD_ADD:
+		if (*e) {
+			if (!eexist) {
+				ret = -IPSET_ERR_EXIST;
+				break;
+			}
+			/* Overwrite the extensions */
+			elem->next = (*e)->next;
+			free(*e);
+			*e = elem;
+			return 0;
+		}
+		*e = elem;
+		if (++set->elements > set->hsize)
+			ret = mock_resize(set);
+		return ret;
+	case IPSET_CMD_DEL:
+		if (*e) {
+			struct mock_elem *d = *e;
+
+			*e = d->next;
+			free(d);
+			set->elements--;
+		} else if (!eexist) {
+			ret = -IPSET_ERR_EXIST;
+		}
+		break;
+	case IPSET_CMD_TEST:
+		ret = *e ? 1 : 0;
+		break;
+	default:
+		ret = -IPSET_ERR_PROTOCOL;
+		break;
+	}
+	free(elem);
+	return ret;
+}
+
+static int
+mock_adt(struct ipset_handle *handle, const struct nlmsghdr *nlh,
+	 enum ipset_cmd cmd, struct nlattr *tb[], uint32_t *lineno)
+{
+	bool eexist = !(nlh->nlmsg_flags & NLM_F_EXCL);
+	struct mock_set *set;
+	struct nlattr *nest;
+	int ret = 0;
+
+	if (!tb[IPSET_ATTR_SETNAME] ||
+	    !((tb[IPSET_ATTR_DATA] != NULL) ^ (tb[IPSET_ATTR_ADT] != NULL)) ||
+	    (tb[IPSET_ATTR_ADT] &&
+	     (cmd == IPSET_CMD_TEST || !tb[IPSET_ATTR_LINENO])))
+		return -IPSET_ERR_PROTOCOL;
+	/* Replacing the content of sets is not supported */
+	if (tb[IPSET_ATTR_FLAGS] &&
+	    ntohl(mnl_attr_get_u32(tb[IPSET_ATTR_FLAGS])) & IPSET_FLAG_SHADOW)
+		return -EOPNOTSUPP;
+
+	set = *mock_set_find(handle, mnl_attr_get_str(tb[IPSET_ATTR_SETNAME]));
+	if (!set)
+		return -ENOENT;
+
+	if (tb[IPSET_ATTR_DATA]) {
+		ret = mock_adt_elem(set, cmd, tb[IPSET_ATTR_DATA], eexist,
+				    lineno);
+		if (cmd == IPSET_CMD_TEST)
+			return ret > 0 ? 0 : ret ? ret : -IPSET_ERR_EXIST;
+		return ret;
+	}
+	mnl_attr_for_each_nested(nest, tb[IPSET_ATTR_ADT]) {
+		ret = mock_adt_elem(set, cmd, nest, eexist, lineno);
+		if (ret < 0)
+			break;
+	}
+	return ret;
+}
+
+/*
+ * Replies
+ */
+
+static struct nlmsghdr *
+mock_put_header(struct ipset_handle *handle, const struct nlmsghdr *req,
+		enum ipset_cmd cmd, uint16_t flags)
+{
+	struct nlmsghdr *nlh;
+	struct nfgenmsg *nfg;
+
+	nlh = mnl_nlmsg_put_header(handle->reply);
+	nlh->nlmsg_type = cmd | (NFNL_SUBSYS_IPSET << 8);
+	nlh->nlmsg_flags = flags;
+	nlh->nlmsg_seq = req->nlmsg_seq;
+
+	nfg = mnl_nlmsg_put_extra_header(nlh, sizeof(struct nfgenmsg));
+	nfg->nfgen_family = AF_INET;
+	nfg->version = NFNETLINK_V0;
+	nfg->res_id = htons(0);
+
+	return nlh;
+}
+
+static int
+mock_run(struct ipset_handle *handle, const struct nlmsghdr *nlh)
+{
+#ifdef IPSET_DEBUG
+	ipset_debug_msg("received", nlh, nlh->nlmsg_len);
+#endif
+	return mnl_cb_run2(nlh, nlh->nlmsg_len, handle->seq, 0,
+			   handle->cb_ctl[NLMSG_MIN_TYPE],
+			   handle->data,
+			   handle->cb_ctl, NLMSG_MIN_TYPE);
+}
+
+/* Send back an ACK or an error message. In the error message of
+ * restore mode the line number of the failed element is reported,
+ * like the kernel does.
+ */
+static int
+mock_ack(struct ipset_handle *handle, const struct nlmsghdr *req,
+	 int error, uint32_t lineno)
+{
+	struct nlmsghdr *nlh;
+	struct nlmsgerr *err;
+
+	if (!error && !(req->nlmsg_flags & NLM_F_ACK))
+		return 0;
+
+	nlh = mnl_nlmsg_put_header(handle->reply);
+	nlh->nlmsg_type = NLMSG_ERROR;
+	nlh->nlmsg_seq = req->nlmsg_seq;
+	err = mnl_nlmsg_put_extra_header(nlh, sizeof(struct nlmsgerr));
+	err->error = error;
+	if (!error) {
+		memcpy(&err->msg, req, sizeof(*req));
+	} else {
+		struct nlattr *attr;
+
+		/* Room is reserved for the whole request at query */
+		memcpy(&err->msg, req, req->nlmsg_len);
+		nlh->nlmsg_len += req->nlmsg_len - sizeof(*req);
+		mnl_attr_for_each(attr, &err->msg,
+				  sizeof(struct nfgenmsg)) {
+			if (mnl_attr_get_type(attr) == IPSET_ATTR_LINENO &&
+			    lineno != 0)
+				*(uint32_t *)mnl_attr_get_payload(attr) =
+					lineno;
+		}
+	}
+	return mock_run(handle, nlh);
+}
+
+static int
+mock_protocol(struct ipset_handle *handle, const struct nlmsghdr *req,
+	      uint8_t protocol)
+{
+	struct nlmsghdr *nlh;
+
+	nlh = mock_put_header(handle, req, IPSET_CMD_PROTOCOL, 0);
+	mnl_attr_put_u8(nlh, IPSET_ATTR_PROTOCOL, protocol);
+	return mock_run(handle, nlh);
+}
+
+/* All set types are supported in every revision known by userspace */
+static int
+mock_type(struct ipset_handle *handle, const struct nlmsghdr *req,
+	  struct nlattr *tb[], uint8_t protocol)
+{
+	struct nlmsghdr *nlh;
+
+	if (!(tb[IPSET_ATTR_TYPENAME] && tb[IPSET_ATTR_FAMILY]))
+		return mock_ack(handle, req, -IPSET_ERR_PROTOCOL, 0);
+
+	nlh = mock_put_header(handle, req, IPSET_CMD_TYPE, 0);
+	mnl_attr_put_u8(nlh, IPSET_ATTR_PROTOCOL, protocol);
+	mnl_attr_put_strz(nlh, IPSET_ATTR_TYPENAME,
+			  mnl_attr_get_str(tb[IPSET_ATTR_TYPENAME]));
+	mnl_attr_put_u8(nlh, IPSET_ATTR_FAMILY,
+			mnl_attr_get_u8(tb[IPSET_ATTR_FAMILY]));
+	mnl_attr_put_u8(nlh, IPSET_ATTR_REVISION, UINT8_MAX);
+	mnl_attr_put_u8(nlh, IPSET_ATTR_REVISION_MIN, 0);
+	return mock_run(handle, nlh);
+}
+
+static int
+mock_header(struct ipset_handle *handle, const struct nlmsghdr *req,
+	    struct nlattr *tb[], uint8_t protocol)
+{
+	struct nlmsghdr *nlh;
+	struct mock_set *set;
+
+	if (!tb[IPSET_ATTR_SETNAME])
+		return mock_ack(handle, req, -IPSET_ERR_PROTOCOL, 0);
+	set = *mock_set_find(handle, mnl_attr_get_str(tb[IPSET_ATTR_SETNAME]));
+	if (!set)
+		return mock_ack(handle, req, -ENOENT, 0);
+
+	nlh = mock_put_header(handle, req, IPSET_CMD_HEADER, 0);
+	mnl_attr_put_u8(nlh, IPSET_ATTR_PROTOCOL, protocol);
+	mnl_attr_put_strz(nlh, IPSET_ATTR_SETNAME, set->name);
+	mnl_attr_put_strz(nlh, IPSET_ATTR_TYPENAME, set->typename);
+	mnl_attr_put_u8(nlh, IPSET_ATTR_REVISION, set->revision);
+	mnl_attr_put_u8(nlh, IPSET_ATTR_FAMILY, set->family);
+	return mock_run(handle, nlh);
+}
+
+static int
+mock_test_batch(struct ipset_handle *handle, const struct nlmsghdr *req,
+		struct nlattr *tb[], uint8_t protocol)
+{
+	struct nlmsghdr *nlh;
+	struct nlattr *nest, *results;
+	struct mock_set *set;
+	uint32_t count = 0, n = 0, lineno = 0;
+	uint8_t *bits;
+	int ret;
+
+	if (!tb[IPSET_ATTR_SETNAME] || !tb[IPSET_ATTR_ADT])
+		return mock_ack(handle, req, -IPSET_ERR_PROTOCOL, 0);
+	set = *mock_set_find(handle, mnl_attr_get_str(tb[IPSET_ATTR_SETNAME]));
+	if (!set)
+		return mock_ack(handle, req, -ENOENT, 0);
+	mnl_attr_for_each_nested(nest, tb[IPSET_ATTR_ADT])
+		count++;
+	if (!count)
+		return mock_ack(handle, req, -IPSET_ERR_PROTOCOL, 0);
+
+	nlh = mock_put_header(handle, req, IPSET_CMD_TEST_BATCH, 0);
+	mnl_attr_put_u8(nlh, IPSET_ATTR_PROTOCOL, protocol);
+	mnl_attr_put_strz(nlh, IPSET_ATTR_SETNAME, set->name);
+	results = mnl_nlmsg_get_payload_tail(nlh);
+	mnl_attr_put(nlh, IPSET_ATTR_RESULTS, (count + 7) / 8, NULL);
+	bits = mnl_attr_get_payload(results);
+	memset(bits, 0, (count + 7) / 8);
+	mnl_attr_for_each_nested(nest, tb[IPSET_ATTR_ADT]) {
+		ret = mock_adt_elem(set, IPSET_CMD_TEST, nest, false, &lineno);
+		if (ret < 0)
+			return mock_ack(handle, req, ret, 0);
+		if (ret > 0)
+			bits[n / 8] |= 1 << (n % 8);
+		n++;
+	}
+	return mock_run(handle, nlh);
+}
+
+/* Start a dump message of the set */
+static struct nlmsghdr *
+mock_dump_start(struct ipset_handle *handle, const struct nlmsghdr *req,
+		const struct mock_set *set, uint8_t protocol)
+{
+	struct nlmsghdr *nlh;
+
+	nlh = mock_put_header(handle, req, IPSET_CMD_LIST, NLM_F_MULTI);
+	mnl_attr_put_u8(nlh, IPSET_ATTR_PROTOCOL, protocol);
+	mnl_attr_put_strz(nlh, IPSET_ATTR_SETNAME, set->name);
+	return nlh;
+}
+
+static uint32_t
+mock_memsize(const struct mock_set *set)
+{
+	const struct mock_elem *e;
+	uint32_t memsize, i;
+
+	memsize = sizeof(*set) + set->datalen +
+		  set->hsize * sizeof(*set->table);
+	for (i = 0; i < set->hsize; i++)
+		for (e = set->table[i]; e; e = e->next)
+			memsize += sizeof(*e) + e->len;
+	return memsize;
+}
+
+/* Dump the set into as many messages as required, each one filling
+ * up the buffer of the size of the userspace receive buffer.
+ */
+static int
+mock_dump_set(struct ipset_handle *handle, const struct nlmsghdr *req,
+	      const struct mock_set *set, uint32_t flags, uint8_t protocol,
+	      size_t len)
+{
+	const struct mock_elem *e;
+	struct nlmsghdr *nlh;
+	struct nlattr *nest, *adt;
+	uint32_t i;
+	int ret;
+
+	nlh = mock_dump_start(handle, req, set, protocol);
+	if (flags & IPSET_FLAG_LIST_SETNAME)
+		return mock_run(handle, nlh);
+
+	mnl_attr_put_strz(nlh, IPSET_ATTR_TYPENAME, set->typename);
+	mnl_attr_put_u8(nlh, IPSET_ATTR_FAMILY, set->family);
+	mnl_attr_put_u8(nlh, IPSET_ATTR_REVISION, set->revision);
+	nest = mnl_attr_nest_start(nlh, IPSET_ATTR_DATA);
+	memcpy(mnl_nlmsg_get_payload_tail(nlh), set->data, set->datalen);
+	nlh->nlmsg_len += MNL_ALIGN(set->datalen);
+	mnl_attr_put_u32(nlh, IPSET_ATTR_REFERENCES | NLA_F_NET_BYTEORDER,
+			 htonl(0));
+	mnl_attr_put_u32(nlh, IPSET_ATTR_MEMSIZE | NLA_F_NET_BYTEORDER,
+			 htonl(mock_memsize(set)));
+	mnl_attr_put_u32(nlh, IPSET_ATTR_ELEMENTS | NLA_F_NET_BYTEORDER,
+			 htonl(set->elements));
+	mnl_attr_nest_end(nlh, nest);
+	if (flags & IPSET_FLAG_LIST_HEADER)
+		return mock_run(handle, nlh);
+
+	adt = mnl_attr_nest_start(nlh, IPSET_ATTR_ADT);
+	for (i = 0; i < set->hsize; i++) {
+		for (e = set->table[i]; e; e = e->next) {
+			if (nlh->nlmsg_len + MNL_ATTR_HDRLEN + e->len > len) {
+				/* Send out full message, continue in a new */
+				mnl_attr_nest_end(nlh, adt);
+				ret = mock_run(handle, nlh);
+				if (ret <= MNL_CB_STOP)
+					return ret;
+				nlh = mock_dump_start(handle, req, set,
+						      protocol);
+				adt = mnl_attr_nest_start(nlh, IPSET_ATTR_ADT);
+			}
+			nest = mnl_attr_nest_start(nlh, IPSET_ATTR_DATA);
+			memcpy(mnl_nlmsg_get_payload_tail(nlh),
+			       e->attrs, e->len);
+			nlh->nlmsg_len += e->len;
+			mnl_attr_nest_end(nlh, nest);
+		}
+	}
+	mnl_attr_nest_end(nlh, adt);
+	return mock_run(handle, nlh);
+}
+
+static int
+mock_dump(struct ipset_handle *handle, const struct nlmsghdr *req,
+	  struct nlattr *tb[], uint8_t protocol, size_t len)
+{
+	const struct mock_set *set;
+	struct nlmsghdr *nlh;
+	uint32_t flags = 0;
+	int ret;
+
+	/* Dumping parts of the sets or elements is not supported */
+	if (tb[IPSET_ATTR_INDEX] || tb[IPSET_ATTR_INDEX_TO] ||
+	    tb[IPSET_ATTR_SETNAME_PREFIX] || tb[IPSET_ATTR_DATA])
+		return mock_ack(handle, req, -EOPNOTSUPP, 0);
+	if (tb[IPSET_ATTR_FLAGS])
+		flags = ntohl(mnl_attr_get_u32(tb[IPSET_ATTR_FLAGS]));
+
+	if (tb[IPSET_ATTR_SETNAME]) {
+		set = *mock_set_find(handle,
+				     mnl_attr_get_str(tb[IPSET_ATTR_SETNAME]));
+		if (!set)
+			return mock_ack(handle, req, -ENOENT, 0);
+		ret = mock_dump_set(handle, req, set, flags, protocol, len);
+		if (ret <= MNL_CB_STOP)
+			return ret;
+	} else {
+		for (set = mock_sets; set; set = set->next) {
+			ret = mock_dump_set(handle, req, set, flags, protocol,
+					    len);
+			if (ret <= MNL_CB_STOP)
+				return ret;
+		}
+	}
+
+	nlh = mnl_nlmsg_put_header(handle->reply);
+	nlh->nlmsg_type = NLMSG_DONE;
+	nlh->nlmsg_flags = NLM_F_MULTI;
+	nlh->nlmsg_seq = req->nlmsg_seq;
+	*(int *)mnl_nlmsg_put_extra_header(nlh, sizeof(int)) = 0;
+	return mock_run(handle, nlh);
+}
+
+/*
+ * Transport interface
+ */
+
+static int
+mock_attr_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	uint16_t type = mnl_attr_get_type(attr);
+
+	if (type <= IPSET_ATTR_CMD_MAX)
+		tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+/* The requests are the same as of the netlink transport */
+static void
+ipset_mock_fill_hdr(struct ipset_handle *handle, enum ipset_cmd cmd,
+		    void *buffer, size_t len, uint8_t envflags)
+{
+	ipset_mnl_transport.fill_hdr(handle, cmd, buffer, len, envflags);
+}
+
+static int
+ipset_mock_query(struct ipset_handle *handle, void *buffer, size_t len)
+{
+	struct nlattr *tb[IPSET_ATTR_CMD_MAX + 1] = {};
+	struct nlmsghdr *nlh = buffer;
+	uint32_t lineno = 0;
+	uint8_t protocol;
+	int cmd, ret;
+
+	assert(handle);
+	assert(buffer);
+
+	nlh->nlmsg_seq = ++handle->seq;
+#ifdef IPSET_DEBUG
+	ipset_debug_msg("sent", nlh, nlh->nlmsg_len);
+#endif
+	/* Room for an error message with the whole request */
+	if (len + MNL_NLMSG_HDRLEN + sizeof(struct nlmsgerr) >
+	    handle->replylen) {
+		void *reply = realloc(handle->reply, len + MNL_NLMSG_HDRLEN +
+						     sizeof(struct nlmsgerr));
+
+		if (!reply)
+			return -ENOMEM;
+		handle->reply = reply;
+		handle->replylen = len + MNL_NLMSG_HDRLEN +
+				   sizeof(struct nlmsgerr);
+	}
+
+	cmd = ipset_get_nlmsg_type(nlh);
+	if (mnl_attr_parse(nlh, sizeof(struct nfgenmsg),
+			   mock_attr_cb, tb) < MNL_CB_STOP ||
+	    !tb[IPSET_ATTR_PROTOCOL])
+		return mock_ack(handle, nlh, -IPSET_ERR_PROTOCOL, 0);
+	protocol = mnl_attr_get_u8(tb[IPSET_ATTR_PROTOCOL]);
+	D("cmd %u, protocol %u", cmd, protocol);
+
+	switch (cmd) {
+	case IPSET_CMD_PROTOCOL:
+		return mock_protocol(handle, nlh, protocol);
+	case IPSET_CMD_TYPE:
+		return mock_type(handle, nlh, tb, protocol);
+	case IPSET_CMD_HEADER:
+		return mock_header(handle, nlh, tb, protocol);
+	case IPSET_CMD_LIST:
+	case IPSET_CMD_SAVE:
+		return mock_dump(handle, nlh, tb, protocol, len);
+	case IPSET_CMD_TEST_BATCH:
+		return mock_test_batch(handle, nlh, tb, protocol);
+	case IPSET_CMD_CREATE:
+		ret = mock_create(handle, nlh, tb);
+		break;
+	case IPSET_CMD_DESTROY:
+	case IPSET_CMD_FLUSH:
+		ret = mock_destroy_flush(handle, cmd, tb);
+		break;
+	case IPSET_CMD_ADD:
+	case IPSET_CMD_DEL:
+	case IPSET_CMD_TEST:
+		ret = mock_adt(handle, nlh, cmd, tb, &lineno);
+		break;
+	default:
+		ret = -EOPNOTSUPP;
+		break;
+	}
+	return mock_ack(handle, nlh, ret, lineno);
+}
+
+static struct ipset_handle *
+ipset_mock_init(mnl_cb_t *cb_ctl, void *data)
+{
+	struct ipset_handle *handle;
+
+	assert(cb_ctl);
+	assert(data);
+
+	handle = calloc(1, sizeof(*handle));
+	if (!handle)
+		return NULL;
+
+	handle->cb_ctl = cb_ctl;
+	handle->data = data;
+	mock_handles++;
+
+	return handle;
+}
+
+static int
+ipset_mock_fini(struct ipset_handle *handle)
+{
+	struct mock_set *set;
+
+	assert(handle);
+
+	if (--mock_handles == 0) {
+		while ((set = mock_sets) != NULL) {
+			mock_sets = set->next;
+			mock_destroy(set);
+		}
+	}
+	free(handle->reply);
+	free(handle);
+	return 0;
+}
+
+const struct ipset_transport ipset_mock_transport = {
+	.init	= ipset_mock_init,
+	.fini	= ipset_mock_fini,
+	.fill_hdr = ipset_mock_fill_hdr,
+	.query	= ipset_mock_query,
+};
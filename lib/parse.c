@@ -1489,7 +1489,8 @@ ipset_parse_setname(struct ipset_session *session,
 	assert(session);
 	assert(opt == IPSET_SETNAME ||
 	       opt == IPSET_OPT_NAME ||
-	       opt == IPSET_OPT_SETNAME2);
+	       opt == IPSET_OPT_SETNAME2 ||
+	       opt == IPSET_OPT_SETNAME3);
 	assert(str);
 
 	check_setname(str, NULL);
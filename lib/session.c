@@ -5,6 +5,7 @@
  * published by the Free Software Foundation.
  */
 #include <assert.h>				/* assert */
+#include <arpa/inet.h>				/* inet_pton */
 #include <endian.h>				/* htobe64 */
 #include <errno.h>				/* errno */
 #include <setjmp.h>				/* setjmp, longjmp */
@@ -21,6 +22,7 @@
 #include <libipset/debug.h>			/* D() */
 #include <libipset/data.h>			/* IPSET_OPT_* */
 #include <libipset/errcode.h>			/* ipset_errcode */
+#include <libipset/parse.h>			/* ipset_parse_setname */
 #include <libipset/print.h>			/* ipset_print_* */
 #include <libipset/types.h>			/* struct ipset_type */
 #include <libipset/transport.h>			/* transport */
@@ -71,6 +73,26 @@ struct ipset_session {
 	char report[IPSET_ERRORBUFLEN];		/* Error/report buffer */
 	enum ipset_err_type err_type;		/* ERROR/WARNING/NOTICE */
 	uint8_t envopts;			/* Session env opts */
+	/* Dump filter for the next list/save of all sets */
+	bool dump_filter;			/* Dump filter is set */
+	uint16_t dump_from, dump_to;		/* Set index range */
+	uint32_t dump_flags;			/* Dump pass flags */
+	char dump_prefix[IPSET_MAXNAMELEN];	/* Setname prefix */
+	/* Element filter for the next list/save */
+	uint8_t filter_family;			/* Family of filter_ip */
+	union nf_inet_addr filter_ip;		/* Elements within ip/cidr */
+	uint8_t filter_cidr;
+	bool filter_port;			/* Port range is set */
+	uint16_t filter_port_from, filter_port_to;
+	char filter_comment[IPSET_MAX_COMMENT_SIZE + 1]; /* Substring */
+	/* Replace transaction */
+	char replace_setname[IPSET_MAXNAMELEN];	/* Set being replaced */
+	bool replace_publish;			/* Publish the new content */
+	/* Batched tests */
+	uint8_t *batch_results;			/* Bitmap of the results */
+	size_t batch_size;			/* Allocated bytes */
+	uint32_t batch_count;			/* Number of results */
+	uint32_t batch_pending;			/* Elements in the buffer */
 	/* Kernel message buffer */
 	size_t bufsize;
 	void *buffer;
@@ -213,6 +235,175 @@ ipset_session_output(struct ipset_session *session,
 	return 0;
 }
 
+/**
+ * ipset_session_dump_filter - restrict the next list/save of all sets
+ * @session: session structure
+ * @from: index of the first set to dump
+ * @to: index of the last set to dump
+ * @prefix: dump the sets with this setname prefix only, may be NULL
+ * @flags: IPSET_FLAG_LIST_SKIP_LAST and/or IPSET_FLAG_LIST_ONLY_LAST
+ *
+ * Restrict the next list/save command without a setname to a range
+ * of set indices, so that disjoint parts of the ruleset can be dumped
+ * over separate sessions in parallel. The filter is cleared when the
+ * next command is completed.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int
+ipset_session_dump_filter(struct ipset_session *session,
+			  uint16_t from, uint16_t to,
+			  const char *prefix, uint32_t flags)
+{
+	assert(session);
+
+	if (from > to)
+		return ipset_err(session,
+			"Invalid dump range %u-%u", from, to);
+	if (prefix && strlen(prefix) >= IPSET_MAXNAMELEN)
+		return ipset_err(session,
+			"Setname prefix '%s' is longer than %u characters",
+			prefix, IPSET_MAXNAMELEN - 1);
+
+	session->dump_filter = true;
+	session->dump_from = from;
+	session->dump_to = to;
+	session->dump_flags = flags &
+		(IPSET_FLAG_LIST_SKIP_LAST | IPSET_FLAG_LIST_ONLY_LAST);
+	if (prefix)
+		strcpy(session->dump_prefix, prefix);
+	else
+		session->dump_prefix[0] = '\0';
+	return 0;
+}
+
+static int
+elem_filter_ip(struct ipset_session *session, const char *str)
+{
+	char buf[INET6_ADDRSTRLEN + sizeof("/128")];
+	unsigned long cidr;
+	uint8_t family, maxcidr;
+	char *slash, *end;
+
+	if (strlen(str) >= sizeof(buf))
+		goto error;
+	strcpy(buf, str);
+	slash = strchr(buf, '/');
+	if (slash)
+		*slash = '\0';
+	if (inet_pton(AF_INET, buf, &session->filter_ip) == 1) {
+		family = NFPROTO_IPV4;
+		maxcidr = 32;
+	} else if (inet_pton(AF_INET6, buf, &session->filter_ip) == 1) {
+		family = NFPROTO_IPV6;
+		maxcidr = 128;
+	} else {
+		goto error;
+	}
+	cidr = maxcidr;
+	if (slash) {
+		errno = 0;
+		cidr = strtoul(slash + 1, &end, 10);
+		if (errno || end == slash + 1 || *end != '\0' ||
+		    cidr > maxcidr)
+			goto error;
+	}
+	session->filter_family = family;
+	session->filter_cidr = cidr;
+	return 0;
+
+error:
+	return ipset_err(session,
+		"Syntax error: '%s' is not a valid ADDR[/CIDR] filter", str);
+}
+
+static int
+elem_filter_port(struct ipset_session *session, const char *str)
+{
+	unsigned long port[2];
+	const char *p = str;
+	char *end;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		errno = 0;
+		port[i] = strtoul(p, &end, 10);
+		if (errno || end == p || port[i] > UINT16_MAX)
+			goto error;
+		if (*end == '\0')
+			break;
+		if (*end != '-' || i == 1)
+			goto error;
+		p = end + 1;
+	}
+	if (i == 0)
+		port[1] = port[0];
+	if (port[0] > port[1])
+		goto error;
+	session->filter_port = true;
+	session->filter_port_from = port[0];
+	session->filter_port_to = port[1];
+	return 0;
+
+error:
+	return ipset_err(session,
+		"Syntax error: '%s' is not a valid PORT[-PORT] filter", str);
+}
+
+/**
+ * ipset_session_elem_filter - filter the elements of the next list/save
+ * @session: session structure
+ * @opt: IPSET_OPT_IP, IPSET_OPT_PORT or IPSET_OPT_ADT_COMMENT
+ * @str: ADDR[/CIDR], numeric PORT[-PORT] or comment substring
+ *
+ * Ask the kernel to send only the elements which are within the
+ * network, have got a port in the range or a comment containing
+ * the string. When multiple filters are set, all of them must match.
+ * The filters are cleared when the next command is completed.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int
+ipset_session_elem_filter(struct ipset_session *session,
+			  enum ipset_opt opt, const char *str)
+{
+	assert(session);
+	assert(str);
+
+	switch (opt) {
+	case IPSET_OPT_IP:
+		return elem_filter_ip(session, str);
+	case IPSET_OPT_PORT:
+		return elem_filter_port(session, str);
+	case IPSET_OPT_ADT_COMMENT:
+		if (strlen(str) > IPSET_MAX_COMMENT_SIZE)
+			return ipset_err(session,
+				"Comment filter is longer than "
+				"the maximum allowed %d characters",
+				IPSET_MAX_COMMENT_SIZE);
+		strcpy(session->filter_comment, str);
+		return 0;
+	default:
+		return ipset_err(session,
+			"Internal error: unsupported element filter");
+	}
+}
+
+static inline bool
+elem_filter_set(const struct ipset_session *session)
+{
+	return session->filter_family || session->filter_port ||
+	       session->filter_comment[0];
+}
+
+static inline void
+elem_filter_reset(struct ipset_session *session)
+{
+	session->filter_family = NFPROTO_UNSPEC;
+	session->filter_port = false;
+	session->filter_comment[0] = '\0';
+}
+
 /*
  * Error and warning reporting
  */
@@ -382,6 +573,21 @@ static const struct ipset_attr_policy cmd_attrs[] = {
 		.type = MNL_TYPE_U16,
 		.opt = IPSET_OPT_INDEX,
 	},
+	[IPSET_ATTR_INDEX_TO] = {
+		.type = MNL_TYPE_U16,
+	},
+	[IPSET_ATTR_SETNAME_PREFIX] = {
+		.type = MNL_TYPE_NUL_STRING,
+		.len  = IPSET_MAXNAMELEN,
+	},
+	[IPSET_ATTR_SETNAME3] = {
+		.type = MNL_TYPE_NUL_STRING,
+		.opt = IPSET_OPT_SETNAME3,
+		.len  = IPSET_MAXNAMELEN,
+	},
+	[IPSET_ATTR_RESULTS] = {
+		.type = MNL_TYPE_BINARY,
+	},
 };
 
 static const struct ipset_attr_policy create_attrs[] = {
@@ -461,6 +667,17 @@ static const struct ipset_attr_policy create_attrs[] = {
 		.type = MNL_TYPE_U32,
 		.opt = IPSET_OPT_MEMSIZE,
 	},
+	[IPSET_ATTR_CACHE_HITS] = {
+		.type = MNL_TYPE_U64,
+		.opt = IPSET_OPT_CACHE_HITS,
+	},
+	[IPSET_ATTR_CACHE_MISSES] = {
+		.type = MNL_TYPE_U64,
+		.opt = IPSET_OPT_CACHE_MISSES,
+	},
+	[IPSET_ATTR_CREATE_PAD] = {
+		.type = MNL_TYPE_UNSPEC,
+	},
 };
 
 static const struct ipset_attr_policy adt_attrs[] = {
@@ -733,7 +950,7 @@ attr2data(struct ipset_session *session, struct nlattr *nla[],
 	if (attr2data(session, nla, type, attrs) < 0)	\
 		return MNL_CB_ERROR
 
-static const char cmd2name[][9] = {
+static const char cmd2name[][10] = {
 	[IPSET_CMD_NONE]	= "NONE",
 	[IPSET_CMD_CREATE]	= "CREATE",
 	[IPSET_CMD_DESTROY]	= "DESTROY",
@@ -748,6 +965,11 @@ static const char cmd2name[][9] = {
 	[IPSET_CMD_HEADER]	= "HEADER",
 	[IPSET_CMD_TYPE]	= "TYPE",
 	[IPSET_CMD_PROTOCOL]	= "PROTOCOL",
+	[IPSET_CMD_UNION]	= "UNION",
+	[IPSET_CMD_INTERSECT]	= "INTERSECT",
+	[IPSET_CMD_DIFF]	= "DIFF",
+	[IPSET_CMD_REPLACE]	= "REPLACE",
+	[IPSET_CMD_TEST_BATCH]	= "TEST_BATCH",
 };
 
 static inline int
@@ -1053,6 +1275,14 @@ list_create(struct ipset_session *session, struct nlattr *nla[])
 			safe_snprintf(session, "\nNumber of entries: ");
 			safe_dprintf(session, ipset_print_number, IPSET_OPT_ELEMENTS);
 		}
+		if (ipset_data_test(data, IPSET_OPT_CACHE_HITS)) {
+			safe_snprintf(session, "\nCache hits: ");
+			safe_dprintf(session, ipset_print_number,
+				     IPSET_OPT_CACHE_HITS);
+			safe_snprintf(session, "\nCache misses: ");
+			safe_dprintf(session, ipset_print_number,
+				     IPSET_OPT_CACHE_MISSES);
+		}
 		safe_snprintf(session,
 			session->envopts & IPSET_ENV_LIST_HEADER ?
 			"\n" : "\nMembers:\n");
@@ -1068,6 +1298,15 @@ list_create(struct ipset_session *session, struct nlattr *nla[])
 			safe_dprintf(session, ipset_print_number, IPSET_OPT_ELEMENTS);
 			safe_snprintf(session, "</numentries>\n");
 		}
+		if (ipset_data_test(data, IPSET_OPT_CACHE_HITS)) {
+			safe_snprintf(session, "<cachehits>");
+			safe_dprintf(session, ipset_print_number,
+				     IPSET_OPT_CACHE_HITS);
+			safe_snprintf(session, "</cachehits>\n<cachemisses>");
+			safe_dprintf(session, ipset_print_number,
+				     IPSET_OPT_CACHE_MISSES);
+			safe_snprintf(session, "</cachemisses>\n");
+		}
 		safe_snprintf(session,
 			session->envopts & IPSET_ENV_LIST_HEADER ?
 			"</header>\n" :
@@ -1343,6 +1582,47 @@ callback_type(struct ipset_session *session, struct nlattr *nla[])
 	return MNL_CB_STOP;
 }
 
+/* Append the results of the elements sent in the last batch */
+static int
+callback_test_batch(struct ipset_session *session, struct nlattr *nla[])
+{
+	const uint8_t *bits;
+	uint32_t i, n;
+	size_t len;
+
+	if (!nla[IPSET_ATTR_RESULTS] ||
+	    mnl_attr_get_payload_len(nla[IPSET_ATTR_RESULTS]) <
+	    (session->batch_pending + 7) / 8)
+		FAILURE("Broken TEST_BATCH kernel message: "
+			"missing or short test results");
+
+	n = session->batch_count + session->batch_pending;
+	len = (n + 7) / 8;
+	if (len > session->batch_size) {
+		size_t size = session->batch_size * 2 > len ?
+			      session->batch_size * 2 : len;
+		uint8_t *results = realloc(session->batch_results, size);
+
+		if (results == NULL)
+			FAILURE("Cannot allocate memory for the test results");
+		memset(results + session->batch_size, 0,
+		       size - session->batch_size);
+		session->batch_results = results;
+		session->batch_size = size;
+	}
+	bits = mnl_attr_get_payload(nla[IPSET_ATTR_RESULTS]);
+	for (i = 0; i < session->batch_pending; i++) {
+		if (bits[i / 8] & (1 << (i % 8))) {
+			n = session->batch_count + i;
+			session->batch_results[n / 8] |= 1 << (n % 8);
+		}
+	}
+	session->batch_count += session->batch_pending;
+	session->batch_pending = 0;
+
+	return MNL_CB_STOP;
+}
+
 static int
 cmd_attr_cb(const struct nlattr *attr, void *data)
 {
@@ -1426,6 +1706,9 @@ callback_data(const struct nlmsghdr *nlh, void *data)
 	case IPSET_CMD_TYPE:
 		ret = callback_type(session, nla);
 		break;
+	case IPSET_CMD_TEST_BATCH:
+		ret = callback_test_batch(session, nla);
+		break;
 	default:
 		FAILURE("Data message received when not expected at %s",
 			cmd2name[session->cmd]);
@@ -1539,6 +1822,10 @@ callback_error(const struct nlmsghdr *nlh, void *cbdata)
 			/* Fall through */
 		case IPSET_CMD_ADD:
 		case IPSET_CMD_DEL:
+		case IPSET_CMD_UNION:
+		case IPSET_CMD_INTERSECT:
+		case IPSET_CMD_DIFF:
+		case IPSET_CMD_REPLACE:
 			break;
 		case IPSET_CMD_LIST:
 		case IPSET_CMD_SAVE:
@@ -1803,8 +2090,9 @@ build_send_private_msg(struct ipset_session *session, enum ipset_cmd cmd)
 static inline bool
 may_aggregate_ad(struct ipset_session *session, enum ipset_cmd cmd)
 {
-	return session->lineno != 0 &&
-	       (cmd == IPSET_CMD_ADD || cmd == IPSET_CMD_DEL) &&
+	return (cmd == IPSET_CMD_TEST_BATCH ||
+		(session->lineno != 0 &&
+		 (cmd == IPSET_CMD_ADD || cmd == IPSET_CMD_DEL))) &&
 	       cmd == session->cmd &&
 	       STREQ(ipset_data_setname(session->data), session->saved_setname);
 }
@@ -1867,20 +2155,59 @@ build_msg(struct ipset_session *session, bool aggregate)
 	}
 	case IPSET_CMD_DESTROY:
 	case IPSET_CMD_FLUSH:
-	case IPSET_CMD_SAVE:
 		if (ipset_data_test(data, IPSET_SETNAME))
 			ADDATTR_SETNAME(session, nlh, data);
 		break;
-	case IPSET_CMD_LIST: {
+	case IPSET_CMD_LIST:
+	case IPSET_CMD_SAVE: {
 		uint32_t flags = 0;
 
-		if (session->envopts & IPSET_ENV_LIST_SETNAME)
-			flags |= IPSET_FLAG_LIST_SETNAME;
-		if (session->envopts & IPSET_ENV_LIST_HEADER)
-			flags |= IPSET_FLAG_LIST_HEADER;
+		if (session->cmd == IPSET_CMD_LIST &&
+		    session->mode != IPSET_LIST_SAVE) {
+			if (session->envopts & IPSET_ENV_LIST_SETNAME)
+				flags |= IPSET_FLAG_LIST_SETNAME;
+			if (session->envopts & IPSET_ENV_LIST_HEADER)
+				flags |= IPSET_FLAG_LIST_HEADER;
+		}
 		if (ipset_data_test(data, IPSET_SETNAME))
 			ADDATTR_SETNAME(session, nlh, data);
-		if (flags && session->mode != IPSET_LIST_SAVE) {
+		else if (session->dump_filter) {
+			flags |= session->dump_flags;
+			ADDATTR_RAW(session, nlh, &session->dump_from,
+				    IPSET_ATTR_INDEX, cmd_attrs);
+			ADDATTR_RAW(session, nlh, &session->dump_to,
+				    IPSET_ATTR_INDEX_TO, cmd_attrs);
+			if (session->dump_prefix[0])
+				ADDATTR_RAW(session, nlh, session->dump_prefix,
+					    IPSET_ATTR_SETNAME_PREFIX,
+					    cmd_attrs);
+		}
+		if (elem_filter_set(session)) {
+			/* Filtered out elements are not sent by the kernel */
+			open_nested(session, nlh, IPSET_ATTR_DATA);
+			if (session->filter_family) {
+				rawdata2attr(session, nlh, &session->filter_ip,
+					     IPSET_ATTR_IP,
+					     session->filter_family,
+					     adt_attrs);
+				ADDATTR_RAW(session, nlh, &session->filter_cidr,
+					    IPSET_ATTR_CIDR, adt_attrs);
+			}
+			if (session->filter_port) {
+				ADDATTR_RAW(session, nlh,
+					    &session->filter_port_from,
+					    IPSET_ATTR_PORT, adt_attrs);
+				ADDATTR_RAW(session, nlh,
+					    &session->filter_port_to,
+					    IPSET_ATTR_PORT_TO, adt_attrs);
+			}
+			if (session->filter_comment[0])
+				ADDATTR_RAW(session, nlh,
+					    session->filter_comment,
+					    IPSET_ATTR_COMMENT, adt_attrs);
+			close_nested(session, nlh);
+		}
+		if (flags) {
 			ipset_data_set(data, IPSET_OPT_FLAGS, &flags);
 			ADDATTR(session, nlh, data, IPSET_ATTR_FLAGS,
 				NFPROTO_IPV4, cmd_attrs);
@@ -1904,6 +2231,38 @@ build_msg(struct ipset_session *session, bool aggregate)
 			    ipset_data_get(data, IPSET_OPT_SETNAME2),
 			    IPSET_ATTR_SETNAME2, cmd_attrs);
 		break;
+	case IPSET_CMD_UNION:
+	case IPSET_CMD_INTERSECT:
+	case IPSET_CMD_DIFF:
+		if (!ipset_data_test(data, IPSET_SETNAME))
+			return ipset_err(session,
+				"Invalid %s command: missing to-setname",
+				cmd2name[session->cmd]);
+		if (!ipset_data_test(data, IPSET_OPT_SETNAME2) ||
+		    !ipset_data_test(data, IPSET_OPT_SETNAME3))
+			return ipset_err(session,
+				"Invalid %s command: missing setname",
+				cmd2name[session->cmd]);
+		ADDATTR_SETNAME(session, nlh, data);
+		ADDATTR_RAW(session, nlh,
+			    ipset_data_get(data, IPSET_OPT_SETNAME2),
+			    IPSET_ATTR_SETNAME2, cmd_attrs);
+		ADDATTR_RAW(session, nlh,
+			    ipset_data_get(data, IPSET_OPT_SETNAME3),
+			    IPSET_ATTR_SETNAME3, cmd_attrs);
+		break;
+	case IPSET_CMD_REPLACE: {
+		uint32_t flags = IPSET_FLAG_PUBLISH;
+
+		if (!ipset_data_test(data, IPSET_SETNAME))
+			return ipset_err(session,
+				"Invalid replace command: missing setname");
+		ADDATTR_SETNAME(session, nlh, data);
+		if (session->replace_publish)
+			ADDATTR_RAW(session, nlh, &flags,
+				    IPSET_ATTR_FLAGS, cmd_attrs);
+		break;
+	}
 	case IPSET_CMD_ADD:
 	case IPSET_CMD_DEL: {
 		const struct ipset_type *type;
@@ -1924,6 +2283,15 @@ build_msg(struct ipset_session *session, bool aggregate)
 
 			/* Core options: setname */
 			ADDATTR_SETNAME(session, nlh, data);
+			if (session->cmd == IPSET_CMD_ADD &&
+			    STREQ(ipset_data_setname(data),
+				  session->replace_setname)) {
+				/* Fill up the new content of the set */
+				uint32_t flags = IPSET_FLAG_SHADOW;
+
+				ADDATTR_RAW(session, nlh, &flags,
+					    IPSET_ATTR_FLAGS, cmd_attrs);
+			}
 			if (session->lineno != 0) {
 				/* Restore mode */
 				ADDATTR_RAW(session, nlh, &session->lineno,
@@ -1973,6 +2341,34 @@ build_msg(struct ipset_session *session, bool aggregate)
 		close_nested(session, nlh);
 		break;
 	}
+	case IPSET_CMD_TEST_BATCH:
+		if (!aggregate) {
+			/* Setname, type not checked/added yet */
+			if (!ipset_data_test(data, IPSET_SETNAME))
+				return ipset_err(session,
+					"Invalid test-batch command: "
+					"missing setname");
+
+			if (!ipset_data_test(data, IPSET_OPT_TYPE))
+				return ipset_err(session,
+					"Invalid test-batch command: "
+					"missing settype");
+
+			ADDATTR_SETNAME(session, nlh, data);
+			open_nested(session, nlh, IPSET_ATTR_ADT);
+		}
+		if (open_nested(session, nlh, IPSET_ATTR_DATA))
+			return 1;
+		if (addattr_adt(session, nlh, data, ipset_data_family(data))) {
+			/* Cancel last, unfinished nested attribute */
+			mnl_attr_nest_cancel(nlh,
+					session->nested[session->nestid-1]);
+			session->nested[--session->nestid] = NULL;
+			return 1;
+		}
+		close_nested(session, nlh);
+		session->batch_pending++;
+		break;
 	default:
 		return ipset_err(session, "Internal error: unknown command %u",
 				 session->cmd);
@@ -1980,6 +2376,80 @@ build_msg(struct ipset_session *session, bool aggregate)
 	return 0;
 }
 
+/**
+ * ipset_test_batch_results - get the results of the batched tests
+ * @session: session structure
+ * @count: pointer to store the number of results
+ *
+ * Elements tested by IPSET_CMD_TEST_BATCH commands on the same set are
+ * buffered and sent in as few messages as possible. When the tests are
+ * committed by ipset_commit(), the results are available as a bitmap in
+ * the order of the commands: bit n (bit n % 8 of byte n / 8) is set when
+ * the nth element is in the set. The results are accumulated until
+ * ipset_test_batch_reset() is called.
+ *
+ * Returns the bitmap of the results or NULL if there is no result.
+ */
+const uint8_t *
+ipset_test_batch_results(const struct ipset_session *session,
+			 uint32_t *count)
+{
+	assert(session);
+	assert(count);
+
+	*count = session->batch_count;
+	return session->batch_count ? session->batch_results : NULL;
+}
+
+/**
+ * ipset_test_batch_reset - forget the results of the batched tests
+ * @session: session structure
+ */
+void
+ipset_test_batch_reset(struct ipset_session *session)
+{
+	assert(session);
+
+	if (session->batch_results)
+		memset(session->batch_results, 0, session->batch_size);
+	session->batch_count = 0;
+}
+
+/**
+ * ipset_replace_publish - publish the new content of the replaced set
+ * @session: session structure
+ *
+ * Commit the buffered elements of the set started to be replaced by
+ * the replace command and make the kernel switch over to the new
+ * content of the set. Nothing is done when no set is being replaced.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int
+ipset_replace_publish(struct ipset_session *session)
+{
+	int ret;
+
+	assert(session);
+
+	if (session->replace_setname[0] == '\0')
+		return 0;
+
+	ret = ipset_commit(session);
+	if (ret < 0)
+		goto out;
+
+	ipset_data_reset(session->data);
+	ipset_data_set(session->data, IPSET_SETNAME,
+		       session->replace_setname);
+	session->replace_publish = true;
+	ret = ipset_cmd(session, IPSET_CMD_REPLACE, 0);
+	session->replace_publish = false;
+out:
+	session->replace_setname[0] = '\0';
+	return ret;
+}
+
 /**
  * ipset_commit - commit buffered commands
  * @session: session structure
@@ -2014,6 +2484,7 @@ ipset_commit(struct ipset_session *session)
 
 	/* Reset saved data and nested state */
 	session->saved_setname[0] = '\0';
+	session->batch_pending = 0;
 	session->printed_set = 0;
 	for (i = session->nestid - 1; i >= 0; i--)
 		session->nested[i] = NULL;
@@ -2142,8 +2613,9 @@ ipset_cmd(struct ipset_session *session, enum ipset_cmd cmd, uint32_t lineno)
 
 	/* We have to save the type for error handling */
 	session->saved_type = ipset_data_get(data, IPSET_OPT_TYPE);
-	if (session->lineno != 0 &&
-	    (cmd == IPSET_CMD_ADD || cmd == IPSET_CMD_DEL)) {
+	if (cmd == IPSET_CMD_TEST_BATCH ||
+	    (session->lineno != 0 &&
+	     (cmd == IPSET_CMD_ADD || cmd == IPSET_CMD_DEL))) {
 		/* Save setname for the next possible aggregated restore line */
 		strcpy(session->saved_setname, ipset_data_setname(data));
 		ipset_data_reset(data);
@@ -2154,10 +2626,15 @@ ipset_cmd(struct ipset_session *session, enum ipset_cmd cmd, uint32_t lineno)
 
 	D("call commit");
 	ret = ipset_commit(session);
+	if (cmd == IPSET_CMD_REPLACE && ret == 0 && !session->replace_publish)
+		/* The next elements of the set go to the new content */
+		strcpy(session->replace_setname, ipset_data_setname(data));
 
 cleanup:
 	D("reset data");
 	ipset_data_reset(data);
+	session->dump_filter = false;
+	elem_filter_reset(session);
 	return ret;
 }
 
@@ -2199,6 +2676,117 @@ ipset_session_print_outfn(struct ipset_session *session,
 	return 0;
 }
 
+/**
+ * ipset_session_transport - set the transport method of the session
+ * @session: session structure
+ * @transport: transport method
+ *
+ * Replace the default netlink transport method of the session, like by
+ * the in-process ipset_mock_transport. The transport method cannot be
+ * changed after the first command of the session was executed.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int
+ipset_session_transport(struct ipset_session *session,
+			const struct ipset_transport *transport)
+{
+	assert(session);
+	assert(transport);
+
+	if (session->handle)
+		return ipset_err(session,
+				 "Transport method cannot be changed "
+				 "in an opened session.");
+	session->transport = transport;
+	return 0;
+}
+
+struct save_lines {
+	ipset_save_linefn linefn;
+	void *p;
+	char line[1024];			/* Partial output line */
+	size_t pos;
+};
+
+static int __attribute__((format(printf, 3, 4)))
+save_lines_outfn(struct ipset_session *session UNUSED, void *p,
+		 const char *fmt, ...)
+{
+	struct save_lines *save = p;
+	va_list args, copy;
+	char *buf, *c;
+	int len;
+
+	va_start(args, fmt);
+	va_copy(copy, args);
+	len = vsnprintf(NULL, 0, fmt, copy);
+	va_end(copy);
+	buf = len < 0 ? NULL : malloc(len + 1);
+	if (buf) {
+		vsnprintf(buf, len + 1, fmt, args);
+		/* Output may be flushed in the middle of a line */
+		for (c = buf; *c; c++) {
+			if (*c != '\n') {
+				if (save->pos < sizeof(save->line) - 1)
+					save->line[save->pos++] = *c;
+				continue;
+			}
+			save->line[save->pos] = '\0';
+			save->linefn(save->p, save->line);
+			save->pos = 0;
+		}
+		free(buf);
+	} else
+		len = -1;
+	va_end(args);
+
+	return len;
+}
+
+/**
+ * ipset_session_save_lines - save a set line by line
+ * @session: session structure
+ * @setname: name of the set
+ * @linefn: function called with the lines of the saved set
+ * @p: private data passed to @linefn
+ *
+ * Save the set over a separate session with the transport method of
+ * @session and call @linefn with each line of the output, without the
+ * newline. @linefn may use @session, even to send commands. Errors of
+ * the save command are reported in @session.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int
+ipset_session_save_lines(struct ipset_session *session, const char *setname,
+			 ipset_save_linefn linefn, void *p)
+{
+	struct save_lines save = { .linefn = linefn, .p = p };
+	struct ipset_session *dump;
+	int ret;
+
+	assert(session);
+	assert(setname);
+	assert(linefn);
+
+	dump = ipset_session_init(save_lines_outfn, &save);
+	if (dump == NULL)
+		return ipset_err(session,
+				 "Cannot allocate memory for the session");
+	ret = ipset_session_transport(dump, session->transport);
+	if (ret == 0)
+		ret = ipset_session_output(dump, IPSET_LIST_SAVE);
+	if (ret == 0)
+		ret = ipset_parse_setname(dump, IPSET_SETNAME, setname);
+	if (ret == 0)
+		ret = ipset_cmd(dump, IPSET_CMD_SAVE, 0);
+	if (ret < 0)
+		ret = ipset_err(session, "%s", ipset_session_report_msg(dump));
+	ipset_session_fini(dump);
+	return ret;
+}
+
 /**
  * ipset_session_init - initialize an ipset session
  * @outfn: output printing function
@@ -2232,7 +2820,7 @@ ipset_session_init(ipset_print_outfn print_outfn, void *p)
 	INIT_LIST_HEAD(&session->sorted);
 	INIT_LIST_HEAD(&session->pool);
 
-	/* The single transport method yet */
+	/* Default transport method */
 	session->transport = &ipset_mnl_transport;
 
 	/* Output function */
@@ -2477,6 +3065,7 @@ ipset_session_fini(struct ipset_session *session)
 		list_del(&pos->list);
 		free(pos);
 	}
+	free(session->batch_results);
 	free(session->outbuf);
 	free(session);
 	return 0;
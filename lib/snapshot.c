@@ -0,0 +1,606 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <assert.h>				/* assert */
+#include <arpa/inet.h>				/* inet_pton */
+#include <ctype.h>				/* isspace */
+#include <errno.h>				/* errno */
+#include <fcntl.h>				/* open */
+#include <limits.h>				/* PATH_MAX */
+#include <stdio.h>				/* fopen, snprintf */
+#include <stdlib.h>				/* malloc, free */
+#include <string.h>				/* str* */
+#include <sys/mman.h>				/* mmap */
+#include <sys/stat.h>				/* fstat */
+#include <unistd.h>				/* close */
+
+#include <libipset/data.h>			/* ipset_data_* */
+#include <libipset/nfproto.h>			/* NFPROTO_* */
+#include <libipset/parse.h>			/* ipset_parse_setname */
+#include <libipset/session.h>			/* ipset_session_* */
+#include <libipset/types.h>			/* ipset_type_get */
+#include <libipset/utils.h>			/* STREQ */
+#include <libipset/snapshot.h>			/* prototypes */
+
+/* Read-only snapshots of the sets for lookups in userspace
+ *
+ * A snapshot is created from the saved content of a set with IPv4 or
+ * IPv6 address/network elements. The elements, ranges and nomatch
+ * networks are flattened into sorted, disjoint address intervals, so
+ * a lookup in the memory mapped file is a binary search without any
+ * syscall. The file is replaced atomically, processes which mapped
+ * the previous snapshot keep using it until they open the new one.
+ */
+
+/* Host order address, IPv4 addresses in the low 32 bits */
+struct snap_addr {
+	uint64_t hi, lo;
+};
+
+struct snap_interval {
+	struct snap_addr first, last;
+	bool match;				/* false for nomatch */
+};
+
+struct snap_build {
+	struct snap_interval *items;		/* Intervals of the elements */
+	size_t count, size;
+	struct snap_interval *out;		/* Flattened intervals */
+	size_t outcount, outsize;
+	uint8_t family;
+	uint8_t netmask;			/* Netmask of the set or 0 */
+	const char *setname;
+	int error;				/* Unparsable element, ENOMEM */
+};
+
+struct ipset_snapshot {
+	void *map;
+	size_t len;
+	const struct ipset_snapshot_hdr *hdr;
+	const void *items;
+};
+
+static inline int
+addr_cmp(const struct snap_addr *a, const struct snap_addr *b)
+{
+	if (a->hi != b->hi)
+		return a->hi < b->hi ? -1 : 1;
+	if (a->lo != b->lo)
+		return a->lo < b->lo ? -1 : 1;
+	return 0;
+}
+
+/* Returns true on overflow */
+static inline bool
+addr_inc(struct snap_addr *a, uint8_t family)
+{
+	if (family == NFPROTO_IPV4) {
+		if (a->lo == UINT32_MAX)
+			return true;
+		a->lo++;
+		return false;
+	}
+	if (++a->lo == 0 && ++a->hi == 0)
+		return true;
+	return false;
+}
+
+static inline void
+addr_dec(struct snap_addr *a)
+{
+	if (a->lo-- == 0)
+		a->hi--;
+}
+
+static int
+addr_parse(const char *str, uint8_t family, struct snap_addr *a)
+{
+	uint8_t buf[sizeof(struct in6_addr)];
+	int i;
+
+	if (inet_pton(family == NFPROTO_IPV4 ? AF_INET : AF_INET6,
+		      str, buf) != 1)
+		return -1;
+	a->hi = a->lo = 0;
+	if (family == NFPROTO_IPV4) {
+		for (i = 0; i < 4; i++)
+			a->lo = (a->lo << 8) | buf[i];
+		return 0;
+	}
+	for (i = 0; i < 8; i++) {
+		a->hi = (a->hi << 8) | buf[i];
+		a->lo = (a->lo << 8) | buf[i + 8];
+	}
+	return 0;
+}
+
+/* Host bits of a network: the low 64 - cidr bits of a 64 bits word */
+static inline uint64_t
+hostmask64(int bits)
+{
+	return bits >= 64 ? UINT64_MAX : bits <= 0 ? 0 :
+	       (UINT64_C(1) << bits) - 1;
+}
+
+/* ELEM := ADDR | ADDR/CIDR | ADDR-ADDR
+ *
+ * A single address of a set with netmask stands for the whole network.
+ */
+static int
+interval_parse(char *elem, uint8_t family, uint8_t netmask,
+	       struct snap_interval *i)
+{
+	unsigned int maxcidr = family == NFPROTO_IPV4 ? 32 : 128;
+	unsigned long cidr = netmask && netmask < maxcidr ? netmask : maxcidr;
+	char *sep, *end;
+	int host;
+
+	sep = strpbrk(elem, "/-");
+	if (sep && *sep == '-') {
+		*sep = '\0';
+		if (addr_parse(elem, family, &i->first) ||
+		    addr_parse(sep + 1, family, &i->last) ||
+		    addr_cmp(&i->first, &i->last) > 0)
+			return -1;
+		return 0;
+	}
+	if (sep) {
+		*sep = '\0';
+		errno = 0;
+		cidr = strtoul(sep + 1, &end, 10);
+		if (errno || end == sep + 1 || *end != '\0' || cidr > maxcidr)
+			return -1;
+	}
+	if (addr_parse(elem, family, &i->first))
+		return -1;
+	host = maxcidr - cidr;
+	i->first.lo &= ~hostmask64(host);
+	i->first.hi &= ~hostmask64(host - 64);
+	i->last.lo = i->first.lo | hostmask64(host);
+	i->last.hi = i->first.hi | hostmask64(host - 64);
+	if (family == NFPROTO_IPV4)
+		i->last.lo &= UINT32_MAX;
+	return 0;
+}
+
+/* Index the "add SETNAME ELEM [options]" lines of the saved set and
+ * pick up the netmask from the "create" line.
+ */
+static void
+snapshot_line(void *p, char *line)
+{
+	struct snap_build *b = p;
+	size_t len = strlen(b->setname);
+	struct snap_interval *i;
+	char *elem, *opt, *c;
+
+	if (strncmp(line, "create ", 7) == 0 &&
+	    strncmp(line + 7, b->setname, len) == 0 &&
+	    line[7 + len] == ' ') {
+		c = strstr(line + 7 + len, " netmask ");
+		if (c)
+			b->netmask = atoi(c + 9);
+		return;
+	}
+	if (b->error ||
+	    strncmp(line, "add ", 4) != 0 ||
+	    strncmp(line + 4, b->setname, len) != 0 ||
+	    line[4 + len] != ' ')
+		return;
+	elem = line + 4 + len + 1;
+	for (c = elem; *c && !isspace(*c); c++)
+		;
+	opt = *c ? c + 1 : c;
+	*c = '\0';
+
+	if (b->count == b->size) {
+		size_t size = b->size ? b->size * 2 : 1024;
+
+		i = realloc(b->items, size * sizeof(*i));
+		if (i == NULL) {
+			b->error = ENOMEM;
+			return;
+		}
+		b->items = i;
+		b->size = size;
+	}
+	i = &b->items[b->count];
+	if (interval_parse(elem, b->family, b->netmask, i)) {
+		b->error = EINVAL;
+		return;
+	}
+	i->match = true;
+	for (c = strtok(opt, " \t"); c; c = strtok(NULL, " \t"))
+		if (STREQ(c, "nomatch"))
+			i->match = false;
+	b->count++;
+}
+
+/* Sort by first address, the wider interval first */
+static int
+interval_cmp(const void *x, const void *y)
+{
+	const struct snap_interval *a = x, *b = y;
+	int ret = addr_cmp(&a->first, &b->first);
+
+	return ret ? ret : -addr_cmp(&a->last, &b->last);
+}
+
+/* Append a flattened interval, merge it with the previous one if they
+ * are adjacent.
+ */
+static int
+snapshot_emit(struct snap_build *b, const struct snap_addr *first,
+	      const struct snap_addr *last, bool match)
+{
+	struct snap_interval *o;
+	struct snap_addr next;
+
+	if (!match || addr_cmp(first, last) > 0)
+		return 0;
+	if (b->outcount) {
+		o = &b->out[b->outcount - 1];
+		next = o->last;
+		if (!addr_inc(&next, b->family) && addr_cmp(&next, first) == 0) {
+			o->last = *last;
+			return 0;
+		}
+	}
+	if (b->outcount == b->outsize) {
+		size_t size = b->outsize ? b->outsize * 2 : 1024;
+
+		o = realloc(b->out, size * sizeof(*o));
+		if (o == NULL)
+			return -1;
+		b->out = o;
+		b->outsize = size;
+	}
+	o = &b->out[b->outcount++];
+	o->first = *first;
+	o->last = *last;
+	o->match = true;
+	return 0;
+}
+
+/* The elements are either disjoint or nested networks, as in a hash:net
+ * set with nomatch entries: the innermost interval decides about an
+ * address, as the most specific network does in the kernel.
+ */
+static int
+snapshot_flatten(struct snap_build *b)
+{
+	struct snap_interval **stack, *top;
+	struct snap_addr cursor = {}, end;
+	bool past_end = false;
+	size_t i, depth = 0;
+	int ret = 0;
+
+	if (b->count == 0)
+		return 0;
+	stack = calloc(b->count, sizeof(*stack));
+	if (stack == NULL)
+		return -1;
+	qsort(b->items, b->count, sizeof(*b->items), interval_cmp);
+
+	for (i = 0; i < b->count && ret == 0; i++) {
+		/* Close the intervals which end before the next one */
+		while (depth &&
+		       addr_cmp(&stack[depth - 1]->last,
+				&b->items[i].first) < 0) {
+			top = stack[--depth];
+			if (!past_end)
+				ret |= snapshot_emit(b, &cursor, &top->last,
+						     top->match);
+			cursor = top->last;
+			past_end = addr_inc(&cursor, b->family);
+		}
+		if (depth && !past_end &&
+		    addr_cmp(&cursor, &b->items[i].first) < 0) {
+			end = b->items[i].first;
+			addr_dec(&end);
+			ret |= snapshot_emit(b, &cursor, &end,
+					     stack[depth - 1]->match);
+		}
+		cursor = b->items[i].first;
+		past_end = false;
+		stack[depth++] = &b->items[i];
+	}
+	while (depth && ret == 0) {
+		top = stack[--depth];
+		if (!past_end)
+			ret |= snapshot_emit(b, &cursor, &top->last,
+					     top->match);
+		cursor = top->last;
+		past_end = addr_inc(&cursor, b->family);
+	}
+	free(stack);
+	return ret;
+}
+
+static int
+snapshot_write(struct ipset_session *session, struct snap_build *b,
+	       const struct ipset_type *type, const char *filename)
+{
+	struct ipset_snapshot_hdr hdr = {};
+	char tmpname[PATH_MAX];
+	size_t i;
+	FILE *f;
+	int fd, ret = 0;
+
+	memcpy(hdr.magic, IPSET_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+	hdr.version = IPSET_SNAPSHOT_VERSION;
+	hdr.byteorder = IPSET_SNAPSHOT_BYTEORDER;
+	hdr.family = b->family;
+	hdr.count = b->outcount;
+	strncpy(hdr.setname, b->setname, IPSET_MAXNAMELEN - 1);
+	strncpy(hdr.typename, type->name, IPSET_MAXNAMELEN - 1);
+
+	/* Write a new file and rename it, so readers never see a partial
+	 * snapshot.
+	 */
+	if (snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", filename)
+	    >= (int)sizeof(tmpname))
+		return ipset_err(session, "Snapshot filename %s is too long",
+				 filename);
+	fd = mkstemp(tmpname);
+	if (fd < 0)
+		return ipset_err(session, "Cannot create snapshot file %s: %s",
+				 filename, strerror(errno));
+	f = fdopen(fd, "w");
+	if (f == NULL) {
+		close(fd);
+		unlink(tmpname);
+		return ipset_err(session, "Cannot create snapshot file %s: %s",
+				 filename, strerror(errno));
+	}
+
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+		ret = -1;
+	for (i = 0; i < b->outcount && ret == 0; i++) {
+		const struct snap_interval *o = &b->out[i];
+
+		if (b->family == NFPROTO_IPV4) {
+			struct ipset_snapshot_ip4 e = {
+				.first = o->first.lo,
+				.last = o->last.lo,
+			};
+
+			if (fwrite(&e, sizeof(e), 1, f) != 1)
+				ret = -1;
+		} else {
+			struct ipset_snapshot_ip6 e = {
+				.first = { o->first.hi, o->first.lo },
+				.last = { o->last.hi, o->last.lo },
+			};
+
+			if (fwrite(&e, sizeof(e), 1, f) != 1)
+				ret = -1;
+		}
+	}
+	if (fclose(f) != 0)
+		ret = -1;
+	if (ret == 0 && (chmod(tmpname, 0644) || rename(tmpname, filename)))
+		ret = -1;
+	if (ret < 0) {
+		ret = ipset_err(session, "Cannot write snapshot file %s: %s",
+				filename, strerror(errno));
+		unlink(tmpname);
+	}
+	return ret;
+}
+
+/**
+ * ipset_snapshot_create - create a snapshot file of a set
+ * @session: session structure
+ * @setname: name of the set
+ * @filename: snapshot file to create or replace
+ *
+ * Save the set and store its elements in a compact, sorted file which
+ * can be memory mapped by ipset_snapshot_open() and searched by
+ * ipset_snapshot_test(). Only the set types with a single IPv4 or IPv6
+ * address or network dimension are supported. Nomatch elements are
+ * taken into account. The snapshot is not updated when the set changes.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int
+ipset_snapshot_create(struct ipset_session *session,
+		      const char *setname, const char *filename)
+{
+	struct ipset_data *data;
+	const struct ipset_type *type;
+	struct snap_build b = { .setname = setname };
+	int ret;
+
+	assert(session);
+	assert(setname);
+	assert(filename);
+
+	data = ipset_session_data(session);
+	ipset_data_reset(data);
+	ret = ipset_parse_setname(session, IPSET_SETNAME, setname);
+	if (ret < 0)
+		return ret;
+	type = ipset_type_get(session, IPSET_CMD_TEST);
+	if (type == NULL)
+		return -1;
+	b.family = ipset_data_family(data);
+	if (type->dimension != IPSET_DIM_ONE ||
+	    type->elem[IPSET_DIM_ONE - 1].opt != IPSET_OPT_IP ||
+	    (b.family != NFPROTO_IPV4 && b.family != NFPROTO_IPV6))
+		return ipset_err(session,
+			"Set %s of type %s cannot be snapshotted: "
+			"only address/network types are supported",
+			setname, type->name);
+
+	ret = ipset_session_save_lines(session, setname, snapshot_line, &b);
+	if (ret < 0)
+		goto out;
+
+	if (b.error == EINVAL)
+		ret = ipset_err(session,
+			"Cannot parse the elements of set %s", setname);
+	else if (b.error || snapshot_flatten(&b) < 0)
+		ret = ipset_err(session,
+			"Cannot allocate memory for the snapshot");
+	else
+		ret = snapshot_write(session, &b, type, filename);
+out:
+	free(b.items);
+	free(b.out);
+	return ret;
+}
+
+/**
+ * ipset_snapshot_open - map a snapshot file
+ * @filename: snapshot file created by ipset_snapshot_create()
+ *
+ * Map the snapshot file read-only and shared, so that multiple processes
+ * can use the same copy.
+ *
+ * Returns the snapshot on success or NULL with errno set.
+ */
+struct ipset_snapshot *
+ipset_snapshot_open(const char *filename)
+{
+	struct ipset_snapshot *snapshot;
+	const struct ipset_snapshot_hdr *hdr;
+	struct stat st;
+	size_t isize;
+	int fd, err = EINVAL;
+
+	assert(filename);
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	snapshot = calloc(1, sizeof(*snapshot));
+	if (snapshot == NULL) {
+		err = ENOMEM;
+		goto close_fd;
+	}
+	if (fstat(fd, &st) < 0) {
+		err = errno;
+		goto free_snapshot;
+	}
+	if ((size_t)st.st_size < sizeof(*hdr))
+		goto free_snapshot;
+	snapshot->len = st.st_size;
+	snapshot->map = mmap(NULL, snapshot->len, PROT_READ, MAP_SHARED,
+			     fd, 0);
+	if (snapshot->map == MAP_FAILED) {
+		err = errno;
+		goto free_snapshot;
+	}
+	hdr = snapshot->map;
+	isize = hdr->family == NFPROTO_IPV4
+		? sizeof(struct ipset_snapshot_ip4)
+		: sizeof(struct ipset_snapshot_ip6);
+	if (memcmp(hdr->magic, IPSET_SNAPSHOT_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != IPSET_SNAPSHOT_VERSION ||
+	    hdr->byteorder != IPSET_SNAPSHOT_BYTEORDER ||
+	    (hdr->family != NFPROTO_IPV4 && hdr->family != NFPROTO_IPV6) ||
+	    hdr->count > (snapshot->len - sizeof(*hdr)) / isize) {
+		munmap(snapshot->map, snapshot->len);
+		goto free_snapshot;
+	}
+	snapshot->hdr = hdr;
+	snapshot->items = hdr + 1;
+	close(fd);
+	return snapshot;
+
+free_snapshot:
+	free(snapshot);
+close_fd:
+	close(fd);
+	errno = err;
+	return NULL;
+}
+
+/**
+ * ipset_snapshot_test - test an address in a snapshot
+ * @snapshot: snapshot mapped by ipset_snapshot_open()
+ * @family: NFPROTO_IPV4 or NFPROTO_IPV6
+ * @addr: struct in_addr or struct in6_addr in network byte order
+ *
+ * Returns true if the address was in the set when the snapshot was
+ * created. Addresses of the other family are never in the set.
+ */
+bool
+ipset_snapshot_test(const struct ipset_snapshot *snapshot,
+		    uint8_t family, const void *addr)
+{
+	const uint8_t *p = addr;
+	size_t lo = 0, hi, mid;
+
+	assert(snapshot);
+	assert(addr);
+
+	if (family != snapshot->hdr->family)
+		return false;
+	hi = snapshot->hdr->count;
+
+	if (family == NFPROTO_IPV4) {
+		const struct ipset_snapshot_ip4 *e = snapshot->items;
+		uint32_t ip = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+			      (uint32_t)p[2] << 8 | p[3];
+
+		/* Find the last interval starting at or below the address */
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (e[mid].first <= ip)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo && ip <= e[lo - 1].last;
+	} else {
+		const struct ipset_snapshot_ip6 *e = snapshot->items;
+		uint64_t ip[2] = {};
+		int i;
+
+		for (i = 0; i < 8; i++) {
+			ip[0] = (ip[0] << 8) | p[i];
+			ip[1] = (ip[1] << 8) | p[i + 8];
+		}
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (e[mid].first[0] < ip[0] ||
+			    (e[mid].first[0] == ip[0] &&
+			     e[mid].first[1] <= ip[1]))
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (!lo)
+			return false;
+		e += lo - 1;
+		return ip[0] < e->last[0] ||
+		       (ip[0] == e->last[0] && ip[1] <= e->last[1]);
+	}
+}
+
+/**
+ * ipset_snapshot_header - get the header of a snapshot
+ * @snapshot: snapshot mapped by ipset_snapshot_open()
+ *
+ * Returns the header with the name, type and family of the set.
+ */
+const struct ipset_snapshot_hdr *
+ipset_snapshot_header(const struct ipset_snapshot *snapshot)
+{
+	assert(snapshot);
+
+	return snapshot->hdr;
+}
+
+/**
+ * ipset_snapshot_close - unmap a snapshot
+ * @snapshot: snapshot mapped by ipset_snapshot_open()
+ */
+void
+ipset_snapshot_close(struct ipset_snapshot *snapshot)
+{
+	assert(snapshot);
+
+	munmap(snapshot->map, snapshot->len);
+	free(snapshot);
+}
@@ -0,0 +1,938 @@
+/* Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/* Benchmark of the hash and bitmap set types in userspace.
+ *
+ * Every set type is driven through its userspace interface, exactly as
+ * the netlink handlers of the core do it: the elements are passed to
+ * uadt() as parsed attributes, full hash tables are resized when uadt()
+ * returns -EAGAIN. The attributes are prepared before the measurements,
+ * so the reported time per operation is spent in the set type only.
+ *
+ * In packet mode the sets are filled the same way, then tested by kadt()
+ * with packets built from the tested elements, as a rule chain of set
+ * matches tests them.
+ */
+
+#include <getopt.h>
+#include <time.h>
+
+#include <linux/netfilter/ipset/ip_set.h>
+#include <linux/netfilter/ipset/ip_set_bitmap.h>
+
+#define BENCH_ELEMS		65536
+#define BENCH_ATTRLEN		128
+#define BENCH_SKBLEN		1024
+#define BENCH_PKTLEN		256
+#define BENCH_PKTALIGN		2	/* NET_IP_ALIGN */
+#define BENCH_PKTCHUNK		4096
+#define BENCH_MAXSETS		32
+#define BENCH_MAXBATCH		64
+
+/* Attributes of an element or of a create request */
+struct bench_attrs {
+	struct nlattr *tb[IPSET_ATTR_ADT_MAX + 1];
+	unsigned char buf[BENCH_ATTRLEN];
+	int len;
+};
+
+struct bench_type {
+	const char *name;
+	u8 family;
+	bool timeout;			/* supports the timeout extension */
+	/* Type specific create attributes */
+	void (*create)(struct bench_attrs *a, u32 n);
+	/* Attributes of the element #i: hosts of network elements
+	 * when test is true
+	 */
+	void (*elem)(struct bench_attrs *a, u8 family, u32 i, bool test);
+};
+
+/* Results in nanosec per operation, negative when not applicable */
+struct bench_result {
+	double add, test_hit, test_miss, del, resize, expire;
+	double pkt_hit, pkt_miss;	/* per packet, all sets tested */
+	u32 memsize;
+};
+
+/* A packet of the packet mode */
+struct bench_pkt {
+	struct sk_buff skb;
+	char iface[IFNAMSIZ];		/* input interface */
+	unsigned char buf[BENCH_PKTLEN] __attribute__((aligned(8)));
+};
+
+static struct net bench_net;
+static bool with_cache;
+static bool pkt_mode;			/* test packets by kadt() */
+static u32 pkt_sets = 1;		/* sets tested with every packet */
+static bool pkt_fresh_opt;		/* new options for every set */
+static u32 pkt_exthdrs;			/* IPv6 extension headers */
+static u32 pkt_batch;			/* packets per ip_set_test_batch() */
+
+static void
+put_attr(struct bench_attrs *a, int type, const void *data, int len)
+{
+	struct nlattr *nla = (struct nlattr *)(a->buf + a->len);
+
+	if (a->len + nla_total_size(len) > BENCH_ATTRLEN) {
+		fprintf(stderr, "attribute buffer too small\n");
+		exit(1);
+	}
+	nla->nla_type = type;
+	nla->nla_len = NLA_HDRLEN + len;
+	if (len)
+		memcpy(nla_data(nla), data, len);
+	a->len += nla_total_size(len);
+}
+
+static void
+put_u8(struct bench_attrs *a, int type, u8 value)
+{
+	put_attr(a, type, &value, sizeof(value));
+}
+
+static void
+put_net16(struct bench_attrs *a, int type, u16 value)
+{
+	__be16 v = htons(value);
+
+	put_attr(a, type | NLA_F_NET_BYTEORDER, &v, sizeof(v));
+}
+
+static void
+put_net32(struct bench_attrs *a, int type, u32 value)
+{
+	__be32 v = htonl(value);
+
+	put_attr(a, type | NLA_F_NET_BYTEORDER, &v, sizeof(v));
+}
+
+static void
+put_ip(struct bench_attrs *a, int type, u8 family,
+       const union nf_inet_addr *ip)
+{
+	struct nlattr *nest = (struct nlattr *)(a->buf + a->len);
+
+	put_attr(a, type | NLA_F_NESTED, NULL, 0);
+	if (family == NFPROTO_IPV4)
+		put_attr(a, IPSET_ATTR_IPADDR_IPV4 | NLA_F_NET_BYTEORDER,
+			 &ip->ip, sizeof(ip->ip));
+	else
+		put_attr(a, IPSET_ATTR_IPADDR_IPV6 | NLA_F_NET_BYTEORDER,
+			 &ip->in6, sizeof(ip->in6));
+	nest->nla_len = a->buf + a->len - (unsigned char *)nest;
+}
+
+/* Element keys. The address and the network #i are distinct for every
+ * i, the host #i is in the network #i.
+ */
+static void
+host(union nf_inet_addr *ip, u8 family, u32 i)
+{
+	memset(ip, 0, sizeof(*ip));
+	if (family == NFPROTO_IPV4) {
+		ip->ip = htonl(0x0a000000 + i);
+	} else {
+		ip->ip6[0] = htonl(0x20010db8);
+		ip->ip6[3] = htonl(i);
+	}
+}
+
+static void
+net(union nf_inet_addr *ip, u8 family, u32 i, bool test)
+{
+	memset(ip, 0, sizeof(*ip));
+	if (family == NFPROTO_IPV4) {
+		ip->ip = htonl(0x0a000000 + (i << 8) + test);
+	} else {
+		ip->ip6[0] = htonl(0x20010db8);
+		ip->ip6[1] = htonl(i);
+		ip->ip6[3] = htonl(test);
+	}
+}
+
+static u8
+net_cidr(u8 family)
+{
+	return family == NFPROTO_IPV4 ? 24 : 64;
+}
+
+static void
+put_host(struct bench_attrs *a, int type, u8 family, u32 i)
+{
+	union nf_inet_addr ip;
+
+	host(&ip, family, i);
+	put_ip(a, type, family, &ip);
+}
+
+static void
+put_net(struct bench_attrs *a, int type, int cidr_type, u8 family, u32 i,
+	bool test)
+{
+	union nf_inet_addr ip;
+
+	net(&ip, family, i, test);
+	put_ip(a, type, family, &ip);
+	if (!test)
+		put_u8(a, cidr_type, net_cidr(family));
+}
+
+static void
+put_ether(struct bench_attrs *a, u32 i)
+{
+	unsigned char ether[ETH_ALEN] = { 0x02, 0x00 };
+
+	ether[2] = i >> 24;
+	ether[3] = i >> 16;
+	ether[4] = i >> 8;
+	ether[5] = i;
+	put_attr(a, IPSET_ATTR_ETHER, ether, ETH_ALEN);
+}
+
+static void
+put_port(struct bench_attrs *a, u32 i)
+{
+	put_net16(a, IPSET_ATTR_PORT, 1 + i % 1024);
+	put_u8(a, IPSET_ATTR_PROTO, IPPROTO_TCP);
+}
+
+/* Set types */
+
+static void
+hash_create(struct bench_attrs *a, u32 n)
+{
+	put_net32(a, IPSET_ATTR_HASHSIZE, n);
+	put_net32(a, IPSET_ATTR_MAXELEM, 4 * n);
+}
+
+static void
+bitmap_ip_create(struct bench_attrs *a, u32 n)
+{
+	put_host(a, IPSET_ATTR_IP, NFPROTO_IPV4, 0);
+	put_host(a, IPSET_ATTR_IP_TO, NFPROTO_IPV4, 2 * n - 1);
+}
+
+static void
+bitmap_port_create(struct bench_attrs *a, u32 n)
+{
+	put_net16(a, IPSET_ATTR_PORT, 0);
+	put_net16(a, IPSET_ATTR_PORT_TO, 2 * n - 1);
+}
+
+static void
+ip_elem(struct bench_attrs *a, u8 family, u32 i, bool test)
+{
+	put_host(a, IPSET_ATTR_IP, family, i);
+}
+
+static void
+ipmac_elem(struct bench_attrs *a, u8 family, u32 i, bool test)
+{
+	put_host(a, IPSET_ATTR_IP, family, i);
+	put_ether(a, i);
+}
+
+static void
+port_elem(struct bench_attrs *a, u8 family, u32 i, bool test)
+{
+	put_net16(a, IPSET_ATTR_PORT, i);
+}
+
+static void
+ipmark_elem(struct bench_attrs *a, u8 family, u32 i, bool test)
+{
+	put_host(a, IPSET_ATTR_IP, family, i);
+	put_net32(a, IPSET_ATTR_MARK, i);
+}
+
+static void
+ipport_elem(struct bench_attrs *a, u8 family, u32 i, bool test)
+{
+	put_host(a, IPSET_ATTR_IP, family, i / 1024);
+	put_port(a, i);
+}
+
+static void
+ipportip_elem(struct bench_attrs *a, u8 family, u32 i, bool test)
+{
+	ipport_elem(a, family, i, test);
+	put_host(a, IPSET_ATTR_IP2, family, i % 7);
+}
+
+static void
+ipportnet_elem(struct bench_attrs *a, u8 family, u32 i, bool test)
+{
+	ipport_elem(a, family, i, test);
+	put_net(a, IPSET_ATTR_IP2, IPSET_ATTR_CIDR2, family, i % 7, test);
+}
+
+static void
+mac_elem(struct bench_attrs *a, u8 family, u32 i, bool test)
+{
+	put_ether(a, i);
+}
+
+static void
+net_elem(struct bench_attrs *a, u8 family, u32 i, bool test)
+{
+	put_net(a, IPSET_ATTR_IP, IPSET_ATTR_CIDR, family, i, test);
+}
+
+static void
+netiface_elem(struct bench_attrs *a, u8 family, u32 i, bool test)
+{
+	char iface[IFNAMSIZ];
+
+	net_elem(a, family, i, test);
+	snprintf(iface, sizeof(iface), "eth%u", i % 16);
+	put_attr(a, IPSET_ATTR_IFACE, iface, strlen(iface) + 1);
+}
+
+static void
+netnet_elem(struct bench_attrs *a, u8 family, u32 i, bool test)
+{
+	net_elem(a, family, i, test);
+	put_net(a, IPSET_ATTR_IP2, IPSET_ATTR_CIDR2, family, i % 7, test);
+}
+
+static void
+netport_elem(struct bench_attrs *a, u8 family, u32 i, bool test)
+{
+	put_net(a, IPSET_ATTR_IP, IPSET_ATTR_CIDR, family, i / 1024, test);
+	put_port(a, i);
+}
+
+static void
+netportnet_elem(struct bench_attrs *a, u8 family, u32 i, bool test)
+{
+	netport_elem(a, family, i, test);
+	put_net(a, IPSET_ATTR_IP2, IPSET_ATTR_CIDR2, family, i % 7, test);
+}
+
+static const struct bench_type bench_types[] = {
+	{ "bitmap:ip",		NFPROTO_IPV4,	true,
+	  bitmap_ip_create,	ip_elem },
+	{ "bitmap:ip,mac",	NFPROTO_IPV4,	true,
+	  bitmap_ip_create,	ipmac_elem },
+	{ "bitmap:port",	NFPROTO_IPV4,	true,
+	  bitmap_port_create,	port_elem },
+	{ "bitmap:sparseip",	NFPROTO_IPV4,	false,
+	  bitmap_ip_create,	ip_elem },
+	{ "hash:ip",		NFPROTO_IPV4,	true,
+	  hash_create,		ip_elem },
+	{ "hash:ip",		NFPROTO_IPV6,	true,
+	  hash_create,		ip_elem },
+	{ "hash:ip,mac",	NFPROTO_IPV4,	true,
+	  hash_create,		ipmac_elem },
+	{ "hash:ip,mac",	NFPROTO_IPV6,	true,
+	  hash_create,		ipmac_elem },
+	{ "hash:ip,mark",	NFPROTO_IPV4,	true,
+	  hash_create,		ipmark_elem },
+	{ "hash:ip,mark",	NFPROTO_IPV6,	true,
+	  hash_create,		ipmark_elem },
+	{ "hash:ip,port",	NFPROTO_IPV4,	true,
+	  hash_create,		ipport_elem },
+	{ "hash:ip,port",	NFPROTO_IPV6,	true,
+	  hash_create,		ipport_elem },
+	{ "hash:ip,port,ip",	NFPROTO_IPV4,	true,
+	  hash_create,		ipportip_elem },
+	{ "hash:ip,port,ip",	NFPROTO_IPV6,	true,
+	  hash_create,		ipportip_elem },
+	{ "hash:ip,port,net",	NFPROTO_IPV4,	true,
+	  hash_create,		ipportnet_elem },
+	{ "hash:ip,port,net",	NFPROTO_IPV6,	true,
+	  hash_create,		ipportnet_elem },
+	{ "hash:mac",		NFPROTO_UNSPEC,	true,
+	  hash_create,		mac_elem },
+	{ "hash:net",		NFPROTO_IPV4,	true,
+	  hash_create,		net_elem },
+	{ "hash:net",		NFPROTO_IPV6,	true,
+	  hash_create,		net_elem },
+	{ "hash:net,iface",	NFPROTO_IPV4,	true,
+	  hash_create,		netiface_elem },
+	{ "hash:net,iface",	NFPROTO_IPV6,	true,
+	  hash_create,		netiface_elem },
+	{ "hash:net,net",	NFPROTO_IPV4,	true,
+	  hash_create,		netnet_elem },
+	{ "hash:net,net",	NFPROTO_IPV6,	true,
+	  hash_create,		netnet_elem },
+	{ "hash:net,port",	NFPROTO_IPV4,	true,
+	  hash_create,		netport_elem },
+	{ "hash:net,port",	NFPROTO_IPV6,	true,
+	  hash_create,		netport_elem },
+	{ "hash:net,port,net",	NFPROTO_IPV4,	true,
+	  hash_create,		netportnet_elem },
+	{ "hash:net,port,net",	NFPROTO_IPV6,	true,
+	  hash_create,		netportnet_elem },
+};
+
+static const char *
+family_name(u8 family)
+{
+	return family == NFPROTO_IPV4 ? "inet" :
+	       family == NFPROTO_IPV6 ? "inet6" : "any";
+}
+
+static void
+parse_attrs(struct bench_attrs *a)
+{
+	if (nla_parse(a->tb, IPSET_ATTR_ADT_MAX, (struct nlattr *)a->buf,
+		      a->len, NULL, NULL)) {
+		fprintf(stderr, "cannot parse attributes\n");
+		exit(1);
+	}
+}
+
+static struct bench_attrs *
+prepare_elems(const struct bench_type *bt, u32 from, u32 n, bool test)
+{
+	struct bench_attrs *elems = calloc(n, sizeof(*elems));
+	u32 i;
+
+	if (!elems) {
+		fprintf(stderr, "cannot allocate %u elements\n", n);
+		exit(1);
+	}
+	for (i = 0; i < n; i++) {
+		bt->elem(&elems[i], bt->family, from + i, test);
+		parse_attrs(&elems[i]);
+	}
+	return elems;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static struct ip_set *
+bench_create(const struct bench_type *bt, u32 n, u32 timeout)
+{
+	struct ip_set_type *type = kshim_find_type(bt->name, bt->family);
+	struct bench_attrs a = { .len = 0 };
+	struct ip_set *set;
+	u32 cadt_flags = with_cache && !timeout ? IPSET_FLAG_WITH_CACHE : 0;
+	int ret;
+
+	if (!type) {
+		fprintf(stderr, "%s: set type is not compiled in\n", bt->name);
+		exit(1);
+	}
+	bt->create(&a, n);
+	if (timeout)
+		put_net32(&a, IPSET_ATTR_TIMEOUT, timeout);
+	if (cadt_flags && strncmp(bt->name, "hash:", 5) == 0)
+		put_net32(&a, IPSET_ATTR_CADT_FLAGS, cadt_flags);
+	if (nla_parse(a.tb, IPSET_ATTR_CREATE_MAX, (struct nlattr *)a.buf,
+		      a.len, NULL, NULL))
+		exit(1);
+
+	set = calloc(1, sizeof(*set));
+	if (!set)
+		exit(1);
+	snprintf(set->name, IPSET_MAXNAMELEN, "bench");
+	spin_lock_init(&set->lock);
+	set->family = bt->family;
+	set->revision = type->revision_max;
+	set->type = type;
+	ret = type->create(&bench_net, set, a.tb, 0);
+	if (ret) {
+		fprintf(stderr, "%s %s: create failed: %d\n",
+			bt->name, family_name(bt->family), ret);
+		exit(1);
+	}
+	return set;
+}
+
+static void
+bench_destroy(struct ip_set *set)
+{
+	set->variant->destroy(set);
+	free(set);
+}
+
+/* Run the operation on the elements, as the core does */
+static double
+bench_adt(const struct bench_type *bt, struct ip_set *set,
+	  enum ipset_adt adt, struct bench_attrs *elems, u32 n, int expect)
+{
+	double start = now();
+	u32 i, lineno;
+	int ret;
+
+	for (i = 0; i < n; i++) {
+		bool retried = false;
+
+		do {
+			ret = set->variant->uadt(set, elems[i].tb, adt,
+						 &lineno, 0, retried);
+			retried = true;
+		} while (ret == -EAGAIN &&
+			 set->variant->resize &&
+			 (ret = set->variant->resize(set, retried)) == 0);
+		if (adt == IPSET_TEST)
+			ret = ret > 0;
+		if (ret != expect) {
+			fprintf(stderr, "%s %s: %s of element #%u: %d\n",
+				bt->name, family_name(bt->family),
+				adt == IPSET_ADD ? "add" :
+				adt == IPSET_DEL ? "del" : "test", i, ret);
+			exit(1);
+		}
+	}
+	return (now() - start) / n;
+}
+
+/* Memory size reported by the listing header */
+static u32
+bench_memsize(struct ip_set *set)
+{
+	unsigned char buf[BENCH_SKBLEN];
+	struct nlattr *attr[IPSET_ATTR_CMD_MAX + 1];
+	struct nlattr *tb[IPSET_ATTR_CREATE_MAX + 1];
+	struct sk_buff skb = {
+		.head = buf,
+		.data = buf,
+		.end = sizeof(buf),
+	};
+
+	if (set->variant->head(set, &skb) ||
+	    nla_parse(attr, IPSET_ATTR_CMD_MAX, (struct nlattr *)buf,
+		      skb.len, NULL, NULL) ||
+	    !attr[IPSET_ATTR_DATA] ||
+	    nla_parse_nested(tb, IPSET_ATTR_CREATE_MAX, attr[IPSET_ATTR_DATA],
+			     NULL, NULL) ||
+	    !tb[IPSET_ATTR_MEMSIZE])
+		return 0;
+	return ntohl(nla_get_be32(tb[IPSET_ATTR_MEMSIZE]));
+}
+
+/* Build the packet which matches the tested element: the second address
+ * of the element is the destination, everything else is taken from the
+ * source direction. The transport header is TCP, IPv6 packets carry
+ * pkt_exthdrs destination options.
+ */
+static void
+build_pkt(struct bench_pkt *p, u8 family, struct bench_attrs *a)
+{
+	unsigned char *l2 = p->buf + BENCH_PKTALIGN, *l3 = l2 + ETH_HLEN, *l4;
+	union nf_inet_addr src = {}, dst = {};
+	struct tcphdr *th;
+	u32 i;
+
+	memset(p, 0, sizeof(*p));
+	if (family == NFPROTO_IPV4) {
+		if (a->tb[IPSET_ATTR_IP])
+			ip_set_get_ipaddr4(a->tb[IPSET_ATTR_IP], &src.ip);
+		if (a->tb[IPSET_ATTR_IP2])
+			ip_set_get_ipaddr4(a->tb[IPSET_ATTR_IP2], &dst.ip);
+	} else {
+		if (a->tb[IPSET_ATTR_IP])
+			ip_set_get_ipaddr6(a->tb[IPSET_ATTR_IP], &src);
+		if (a->tb[IPSET_ATTR_IP2])
+			ip_set_get_ipaddr6(a->tb[IPSET_ATTR_IP2], &dst);
+	}
+	if (a->tb[IPSET_ATTR_ETHER])
+		memcpy(l2 + ETH_ALEN, nla_data(a->tb[IPSET_ATTR_ETHER]),
+		       ETH_ALEN);
+	if (a->tb[IPSET_ATTR_MARK])
+		p->skb.mark = ntohl(nla_get_be32(a->tb[IPSET_ATTR_MARK]));
+	if (a->tb[IPSET_ATTR_IFACE])
+		strncpy(p->iface, nla_data(a->tb[IPSET_ATTR_IFACE]),
+			IFNAMSIZ - 1);
+
+	if (family == NFPROTO_IPV4) {
+		struct iphdr *iph = (struct iphdr *)l3;
+
+		iph->version = 4;
+		iph->ihl = 5;
+		iph->protocol = IPPROTO_TCP;
+		iph->saddr = src.ip;
+		iph->daddr = dst.ip;
+		l4 = l3 + sizeof(*iph);
+		p->skb.protocol = htons(ETH_P_IP);
+	} else {
+		struct ipv6hdr *ip6h = (struct ipv6hdr *)l3;
+		u8 *nexthdr = &ip6h->nexthdr;
+
+		ip6h->version = 6;
+		ip6h->saddr = src.in6;
+		ip6h->daddr = dst.in6;
+		l4 = l3 + sizeof(*ip6h);
+		for (i = 0; i < pkt_exthdrs; i++) {
+			/* Empty destination options: one PadN option */
+			*nexthdr = IPPROTO_DSTOPTS;
+			nexthdr = l4;
+			l4[2] = 1;
+			l4[3] = 4;
+			l4 += 8;
+		}
+		*nexthdr = IPPROTO_TCP;
+		p->skb.protocol = htons(ETH_P_IPV6);
+	}
+	th = (struct tcphdr *)l4;
+	th->source = a->tb[IPSET_ATTR_PORT] ?
+		     nla_get_be16(a->tb[IPSET_ATTR_PORT]) : htons(1024);
+	th->dest = htons(80);
+
+	p->skb.head = p->buf;
+	p->skb.data = l3;
+	p->skb.len = l4 + sizeof(*th) - l3;
+	p->skb.tail = l4 + sizeof(*th) - p->buf;
+	p->skb.end = BENCH_PKTLEN;
+	p->skb.mac_header = l2 - p->buf;
+	p->skb.network_header = l3 - p->buf;
+}
+
+static void
+bench_pkt_check(const struct bench_type *bt, u32 i, int ret, int expect)
+{
+	if ((ret > 0) != expect) {
+		fprintf(stderr, "%s %s: packet #%u: %d\n", bt->name,
+			family_name(bt->family), i, ret);
+		exit(1);
+	}
+}
+
+/* Test the packets #0..m-1 of a chunk against the sets by batches of
+ * pkt_batch packets, as ip_set_test_batch() does: two prefetch passes
+ * over the packets of the batch, then the tests.
+ */
+static void
+bench_pkts_batch(const struct bench_type *bt, struct ip_set **sets,
+		 struct bench_pkt *pkts, u32 from, u32 m, int expect,
+		 const struct ip_set_adt_opt *tmpl,
+		 struct xt_action_param *par)
+{
+	struct ip_set_adt_opt opt[BENCH_MAXBATCH];
+	u32 i, j, k, nb, pass;
+
+	for (i = 0; i < m; i += nb) {
+		nb = min_t(u32, pkt_batch, m - i);
+		for (j = 0; j < nb; j++)
+			memcpy(par[j].state->in->name, pkts[i + j].iface,
+			       IFNAMSIZ);
+		for (k = 0; k < pkt_sets; k++) {
+			if (k == 0 || pkt_fresh_opt)
+				for (j = 0; j < nb; j++)
+					opt[j] = *tmpl;
+			for (pass = IPSET_FLAG_PREFETCH_TABLE;
+			     pass & IPSET_FLAG_PREFETCH; pass <<= 1)
+				for (j = 0; j < nb; j++) {
+					opt[j].cmdflags |= pass;
+					sets[k]->variant->kadt(sets[k],
+							       &pkts[i + j].skb,
+							       &par[j],
+							       IPSET_TEST,
+							       &opt[j]);
+					opt[j].cmdflags &= ~pass;
+				}
+			for (j = 0; j < nb; j++)
+				bench_pkt_check(bt, from + i + j,
+						sets[k]->variant->kadt(sets[k],
+							&pkts[i + j].skb,
+							&par[j], IPSET_TEST,
+							&opt[j]),
+						expect);
+		}
+	}
+}
+
+/* Test the packets of the elements #from..from+n-1 against the sets,
+ * as ip_set_test() does. The options are shared by the sets, like
+ * by the members of a list:set, unless pkt_fresh_opt is set. The
+ * dimension of the second address is matched in the destination
+ * direction: "src,dst" for hash:net,net, "src,src,dst" for the others.
+ */
+static double
+bench_pkts(const struct bench_type *bt, struct ip_set **sets, u32 from,
+	   u32 n, int expect)
+{
+	u8 family = bt->family == NFPROTO_UNSPEC ? NFPROTO_IPV4 : bt->family;
+	struct bench_pkt *pkts = calloc(BENCH_PKTCHUNK, sizeof(*pkts));
+	struct net_device in[BENCH_MAXBATCH];
+	struct nf_hook_state state[BENCH_MAXBATCH];
+	struct xt_action_param par[BENCH_MAXBATCH];
+	const struct ip_set_type *type = sets[0]->type;
+	const struct ip_set_adt_opt tmpl = {
+		.family = family,
+		.dim = IPSET_DIM_MAX,
+		.flags = IPSET_DIM_ONE_SRC |
+			 (type->features & IPSET_TYPE_IP2 &&
+			  type->dimension == IPSET_DIM_TWO ?
+			  0 : IPSET_DIM_TWO_SRC),
+		.ext.timeout = UINT_MAX,
+	};
+	struct bench_attrs a;
+	double start, spent = 0;
+	u32 i, j, k, m;
+
+	if (!pkts)
+		exit(1);
+	memset(in, 0, sizeof(in));
+	memset(state, 0, sizeof(state));
+	memset(par, 0, sizeof(par));
+	for (j = 0; j < BENCH_MAXBATCH; j++) {
+		in[j].ifindex = 1;
+		state[j].pf = family;
+		state[j].in = &in[j];
+		par[j].state = &state[j];
+	}
+	for (i = 0; i < n; i += m) {
+		/* The packets are built outside of the measurement */
+		m = min_t(u32, BENCH_PKTCHUNK, n - i);
+		for (j = 0; j < m; j++) {
+			memset(&a, 0, sizeof(a));
+			bt->elem(&a, bt->family, from + i + j, true);
+			parse_attrs(&a);
+			build_pkt(&pkts[j], family, &a);
+		}
+		start = now();
+		if (pkt_batch) {
+			bench_pkts_batch(bt, sets, pkts, from + i, m, expect,
+					 &tmpl, par);
+			spent += now() - start;
+			continue;
+		}
+		for (j = 0; j < m; j++) {
+			struct ip_set_adt_opt opt = tmpl;
+
+			memcpy(in[0].name, pkts[j].iface, IFNAMSIZ);
+			for (k = 0; k < pkt_sets; k++) {
+				if (pkt_fresh_opt)
+					opt = tmpl;
+				bench_pkt_check(bt, from + i + j,
+						sets[k]->variant->kadt(sets[k],
+							&pkts[j].skb, &par[0],
+							IPSET_TEST, &opt),
+						expect);
+			}
+		}
+		spent += now() - start;
+	}
+	free(pkts);
+	return spent / n;
+}
+
+static void
+bench_run_pkts(const struct bench_type *bt, u32 n, struct bench_result *r)
+{
+	struct ip_set *sets[BENCH_MAXSETS];
+	struct bench_attrs *elems;
+	u32 i, k, m;
+
+	for (k = 0; k < pkt_sets; k++)
+		sets[k] = bench_create(bt, n, 0);
+	/* The elements are added by chunks, so that the sets larger than
+	 * the cache fit into the memory of the box together with them.
+	 */
+	for (i = 0; i < n; i += m) {
+		m = min_t(u32, BENCH_PKTCHUNK, n - i);
+		elems = prepare_elems(bt, i, m, false);
+		for (k = 0; k < pkt_sets; k++)
+			bench_adt(bt, sets[k], IPSET_ADD, elems, m, 0);
+		free(elems);
+	}
+	r->memsize = bench_memsize(sets[0]);
+	r->pkt_hit = bench_pkts(bt, sets, 0, n, 1);
+	r->pkt_miss = bench_pkts(bt, sets, n, n, 0);
+	for (k = 0; k < pkt_sets; k++)
+		bench_destroy(sets[k]);
+}
+
+static void
+bench_run(const struct bench_type *bt, u32 n, struct bench_result *r)
+{
+	struct bench_attrs *elems, *tests, *misses;
+	struct ip_set *set;
+	double start;
+
+	elems = prepare_elems(bt, 0, n, false);
+	tests = prepare_elems(bt, 0, n, true);
+	misses = prepare_elems(bt, n, n, true);
+
+	set = bench_create(bt, n, 0);
+	r->add = bench_adt(bt, set, IPSET_ADD, elems, n, 0);
+	r->test_hit = bench_adt(bt, set, IPSET_TEST, tests, n, 1);
+	r->test_miss = bench_adt(bt, set, IPSET_TEST, misses, n, 0);
+	r->memsize = bench_memsize(set);
+	r->resize = -1;
+	if (set->variant->resize) {
+		start = now();
+		if (set->variant->resize(set, true)) {
+			fprintf(stderr, "%s %s: resize failed\n",
+				bt->name, family_name(bt->family));
+			exit(1);
+		}
+		r->resize = (now() - start) / n;
+	}
+	r->del = bench_adt(bt, set, IPSET_DEL, elems, n, 0);
+	bench_destroy(set);
+
+	r->expire = -1;
+	if (bt->timeout) {
+		set = bench_create(bt, n, 1);
+		bench_adt(bt, set, IPSET_ADD, elems, n, 0);
+		jiffies += 2 * HZ;
+		start = now();
+		kshim_run_timers();
+		r->expire = (now() - start) / n;
+		if (set->elements && strncmp(bt->name, "hash:", 5) == 0) {
+			fprintf(stderr, "%s %s: %u elements not expired\n",
+				bt->name, family_name(bt->family),
+				set->elements);
+			exit(1);
+		}
+		bench_destroy(set);
+	}
+
+	free(elems);
+	free(tests);
+	free(misses);
+}
+
+static void
+print_ns(double ns)
+{
+	if (ns < 0)
+		printf(" %9s", "-");
+	else
+		printf(" %9.1f", ns);
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [-n elements] [-t type] [-4|-6] [-c]\n"
+	       "       [-p [-s sets] [-o] [-x exthdrs] [-b batch]]\n"
+	       "  -n N     number of elements, default %u\n"
+	       "  -t TYPE  benchmark the set type TYPE only\n"
+	       "  -4, -6   benchmark the IPv4 or IPv6 variants only\n"
+	       "  -c       create the hash types with the cache enabled\n"
+	       "  -p       packet mode: test packets by kadt()\n"
+	       "  -s N     test every packet against N sets, default 1\n"
+	       "  -o       new lookup options for every set of a packet\n"
+	       "  -x N     IPv6 extension headers in the packets\n"
+	       "  -b N     test the packets by batches of N with prefetching,\n"
+	       "           as ip_set_test_batch(), at most %u\n"
+	       "Times are nanosec per element or per packet, bytes per\n"
+	       "element are computed from the reported memory size.\n",
+	       prog, BENCH_ELEMS, BENCH_MAXBATCH);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *only = NULL;
+	u8 family = NFPROTO_UNSPEC;
+	u32 n = BENCH_ELEMS;
+	unsigned int i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:t:46cps:ox:b:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			only = optarg;
+			break;
+		case '4':
+			family = NFPROTO_IPV4;
+			break;
+		case '6':
+			family = NFPROTO_IPV6;
+			break;
+		case 'c':
+			with_cache = true;
+			break;
+		case 'p':
+			pkt_mode = true;
+			break;
+		case 's':
+			pkt_sets = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			pkt_fresh_opt = true;
+			break;
+		case 'x':
+			pkt_exthdrs = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			pkt_batch = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (n == 0 || n > 32768 * 1024) {
+		fprintf(stderr, "invalid number of elements\n");
+		return 1;
+	}
+	if (pkt_sets == 0 || pkt_sets > BENCH_MAXSETS ||
+	    pkt_batch > BENCH_MAXBATCH ||
+	    BENCH_PKTALIGN + ETH_HLEN + sizeof(struct ipv6hdr) +
+	    8 * pkt_exthdrs + sizeof(struct tcphdr) > BENCH_PKTLEN) {
+		fprintf(stderr, "invalid packet mode parameters\n");
+		return 1;
+	}
+
+	if (pkt_mode)
+		printf("%-18s %-6s %8s %4s %9s %9s %7s\n",
+		       "type", "family", "elements", "sets", "pkt+", "pkt-",
+		       "B/elem");
+	else
+		printf("%-18s %-6s %8s %9s %9s %9s %9s %9s %9s %7s\n",
+		       "type", "family", "elements", "add", "test+",
+		       "test-", "del", "resize", "expire", "B/elem");
+	for (i = 0; i < ARRAY_SIZE(bench_types); i++) {
+		const struct bench_type *bt = &bench_types[i];
+		struct bench_result r;
+		u32 elems = n;
+
+		if (only && strcmp(only, bt->name) != 0)
+			continue;
+		if (family != NFPROTO_UNSPEC && bt->family != NFPROTO_UNSPEC &&
+		    family != bt->family)
+			continue;
+		/* The bitmaps store a range of at most 64k elements,
+		 * half of which is used for the missing ones.
+		 */
+		if (strncmp(bt->name, "bitmap:", 7) == 0)
+			elems = min_t(u32, n, (IPSET_BITMAP_MAX_RANGE + 1) / 2);
+
+		if (pkt_mode) {
+			bench_run_pkts(bt, elems, &r);
+			printf("%-18s %-6s %8u %4u", bt->name,
+			       family_name(bt->family), elems, pkt_sets);
+			print_ns(r.pkt_hit);
+			print_ns(r.pkt_miss);
+			printf(" %7.1f\n", (double)r.memsize / elems);
+			fflush(stdout);
+			continue;
+		}
+		bench_run(bt, elems, &r);
+		printf("%-18s %-6s %8u", bt->name, family_name(bt->family),
+		       elems);
+		print_ns(r.add);
+		print_ns(r.test_hit);
+		print_ns(r.test_miss);
+		print_ns(r.del);
+		print_ns(r.resize);
+		print_ns(r.expire);
+		printf(" %7.1f\n", (double)r.memsize / elems);
+		fflush(stdout);
+	}
+	return 0;
+}
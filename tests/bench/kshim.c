@@ -0,0 +1,318 @@
+/* Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/* Userspace implementation of the out of line kernel interfaces used by
+ * the set types, together with the parts of the IP set core which the
+ * set types call into.
+ */
+
+#include <linux/netfilter/ipset/ip_set.h>
+
+/* Time */
+unsigned long jiffies = 1000000;
+
+#define KSHIM_MAX_TIMERS	64
+
+static struct timer_list *timers[KSHIM_MAX_TIMERS];
+
+void
+add_timer(struct timer_list *t)
+{
+	int i;
+
+	if (t->pending)
+		return;
+	for (i = 0; i < KSHIM_MAX_TIMERS; i++)
+		if (!timers[i]) {
+			timers[i] = t;
+			t->pending = true;
+			return;
+		}
+	fprintf(stderr, "kshim: too many timers\n");
+	abort();
+}
+
+int
+del_timer_sync(struct timer_list *t)
+{
+	int i;
+
+	if (!t->pending)
+		return 0;
+	for (i = 0; i < KSHIM_MAX_TIMERS; i++)
+		if (timers[i] == t) {
+			timers[i] = NULL;
+			break;
+		}
+	t->pending = false;
+	return 1;
+}
+
+void
+kshim_run_timers(void)
+{
+	struct timer_list *expired[KSHIM_MAX_TIMERS];
+	int i, n = 0;
+
+	/* Timers re-armed by their function run at the next call only */
+	for (i = 0; i < KSHIM_MAX_TIMERS; i++) {
+		struct timer_list *t = timers[i];
+
+		if (t && !time_after(t->expires, jiffies)) {
+			timers[i] = NULL;
+			t->pending = false;
+			expired[n++] = t;
+		}
+	}
+	for (i = 0; i < n; i++)
+		expired[i]->function(expired[i]);
+}
+
+void
+get_random_bytes(void *buf, int nbytes)
+{
+	unsigned char *p = buf;
+
+	while (nbytes--)
+		*p++ = random();
+}
+
+/* ID allocator */
+int
+idr_alloc(struct idr *idr, void *ptr, int start, int end, gfp_t flags)
+{
+	int id;
+
+	for (id = start; id < end; id++) {
+		if (id >= idr->size) {
+			int size = idr->size ? idr->size * 2 : 64;
+			void **ptrs;
+
+			while (size <= id)
+				size *= 2;
+			ptrs = realloc(idr->ptrs, size * sizeof(void *));
+			if (!ptrs)
+				return -ENOMEM;
+			memset(ptrs + idr->size, 0,
+			       (size - idr->size) * sizeof(void *));
+			idr->ptrs = ptrs;
+			idr->size = size;
+		}
+		if (!idr->ptrs[id]) {
+			idr->ptrs[id] = ptr;
+			return id;
+		}
+	}
+	return -ENOSPC;
+}
+
+int
+idr_alloc_cyclic(struct idr *idr, void *ptr, int start, int end,
+		 gfp_t flags)
+{
+	int id = idr_alloc(idr, ptr, max(start, idr->next), end, flags);
+
+	if (id == -ENOSPC)
+		id = idr_alloc(idr, ptr, start, end, flags);
+	if (id >= 0)
+		idr->next = id + 1;
+	return id;
+}
+
+void *
+idr_find(const struct idr *idr, unsigned long id)
+{
+	return id < (unsigned long)idr->size ? idr->ptrs[id] : NULL;
+}
+
+void *
+idr_remove(struct idr *idr, unsigned long id)
+{
+	void *ptr = idr_find(idr, id);
+
+	if (ptr)
+		idr->ptrs[id] = NULL;
+	return ptr;
+}
+
+void *
+idr_get_next(struct idr *idr, int *id)
+{
+	for (; *id < idr->size; (*id)++)
+		if (idr->ptrs[*id])
+			return idr->ptrs[*id];
+	return NULL;
+}
+
+void
+idr_destroy(struct idr *idr)
+{
+	free(idr->ptrs);
+	idr->ptrs = NULL;
+	idr->size = 0;
+}
+
+/* Bit operations */
+static unsigned long
+find_next(const unsigned long *addr, unsigned long size,
+	  unsigned long offset, unsigned long invert)
+{
+	unsigned long word;
+
+	if (offset >= size)
+		return size;
+	word = (addr[BIT_WORD(offset)] ^ invert) &
+	       BITMAP_FIRST_WORD_MASK(offset);
+	offset -= offset % BITS_PER_LONG;
+	while (!word) {
+		offset += BITS_PER_LONG;
+		if (offset >= size)
+			return size;
+		word = addr[BIT_WORD(offset)] ^ invert;
+	}
+	offset += __builtin_ctzl(word);
+	return offset < size ? offset : size;
+}
+
+unsigned long
+find_next_bit(const unsigned long *addr, unsigned long size,
+	      unsigned long offset)
+{
+	return find_next(addr, size, offset, 0UL);
+}
+
+unsigned long
+find_next_zero_bit(const unsigned long *addr, unsigned long size,
+		   unsigned long offset)
+{
+	return find_next(addr, size, offset, ~0UL);
+}
+
+/* Netlink attributes */
+int
+nla_parse(struct nlattr **tb, int maxtype, const struct nlattr *head,
+	  int len, const struct nla_policy *policy,
+	  struct netlink_ext_ack *extack)
+{
+	const struct nlattr *nla = head;
+
+	memset(tb, 0, sizeof(struct nlattr *) * (maxtype + 1));
+	while (len >= (int)sizeof(*nla) &&
+	       nla->nla_len >= sizeof(*nla) && nla->nla_len <= len) {
+		int type = nla_type(nla);
+
+		if (type > 0 && type <= maxtype)
+			tb[type] = (struct nlattr *)nla;
+		len -= NLA_ALIGN(nla->nla_len);
+		nla = (const struct nlattr *)((const char *)nla +
+					      NLA_ALIGN(nla->nla_len));
+	}
+	return len > 0 ? -EINVAL : 0;
+}
+
+int
+nla_put(struct sk_buff *skb, int attrtype, int attrlen, const void *data)
+{
+	struct nlattr *nla;
+
+	if (skb->tail + nla_total_size(attrlen) > skb->end)
+		return -EMSGSIZE;
+	nla = (struct nlattr *)skb_tail_pointer(skb);
+	nla->nla_type = attrtype;
+	nla->nla_len = NLA_HDRLEN + attrlen;
+	if (attrlen)
+		memcpy(nla_data(nla), data, attrlen);
+	memset((char *)nla + nla->nla_len, 0,
+	       nla_total_size(attrlen) - nla->nla_len);
+	skb->tail += nla_total_size(attrlen);
+	skb->len = skb->tail;
+	return 0;
+}
+
+/* IP set core: type registry */
+static LIST_HEAD(ip_set_type_list);
+
+int
+ip_set_type_register(struct ip_set_type *type)
+{
+	if (type->protocol != IPSET_PROTOCOL)
+		return -EINVAL;
+	list_add(&type->list, &ip_set_type_list);
+	return 0;
+}
+
+void
+ip_set_type_unregister(struct ip_set_type *type)
+{
+	list_del(&type->list);
+}
+
+struct ip_set_type *
+kshim_find_type(const char *name, u8 family)
+{
+	struct ip_set_type *type;
+
+	list_for_each_entry(type, &ip_set_type_list, list)
+		if (strcmp(type->name, name) == 0 &&
+		    (type->family == family ||
+		     type->family == NFPROTO_UNSPEC))
+			return type;
+	return NULL;
+}
+
+/* Skip the IPv6 extension headers, as net/ipv6/exthdrs_core.c does */
+int
+ipv6_skip_exthdr(const struct sk_buff *skb, int start, u8 *nexthdrp,
+		 __be16 *frag_offp)
+{
+	u8 nexthdr = *nexthdrp;
+
+	*frag_offp = 0;
+	for (;;) {
+		struct ipv6_opt_hdr _hdr;
+		const struct ipv6_opt_hdr *hp;
+		int hdrlen;
+
+		switch (nexthdr) {
+		case IPPROTO_HOPOPTS:
+		case IPPROTO_ROUTING:
+		case IPPROTO_FRAGMENT:
+		case IPPROTO_AH:
+		case IPPROTO_DSTOPTS:
+			break;
+		case IPPROTO_NONE:
+			return -1;
+		default:
+			*nexthdrp = nexthdr;
+			return start;
+		}
+		hp = skb_header_pointer(skb, start, sizeof(_hdr), &_hdr);
+		if (!hp)
+			return -1;
+		if (nexthdr == IPPROTO_FRAGMENT) {
+			__be16 _frag_off;
+			const __be16 *fp;
+
+			fp = skb_header_pointer(skb, start + 2,
+						sizeof(_frag_off), &_frag_off);
+			if (!fp)
+				return -1;
+			*frag_offp = *fp;
+			if (ntohs(*frag_offp) & ~0x7) {
+				*nexthdrp = nexthdr;
+				return start;
+			}
+			hdrlen = 8;
+		} else if (nexthdr == IPPROTO_AH) {
+			hdrlen = (hp->hdrlen + 2) << 2;
+		} else {
+			hdrlen = (hp->hdrlen + 1) << 3;
+		}
+		nexthdr = hp->nexthdr;
+		start += hdrlen;
+	}
+}
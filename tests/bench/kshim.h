@@ -0,0 +1,913 @@
+/* Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef _KSHIM_H
+#define _KSHIM_H
+
+/* Userspace stand-ins for the kernel interfaces used by the set types.
+ *
+ * The harness is single threaded: locks are no-ops, RCU readers need no
+ * protection and the grace periods end immediately. Time is the jiffies
+ * counter, which is advanced by the benchmark only, and the timers fire
+ * when kshim_run_timers() is called.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/types.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/icmp.h>
+#include <linux/icmpv6.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+
+/* Types */
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef unsigned int gfp_t;
+
+#define __force
+#define __rcu
+#define __percpu
+#define __read_mostly
+#define __init
+#define __exit
+#define __aligned(x)		__attribute__((aligned(x)))
+#define __packed		__attribute__((packed))
+
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+
+#define BUILD_BUG_ON(c)		((void)sizeof(char[1 - 2 * !!(c)]))
+#define BUG_ON(c)		do { if (unlikely(c)) abort(); } while (0)
+#define WARN_ON(c)		({ int __c = !!(c); __c; })
+#define WARN_ON_ONCE(c)		WARN_ON(c)
+
+#define MAX_ERRNO		4095
+#define IS_ERR_VALUE(x)		((unsigned long)(x) >= (unsigned long)-MAX_ERRNO)
+#define ERR_PTR(err)		((void *)(long)(err))
+#define PTR_ERR(ptr)		((long)(ptr))
+#define IS_ERR(ptr)		IS_ERR_VALUE(ptr)
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+#define ALIGN(x, a)		(((x) + (a) - 1) & ~((typeof(x))(a) - 1))
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+
+#define BITS_PER_BYTE		8
+#define BITS_PER_LONG		(__SIZEOF_LONG__ * 8)
+#define BITS_TO_LONGS(n)	DIV_ROUND_UP(n, BITS_PER_LONG)
+#define DECLARE_BITMAP(name, bits) unsigned long name[BITS_TO_LONGS(bits)]
+
+#define U16_MAX			((u16)~0U)
+#define U32_MAX			((u32)~0U)
+#define MSEC_PER_SEC		1000L
+
+#define min(a, b)		({ typeof(a) __a = (a); typeof(b) __b = (b); \
+				   __a < __b ? __a : __b; })
+#define max(a, b)		({ typeof(a) __a = (a); typeof(b) __b = (b); \
+				   __a > __b ? __a : __b; })
+#define min_t(t, a, b)		min((t)(a), (t)(b))
+#define max_t(t, a, b)		max((t)(a), (t)(b))
+#define swap(a, b)		do { typeof(a) __t = (a); (a) = (b); \
+				     (b) = __t; } while (0)
+
+#define __stringify_1(x...)	#x
+#define __stringify(x...)	__stringify_1(x)
+
+/* Messages */
+#define pr_debug(fmt, ...)	do { if (0) printf(fmt, ##__VA_ARGS__); } while (0)
+#define pr_warn(fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+#define net_ratelimit()		1
+
+/* Modules */
+struct module;
+#define THIS_MODULE		((struct module *)NULL)
+#define MODULE_LICENSE(x)	extern int __kshim_modinfo
+#define MODULE_AUTHOR(x)	extern int __kshim_modinfo
+#define MODULE_DESCRIPTION(x)	extern int __kshim_modinfo
+#define MODULE_ALIAS(x)		extern int __kshim_modinfo
+#define MODULE_PARM_DESC(p, x)	extern int __kshim_modinfo
+#define module_param(p, t, m)	extern int __kshim_modinfo
+#define EXPORT_SYMBOL(s)	extern int __kshim_modinfo
+#define EXPORT_SYMBOL_GPL(s)	extern int __kshim_modinfo
+#define module_init(fn)					\
+static void __attribute__((constructor)) __kshim_init_##fn(void) \
+{							\
+	fn();						\
+}
+#define module_exit(fn)		extern int __kshim_modinfo
+
+/* Byte order */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define __kshim_be16(x)		((u16)__builtin_bswap16(x))
+#define __kshim_be32(x)		((u32)__builtin_bswap32(x))
+#define __kshim_be64(x)		((u64)__builtin_bswap64(x))
+#else
+#define __kshim_be16(x)		((u16)(x))
+#define __kshim_be32(x)		((u32)(x))
+#define __kshim_be64(x)		((u64)(x))
+#endif
+#define htons(x)		((__be16)__kshim_be16(x))
+#define ntohs(x)		__kshim_be16(x)
+#define htonl(x)		((__be32)__kshim_be32(x))
+#define ntohl(x)		__kshim_be32(x)
+#define cpu_to_be16(x)		htons(x)
+#define cpu_to_be32(x)		htonl(x)
+#define cpu_to_be64(x)		((__be64)__kshim_be64(x))
+#define be16_to_cpu(x)		ntohs(x)
+#define be32_to_cpu(x)		ntohl(x)
+#define be64_to_cpu(x)		__kshim_be64(x)
+
+/* Memory */
+#define GFP_KERNEL		0x01u
+#define GFP_ATOMIC		0x02u
+#define __GFP_NOWARN		0x04u
+#define __GFP_ZERO		0x08u
+#define KMALLOC_MAX_SIZE	(1UL << 22)
+
+static inline void *kmalloc(size_t size, gfp_t flags)
+{
+	return flags & __GFP_ZERO ? calloc(1, size) : malloc(size);
+}
+#define kzalloc(size, flags)	calloc(1, size)
+#define kcalloc(n, size, flags)	calloc(n, size)
+#define kvcalloc(n, size, flags) calloc(n, size)
+#define vzalloc(size)		calloc(1, size)
+#define kfree(p)		free((void *)(p))
+#define kvfree(p)		free((void *)(p))
+#define vfree(p)		free((void *)(p))
+#define is_vmalloc_addr(p)	false
+
+static inline void *kmemdup(const void *src, size_t len, gfp_t flags)
+{
+	void *p = malloc(len);
+
+	if (p)
+		memcpy(p, src, len);
+	return p;
+}
+
+static inline size_t kshim_strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+
+	if (size) {
+		size_t n = len >= size ? size - 1 : len;
+
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+	return len;
+}
+#define strlcpy(d, s, n)	kshim_strlcpy(d, s, n)
+#define strscpy(d, s, n)	kshim_strlcpy(d, s, n)
+
+/* Memory ordering and atomics */
+#define barrier()		__asm__ __volatile__("" : : : "memory")
+#define cpu_relax()		barrier()
+#define prefetch(x)		__builtin_prefetch(x)
+#define smp_mb()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define smp_rmb()		__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_wmb()		__atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_mb__before_atomic()	smp_mb()
+#define smp_mb__after_atomic()	smp_mb()
+#define READ_ONCE(x)		(*(const volatile typeof(x) *)&(x))
+#define WRITE_ONCE(x, v)	(*(volatile typeof(x) *)&(x) = (v))
+#define smp_load_acquire(p)	__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define cmpxchg(p, o, n)	__sync_val_compare_and_swap(p, o, n)
+
+typedef struct { int counter; } atomic_t;
+typedef struct { s64 counter; } atomic64_t;
+
+#define ATOMIC_INIT(i)		{ (i) }
+#define atomic_read(v)		READ_ONCE((v)->counter)
+#define atomic_set(v, i)	WRITE_ONCE((v)->counter, i)
+#define atomic_inc(v)		__atomic_add_fetch(&(v)->counter, 1, __ATOMIC_RELAXED)
+#define atomic_dec(v)		__atomic_sub_fetch(&(v)->counter, 1, __ATOMIC_RELAXED)
+#define atomic_dec_and_test(v)	(__atomic_sub_fetch(&(v)->counter, 1, __ATOMIC_SEQ_CST) == 0)
+#define atomic64_read(v)	READ_ONCE((v)->counter)
+#define atomic64_set(v, i)	WRITE_ONCE((v)->counter, i)
+#define atomic64_add(i, v)	__atomic_add_fetch(&(v)->counter, i, __ATOMIC_RELAXED)
+
+/* Locks */
+typedef struct { int locked; } spinlock_t;
+
+#define DEFINE_SPINLOCK(x)	spinlock_t x = { 0 }
+#define spin_lock_init(l)	((l)->locked = 0)
+#define spin_lock(l)		((l)->locked++)
+#define spin_unlock(l)		((l)->locked--)
+#define spin_lock_bh(l)		spin_lock(l)
+#define spin_unlock_bh(l)	spin_unlock(l)
+#define lockdep_is_held(l)	1
+
+/* RCU */
+struct rcu_head {
+	struct rcu_head *next;
+	void (*func)(struct rcu_head *head);
+};
+
+#define rcu_read_lock()			do { } while (0)
+#define rcu_read_unlock()		do { } while (0)
+#define rcu_read_lock_bh()		do { } while (0)
+#define rcu_read_unlock_bh()		do { } while (0)
+#define rcu_read_lock_held()		1
+#define rcu_dereference(p)		(p)
+#define rcu_dereference_bh(p)		(p)
+#define rcu_dereference_protected(p, c)	(p)
+#define rcu_access_pointer(p)		(p)
+#define rcu_dereference_bh_check(p, c)	(p)
+#define rcu_assign_pointer(p, v)	((p) = (v))
+#define RCU_INIT_POINTER(p, v)		((p) = (v))
+#define synchronize_rcu()		do { } while (0)
+#define synchronize_rcu_bh()		do { } while (0)
+#define rcu_barrier()			do { } while (0)
+#define cond_resched()			do { } while (0)
+#define cond_resched_rcu()		do { } while (0)
+#define call_rcu(head, fn)		(fn)(head)
+#define kfree_rcu(ptr, field)		kfree(ptr)
+
+/* Per-CPU data: there is a single CPU */
+#define alloc_percpu(type)		((type *)calloc(1, sizeof(type)))
+#define free_percpu(p)			free(p)
+#define this_cpu_ptr(p)			(p)
+#define per_cpu_ptr(p, cpu)		(p)
+#define for_each_possible_cpu(cpu)	for ((cpu) = 0; (cpu) < 1; (cpu)++)
+
+/* Lists */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(name)	{ &(name), &(name) }
+#define LIST_HEAD(name)		struct list_head name = LIST_HEAD_INIT(name)
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list->prev = list;
+}
+
+static inline void list_add(struct list_head *new, struct list_head *head)
+{
+	head->next->prev = new;
+	new->next = head->next;
+	new->prev = head;
+	head->next = new;
+}
+#define list_add_rcu(new, head)	list_add(new, head)
+
+static inline void list_del(struct list_head *entry)
+{
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+}
+#define list_del_rcu(entry)	list_del(entry)
+
+#define list_entry(ptr, type, member)	container_of(ptr, type, member)
+#define list_first_entry(ptr, type, member) \
+	list_entry((ptr)->next, type, member)
+#define list_last_entry(ptr, type, member) \
+	list_entry((ptr)->prev, type, member)
+#define list_next_entry(pos, member) \
+	list_entry((pos)->member.next, typeof(*(pos)), member)
+#define list_for_each_entry(pos, head, member)			\
+	for (pos = list_first_entry(head, typeof(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = list_next_entry(pos, member))
+#define list_for_each_entry_rcu(pos, head, member) \
+	list_for_each_entry(pos, head, member)
+
+struct hlist_node {
+	struct hlist_node *next, **pprev;
+};
+
+struct hlist_head {
+	struct hlist_node *first;
+};
+
+#define INIT_HLIST_HEAD(h)	((h)->first = NULL)
+
+static inline void hlist_add_head_rcu(struct hlist_node *n,
+				      struct hlist_head *h)
+{
+	n->next = h->first;
+	if (h->first)
+		h->first->pprev = &n->next;
+	h->first = n;
+	n->pprev = &h->first;
+}
+
+static inline void hlist_del_rcu(struct hlist_node *n)
+{
+	*n->pprev = n->next;
+	if (n->next)
+		n->next->pprev = n->pprev;
+}
+
+#define hlist_entry_safe(ptr, type, member) \
+	({ typeof(ptr) __p = (ptr); __p ? container_of(__p, type, member) : NULL; })
+#define hlist_for_each_entry_rcu(pos, head, member)			\
+	for (pos = hlist_entry_safe((head)->first, typeof(*(pos)), member); \
+	     pos;							\
+	     pos = hlist_entry_safe((pos)->member.next, typeof(*(pos)), member))
+
+/* ID allocator */
+struct idr {
+	void **ptrs;
+	int size;
+	int next;		/* next id of idr_alloc_cyclic() */
+};
+
+static inline void idr_init(struct idr *idr)
+{
+	*idr = (struct idr){ NULL, 0, 0 };
+}
+
+extern int idr_alloc(struct idr *idr, void *ptr, int start, int end,
+		     gfp_t flags);
+extern int idr_alloc_cyclic(struct idr *idr, void *ptr, int start, int end,
+			    gfp_t flags);
+extern void *idr_find(const struct idr *idr, unsigned long id);
+extern void *idr_remove(struct idr *idr, unsigned long id);
+extern void *idr_get_next(struct idr *idr, int *id);
+extern void idr_destroy(struct idr *idr);
+
+#define idr_for_each_entry(idr, entry, id)			\
+	for (id = 0; ((entry) = idr_get_next(idr, &(id))) != NULL; ++id)
+
+/* Bit operations */
+#define BIT_WORD(nr)		((nr) / BITS_PER_LONG)
+#define BIT_MASK(nr)		(1UL << ((nr) % BITS_PER_LONG))
+
+static inline int test_bit(long nr, const volatile unsigned long *addr)
+{
+	return !!(addr[BIT_WORD(nr)] & BIT_MASK(nr));
+}
+
+static inline void set_bit(long nr, volatile unsigned long *addr)
+{
+	addr[BIT_WORD(nr)] |= BIT_MASK(nr);
+}
+
+static inline void clear_bit(long nr, volatile unsigned long *addr)
+{
+	addr[BIT_WORD(nr)] &= ~BIT_MASK(nr);
+}
+
+static inline int test_and_set_bit(long nr, volatile unsigned long *addr)
+{
+	int old = test_bit(nr, addr);
+
+	set_bit(nr, addr);
+	return old;
+}
+
+static inline int test_and_clear_bit(long nr, volatile unsigned long *addr)
+{
+	int old = test_bit(nr, addr);
+
+	clear_bit(nr, addr);
+	return old;
+}
+
+static inline int test_and_set_bit_lock(long nr, volatile unsigned long *addr)
+{
+	return !!(__atomic_fetch_or(&addr[BIT_WORD(nr)], BIT_MASK(nr),
+				    __ATOMIC_ACQUIRE) & BIT_MASK(nr));
+}
+
+static inline void clear_bit_unlock(long nr, volatile unsigned long *addr)
+{
+	__atomic_fetch_and(&addr[BIT_WORD(nr)], ~BIT_MASK(nr),
+			   __ATOMIC_RELEASE);
+}
+
+extern unsigned long find_next_bit(const unsigned long *addr,
+				   unsigned long size, unsigned long offset);
+extern unsigned long find_next_zero_bit(const unsigned long *addr,
+					unsigned long size,
+					unsigned long offset);
+
+#define for_each_set_bit(bit, addr, size)			\
+	for ((bit) = find_next_bit((addr), (size), 0);		\
+	     (bit) < (size);					\
+	     (bit) = find_next_bit((addr), (size), (bit) + 1))
+
+#define BITMAP_FIRST_WORD_MASK(start) (~0UL << ((start) & (BITS_PER_LONG - 1)))
+#define BITMAP_LAST_WORD_MASK(nbits) (~0UL >> (-(nbits) & (BITS_PER_LONG - 1)))
+
+static inline void bitmap_zero(unsigned long *dst, unsigned int nbits)
+{
+	memset(dst, 0, BITS_TO_LONGS(nbits) * sizeof(unsigned long));
+}
+
+static inline void bitmap_set(unsigned long *map, unsigned int start,
+			      unsigned int len)
+{
+	while (len--)
+		set_bit(start++, map);
+}
+
+static inline void bitmap_clear(unsigned long *map, unsigned int start,
+				unsigned int len)
+{
+	while (len--)
+		clear_bit(start++, map);
+}
+
+#define hweight_long(w)		__builtin_popcountl(w)
+#define fls(x)			((x) ? 32 - __builtin_clz(x) : 0)
+
+static inline u32 rol32(u32 word, unsigned int shift)
+{
+	return (word << (shift & 31)) | (word >> ((-shift) & 31));
+}
+
+/* Time */
+extern unsigned long jiffies;
+
+#define HZ			1000
+#define msecs_to_jiffies(m)	((unsigned long)(m))
+#define jiffies_to_msecs(j)	((unsigned int)(j))
+#define time_after(a, b)	((long)((b) - (a)) < 0)
+#define time_before(a, b)	time_after(b, a)
+#define time_is_before_jiffies(a) time_after(jiffies, a)
+#define time_is_after_jiffies(a) time_before(jiffies, a)
+
+/* Sequence number comparison of net/tcp.h */
+static inline bool before(u32 seq1, u32 seq2)
+{
+	return (s32)(seq1 - seq2) < 0;
+}
+#define after(seq2, seq1)	before(seq1, seq2)
+
+struct timer_list {
+	unsigned long expires;
+	void (*function)(struct timer_list *t);
+	bool pending;
+};
+
+#define timer_setup(t, fn, flags)	\
+	do { (t)->function = (fn); (t)->pending = false; } while (0)
+#define from_timer(var, t, field)	container_of(t, typeof(*var), field)
+
+extern void add_timer(struct timer_list *t);
+extern int del_timer_sync(struct timer_list *t);
+
+static inline int mod_timer(struct timer_list *t, unsigned long expires)
+{
+	t->expires = expires;
+	add_timer(t);
+	return 0;
+}
+
+/* Fire the pending timers which expired by the current jiffies */
+extern void kshim_run_timers(void);
+
+/* Random numbers */
+extern void get_random_bytes(void *buf, int nbytes);
+
+/* Jenkins hash, as in linux/jhash.h */
+#define JHASH_INITVAL		0xdeadbeef
+#define jhash_size(n)		((u32)1 << (n))
+#define jhash_mask(n)		(jhash_size(n) - 1)
+
+#define __jhash_mix(a, b, c)			\
+{						\
+	a -= c;  a ^= rol32(c, 4);  c += b;	\
+	b -= a;  b ^= rol32(a, 6);  a += c;	\
+	c -= b;  c ^= rol32(b, 8);  b += a;	\
+	a -= c;  a ^= rol32(c, 16); c += b;	\
+	b -= a;  b ^= rol32(a, 19); a += c;	\
+	c -= b;  c ^= rol32(b, 4);  b += a;	\
+}
+
+#define __jhash_final(a, b, c)			\
+{						\
+	c ^= b; c -= rol32(b, 14);		\
+	a ^= c; a -= rol32(c, 11);		\
+	b ^= a; b -= rol32(a, 25);		\
+	c ^= b; c -= rol32(b, 16);		\
+	a ^= c; a -= rol32(c, 4);		\
+	b ^= a; b -= rol32(a, 14);		\
+	c ^= b; c -= rol32(b, 24);		\
+}
+
+static inline u32 jhash(const void *key, u32 length, u32 initval)
+{
+	const u8 *k = key;
+	u32 a, b, c, w[3];
+
+	a = b = c = JHASH_INITVAL + length + initval;
+
+	while (length > 12) {
+		memcpy(w, k, sizeof(w));
+		a += w[0];
+		b += w[1];
+		c += w[2];
+		__jhash_mix(a, b, c);
+		length -= 12;
+		k += 12;
+	}
+	switch (length) {
+	case 12: c += (u32)k[11] << 24;	/* fall through */
+	case 11: c += (u32)k[10] << 16;	/* fall through */
+	case 10: c += (u32)k[9] << 8;	/* fall through */
+	case 9:  c += k[8];		/* fall through */
+	case 8:  b += (u32)k[7] << 24;	/* fall through */
+	case 7:  b += (u32)k[6] << 16;	/* fall through */
+	case 6:  b += (u32)k[5] << 8;	/* fall through */
+	case 5:  b += k[4];		/* fall through */
+	case 4:  a += (u32)k[3] << 24;	/* fall through */
+	case 3:  a += (u32)k[2] << 16;	/* fall through */
+	case 2:  a += (u32)k[1] << 8;	/* fall through */
+	case 1:  a += k[0];
+		 __jhash_final(a, b, c);
+	case 0:
+		break;
+	}
+	return c;
+}
+
+static inline u32 jhash2(const u32 *k, u32 length, u32 initval)
+{
+	u32 a, b, c;
+
+	a = b = c = JHASH_INITVAL + (length << 2) + initval;
+
+	while (length > 3) {
+		a += k[0];
+		b += k[1];
+		c += k[2];
+		__jhash_mix(a, b, c);
+		length -= 3;
+		k += 3;
+	}
+	switch (length) {
+	case 3: c += k[2];	/* fall through */
+	case 2: b += k[1];	/* fall through */
+	case 1: a += k[0];
+		__jhash_final(a, b, c);
+	case 0:
+		break;
+	}
+	return c;
+}
+
+/* Networking */
+#define IFNAMSIZ		16
+
+struct net {
+	int dummy;
+};
+
+struct net_device {
+	char name[IFNAMSIZ];
+	int ifindex;
+};
+
+struct sk_buff {
+	unsigned char *head;
+	unsigned char *data;
+	unsigned int len;
+	unsigned int tail;
+	unsigned int end;
+	u16 mac_header;
+	u16 network_header;
+	__be16 protocol;
+	u32 mark;
+	u32 priority;
+	u16 queue_mapping;
+	int skb_iif;
+	struct net_device *dev;
+};
+
+static inline unsigned char *skb_tail_pointer(const struct sk_buff *skb)
+{
+	return skb->head + skb->tail;
+}
+
+static inline unsigned char *skb_mac_header(const struct sk_buff *skb)
+{
+	return skb->head + skb->mac_header;
+}
+
+static inline unsigned char *skb_network_header(const struct sk_buff *skb)
+{
+	return skb->head + skb->network_header;
+}
+
+static inline void skb_set_queue_mapping(struct sk_buff *skb, u16 queue)
+{
+	skb->queue_mapping = queue;
+}
+
+#define eth_hdr(skb)		((struct ethhdr *)skb_mac_header(skb))
+#define ip_hdr(skb)		((struct iphdr *)skb_network_header(skb))
+#define ipv6_hdr(skb)		((struct ipv6hdr *)skb_network_header(skb))
+#define ip_hdrlen(skb)		(ip_hdr(skb)->ihl * 4)
+#define IP_OFFSET		0x1FFF
+
+static inline int skb_network_offset(const struct sk_buff *skb)
+{
+	return skb_network_header(skb) - skb->data;
+}
+
+/* The packets of the harness are linear */
+static inline void *skb_header_pointer(const struct sk_buff *skb, int offset,
+				       int len, void *buffer)
+{
+	if (offset < 0 || offset + len > (int)skb->len)
+		return NULL;
+	return skb->data + offset;
+}
+
+extern int ipv6_skip_exthdr(const struct sk_buff *skb, int start,
+			    u8 *nexthdrp, __be16 *frag_offp);
+
+typedef struct sctphdr {
+	__be16 source;
+	__be16 dest;
+	__be32 vtag;
+	__le32 checksum;
+} sctp_sctphdr_t;
+
+static inline void ether_addr_copy(u8 *dst, const u8 *src)
+{
+	memcpy(dst, src, ETH_ALEN);
+}
+
+/* The variants of the kernel for efficient unaligned access, the loads
+ * are done by memcpy() to keep the sanitizers quiet.
+ */
+static inline bool ether_addr_equal(const u8 *addr1, const u8 *addr2)
+{
+	u32 a32, b32;
+	u16 a16, b16;
+
+	memcpy(&a32, addr1, sizeof(a32));
+	memcpy(&b32, addr2, sizeof(b32));
+	memcpy(&a16, addr1 + 4, sizeof(a16));
+	memcpy(&b16, addr2 + 4, sizeof(b16));
+	return ((a32 ^ b32) | (a16 ^ b16)) == 0;
+}
+
+static inline bool ether_addr_equal_64bits(const u8 *addr1, const u8 *addr2)
+{
+	u64 a, b;
+
+	memcpy(&a, addr1, sizeof(a));
+	memcpy(&b, addr2, sizeof(b));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	return ((a ^ b) << 16) == 0;
+#else
+	return ((a ^ b) >> 16) == 0;
+#endif
+}
+
+static inline bool is_zero_ether_addr(const u8 *addr)
+{
+	static const u8 zero[ETH_ALEN];
+
+	return ether_addr_equal(addr, zero);
+}
+
+static inline bool ipv6_addr_equal(const struct in6_addr *a1,
+				   const struct in6_addr *a2)
+{
+	return memcmp(a1, a2, sizeof(*a1)) == 0;
+}
+
+static inline bool ipv6_addr_any(const struct in6_addr *a)
+{
+	static const struct in6_addr any;
+
+	return ipv6_addr_equal(a, &any);
+}
+
+struct nf_hook_state {
+	u8 hook;
+	u8 pf;
+	struct net_device *in;
+	struct net_device *out;
+	struct net *net;
+};
+
+struct xt_action_param {
+	const void *matchinfo;
+	const struct nf_hook_state *state;
+	unsigned int thoff;
+	u16 fragoff;
+	bool hotdrop;
+};
+
+#define xt_net(par)		((par)->state->net)
+#define xt_family(par)		((par)->state->pf)
+#define xt_in(par)		((par)->state->in)
+#define xt_out(par)		((par)->state->out)
+
+/* Netlink attributes */
+enum {
+	NLA_UNSPEC,
+	NLA_U8,
+	NLA_U16,
+	NLA_U32,
+	NLA_U64,
+	NLA_STRING,
+	NLA_FLAG,
+	NLA_MSECS,
+	NLA_NESTED,
+	NLA_NESTED_ARRAY,
+	NLA_NUL_STRING,
+	NLA_BINARY,
+};
+
+struct nla_policy {
+	u16 type;
+	u16 len;
+};
+
+struct netlink_ext_ack;
+
+struct netlink_callback {
+	long args[6];
+};
+
+static inline void *nla_data(const struct nlattr *nla)
+{
+	return (char *)nla + NLA_HDRLEN;
+}
+
+static inline int nla_len(const struct nlattr *nla)
+{
+	return nla->nla_len - NLA_HDRLEN;
+}
+
+static inline int nla_type(const struct nlattr *nla)
+{
+	return nla->nla_type & NLA_TYPE_MASK;
+}
+
+static inline int nla_total_size(int payload)
+{
+	return NLA_ALIGN(NLA_HDRLEN + payload);
+}
+
+#define __kshim_nla_get(type, nla)	\
+	({ type __v; memcpy(&__v, nla_data(nla), sizeof(__v)); __v; })
+#define nla_get_u8(nla)		__kshim_nla_get(u8, nla)
+#define nla_get_u16(nla)	__kshim_nla_get(u16, nla)
+#define nla_get_u32(nla)	__kshim_nla_get(u32, nla)
+#define nla_get_u64(nla)	__kshim_nla_get(u64, nla)
+#define nla_get_be16(nla)	__kshim_nla_get(__be16, nla)
+#define nla_get_be32(nla)	__kshim_nla_get(__be32, nla)
+#define nla_get_be64(nla)	__kshim_nla_get(__be64, nla)
+
+static inline size_t nla_strlcpy(char *dst, const struct nlattr *nla,
+				 size_t dstsize)
+{
+	size_t srclen = nla_len(nla);
+	const char *src = nla_data(nla);
+
+	if (srclen > 0 && src[srclen - 1] == '\0')
+		srclen--;
+	if (dstsize > 0) {
+		size_t len = srclen >= dstsize ? dstsize - 1 : srclen;
+
+		memset(dst, 0, dstsize);
+		memcpy(dst, src, len);
+	}
+	return srclen;
+}
+
+extern int nla_parse(struct nlattr **tb, int maxtype,
+		     const struct nlattr *head, int len,
+		     const struct nla_policy *policy,
+		     struct netlink_ext_ack *extack);
+
+static inline int nla_parse_nested(struct nlattr *tb[], int maxtype,
+				   const struct nlattr *nla,
+				   const struct nla_policy *policy,
+				   struct netlink_ext_ack *extack)
+{
+	return nla_parse(tb, maxtype, nla_data(nla), nla_len(nla), policy,
+			 extack);
+}
+
+extern int nla_put(struct sk_buff *skb, int attrtype, int attrlen,
+		   const void *data);
+
+static inline int nla_put_u8(struct sk_buff *skb, int type, u8 value)
+{
+	return nla_put(skb, type, sizeof(value), &value);
+}
+
+static inline int nla_put_u32(struct sk_buff *skb, int type, u32 value)
+{
+	return nla_put(skb, type, sizeof(value), &value);
+}
+
+static inline int nla_put_be16(struct sk_buff *skb, int type, __be16 value)
+{
+	return nla_put(skb, type, sizeof(value), &value);
+}
+
+static inline int nla_put_net16(struct sk_buff *skb, int type, __be16 value)
+{
+	return nla_put_be16(skb, type | NLA_F_NET_BYTEORDER, value);
+}
+
+static inline int nla_put_be32(struct sk_buff *skb, int type, __be32 value)
+{
+	return nla_put(skb, type, sizeof(value), &value);
+}
+
+static inline int nla_put_net32(struct sk_buff *skb, int type, __be32 value)
+{
+	return nla_put_be32(skb, type | NLA_F_NET_BYTEORDER, value);
+}
+
+static inline int nla_put_be64(struct sk_buff *skb, int type, __be64 value,
+			       int padattr)
+{
+	return nla_put(skb, type, sizeof(value), &value);
+}
+
+static inline int nla_put_net64(struct sk_buff *skb, int type, __be64 value,
+				int padattr)
+{
+	return nla_put_be64(skb, type | NLA_F_NET_BYTEORDER, value, padattr);
+}
+
+static inline int nla_put_string(struct sk_buff *skb, int type,
+				 const char *str)
+{
+	return nla_put(skb, type, strlen(str) + 1, str);
+}
+
+static inline int nla_put_in_addr(struct sk_buff *skb, int type, __be32 addr)
+{
+	return nla_put_be32(skb, type, addr);
+}
+
+static inline int nla_put_in6_addr(struct sk_buff *skb, int type,
+				   const struct in6_addr *addr)
+{
+	return nla_put(skb, type, sizeof(*addr), addr);
+}
+
+static inline struct nlattr *nla_nest_start(struct sk_buff *skb, int type)
+{
+	struct nlattr *start = (struct nlattr *)skb_tail_pointer(skb);
+
+	if (nla_put(skb, type, 0, NULL))
+		return NULL;
+	return start;
+}
+
+static inline int nla_nest_end(struct sk_buff *skb, struct nlattr *start)
+{
+	start->nla_len = skb_tail_pointer(skb) - (unsigned char *)start;
+	return skb->len;
+}
+
+static inline void nlmsg_trim(struct sk_buff *skb, const void *mark)
+{
+	if (mark) {
+		skb->tail = (const unsigned char *)mark - skb->head;
+		skb->len = skb->tail;
+	}
+}
+
+static inline void nla_nest_cancel(struct sk_buff *skb, struct nlattr *start)
+{
+	nlmsg_trim(skb, start);
+}
+
+/* Registered set type of the given name, supporting the family */
+struct ip_set_type;
+extern struct ip_set_type *kshim_find_type(const char *name, u8 family);
+
+#endif /* _KSHIM_H */
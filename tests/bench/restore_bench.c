@@ -0,0 +1,359 @@
+/* Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/* Benchmark of the restore, save and list commands of libipset and of
+ * the lookups in the snapshots of the sets.
+ *
+ * The commands are executed by the command line parser of the library,
+ * as the ipset program does, but the sets are stored by the in-process
+ * mock transport instead of the kernel. So the throughput of the
+ * userspace code paths (parsing, message building and the decoding and
+ * printing of the replies) can be measured without the kernel module
+ * and without root privileges.
+ *
+ * The sets of a single address or network dimension are snapshotted
+ * after the save and the addresses of the elements are looked up in
+ * the mapped snapshot file.
+ */
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libipset/ipset.h>
+#include <libipset/mock.h>
+#include <libipset/nfproto.h>
+#include <libipset/snapshot.h>
+
+#define BENCH_ELEMS		65536
+#define BENCH_LOOKUP_ROUNDS	16
+
+struct bench_type {
+	const char *name;
+	const char *family;
+	const char *create;		/* create options */
+	bool ext;			/* elements with extensions */
+	bool snapshot;			/* snapshots are supported */
+	/* Print the element #i into buf */
+	void (*elem)(char *buf, size_t len, unsigned int i);
+};
+
+static void
+ip4_elem(char *buf, size_t len, unsigned int i)
+{
+	snprintf(buf, len, "10.%u.%u.%u", (i >> 16) & 255, (i >> 8) & 255,
+		 i & 255);
+}
+
+static void
+ip6_elem(char *buf, size_t len, unsigned int i)
+{
+	snprintf(buf, len, "2001:db8::%x:%x", i >> 16, i & 0xffff);
+}
+
+static void
+ip4_ext_elem(char *buf, size_t len, unsigned int i)
+{
+	snprintf(buf, len, "10.%u.%u.%u timeout %u packets %u bytes %u "
+		 "comment \"elem%u\"", (i >> 16) & 255, (i >> 8) & 255,
+		 i & 255, 100 + i % 1000, i, 64 * i, i);
+}
+
+static void
+net4_elem(char *buf, size_t len, unsigned int i)
+{
+	snprintf(buf, len, "%u.%u.%u.0/24", 1 + (i >> 16), (i >> 8) & 255,
+		 i & 255);
+}
+
+static void
+ipport4_elem(char *buf, size_t len, unsigned int i)
+{
+	snprintf(buf, len, "10.0.%u.%u,tcp:%u", (i >> 12) & 255,
+		 (i >> 4) & 255, 1 + i % 16);
+}
+
+static void
+netportnet4_elem(char *buf, size_t len, unsigned int i)
+{
+	snprintf(buf, len, "10.%u.%u.0/24,udp:%u,192.168.%u.0/24",
+		 (i >> 12) & 255, (i >> 4) & 255, 1 + i % 16, i % 7);
+}
+
+static void
+netportnet6_elem(char *buf, size_t len, unsigned int i)
+{
+	snprintf(buf, len, "2001:db8:%x:%x::/64,udp:%u,2001:db8:ffff:%x::/64",
+		 i >> 16, i & 0xffff, 1 + i % 16, i % 7);
+}
+
+static const struct bench_type bench_types[] = {
+	{ "bitmap:ip", "inet", "range 10.0.0.0/16", false, true, ip4_elem },
+	{ "hash:ip", "inet", "family inet maxelem 131072", false, true,
+	  ip4_elem },
+	{ "hash:ip", "inet6", "family inet6 maxelem 131072", false, true,
+	  ip6_elem },
+	{ "hash:ip", "inet", "family inet maxelem 131072 "
+	  "timeout 600 counters comment", true, true, ip4_ext_elem },
+	{ "hash:net", "inet", "family inet maxelem 131072", false, true,
+	  net4_elem },
+	{ "hash:ip,port", "inet", "family inet maxelem 131072", false, false,
+	  ipport4_elem },
+	{ "hash:net,port,net", "inet", "family inet maxelem 131072", false,
+	  false, netportnet4_elem },
+	{ "hash:net,port,net", "inet6", "family inet6 maxelem 131072", false,
+	  false, netportnet6_elem },
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+write_restore(const char *path, const struct bench_type *bt, unsigned int n)
+{
+	FILE *f = fopen(path, "w");
+	char elem[256];
+	unsigned int i;
+
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	fprintf(f, "create bench %s %s\n", bt->name, bt->create);
+	for (i = 0; i < n; i++) {
+		bt->elem(elem, sizeof(elem), i);
+		fprintf(f, "add bench %s\n", elem);
+	}
+	if (fclose(f)) {
+		perror(path);
+		exit(1);
+	}
+}
+
+static unsigned int
+count_lines(const char *path, const char *prefix)
+{
+	FILE *f = fopen(path, "r");
+	char line[1024];
+	unsigned int n = 0;
+
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f))
+		if (strncmp(line, prefix, strlen(prefix)) == 0)
+			n++;
+	fclose(f);
+	return n;
+}
+
+/* Restore the file like "ipset restore" does */
+static double
+restore(struct ipset *ipset, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	double start = now();
+
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	if (ipset_parse_stream(ipset, f) < 0) {
+		fprintf(stderr, "ipset restore failed\n");
+		exit(1);
+	}
+	fclose(f);
+	return now() - start;
+}
+
+/* Run the command with output into the file */
+static double
+run(struct ipset *ipset, const char *cmd, const char *path)
+{
+	struct ipset_session *session = ipset_session(ipset);
+	char *argv[] = { "ipset", (char *)cmd, NULL };
+	double start = now();
+
+	if (ipset_session_io_full(session, path, IPSET_IO_OUTPUT) < 0 ||
+	    ipset_parse_argv(ipset, 2, argv) < 0 ||
+	    ipset_session_io_close(session, IPSET_IO_OUTPUT) < 0) {
+		fprintf(stderr, "ipset %s failed\n", cmd);
+		exit(1);
+	}
+	return now() - start;
+}
+
+/* Snapshot the set and look up the addresses of the elements in it,
+ * returns the number of lookups per sec.
+ */
+static double
+lookup(struct ipset *ipset, const struct bench_type *bt, unsigned int n,
+       const char *path)
+{
+	struct ipset_session *session = ipset_session(ipset);
+	bool ipv6 = strcmp(bt->family, "inet6") == 0;
+	uint8_t family = ipv6 ? NFPROTO_IPV6 : NFPROTO_IPV4;
+	struct ipset_snapshot *snapshot;
+	struct in6_addr *addrs;
+	unsigned int i, r, hits = 0;
+	char elem[256];
+	double start, elapsed;
+
+	addrs = calloc(n, sizeof(*addrs));
+	if (!addrs) {
+		fprintf(stderr, "cannot allocate memory\n");
+		exit(1);
+	}
+	for (i = 0; i < n; i++) {
+		bt->elem(elem, sizeof(elem), i);
+		elem[strcspn(elem, "/ ")] = '\0';
+		if (inet_pton(ipv6 ? AF_INET6 : AF_INET, elem, &addrs[i]) != 1) {
+			fprintf(stderr, "cannot parse address %s\n", elem);
+			exit(1);
+		}
+	}
+	if (ipset_snapshot_create(session, "bench", path) < 0) {
+		fprintf(stderr, "snapshot failed: %s\n",
+			ipset_session_report_msg(session));
+		exit(1);
+	}
+	snapshot = ipset_snapshot_open(path);
+	if (!snapshot) {
+		perror(path);
+		exit(1);
+	}
+
+	start = now();
+	for (r = 0; r < BENCH_LOOKUP_ROUNDS; r++)
+		for (i = 0; i < n; i++)
+			hits += ipset_snapshot_test(snapshot, family,
+						    &addrs[i]);
+	elapsed = now() - start;
+
+	ipset_snapshot_close(snapshot);
+	unlink(path);
+	free(addrs);
+	if (hits != n * BENCH_LOOKUP_ROUNDS) {
+		fprintf(stderr, "%s %s: %u of %u lookups matched\n",
+			bt->name, bt->family, hits, n * BENCH_LOOKUP_ROUNDS);
+		exit(1);
+	}
+	return n * BENCH_LOOKUP_ROUNDS / elapsed * 1e9;
+}
+
+static void
+bench_run(const struct bench_type *bt, unsigned int n, const char *dir)
+{
+	char input[256], output[256], snap[256], lookups[16] = "-";
+	double restored, save, list;
+	struct ipset *ipset;
+	unsigned int saved;
+
+	snprintf(input, sizeof(input), "%s/restore_bench.in", dir);
+	snprintf(output, sizeof(output), "%s/restore_bench.out", dir);
+	snprintf(snap, sizeof(snap), "%s/restore_bench.snap", dir);
+	write_restore(input, bt, n);
+
+	ipset = ipset_init();
+	if (!ipset ||
+	    ipset_session_transport(ipset_session(ipset),
+				    &ipset_mock_transport) < 0) {
+		fprintf(stderr, "cannot initialize the library\n");
+		exit(1);
+	}
+	restored = restore(ipset, input);
+	save = run(ipset, "save", output);
+	saved = count_lines(output, "add ");
+	list = run(ipset, "list", output);
+	if (bt->snapshot)
+		snprintf(lookups, sizeof(lookups), "%.0f",
+			 lookup(ipset, bt, n, snap));
+	ipset_fini(ipset);
+
+	if (saved != n) {
+		fprintf(stderr, "%s %s: %u elements restored, %u saved\n",
+			bt->name, bt->family, n, saved);
+		exit(1);
+	}
+	unlink(input);
+	unlink(output);
+
+	printf("%-18s %-6s %-5s %8u %10.1f %10.1f %10.1f %10.0f %10s\n",
+	       bt->name, bt->family, bt->ext ? "yes" : "no", n,
+	       restored / n, save / n, list / n, n / restored * 1e9,
+	       lookups);
+	fflush(stdout);
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [-n elements] [-t type] [-d dir]\n"
+	       "  -n N     number of elements, default %u\n"
+	       "  -t TYPE  benchmark the set type TYPE only\n"
+	       "  -d DIR   directory of the temporary files, default /tmp\n"
+	       "Times are nanosec per element, the last columns are the\n"
+	       "number of restored elements per sec and the number of\n"
+	       "lookups per sec in the snapshot of the set.\n",
+	       prog, BENCH_ELEMS);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *only = NULL, *dir = "/tmp";
+	unsigned int n = BENCH_ELEMS, i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:t:d:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			only = optarg;
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	/* The bitmap range holds 64k elements */
+	if (n == 0 || n > BENCH_ELEMS) {
+		fprintf(stderr, "invalid number of elements\n");
+		return 1;
+	}
+
+	ipset_load_types();
+
+	printf("%-18s %-6s %-5s %8s %10s %10s %10s %10s %10s\n",
+	       "type", "family", "ext", "elements", "restore", "save",
+	       "list", "restore/s", "lookup/s");
+	for (i = 0; i < sizeof(bench_types) / sizeof(bench_types[0]); i++) {
+		const struct bench_type *bt = &bench_types[i];
+
+		if (only && strcmp(only, bt->name) != 0)
+			continue;
+		bench_run(bt, n, dir);
+	}
+	return 0;
+}
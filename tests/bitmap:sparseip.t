@@ -0,0 +1,97 @@
+# Range: Try to create a set with an invalid range
+1 ipset create test bitmap:sparseip range 10.0.0.0/33
+# Range: Create a set covering a /8 network
+0 ipset create test bitmap:sparseip range 10.0.0.0/8
+# Range: Add lower boundary
+0 ipset add test 10.0.0.0
+# Range: Add upper boundary
+0 ipset add test 10.255.255.255
+# Range: Test lower boundary
+0 ipset test test 10.0.0.0
+# Range: Test upper boundary
+0 ipset test test 10.255.255.255
+# Range: Test element not added to the set
+1 ipset test test 10.0.0.1
+# Range: Test element in a chunk not populated
+1 ipset test test 10.100.0.1
+# Range: Test element before lower boundary
+1 ipset test test 9.255.255.255
+# Range: Test element after upper boundary
+1 ipset test test 11.0.0.0
+# Range: Try to add element before lower boundary
+1 ipset add test 9.255.255.255
+# Range: Try to add element after upper boundary
+1 ipset add test 11.0.0.0
+# Range: Delete element not added to the set
+1 ipset -D test 10.0.0.2
+# Range: Delete element not added to the set, with exist flag
+0 ipset -! -D test 10.0.0.2
+# Range: Add element in the middle
+0 ipset -A test 10.128.0.1
+# Range: Add element in the middle again
+1 ipset -A test 10.128.0.1
+# Range: Add element in the middle again, with exist flag
+0 ipset -! -A test 10.128.0.1
+# Range: Delete the same element
+0 ipset -D test 10.128.0.1
+# Range: Add a range of elements crossing a chunk boundary
+0 ipset -A test 10.1.255.250-10.2.0.5
+# Range: Try to add an overlapping range
+1 ipset -A test 10.2.0.0-10.2.0.10
+# Range: Add an overlapping range, with exist flag
+0 ipset -! -A test 10.2.0.0-10.2.0.10
+# Range: Test element from the range
+0 ipset test test 10.2.0.10
+# Range: List set
+0 ipset list test | grep -v Revision: > .foo
+# Range: Check listing
+0 diff -u -I 'Size in memory.*' .foo bitmap:sparseip.t.list0
+# Range: Delete a network from the range
+0 ipset -D test 10.2.0.0/30
+# Range: Try to delete a range with missing elements
+1 ipset -D test 10.2.0.0-10.2.0.5
+# Range: Delete a range with missing elements, with exist flag
+0 ipset -! -D test 10.2.0.0-10.2.0.5
+# Range: List set
+0 ipset list test | grep -v Revision: > .foo
+# Range: Check listing
+0 diff -u -I 'Size in memory.*' .foo bitmap:sparseip.t.list1
+# Range: Save set
+0 ipset save test > .foo.save
+# Range: Destroy set
+0 ipset destroy test
+# Range: Restore saved set
+0 ipset restore < .foo.save
+# Range: List restored set
+0 ipset list test | grep -v Revision: > .foo
+# Range: Check listing
+0 diff -u -I 'Size in memory.*' .foo bitmap:sparseip.t.list1
+# Range: Flush test set
+0 ipset flush test
+# Range: Test element after flush
+1 ipset test test 10.0.0.0
+# Range: Delete test set
+0 ipset destroy test && rm .foo.save
+# Full space: Create a set covering the whole IPv4 address space
+0 ipset create test bitmap:sparseip range 0.0.0.0-255.255.255.255
+# Full space: Add upper boundary
+0 ipset add test 255.255.255.255
+# Full space: Add a /16 network
+0 ipset add test 192.168.0.0/16
+# Full space: Test element from the network
+0 ipset test test 192.168.1.1
+# Full space: Test element after the network
+1 ipset test test 192.169.0.0
+# Full space: Test lower boundary
+1 ipset test test 0.0.0.0
+# Full space: List set
+0 ipset list test | grep -v Revision: > .foo
+# Full space: Check listing
+0 diff -u -I 'Size in memory.*' .foo bitmap:sparseip.t.list2
+# Full space: Delete the network
+0 ipset del test 192.168.0.0/16
+# Full space: Test element from the deleted network
+1 ipset test test 192.168.1.1
+# Full space: Delete test set
+0 ipset destroy test
+# eof
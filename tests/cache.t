@@ -0,0 +1,61 @@
+# hash:ip: Create set with cache
+0 ipset n test hash:ip cache
+# hash:ip: Check cache flag in header
+0 ipset -L test | grep -q '^Header:.* cache'
+# hash:ip: Add element
+0 ipset a test 10.0.0.1
+# hash:ip: Test element on CPU 0, cache miss
+0 taskset -c 0 ipset t test 10.0.0.1
+# hash:ip: Test element again on the same CPU, cache hit
+0 taskset -c 0 ipset t test 10.0.0.1
+# hash:ip: Check cache hits
+0 ipset -L test | grep -q '^Cache hits: [1-9]'
+# hash:ip: Check cache misses
+0 ipset -L test | grep -q '^Cache misses: [1-9]'
+# hash:ip: Test missing element twice
+1 ipset t test 10.0.0.2 || ipset t test 10.0.0.2
+# hash:ip: Add the missing element
+0 ipset a test 10.0.0.2
+# hash:ip: Test the added element, no stale verdict
+0 ipset t test 10.0.0.2
+# hash:ip: Delete element
+0 ipset d test 10.0.0.1
+# hash:ip: Test deleted element, no stale verdict
+1 ipset t test 10.0.0.1
+# hash:ip: Flush set
+0 ipset f test
+# hash:ip: Test flushed element, no stale verdict
+1 ipset t test 10.0.0.2
+# hash:ip: Save set, cache is restored
+0 ipset save test | grep -q '^create test hash:ip .* cache'
+# hash:ip: Destroy set
+0 ipset x test
+# hash:ip: Create set with cache and timeout
+1 ipset n test hash:ip cache timeout 10
+# hash:ip: Create set with cache and counters
+1 ipset n test hash:ip cache counters
+# hash:ip: Create set with cache and skbinfo
+1 ipset n test hash:ip cache skbinfo
+# hash:net: Create set with cache
+0 ipset n test hash:net cache
+# hash:net: Add networks with a nomatch one
+0 ipset a test 10.0.0.0/24 && ipset a test 10.0.0.128/25 nomatch
+# hash:net: Test address in network
+0 ipset t test 10.0.0.1 && ipset t test 10.0.0.1
+# hash:net: Test address in nomatch network
+1 ipset t test 10.0.0.129 || ipset t test 10.0.0.129
+# hash:net: Delete nomatch network
+0 ipset d test 10.0.0.128/25
+# hash:net: Test address, now in network
+0 ipset t test 10.0.0.129
+# hash:net: Destroy set
+0 ipset x test
+# hash:ip6: Create set with cache
+0 ipset n test hash:ip family inet6 cache
+# hash:ip6: Add element and test it twice on CPU 0
+0 ipset a test 2001:db8::1 && taskset -c 0 ipset t test 2001:db8::1 && taskset -c 0 ipset t test 2001:db8::1
+# hash:ip6: Check cache hits
+0 ipset -L test | grep -q '^Cache hits: [1-9]'
+# hash:ip6: Destroy set
+0 ipset x test
+# eof
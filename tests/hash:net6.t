@@ -136,4 +136,152 @@
 0 ./check_extensions test 2:: 700 13 12479
 # Counters and timeout: destroy set
 0 ipset x test
+# Prefixes: create set
+0 ipset n test hash:net -6
+# Prefixes: add /8 network
+0 ipset a test 100::/8
+# Prefixes: add /16 network
+0 ipset a test 25a::/16
+# Prefixes: add /24 network
+0 ipset a test 35a:5a00::/24
+# Prefixes: add /31 network
+0 ipset a test 45a:5a5a::/31
+# Prefixes: add /32 network
+0 ipset a test 55a:5a5a::/32
+# Prefixes: add /33 network
+0 ipset a test 65a:5a5a::/33
+# Prefixes: add /40 network
+0 ipset a test 75a:5a5a:5a00::/40
+# Prefixes: add /48 network
+0 ipset a test 85a:5a5a:5a5a::/48
+# Prefixes: add /56 network
+0 ipset a test 95a:5a5a:5a5a:5a00::/56
+# Prefixes: add /63 network
+0 ipset a test a5a:5a5a:5a5a:5a5a::/63
+# Prefixes: add /64 network
+0 ipset a test b5a:5a5a:5a5a:5a5a::/64
+# Prefixes: add /65 network
+0 ipset a test c5a:5a5a:5a5a:5a5a::/65
+# Prefixes: add /72 network
+0 ipset a test d5a:5a5a:5a5a:5a5a:5a00::/72
+# Prefixes: add /80 network
+0 ipset a test e5a:5a5a:5a5a:5a5a:5a5a::/80
+# Prefixes: add /88 network
+0 ipset a test f5a:5a5a:5a5a:5a5a:5a5a:5a00::/88
+# Prefixes: add /95 network
+0 ipset a test 105a:5a5a:5a5a:5a5a:5a5a:5a5a::/95
+# Prefixes: add /96 network
+0 ipset a test 115a:5a5a:5a5a:5a5a:5a5a:5a5a::/96
+# Prefixes: add /97 network
+0 ipset a test 125a:5a5a:5a5a:5a5a:5a5a:5a5a::/97
+# Prefixes: add /104 network
+0 ipset a test 135a:5a5a:5a5a:5a5a:5a5a:5a5a:5a00:0/104
+# Prefixes: add /112 network
+0 ipset a test 145a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:0/112
+# Prefixes: add /120 network
+0 ipset a test 155a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:5a00/120
+# Prefixes: add /126 network
+0 ipset a test 165a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:5a58/126
+# Prefixes: add /127 network
+0 ipset a test 175a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a/127
+# Prefixes: add /128 network
+0 ipset a test 185a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a/128
+# Prefixes: test address in /8 network
+0 ipset t test 1ff:ffff:ffff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address out of /8 network
+1 ipset t test ff:ffff:ffff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address in /16 network
+0 ipset t test 25a:ffff:ffff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address out of /16 network
+1 ipset t test 25b:ffff:ffff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address in /24 network
+0 ipset t test 35a:5aff:ffff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address out of /24 network
+1 ipset t test 35a:5bff:ffff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address in /31 network
+0 ipset t test 45a:5a5b:ffff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address out of /31 network
+1 ipset t test 45a:5a59:ffff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address in /32 network
+0 ipset t test 55a:5a5a:ffff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address out of /32 network
+1 ipset t test 55a:5a5b:ffff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address in /33 network
+0 ipset t test 65a:5a5a:7fff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address out of /33 network
+1 ipset t test 65a:5a5a:ffff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address in /40 network
+0 ipset t test 75a:5a5a:5aff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address out of /40 network
+1 ipset t test 75a:5a5a:5bff:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address in /48 network
+0 ipset t test 85a:5a5a:5a5a:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address out of /48 network
+1 ipset t test 85a:5a5a:5a5b:ffff:ffff:ffff:ffff:ffff
+# Prefixes: test address in /56 network
+0 ipset t test 95a:5a5a:5a5a:5aff:ffff:ffff:ffff:ffff
+# Prefixes: test address out of /56 network
+1 ipset t test 95a:5a5a:5a5a:5bff:ffff:ffff:ffff:ffff
+# Prefixes: test address in /63 network
+0 ipset t test a5a:5a5a:5a5a:5a5b:ffff:ffff:ffff:ffff
+# Prefixes: test address out of /63 network
+1 ipset t test a5a:5a5a:5a5a:5a59:ffff:ffff:ffff:ffff
+# Prefixes: test address in /64 network
+0 ipset t test b5a:5a5a:5a5a:5a5a:ffff:ffff:ffff:ffff
+# Prefixes: test address out of /64 network
+1 ipset t test b5a:5a5a:5a5a:5a5b:ffff:ffff:ffff:ffff
+# Prefixes: test address in /65 network
+0 ipset t test c5a:5a5a:5a5a:5a5a:7fff:ffff:ffff:ffff
+# Prefixes: test address out of /65 network
+1 ipset t test c5a:5a5a:5a5a:5a5a:ffff:ffff:ffff:ffff
+# Prefixes: test address in /72 network
+0 ipset t test d5a:5a5a:5a5a:5a5a:5aff:ffff:ffff:ffff
+# Prefixes: test address out of /72 network
+1 ipset t test d5a:5a5a:5a5a:5a5a:5bff:ffff:ffff:ffff
+# Prefixes: test address in /80 network
+0 ipset t test e5a:5a5a:5a5a:5a5a:5a5a:ffff:ffff:ffff
+# Prefixes: test address out of /80 network
+1 ipset t test e5a:5a5a:5a5a:5a5a:5a5b:ffff:ffff:ffff
+# Prefixes: test address in /88 network
+0 ipset t test f5a:5a5a:5a5a:5a5a:5a5a:5aff:ffff:ffff
+# Prefixes: test address out of /88 network
+1 ipset t test f5a:5a5a:5a5a:5a5a:5a5a:5bff:ffff:ffff
+# Prefixes: test address in /95 network
+0 ipset t test 105a:5a5a:5a5a:5a5a:5a5a:5a5b:ffff:ffff
+# Prefixes: test address out of /95 network
+1 ipset t test 105a:5a5a:5a5a:5a5a:5a5a:5a59:ffff:ffff
+# Prefixes: test address in /96 network
+0 ipset t test 115a:5a5a:5a5a:5a5a:5a5a:5a5a:ffff:ffff
+# Prefixes: test address out of /96 network
+1 ipset t test 115a:5a5a:5a5a:5a5a:5a5a:5a5b:ffff:ffff
+# Prefixes: test address in /97 network
+0 ipset t test 125a:5a5a:5a5a:5a5a:5a5a:5a5a:7fff:ffff
+# Prefixes: test address out of /97 network
+1 ipset t test 125a:5a5a:5a5a:5a5a:5a5a:5a5a:ffff:ffff
+# Prefixes: test address in /104 network
+0 ipset t test 135a:5a5a:5a5a:5a5a:5a5a:5a5a:5aff:ffff
+# Prefixes: test address out of /104 network
+1 ipset t test 135a:5a5a:5a5a:5a5a:5a5a:5a5a:5bff:ffff
+# Prefixes: test address in /112 network
+0 ipset t test 145a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:ffff
+# Prefixes: test address out of /112 network
+1 ipset t test 145a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5b:ffff
+# Prefixes: test address in /120 network
+0 ipset t test 155a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:5aff
+# Prefixes: test address out of /120 network
+1 ipset t test 155a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:5bff
+# Prefixes: test address in /126 network
+0 ipset t test 165a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5b
+# Prefixes: test address out of /126 network
+1 ipset t test 165a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5f
+# Prefixes: test address in /127 network
+0 ipset t test 175a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5b
+# Prefixes: test address out of /127 network
+1 ipset t test 175a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:5a59
+# Prefixes: test address in /128 network
+0 ipset t test 185a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a
+# Prefixes: test address out of /128 network
+1 ipset t test 185a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5a:5a5b
+# Prefixes: destroy set
+0 ipset x test
 # eof
@@ -0,0 +1,59 @@
+# hash:net: Create set with comments
+0 ipset n a hash:net comment
+# hash:net: Fill set
+0 ipset a a 10.0.0.0/24 comment "web servers" && ipset a a 10.0.1.0/24 comment "mail servers" && ipset a a 10.1.0.0/16 && ipset a a 10.0.0.0/8
+# hash:net: List elements within a network
+0 test `ipset l a -match-ip 10.0.0.0/16 | grep -c '^10\.'` -eq 2
+# hash:net: Less specific elements do not match
+0 test `ipset l a -match-ip 10.0.0.0/16 | grep -c '^10.0.0.0/8'` -eq 0
+# hash:net: List elements by comment
+0 test `ipset l a -match-comment servers | grep -c '^10\.'` -eq 2
+# hash:net: Combine address and comment filters
+0 test `ipset l a -match-ip 10.0.1.0/24 -match-comment servers | grep -c '^10\.'` -eq 1
+# hash:net: Elements without comment do not match
+0 test `ipset l a -match-comment mail | grep -c '^10\.'` -eq 1
+# hash:net: Filter on a port does not match any element
+0 test `ipset l a -match-port 80 | grep -c '^10\.'` -eq 0
+# hash:net: Invalid address filter
+1 ipset l a -match-ip 10.0.0.0/33
+# hash:net: Destroy set
+0 ipset x a
+# hash:ip,port: Create set
+0 ipset n a hash:ip,port
+# hash:ip,port: Fill set
+0 ipset a a 10.0.0.1,tcp:80 && ipset a a 10.0.0.1,tcp:443 && ipset a a 10.0.0.2,udp:53
+# hash:ip,port: List elements with port in range
+0 test `ipset l a -match-port 53-100 | grep -c '^10\.'` -eq 2
+# hash:ip,port: Save elements with port and address
+0 test `ipset save a -match-port 1-1024 -match-ip 10.0.0.1 | grep -c '^add a'` -eq 2
+# hash:ip,port: Invalid port range
+1 ipset l a -match-port 100-53
+# hash:ip,port: Destroy set
+0 ipset x a
+# hash:ip6: Create set
+0 ipset n a hash:ip6
+# hash:ip6: Fill set
+0 ipset a a 2001:db8::1 && ipset a a 2001:db8:1::1
+# hash:ip6: List elements within a network
+0 test `ipset l a -match-ip 2001:db8::/48 | grep -c '^2001'` -eq 1
+# hash:ip6: IPv4 filter does not match
+0 test `ipset l a -match-ip 10.0.0.0/8 | grep -c '^2001'` -eq 0
+# hash:ip6: Destroy set
+0 ipset x a
+# bitmap:port: Create set
+0 ipset n a bitmap:port range 1-1024
+# bitmap:port: Fill set
+0 ipset a a 20-25
+# bitmap:port: List elements with port in range
+0 test `ipset l a -match-port 22-30 | grep -c '^[0-9]'` -eq 4
+# bitmap:port: Destroy set
+0 ipset x a
+# bitmap:sparseip: Create set
+0 ipset n a bitmap:sparseip range 10.0.0.0/8
+# bitmap:sparseip: Fill set
+0 ipset a a 10.0.0.250-10.0.1.5
+# bitmap:sparseip: Range is clipped to the network
+0 ipset l a -match-ip 10.0.1.0/24 | grep -q '^10.0.1.0-10.0.1.5$'
+# bitmap:sparseip: Destroy set
+0 ipset x a
+# eof
@@ -0,0 +1,35 @@
+# Create set with comment support
+0 ipset n test hash:net comment
+# Add initial elements
+0 ipset a test 10.0.0.0/24 comment "old" && ipset a test 10.0.1.0/24
+# Replace the content of the set
+0 ipset restore < replace.t.restore
+# Check number of elements after replace
+0 ipset l test | grep -q '^Number of entries: 3$'
+# Test element from the old content
+1 ipset t test 10.0.1.1
+# Test element from the new content
+0 ipset t test 192.168.0.1
+# Test element matching the new nomatch element
+1 ipset t test 192.168.0.129
+# Check the comment of the replaced element
+0 ipset l test | grep -q '^10.0.0.0/24 comment "new"$'
+# Try to replace with an invalid element stream
+1 ipset restore < replace.t.fail
+# Check that the set is left unchanged
+0 ipset l test | grep -q '^Number of entries: 3$'
+# Test element from the failed stream
+1 ipset t test 172.16.0.1
+# Replace again, now the stream is fine
+0 ipset restore < replace.t.restore
+# Check number of elements after the second replace
+0 ipset l test | grep -q '^Number of entries: 3$'
+# Try replace outside restore mode
+1 ipset replace test
+# Create bitmap set
+0 ipset n portmap bitmap:port range 1-1024
+# Try to replace the content of a bitmap set
+1 echo "replace portmap" | ipset restore
+# Destroy sets
+0 ipset x
+# eof
@@ -5,7 +5,7 @@
 ipset=${IPSET_BIN:-../src/ipset}
 
 tests="init"
-tests="$tests ipmap bitmap:ip"
+tests="$tests ipmap bitmap:ip bitmap:sparseip"
 tests="$tests macipmap portmap"
 tests="$tests iphash hash:ip hash:ip6"
 tests="$tests ipporthash hash:ip,port hash:ip6,port"
@@ -15,7 +15,7 @@ tests="$tests nethash hash:net hash:net6 hash:net,port hash:net6,port"
 tests="$tests hash:ip,port,net hash:ip6,port,net6 hash:net,net hash:net6,net6"
 tests="$tests hash:net,port,net hash:net6,port,net6"
 tests="$tests hash:net,iface.t hash:mac.t"
-tests="$tests comment setlist restore"
+tests="$tests comment setlist restore setop replace sync listfilter testbatch snapshot cache"
 # tests="$tests iptree iptreemap"
 
 # For correct sorting:
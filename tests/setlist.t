@@ -30,6 +30,10 @@
 1 ipset -T test foo,after,bar
 # Save sets
 0 ipset -S > setlist.t.r
+# Save sets over parallel sessions
+0 ipset -S -parallel 3 > .foo
+# Check parallel save against serial save
+0 diff -u setlist.t.r .foo
 # Delete bar,before,foo
 1 ipset -D test bar,before,foo
 # Delete foo,after,bar
@@ -0,0 +1,211 @@
+# bitmap:ip: Create first operand
+0 ipset n a bitmap:ip range 10.0.0.0/24
+# bitmap:ip: Create second operand
+0 ipset n b bitmap:ip range 10.0.0.0/24
+# bitmap:ip: Create target with counters
+0 ipset n c bitmap:ip range 10.0.0.0/24 counters
+# bitmap:ip: Fill first operand
+0 ipset a a 10.0.0.1-10.0.0.5
+# bitmap:ip: Fill second operand
+0 ipset a b 10.0.0.4-10.0.0.8
+# bitmap:ip: Union
+0 ipset union c a b
+# bitmap:ip: Check number of elements in union
+0 ipset l c | grep -q '^Number of entries: 8$'
+# bitmap:ip: Test element from first operand
+0 ipset t c 10.0.0.1
+# bitmap:ip: Test element from second operand
+0 ipset t c 10.0.0.8
+# bitmap:ip: Test element not in union
+1 ipset t c 10.0.0.9
+# bitmap:ip: Intersection
+0 ipset intersect c a b
+# bitmap:ip: Check number of elements in intersection
+0 ipset l c | grep -q '^Number of entries: 2$'
+# bitmap:ip: Test element in intersection
+0 ipset t c 10.0.0.5
+# bitmap:ip: Test element not in intersection
+1 ipset t c 10.0.0.3
+# bitmap:ip: Difference
+0 ipset diff c a b
+# bitmap:ip: Check number of elements in difference
+0 ipset l c | grep -q '^Number of entries: 3$'
+# bitmap:ip: Test element in difference
+0 ipset t c 10.0.0.3
+# bitmap:ip: Test element not in difference
+1 ipset t c 10.0.0.4
+# bitmap:ip: Try to store the result in an operand
+1 ipset union a a b
+# bitmap:ip: Create set with different range
+0 ipset n d bitmap:ip range 10.0.1.0/24
+# bitmap:ip: Try to store the union in set with different range
+1 ipset union d a b
+# bitmap:ip: Create set with different type
+0 ipset n e hash:ip
+# bitmap:ip: Try to store the union in set with different type
+1 ipset union e a b
+# bitmap:ip: Try to use a nonexistent operand
+1 ipset union c a nonexistent
+# bitmap:ip: Destroy sets
+0 ipset x
+# bitmap:port: Create sets
+0 ipset n a bitmap:port range 1-1024 && ipset n b bitmap:port range 1-1024 && ipset n c bitmap:port range 1-1024
+# bitmap:port: Fill operands
+0 ipset a a 1-10 && ipset a b 5-20
+# bitmap:port: Difference
+0 ipset diff c a b
+# bitmap:port: Check number of elements in difference
+0 ipset l c | grep -q '^Number of entries: 4$'
+# bitmap:port: Test element in difference
+0 ipset t c 4
+# bitmap:port: Test element not in difference
+1 ipset t c 5
+# bitmap:port: Destroy sets
+0 ipset x
+# bitmap:ip,mac: Create sets
+0 ipset n a bitmap:ip,mac range 10.0.0.0/24 && ipset n b bitmap:ip,mac range 10.0.0.0/24 && ipset n c bitmap:ip,mac range 10.0.0.0/24
+# bitmap:ip,mac: Fill first operand
+0 ipset a a 10.0.0.1,00:11:22:33:44:55 && ipset a a 10.0.0.2,00:11:22:33:44:56
+# bitmap:ip,mac: Fill second operand
+0 ipset a b 10.0.0.1,00:11:22:33:44:55 && ipset a b 10.0.0.2,00:11:22:33:44:57
+# bitmap:ip,mac: Intersection
+0 ipset intersect c a b
+# bitmap:ip,mac: Check number of elements in intersection
+0 ipset l c | grep -q '^Number of entries: 1$'
+# bitmap:ip,mac: Test element with matching MAC address
+0 ipset t c 10.0.0.1,00:11:22:33:44:55
+# bitmap:ip,mac: Test element with different MAC addresses
+1 ipset t c 10.0.0.2
+# bitmap:ip,mac: Destroy sets
+0 ipset x
+# bitmap:sparseip: Create sets
+0 ipset n a bitmap:sparseip range 10.0.0.0/8 && ipset n b bitmap:sparseip range 10.0.0.0/8 && ipset n c bitmap:sparseip range 10.0.0.0/8
+# bitmap:sparseip: Fill operands across a chunk boundary
+0 ipset a a 10.1.255.250-10.2.0.5 && ipset a b 10.2.0.0-10.2.0.10
+# bitmap:sparseip: Intersection
+0 ipset intersect c a b
+# bitmap:sparseip: Check number of elements in intersection
+0 ipset l c | grep -q '^Number of entries: 6$'
+# bitmap:sparseip: Union
+0 ipset union c a b
+# bitmap:sparseip: Check number of elements in union
+0 ipset l c | grep -q '^Number of entries: 17$'
+# bitmap:sparseip: Destroy sets
+0 ipset x
+# hash:ip: Create sets with small hash size
+0 ipset n a hash:ip hashsize 64 && ipset n b hash:ip hashsize 64 && ipset n c hash:ip hashsize 64 timeout 600
+# hash:ip: Fill operands with overlapping ranges
+0 ipset a a 10.0.0.0-10.0.15.255 && ipset a b 10.0.8.0-10.0.23.255
+# hash:ip: Union, target must be resized
+0 ipset union c a b
+# hash:ip: Check number of elements in union
+0 ipset l c | grep -q '^Number of entries: 6144$'
+# hash:ip: Check default timeout of the target
+0 ipset l c | grep -q '^10.0.0.1 timeout'
+# hash:ip: Intersection
+0 ipset intersect c a b
+# hash:ip: Check number of elements in intersection
+0 ipset l c | grep -q '^Number of entries: 2048$'
+# hash:ip: Test element in intersection
+0 ipset t c 10.0.8.0
+# hash:ip: Difference
+0 ipset diff c a b
+# hash:ip: Check number of elements in difference
+0 ipset l c | grep -q '^Number of entries: 2048$'
+# hash:ip: Test element not in difference
+1 ipset t c 10.0.8.0
+# hash:ip: Create set with different netmask
+0 ipset n d hash:ip netmask 24
+# hash:ip: Try to store the union in set with different netmask
+1 ipset union d a b
+# hash:ip: Destroy sets
+0 ipset x
+# hash:ip6: Create sets
+0 ipset n a hash:ip6 && ipset n b hash:ip6 && ipset n c hash:ip6
+# hash:ip6: Fill operands
+0 ipset a a 2001:db8::1 && ipset a a 2001:db8::2 && ipset a b 2001:db8::2 && ipset a b 2001:db8::3
+# hash:ip6: Intersection
+0 ipset intersect c a b
+# hash:ip6: Check number of elements in intersection
+0 ipset l c | grep -q '^Number of entries: 1$'
+# hash:ip6: Test element in intersection
+0 ipset t c 2001:db8::2
+# hash:ip6: Create IPv4 set
+0 ipset n d hash:ip
+# hash:ip6: Try to store the union in set with different family
+1 ipset union d a b
+# hash:ip6: Destroy sets
+0 ipset x
+# hash:ip,port: Create sets
+0 ipset n a hash:ip,port && ipset n b hash:ip,port && ipset n c hash:ip,port
+# hash:ip,port: Fill operands
+0 ipset a a 10.0.0.1,tcp:80 && ipset a a 10.0.0.2,udp:53 && ipset a b 10.0.0.1,tcp:80
+# hash:ip,port: Difference
+0 ipset diff c a b
+# hash:ip,port: Check number of elements in difference
+0 ipset l c | grep -q '^Number of entries: 1$'
+# hash:ip,port: Test element in difference
+0 ipset t c 10.0.0.2,udp:53
+# hash:ip,port: Destroy sets
+0 ipset x
+# hash:net: Create sets
+0 ipset n a hash:net && ipset n b hash:net && ipset n c hash:net
+# hash:net: Fill first operand with a nomatch element
+0 ipset a a 10.0.0.0/24 && ipset a a 10.0.0.128/25 nomatch
+# hash:net: Fill second operand
+0 ipset a b 192.168.0.0/16
+# hash:net: Union
+0 ipset union c a b
+# hash:net: Check number of elements in union
+0 ipset l c | grep -q '^Number of entries: 3$'
+# hash:net: Test element in union
+0 ipset t c 10.0.0.1
+# hash:net: Test element matching the nomatch element
+1 ipset t c 10.0.0.200
+# hash:net: Intersection
+0 ipset intersect c a b
+# hash:net: Check that intersection is empty
+0 ipset l c | grep -q '^Number of entries: 0$'
+# hash:net: Fill the operands with nested networks, the second larger
+0 ipset f a && ipset a a 10.0.0.0/8 && ipset f b && ipset a b 10.1.1.1 && ipset a b 10.2.0.0/16 && ipset a b 192.168.0.1
+# hash:net: Intersection of the larger set with the smaller one
+0 ipset intersect c b a
+# hash:net: Check number of elements in intersection
+0 ipset l c | grep -q '^Number of entries: 1$'
+# hash:net: Test address in intersection
+0 ipset t c 10.1.1.1
+# hash:net: Intersection of the smaller set with the larger one
+0 ipset intersect c a b
+# hash:net: Check that intersection is empty
+0 ipset l c | grep -q '^Number of entries: 0$'
+# hash:net: Make the first operand the larger one
+0 ipset a a 172.16.0.0/12 && ipset a a 192.168.2.0/24 && ipset a a 192.168.3.0/24 && ipset a a 192.168.4.0/24
+# hash:net: Intersection of the larger set with the smaller one
+0 ipset intersect c a b
+# hash:net: Check that intersection is still empty
+0 ipset l c | grep -q '^Number of entries: 0$'
+# hash:net: Intersection of the smaller set with the larger one
+0 ipset intersect c b a
+# hash:net: Check that intersection is unchanged
+0 ipset l c | grep -q '^Number of entries: 1$'
+# hash:net: Destroy sets
+0 ipset x
+# hash:net,iface: Create sets
+0 ipset n a hash:net,iface && ipset n b hash:net,iface && ipset n c hash:net,iface
+# hash:net,iface: Fill operands
+0 ipset a a 10.0.0.0/24,eth0 && ipset a a 10.0.0.0/24,eth1 && ipset a b 10.0.0.0/24,eth1
+# hash:net,iface: Intersection
+0 ipset intersect c a b
+# hash:net,iface: Check number of elements in intersection
+0 ipset l c | grep -q '^Number of entries: 1$'
+# hash:net,iface: Test element in intersection
+0 ipset t c 10.0.0.1,eth1
+# hash:net,iface: Destroy sets
+0 ipset x
+# list:set: Create sets
+0 ipset n a list:set && ipset n b list:set && ipset n c list:set
+# list:set: Try set operation, not supported
+1 ipset union c a b
+# list:set: Destroy sets
+0 ipset x
+# eof
@@ -0,0 +1,39 @@
+# hash:net: Create set
+0 ipset n test hash:net
+# hash:net: Add networks with a nomatch one
+0 ipset a test 10.0.0.0/24 && ipset a test 10.0.0.128/25 nomatch && ipset a test 10.0.0.130
+# hash:net: Add an adjacent network
+0 ipset a test 10.0.1.0/24
+# hash:net: Create snapshot
+0 ipset snapshot test .foo
+# hash:net: Check snapshot magic
+0 test "`head -c 8 .foo`" = "IPSETSNP"
+# hash:net: Check snapshot size, header and three intervals
+0 test `stat -c %s .foo` -eq 120
+# hash:net: Replace snapshot after the set changed
+0 ipset a test 192.168.0.0/16 && ipset snapshot test .foo
+# hash:net: Check snapshot size, header and four intervals
+0 test `stat -c %s .foo` -eq 128
+# hash:net: Snapshot of a nonexistent set
+1 ipset snapshot nonexistent .foo
+# hash:net: Snapshot in restore mode
+1 echo 'snapshot test .foo' | ipset restore
+# hash:net: Destroy set
+0 ipset x test
+# hash:net6: Create set
+0 ipset n test hash:net family inet6
+# hash:net6: Add networks
+0 ipset a test 2001:db8::/32 && ipset a test 2001:db8::/64 nomatch
+# hash:net6: Create snapshot
+0 ipset snapshot test .foo
+# hash:net6: Check snapshot size, header and one interval
+0 test `stat -c %s .foo` -eq 128
+# hash:net6: Destroy set
+0 ipset x test
+# hash:ip,port: Create set
+0 ipset n test hash:ip,port
+# hash:ip,port: Snapshot of an unsupported type
+1 ipset snapshot test .foo
+# hash:ip,port: Destroy set
+0 ipset x test
+# eof
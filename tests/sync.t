@@ -0,0 +1,39 @@
+# Create set
+0 ipset n test hash:ip
+# Add initial elements
+0 ipset a test 10.0.0.1 && ipset a test 10.0.0.2 && ipset a test 10.0.0.3
+# Sync the set with the desired list
+0 ipset sync test < sync.t.list > .foo
+# Check the reported counters
+0 grep -q '^test: 2 added, 1 deleted, 2 unchanged$' .foo
+# Check that the set content equals the list
+0 ipset save test | sed -n 's/^add test //p' | sort > .foo && sort sync.t.list | diff - .foo
+# Sync again with the same list
+0 ipset sync test < sync.t.list > .foo
+# Check that nothing was changed
+0 grep -q '^test: 0 added, 0 deleted, 4 unchanged$' .foo
+# Sync with an empty list
+0 ipset sync test < /dev/null > .foo
+# Check that all elements were deleted
+0 grep -q '^test: 0 added, 4 deleted, 0 unchanged$' .foo && ipset l test | grep -q '^Number of entries: 0$'
+# Try to sync with a list containing a range
+1 echo 10.0.0.1-10.0.0.3 | ipset sync test
+# Try to sync a nonexistent set
+1 ipset sync nonexistent < sync.t.list
+# Destroy set
+0 ipset x test
+# Create hash:net set
+0 ipset n test hash:net
+# Add initial elements
+0 ipset a test 10.0.0.0/24 && ipset a test 10.0.1.0/24
+# Sync the set with the desired list with nomatch element
+0 printf '10.0.1.0/24\n10.0.2.0/24\n10.0.2.128/25 nomatch\n' | ipset sync test > .foo
+# Check the reported counters
+0 grep -q '^test: 2 added, 1 deleted, 1 unchanged$' .foo
+# Test nomatch element
+1 ipset t test 10.0.2.129
+# Test deleted element
+1 ipset t test 10.0.0.1
+# Destroy set
+0 ipset x test
+# eof
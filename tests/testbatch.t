@@ -0,0 +1,29 @@
+# hash:ip: Create set
+0 ipset n test hash:ip
+# hash:ip: Add elements
+0 ipset a test 10.0.0.1 && ipset a test 10.0.0.3
+# hash:ip: Test elements in a batch
+0 ipset test-batch test < testbatch.t.list > .foo
+# hash:ip: Check the results
+0 printf '1\n0\n1\n0\n' | diff - .foo
+# hash:ip: Test many elements, over multiple messages
+0 ipset a test 10.0.1.0-10.0.1.255 && (for i in `seq 0 255`; do echo 10.0.1.$i; echo 10.0.2.$i; done) | ipset test-batch test > .foo
+# hash:ip: Check the number of elements in the set
+0 test `grep -c '^1$' .foo` -eq 256 && test `grep -c '^0$' .foo` -eq 256
+# hash:ip: Check the order of the results
+0 test "`sed -n 1,4p .foo | tr -d '\n'`" = "1010"
+# hash:ip: Invalid element
+1 echo foo | ipset test-batch test
+# hash:ip: Test-batch in restore mode
+1 echo 'test-batch test' | ipset restore
+# hash:ip: Destroy set
+0 ipset x test
+# bitmap:ip: Create set
+0 ipset n test bitmap:ip range 10.0.0.0/24
+# bitmap:ip: Add element
+0 ipset a test 10.0.0.1
+# bitmap:ip: Out of range elements are missing
+0 printf '10.0.0.1\n10.1.0.1\n' | ipset test-batch test > .foo && printf '1\n0\n' | diff - .foo
+# bitmap:ip: Destroy set
+0 ipset x test
+# eof